@@ -0,0 +1,710 @@
+// Differential fuzzer for the RV32IM handlers of EmuCore. Every case is a
+// random loop-free program of valid RV32IM instructions, with forward
+// branches and jumps only, run from random register contents on EmuCore and
+// on a golden model written from the specification, then the registers, pc
+// and data page of both are compared.
+//
+// The core and its memory are built once. Between cases the core's state is
+// put back with restore_state() and memory with its write tracking: the
+// pages a case wrote are copied back from the contents they had before it,
+// so a case costs only the instructions it runs.
+
+#include <getopt.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <print>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ISA/riscv/EmuCore.hpp"
+#include "Memory/Memory.h"
+#include "Utils/Disasm.h"
+
+namespace
+{
+
+constexpr uint32_t page_size = Memory::page_size;
+// The program starts the first page of RAM, loads and stores go to the
+// second one through x31, which points to its middle and is never written.
+constexpr uint32_t code_base = MEMORY_BASE;
+constexpr uint32_t data_base = MEMORY_BASE + page_size;
+constexpr int base_reg = 31;
+constexpr uint32_t base_value = data_base + page_size / 2;
+constexpr size_t max_length = 256;
+
+uint64_t case_count = 1000000;
+uint64_t seed = 0;
+size_t length = 32;
+// --case: run only this case and print it.
+bool single_case = false;
+uint64_t only_case = 0;
+
+// The case running, for when the core brings down the process.
+volatile uint64_t current_case = 0;
+
+// A handler that divides by zero on the host, say, kills the fuzzer with
+// SIGFPE; the case that did it is reported on the way out.
+void on_host_fault(int signal)
+{
+    auto put = [](std::string_view text)
+    {
+        [[maybe_unused]] auto n =
+            write(STDERR_FILENO, text.data(), text.size());
+    };
+    auto put_number = [&](uint64_t value)
+    {
+        char digits[20];
+        put({digits, std::to_chars(digits, std::end(digits), value).ptr});
+    };
+    put("Host signal in case ");
+    put_number(current_case);
+    put("; run it again with -s ");
+    put_number(seed);
+    put(" -c ");
+    put_number(current_case);
+    put("\n");
+    std::signal(signal, SIG_DFL);
+    std::raise(signal);
+}
+
+// splitmix64: cheap to seed, so every case gets a generator of its own and
+// can be run again alone.
+class Random
+{
+   public:
+    explicit Random(uint64_t state) : state(state) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+    // Uniform in [0, n).
+    uint32_t below(uint32_t n) { return next() % n; }
+    bool chance(uint32_t percent) { return below(100) < percent; }
+
+   private:
+    uint64_t state;
+};
+
+// Instruction encoders, by format.
+uint32_t r_type(uint32_t funct7, int rs2, int rs1, uint32_t funct3, int rd,
+                uint32_t opcode)
+{
+    return funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7 |
+           opcode;
+}
+
+uint32_t i_type(int32_t imm, int rs1, uint32_t funct3, int rd,
+                uint32_t opcode)
+{
+    return uint32_t(imm & 0xfff) << 20 | rs1 << 15 | funct3 << 12 | rd << 7 |
+           opcode;
+}
+
+uint32_t s_type(int32_t imm, int rs2, int rs1, uint32_t funct3)
+{
+    uint32_t u = imm;
+    return (u >> 5 & 0x7f) << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 |
+           (u & 0x1f) << 7 | 0x23;
+}
+
+uint32_t b_type(int32_t offset, int rs2, int rs1, uint32_t funct3)
+{
+    uint32_t u = offset;
+    return (u >> 12 & 1) << 31 | (u >> 5 & 0x3f) << 25 | rs2 << 20 |
+           rs1 << 15 | funct3 << 12 | (u >> 1 & 0xf) << 8 |
+           (u >> 11 & 1) << 7 | 0x63;
+}
+
+uint32_t u_type(uint32_t upper, int rd, uint32_t opcode)
+{
+    return (upper & 0xfffff000) | rd << 7 | opcode;
+}
+
+uint32_t j_type(int32_t offset, int rd)
+{
+    uint32_t u = offset;
+    return (u >> 20 & 1) << 31 | (u >> 1 & 0x3ff) << 21 | (u >> 11 & 1) << 20 |
+           (u >> 12 & 0xff) << 12 | rd << 7 | 0x6f;
+}
+
+// Values at the edges of what the ALU and the M extension special-case.
+constexpr std::array<uint32_t, 16> corner_values = {
+    0,          1,          2,          0xffffffff, 0xfffffffe, 0x80000000,
+    0x7fffffff, 0x80000001, 31,         32,         33,         63,
+    0x80,       0xff,       0x8000,     0xffff};
+
+class Generator
+{
+   public:
+    explicit Generator(Random& random) : random(random) {}
+
+    uint32_t value()
+    {
+        if (random.chance(40))
+            return corner_values[random.below(corner_values.size())];
+        return random.next();
+    }
+
+    // A program of n instructions, followed by its end at index n.
+    std::vector<uint32_t> program(size_t n)
+    {
+        std::vector<uint32_t> code(n + 1);
+        entry.assign(n + 1, true);
+        // Backwards, so that every branch target is known when the branch
+        // is made.
+        for (size_t i = n; i > 0;) i -= fill(code, i - 1, n);
+        // jal x0, 0 at the end: a core that overshoots stays there.
+        code[n] = j_type(0, 0);
+        return code;
+    }
+
+   private:
+    Random& random;
+    // Whether a branch may go to an instruction: not to the second half of
+    // a pair, which needs the first one to have run.
+    std::vector<bool> entry;
+
+    // Instruction i, or a pair ending with it. Returns how many
+    // instructions it filled in, 2 for an idiom the core fuses.
+    size_t fill(std::vector<uint32_t>& code, size_t i, size_t n)
+    {
+        uint32_t kind = random.below(100);
+        if (kind < 28) return emit(code, i, op());
+        if (kind < 46) return emit(code, i, m_ext());
+        if (kind < 64) return emit(code, i, op_imm());
+        if (kind < 68)
+            return emit(code, i, u_type(random.next(), rd(), lui_or_auipc()));
+        if (kind < 76) return emit(code, i, load());
+        if (kind < 83) return emit(code, i, store());
+        if (kind < 90) return emit(code, i, branch(i, n, rs(), rs()));
+        if (kind < 93)
+            return emit(code, i, j_type(forward(i, n) * 4, rd()));
+        if (i == 0) return emit(code, i, op());
+        entry[i] = false;
+        return pair(code, i - 1, n);
+    }
+
+    static size_t emit(std::vector<uint32_t>& code, size_t i, uint32_t inst)
+    {
+        code[i] = inst;
+        return 1;
+    }
+
+    // Registers come mostly from a few, so instructions depend on each
+    // other.
+    int rs() { return random.chance(60) ? random.below(8) : random.below(32); }
+    int rd() { return random.chance(60) ? random.below(8) : random.below(31); }
+    uint32_t lui_or_auipc() { return random.chance(50) ? 0x37 : 0x17; }
+
+    // Number of instructions forward, to one in (i, n].
+    int32_t forward(size_t i, size_t n)
+    {
+        size_t target;
+        do
+            target = i + 1 + random.below(n - i);
+        while (!entry[target]);
+        return target - i;
+    }
+
+    uint32_t op()
+    {
+        // funct7, funct3 of add, sub, sll, slt, sltu, xor, srl, sra, or, and.
+        static constexpr std::array<std::pair<uint32_t, uint32_t>, 10> ops = {
+            {{0x00, 0}, {0x20, 0}, {0x00, 1}, {0x00, 2}, {0x00, 3},
+             {0x00, 4}, {0x00, 5}, {0x20, 5}, {0x00, 6}, {0x00, 7}}};
+        auto [funct7, funct3] = ops[random.below(ops.size())];
+        return r_type(funct7, rs(), rs(), funct3, rd(), 0x33);
+    }
+
+    uint32_t m_ext()
+    {
+        return r_type(0x01, rs(), rs(), random.below(8), rd(), 0x33);
+    }
+
+    uint32_t op_imm()
+    {
+        uint32_t funct3 = random.below(8);
+        int32_t imm = int32_t(value() << 20) >> 20;
+        if (funct3 == 1) imm = random.below(32);
+        if (funct3 == 5) imm = random.below(32) | (random.chance(50) << 10);
+        return i_type(imm, rs(), funct3, rd(), 0x13);
+    }
+
+    // An aligned offset from x31 into the data page.
+    int32_t data_offset(int size)
+    {
+        return (int32_t(random.below(page_size)) - int32_t(page_size / 2)) &
+               -size;
+    }
+
+    uint32_t load()
+    {
+        // lb, lh, lw, lbu, lhu.
+        static constexpr std::array<uint32_t, 5> funct3s = {0, 1, 2, 4, 5};
+        uint32_t funct3 = funct3s[random.below(funct3s.size())];
+        return i_type(data_offset(1 << (funct3 & 3)), base_reg, funct3, rd(),
+                      0x03);
+    }
+
+    uint32_t store()
+    {
+        uint32_t funct3 = random.below(3);
+        return s_type(data_offset(1 << funct3), rs(), base_reg, funct3);
+    }
+
+    uint32_t branch(size_t i, size_t n, int rs1, int rs2)
+    {
+        // beq, bne, blt, bge, bltu, bgeu.
+        static constexpr std::array<uint32_t, 6> funct3s = {0, 1, 4, 5, 6, 7};
+        return b_type(forward(i, n) * 4, rs2, rs1,
+                      funct3s[random.below(funct3s.size())]);
+    }
+
+    // lui/auipc followed by addi, auipc followed by lw or jalr, and slt[u]
+    // followed by beq/bne against x0 on its result.
+    size_t pair(std::vector<uint32_t>& code, size_t i, size_t n)
+    {
+        int link = 1 + random.below(30);
+        switch (random.below(4))
+        {
+            case 0:
+                code[i] = u_type(random.next(), link, lui_or_auipc());
+                code[i + 1] = i_type(random.next(), link, 0, rd(), 0x13);
+                break;
+            case 1:
+                // The program, or the zeros after it.
+                code[i] = u_type(0, link, 0x17);
+                code[i + 1] = i_type(random.below(n + 8) * 4, link, 2, rd(),
+                                     0x03);
+                break;
+            case 2:
+                code[i] = u_type(0, link, 0x17);
+                code[i + 1] =
+                    i_type(4 + forward(i + 1, n) * 4, link, 0, rd(), 0x67);
+                break;
+            default:
+                code[i] = r_type(0, rs(), rs(), 2 + random.below(2), link,
+                                 0x33);
+                code[i + 1] = b_type(forward(i + 1, n) * 4, 0, link,
+                                     random.below(2));
+                break;
+        }
+        return 2;
+    }
+};
+
+// RV32IM as the specification words it, on the two pages a case uses.
+struct GoldenModel
+{
+    std::array<uint32_t, 32> x{};
+    uint32_t pc = code_base;
+    std::array<uint8_t, page_size> code{};
+    std::array<uint8_t, page_size> data{};
+
+    uint8_t* byte(uint32_t addr)
+    {
+        if (addr - code_base < page_size) return &code[addr - code_base];
+        if (addr - data_base < page_size) return &data[addr - data_base];
+        return nullptr;
+    }
+
+    uint32_t load(uint32_t addr, int size)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < size; i++)
+            value |= uint32_t(*byte(addr + i)) << 8 * i;
+        return value;
+    }
+
+    void store(uint32_t addr, uint32_t value, int size)
+    {
+        for (int i = 0; i < size; i++) *byte(addr + i) = value >> 8 * i;
+    }
+
+    static int32_t sign_extend(uint32_t value, int bits)
+    {
+        return int32_t(value << (32 - bits)) >> (32 - bits);
+    }
+
+    // Runs until pc reaches end and returns the number of instructions.
+    uint64_t run(uint32_t end)
+    {
+        uint64_t count = 0;
+        while (pc != end)
+        {
+            step(load(pc, 4));
+            count++;
+        }
+        return count;
+    }
+
+    void step(uint32_t inst)
+    {
+        uint32_t opcode = inst & 0x7f;
+        int rd = inst >> 7 & 0x1f;
+        uint32_t funct3 = inst >> 12 & 7;
+        uint32_t a = x[inst >> 15 & 0x1f];
+        uint32_t b = x[inst >> 20 & 0x1f];
+        uint32_t funct7 = inst >> 25;
+        int32_t imm_i = int32_t(inst) >> 20;
+        int32_t imm_s = (int32_t(inst) >> 25 << 5) | (inst >> 7 & 0x1f);
+        uint32_t b_bits = (inst >> 31) << 12 | (inst >> 7 & 1) << 11 |
+                          (inst >> 25 & 0x3f) << 5 | (inst >> 8 & 0xf) << 1;
+        uint32_t j_bits = (inst >> 31) << 20 | (inst >> 12 & 0xff) << 12 |
+                          (inst >> 20 & 1) << 11 | (inst >> 21 & 0x3ff) << 1;
+        int32_t imm_b = sign_extend(b_bits, 13);
+        int32_t imm_j = sign_extend(j_bits, 21);
+        uint32_t next = pc + 4;
+        uint32_t result = 0;
+        bool writes = true;
+        switch (opcode)
+        {
+            case 0x37:
+                result = inst & 0xfffff000;
+                break;
+            case 0x17:
+                result = pc + (inst & 0xfffff000);
+                break;
+            case 0x6f:
+                result = pc + 4;
+                next = pc + imm_j;
+                break;
+            case 0x67:
+                result = pc + 4;
+                next = (a + imm_i) & ~1u;
+                break;
+            case 0x63:
+            {
+                bool taken = false;
+                switch (funct3)
+                {
+                    case 0:
+                        taken = a == b;
+                        break;
+                    case 1:
+                        taken = a != b;
+                        break;
+                    case 4:
+                        taken = int32_t(a) < int32_t(b);
+                        break;
+                    case 5:
+                        taken = int32_t(a) >= int32_t(b);
+                        break;
+                    case 6:
+                        taken = a < b;
+                        break;
+                    case 7:
+                        taken = a >= b;
+                        break;
+                }
+                if (taken) next = pc + imm_b;
+                writes = false;
+                break;
+            }
+            case 0x03:
+            {
+                uint32_t addr = a + imm_i;
+                switch (funct3)
+                {
+                    case 0:
+                        result = sign_extend(load(addr, 1), 8);
+                        break;
+                    case 1:
+                        result = sign_extend(load(addr, 2), 16);
+                        break;
+                    case 2:
+                        result = load(addr, 4);
+                        break;
+                    case 4:
+                        result = load(addr, 1);
+                        break;
+                    case 5:
+                        result = load(addr, 2);
+                        break;
+                }
+                break;
+            }
+            case 0x23:
+                store(a + imm_s, b, 1 << funct3);
+                writes = false;
+                break;
+            case 0x13:
+                result = alu(funct3, funct3 == 5 ? funct7 : 0, a,
+                             funct3 == 1 || funct3 == 5 ? imm_i & 0x1f
+                                                        : uint32_t(imm_i));
+                break;
+            case 0x33:
+                result = funct7 == 1 ? mul_div(funct3, a, b)
+                                     : alu(funct3, funct7, a, b);
+                break;
+        }
+        if (writes && rd != 0) x[rd] = result;
+        pc = next;
+    }
+
+    static uint32_t alu(uint32_t funct3, uint32_t funct7, uint32_t a,
+                        uint32_t b)
+    {
+        int shamt = b & 0x1f;
+        switch (funct3)
+        {
+            case 0:
+                return funct7 == 0x20 ? a - b : a + b;
+            case 1:
+                return a << shamt;
+            case 2:
+                return int32_t(a) < int32_t(b);
+            case 3:
+                return a < b;
+            case 4:
+                return a ^ b;
+            case 5:
+                if (funct7 == 0x20) return int32_t(a) >> shamt;
+                return a >> shamt;
+            case 6:
+                return a | b;
+            default:
+                return a & b;
+        }
+    }
+
+    static uint32_t mul_div(uint32_t funct3, uint32_t a, uint32_t b)
+    {
+        int64_t sa = int32_t(a);
+        int64_t sb = int32_t(b);
+        bool overflow = a == 0x80000000 && b == 0xffffffff;
+        switch (funct3)
+        {
+            case 0:
+                return uint32_t(uint64_t(a) * b);
+            case 1:
+                return uint32_t(uint64_t(sa * sb) >> 32);
+            case 2:
+                return uint32_t(uint64_t(sa * int64_t(b)) >> 32);
+            case 3:
+                return uint32_t(uint64_t(a) * b >> 32);
+            case 4:
+                if (b == 0) return 0xffffffff;
+                return overflow ? a : uint32_t(sa / sb);
+            case 5:
+                return b == 0 ? 0xffffffff : a / b;
+            case 6:
+                if (b == 0) return a;
+                return overflow ? 0 : uint32_t(sa % sb);
+            default:
+                return b == 0 ? a : a % b;
+        }
+    }
+};
+
+class Fuzzer
+{
+   public:
+    Fuzzer() : core(memory), disassembler(core_type::disasm_triple)
+    {
+        // The data page starts out random, the code page zero.
+        Random random(seed);
+        std::array<uint8_t, page_size> data;
+        for (auto& byte : data) byte = random.next();
+        memory.write_block(data_base, data);
+        golden_data = data;
+        initial = core.save_state();
+        saved_pages.reserve(2);
+        saved_data.reserve(2 * page_size);
+        memory.track_writes(
+            [this](size_t page, const uint8_t* old)
+            {
+                saved_pages.push_back(page);
+                saved_data.insert(saved_data.end(), old, old + page_size);
+            });
+    }
+
+    // Returns false, having printed the case, if the core and the golden
+    // model disagree.
+    bool run(uint64_t index, bool verbose)
+    {
+        current_case = index;
+        Random random(seed ^ (index * 0xd1342543de82ef95));
+        Generator generator(random);
+        size_t n = 1 + random.below(length);
+        auto code = generator.program(n);
+
+        GoldenModel golden;
+        auto state = initial;
+        for (int i = 1; i < 32; i++)
+            golden.x[i] = i == base_reg ? base_value : generator.value();
+        std::copy(golden.x.begin(), golden.x.end(),
+                  state.register_file.x.begin());
+        std::span<const uint8_t> bytes(
+            reinterpret_cast<const uint8_t*>(code.data()), code.size() * 4);
+        std::memcpy(golden.code.data(), bytes.data(), bytes.size());
+        golden.data = golden_data;
+        auto initial_x = golden.x;
+        uint64_t count = golden.run(code_base + n * 4);
+
+        memory.write_block(code_base, bytes);
+        core.restore_state(state);
+        std::string error;
+        try
+        {
+            core.execute(count);
+        }
+        catch (std::exception& e)
+        {
+            error = e.what();
+        }
+        auto result = core.save_state();
+        auto ram = memory.ram_view(data_base).first(page_size);
+        bool same = error.empty() && result.pc == golden.pc &&
+                    std::equal(golden.x.begin(), golden.x.end(),
+                               result.register_file.x.begin()) &&
+                    std::equal(ram.begin(), ram.end(), golden.data.begin());
+        if (!same || verbose)
+            print(index, bytes, initial_x, golden, result, ram, error);
+        reset();
+        return same;
+    }
+
+   private:
+    using core_type = RISCV::EmuCore<32>;
+
+    Memory memory;
+    core_type core;
+    Disassembler disassembler;
+    decltype(core.save_state()) initial;
+    std::array<uint8_t, page_size> golden_data;
+    // Pages written by the running case, as they were before it.
+    std::vector<uint32_t> saved_pages;
+    std::vector<uint8_t> saved_data;
+
+    void reset()
+    {
+        for (size_t i = 0; i < saved_pages.size(); i++)
+            memory.restore_page(saved_pages[i], &saved_data[i * page_size]);
+        saved_pages.clear();
+        saved_data.clear();
+        memory.clear_dirty();
+    }
+
+    template <typename State>
+    void print(uint64_t index, std::span<const uint8_t> code,
+               const std::array<uint32_t, 32>& initial_x,
+               const GoldenModel& golden, const State& result,
+               std::span<const uint8_t> ram, const std::string& error)
+    {
+        std::println("Case {} of seed {}:", index, seed);
+        for (const auto& line : disassembler.disassemble_range(code_base, code))
+            std::println("  {}", line);
+        if (!error.empty()) std::println("  core raised: {}", error);
+        if (result.pc != golden.pc)
+            std::println("  pc: core 0x{:08x}, golden 0x{:08x}", result.pc,
+                         golden.pc);
+        for (int i = 1; i < 32; i++)
+        {
+            if (result.register_file.x[i] == golden.x[i]) continue;
+            std::println("  x{}: core 0x{:08x}, golden 0x{:08x}, initially "
+                         "0x{:08x}",
+                         i, result.register_file.x[i], golden.x[i],
+                         initial_x[i]);
+        }
+        for (uint32_t i = 0; i < page_size; i++)
+        {
+            if (ram[i] == golden.data[i]) continue;
+            std::println("  0x{:08x}: core 0x{:02x}, golden 0x{:02x}",
+                         data_base + i, ram[i], golden.data[i]);
+        }
+    }
+};
+
+void print_usage()
+{
+    printf("Usage: nemu-fuzz [OPTION...]\n\n");
+    printf("\t-n,--cases=N            run N cases, by default 1000000\n");
+    printf("\t-s,--seed=S             seed, by default a random one\n");
+    printf(
+        "\t-l,--length=L           programs of up to L instructions, by "
+        "default 32\n");
+    printf("\t-c,--case=N             run and print only case N of the seed\n");
+    printf("\n");
+    exit(0);
+}
+
+void parse_args(int argc, char* argv[])
+{
+    const struct option table[] = {
+        {"cases", required_argument, NULL, 'n'},
+        {"seed", required_argument, NULL, 's'},
+        {"length", required_argument, NULL, 'l'},
+        {"case", required_argument, NULL, 'c'},
+        {"help", no_argument, NULL, 'h'},
+        {0, 0, NULL, 0},
+    };
+    seed = std::random_device()();
+    int o;
+    while ((o = getopt_long(argc, argv, "hn:s:l:c:", table, NULL)) != -1)
+    {
+        switch (o)
+        {
+            case 'n':
+                case_count = std::strtoull(optarg, nullptr, 0);
+                break;
+            case 's':
+                seed = std::strtoull(optarg, nullptr, 0);
+                break;
+            case 'l':
+                length = std::strtoull(optarg, nullptr, 0);
+                if (length == 0 || length > max_length) print_usage();
+                break;
+            case 'c':
+                single_case = true;
+                only_case = std::strtoull(optarg, nullptr, 0);
+                break;
+            default:
+                print_usage();
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    parse_args(argc, argv);
+    for (int signal : {SIGFPE, SIGSEGV, SIGILL})
+        std::signal(signal, on_host_fault);
+    // The core's memory tracing would log every access of every case.
+    spdlog::set_level(spdlog::level::warn);
+    Fuzzer fuzzer;
+    if (single_case) return fuzzer.run(only_case, true) ? 0 : 1;
+
+    std::println("Seed {}, {} cases of up to {} instructions", seed,
+                 case_count, length);
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < case_count; i++)
+    {
+        if (fuzzer.run(i, false)) continue;
+        spdlog::error("Mismatch in case {}; run it again with -s {} -c {}", i,
+                      seed, i);
+        return 1;
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::println("{} cases passed in {:.2f} s, {:.0f} cases/s", case_count,
+                 elapsed.count(), case_count / elapsed.count());
+    return 0;
+}
@@ -1,105 +1,334 @@
 #include <getopt.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
 #include <filesystem>
 #include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #include "Debugger/Debugger.hpp"
-#include "ISA/riscv32/EmuCore.hpp"
+#include "ISA/riscv/EmuCore.hpp"
 #include "Memory/Memory.h"
 #include "Monitor/Monitor.hpp"
+#include "Plugin/Plugin.h"
+#include "Utils/ElfParser.h"
 
 bool is_batch_mode = false;
 bool is_diff = false;
+bool is_realtime = false;
+// Run memcpy, memset, memcmp and strlen of the ELF image on the host.
+bool is_hle = false;
+// Prometheus metrics file, none if empty.
+std::filesystem::path metrics_file;
+// --disk image and whether writes to it stay private.
+std::filesystem::path disk_file;
+bool is_disk_cow = false;
+// --screen sink, a directory or a .ppm file.
+std::filesystem::path screen_sink;
+// Run the ELF image as a Linux user program, with arguments guest_args.
+bool is_user_mode = false;
+std::vector<std::string> guest_args;
+// --plugin arguments, in order.
+std::vector<std::string_view> plugin_specs;
+// Snapshot interval of record mode, 0 when not recording.
+uint64_t record_interval = 0;
+// --intervals: run plugins on a replay of the recording, split into
+// intervals of record_interval instructions on this many threads.
+unsigned interval_threads = 0;
+// Register width of the machine, 0 to take it from the ELF class.
+int xlen = 0;
+
+std::filesystem::path elf_file;
+std::filesystem::path log_file;
+std::filesystem::path firmware_file;
 
 template <typename T>
 class Nemu
 {
    private:
+    // Declared first: the core's decoded instructions hold plugin callbacks,
+    // which must go before shared-object plugins are unloaded.
+    PluginManager plugins;
     std::unique_ptr<T> core;
     std::unique_ptr<Memory> memory;
     std::unique_ptr<Monitor<T>> monitor;
     std::unique_ptr<Debugger<T>> debugger;
 
-    std::filesystem::path elf_file;
-    std::filesystem::path log_file;
-    std::filesystem::path firmware_file;
-
    public:
-    Nemu(int argc = 0, char* argv[] = nullptr)
+    Nemu()
     {
         spdlog::info("Build time: {}, {}", __TIME__, __DATE__);
-        parse_args(argc, argv);
         spdlog::info("Welcome to NEMU!");
         spdlog::info("For help, type \"help\"");
 
         memory = std::make_unique<Memory>();
         core = std::make_unique<T>(*memory);
-        monitor = std::make_unique<Monitor<T>>(*core, *memory, firmware_file);
-        debugger = std::make_unique<Debugger<T>>(*monitor);
+        monitor = std::make_unique<Monitor<T>>(*core, *memory, firmware_file,
+                                               is_user_mode);
+        monitor->set_realtime(is_realtime);
+        if (!disk_file.empty() &&
+            !monitor->attach_disk(disk_file, is_disk_cow))
+            std::exit(1);
+        if (!screen_sink.empty() && !monitor->attach_screen(screen_sink))
+            std::exit(1);
+        if (is_user_mode &&
+            !monitor->start_user_mode(firmware_file, guest_args))
+            std::exit(1);
+        if (record_interval != 0)
+            monitor->start_recording(record_interval, interval_threads != 0);
+        if (!metrics_file.empty()) monitor->enable_metrics(metrics_file);
+        prepare_core(*core);
+        // With --intervals the recorded run goes without plugins; they see
+        // the replay.
+        if (interval_threads == 0)
+        {
+            if (!load_plugins(plugins)) std::exit(1);
+            if (!plugins.empty()) monitor->set_plugins(plugins);
+        }
+        debugger = std::make_unique<Debugger<T>>(*monitor, elf_file);
     }
     ~Nemu() { spdlog::info("Exit NEMU"); }
 
-    int run() { return debugger->run(is_batch_mode); }
+    static bool load_plugins(PluginManager& manager)
+    {
+        manager.set_image(elf_file);
+        for (auto spec : plugin_specs)
+        {
+            if (!manager.load(spec)) return false;
+        }
+        return true;
+    }
+
+    // What a core needs besides the machine state; interval replay sets up
+    // its cores the same way.
+    static void prepare_core(T& core)
+    {
+        if (is_hle) intercept_library_calls(core);
+    }
 
-   private:
-    int parse_args(int argc, char* argv[])
+    static void intercept_library_calls(T& core)
     {
-        const struct option table[] = {
-            {"batch", no_argument, NULL, 'b'},
-            {"log", required_argument, NULL, 'l'},
-            {"diff", required_argument, NULL, 'd'},
-            {"port", required_argument, NULL, 'p'},
-            {"elf", required_argument, NULL, 'e'},
-            {"help", no_argument, NULL, 'h'},
-            {0, 0, NULL, 0},
-        };
-        int o;
-        while ((o = getopt_long(argc, argv, "-bhl:d:p:e:", table, NULL)) != -1)
+        auto elf = elf_file.empty() ? std::nullopt : ElfFile::open(elf_file);
+        if (!elf)
         {
-            switch (o)
-            {
-                case 'b':
-                    is_batch_mode = true;
-                    break;
-                case 'p':
-                    // sscanf(optarg, "%d", &difftest_port);
-                    break;
-                case 'l':
-                    // log_file = optarg;
-                    break;
-                case 'd':
-                    // diff_so_file = optarg;
-                    break;
-                case 'e':
-                    break;
-                case 1:
-                {
-                    firmware_file = optarg;
-                    return 0;
-                }
-                default:
-                    print_usage();
-            }
+            spdlog::warn("No ELF symbols, library calls run as guest code");
+            return;
+        }
+        for (auto name : {"memcpy", "memset", "memcmp", "strlen"})
+        {
+            auto symbol = elf->find_symbol(std::string_view(name));
+            if (symbol == nullptr || symbol->type != SymbolType::FUNC)
+                continue;
+            if (core.intercept_function(name, symbol->addr))
+                spdlog::info("Emulating {} at 0x{:x}", name, symbol->addr);
         }
-        return 0;
     }
-    void print_usage()
+
+    int run()
     {
-        printf("Usage: nemu [OPTION...] IMAGE [args]\n\n");
-        printf("\t-b,--batch              run with batch mode\n");
-        printf("\t-l,--log=FILE           output log to FILE\n");
-        printf(
-            "\t-d,--diff=REF_SO        run DiffTest with reference "
-            "REF_SO\n");
-        printf("\t-p,--port=PORT          run DiffTest with port PORT\n");
-        printf("\n");
-        exit(0);
+        int status = debugger->run(is_batch_mode);
+        if (interval_threads != 0 &&
+            !monitor->run_intervals(interval_threads, load_plugins,
+                                    prepare_core))
+            return 1;
+        // A user-mode program's exit status becomes ours.
+        return status != 0 ? status : monitor->get_exit_status();
     }
 };
 
+void print_usage()
+{
+    printf("Usage: nemu [OPTION...] IMAGE [args]\n\n");
+    printf("\t-b,--batch              run with batch mode\n");
+    printf("\t-l,--log=FILE           output log to FILE\n");
+    printf(
+        "\t-d,--diff=REF_SO        run DiffTest with reference "
+        "REF_SO\n");
+    printf("\t-p,--port=PORT          run DiffTest with port PORT\n");
+    printf("\t-e,--elf=FILE           read symbols from ELF FILE\n");
+    printf("\t-r,--realtime           tie virtual time to host time\n");
+    printf(
+        "\t-R,--record[=N]         record for reverse debugging, "
+        "snapshot every N instructions\n");
+    printf(
+        "\t-x,--xlen=32|64         register width, by default that of "
+        "the ELF image\n");
+    printf(
+        "\t-H,--hle                run memcpy, memset, memcmp and strlen "
+        "on the host\n");
+    printf(
+        "\t-P,--plugin=NAME[,ARGS] load built-in plugin NAME or a shared "
+        "object by path\n");
+    printf(
+        "\t-M,--metrics=FILE       write live statistics to FILE in the "
+        "Prometheus text format\n");
+    printf(
+        "\t-D,--disk=FILE[,cow]    attach disk image FILE, copy-on-write "
+        "with cow\n");
+    printf(
+        "\t-S,--screen=DIR|FILE    write frames to DIR as PPM files, or "
+        "keep FILE.ppm current\n");
+    printf(
+        "\t-u,--user               run IMAGE as a Linux user program with "
+        "args\n");
+    printf(
+        "\t-I,--intervals=N[,T]    run plugins on a replay split into "
+        "intervals of N instructions, on T threads\n");
+    printf("\n");
+    exit(0);
+}
+
+// A whole number of at least 1, decimal or 0x hex; nullopt for anything
+// else, a sign included. The short options take "-R=N" as "=N".
+std::optional<uint64_t> parse_positive(std::string_view text)
+{
+    if (text.starts_with('=')) text.remove_prefix(1);
+    int base = 10;
+    if (text.starts_with("0x") || text.starts_with("0X"))
+    {
+        text.remove_prefix(2);
+        base = 16;
+    }
+    uint64_t value = 0;
+    auto [end, error] =
+        std::from_chars(text.data(), text.data() + text.size(), value, base);
+    if (error != std::errc() || end != text.data() + text.size() || value == 0)
+        return std::nullopt;
+    return value;
+}
+
+int parse_args(int argc, char* argv[])
+{
+    const struct option table[] = {
+        {"batch", no_argument, NULL, 'b'},
+        {"log", required_argument, NULL, 'l'},
+        {"diff", required_argument, NULL, 'd'},
+        {"port", required_argument, NULL, 'p'},
+        {"elf", required_argument, NULL, 'e'},
+        {"realtime", no_argument, NULL, 'r'},
+        {"record", optional_argument, NULL, 'R'},
+        {"xlen", required_argument, NULL, 'x'},
+        {"hle", no_argument, NULL, 'H'},
+        {"plugin", required_argument, NULL, 'P'},
+        {"metrics", required_argument, NULL, 'M'},
+        {"disk", required_argument, NULL, 'D'},
+        {"screen", required_argument, NULL, 'S'},
+        {"user", no_argument, NULL, 'u'},
+        {"intervals", required_argument, NULL, 'I'},
+        {"help", no_argument, NULL, 'h'},
+        {0, 0, NULL, 0},
+    };
+    int o;
+    while ((o = getopt_long(argc, argv, "-bhrHuR::l:d:p:e:x:P:M:D:S:I:", table,
+                            NULL)) != -1)
+    {
+        switch (o)
+        {
+            case 'b':
+                is_batch_mode = true;
+                break;
+            case 'r':
+                is_realtime = true;
+                break;
+            case 'H':
+                is_hle = true;
+                break;
+            case 'u':
+                is_user_mode = true;
+                break;
+            case 'P':
+                plugin_specs.push_back(optarg);
+                break;
+            case 'M':
+                metrics_file = optarg;
+                break;
+            case 'D':
+            {
+                std::string_view spec = optarg;
+                is_disk_cow = spec.ends_with(",cow");
+                if (is_disk_cow) spec.remove_suffix(4);
+                disk_file = spec;
+                break;
+            }
+            case 'S':
+                screen_sink = optarg;
+                break;
+            case 'R':
+            {
+                auto interval = optarg ? parse_positive(optarg) : 100000;
+                if (!interval) print_usage();
+                record_interval = *interval;
+                break;
+            }
+            case 'I':
+            {
+                std::string_view spec = optarg;
+                auto comma = spec.find(',');
+                auto interval = parse_positive(spec.substr(0, comma));
+                std::optional<uint64_t> threads =
+                    std::max(1u, std::thread::hardware_concurrency());
+                if (comma != spec.npos)
+                    threads = parse_positive(spec.substr(comma + 1));
+                if (!interval || !threads || *threads > UINT32_MAX)
+                    print_usage();
+                record_interval = *interval;
+                interval_threads = unsigned(*threads);
+                break;
+            }
+            case 'x':
+                xlen = std::atoi(optarg);
+                if (xlen != 32 && xlen != 64) print_usage();
+                break;
+            case 'p':
+                // sscanf(optarg, "%d", &difftest_port);
+                break;
+            case 'l':
+                // log_file = optarg;
+                break;
+            case 'd':
+                // diff_so_file = optarg;
+                break;
+            case 'e':
+                elf_file = optarg;
+                break;
+            case 1:
+            {
+                firmware_file = optarg;
+                guest_args.assign(argv + optind - 1, argv + argc);
+                return 0;
+            }
+            default:
+                print_usage();
+        }
+    }
+    return 0;
+}
+
 int main(int argc, char* argv[])
 {
-    Nemu<RISCV32::EmuCore> nemu(argc, argv);
-    return nemu.run();
-}
\ No newline at end of file
+    parse_args(argc, argv);
+    if (interval_threads != 0 && (is_user_mode || !disk_file.empty()))
+    {
+        spdlog::error("--intervals cannot replay system calls or disks");
+        return 1;
+    }
+    if (elf_file.empty() && ElfFile::is_elf(firmware_file))
+    {
+        elf_file = firmware_file;
+    }
+    if (xlen == 0)
+    {
+        auto elf = elf_file.empty() ? std::nullopt : ElfFile::open(elf_file);
+        xlen = elf && elf->is_elf64() ? 64 : 32;
+    }
+
+    if (xlen == 64) return Nemu<RISCV::EmuCore<64>>().run();
+    return Nemu<RISCV::EmuCore<32>>().run();
+}
@@ -0,0 +1,75 @@
+#ifndef BLOCK_DEVICE_H_
+#define BLOCK_DEVICE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+#include "Device/Device.h"
+#include "Memory/Memory.h"
+
+// A disk of 512-byte sectors backed by a host image mapped into memory.
+// The guest sets SECTOR, ADDR and COUNT, then writes a command; the
+// transfer between the mapping and RAM is a single copy, done by the time
+// the write returns, and STATUS tells whether it worked. 64-bit registers
+// take two 4-byte accesses, low word first, or one 8-byte access.
+//
+//     0x00 CAPACITY  sectors on the disk, read-only
+//     0x08 SECTOR    first sector of the transfer
+//     0x10 ADDR      guest physical address of the buffer in RAM
+//     0x18 COUNT     sectors to transfer
+//     0x1c COMMAND   1 reads sectors into RAM, 2 writes them, 3 flushes
+//     0x20 STATUS    0 if the last command succeeded, 1 if not
+class BlockDevice : public Device
+{
+   public:
+    static constexpr uint64_t size = 0x40;
+    static constexpr uint64_t sector_size = 512;
+
+    // A shared mapping writes through to the image. A copy-on-write one
+    // leaves the image alone: every instance reads the same page cache and
+    // only the sectors it writes become private to it. nullptr, having
+    // logged why, if the image cannot be mapped.
+    static std::unique_ptr<BlockDevice> open(Memory& memory,
+                                             const std::filesystem::path& path,
+                                             bool copy_on_write);
+    ~BlockDevice() override;
+    BlockDevice(const BlockDevice&) = delete;
+    BlockDevice& operator=(const BlockDevice&) = delete;
+
+    uint64_t read(uint64_t offset, int len) override;
+    void write(uint64_t offset, uint64_t data, int len) override;
+
+   private:
+    static constexpr uint64_t capacity_offset = 0x00;
+    static constexpr uint64_t sector_offset = 0x08;
+    static constexpr uint64_t addr_offset = 0x10;
+    static constexpr uint64_t count_offset = 0x18;
+    static constexpr uint64_t command_offset = 0x1c;
+    static constexpr uint64_t status_offset = 0x20;
+
+    enum Command : uint32_t
+    {
+        READ = 1,
+        WRITE = 2,
+        FLUSH = 3
+    };
+
+    BlockDevice(Memory& memory, uint8_t* image, size_t length,
+                bool copy_on_write);
+
+    Memory& memory;
+    uint8_t* image;
+    size_t length;
+    bool copy_on_write;
+
+    uint64_t sector;
+    uint64_t addr;
+    uint32_t count;
+    uint32_t status;
+
+    bool execute(uint32_t command);
+};
+
+#endif  // BLOCK_DEVICE_H_
@@ -0,0 +1,40 @@
+#ifndef CLINT_H_
+#define CLINT_H_
+
+#include <cstdint>
+
+#include "Device/Device.h"
+#include "Device/EventQueue.h"
+
+// Core-local interruptor: msip, mtimecmp and mtime with a 1 MHz timebase
+// derived from the event queue's virtual time. The timer interrupt is an
+// event scheduled at mtimecmp, never a per-instruction comparison.
+class Clint : public Device
+{
+   public:
+    static constexpr uint64_t size = 0x10000;
+    static constexpr uint64_t mtime_offset = 0xbff8;
+
+    Clint(EventQueue& events, InterruptLine irq);
+
+    uint64_t read(uint64_t offset, int len) override;
+    void write(uint64_t offset, uint64_t data, int len) override;
+
+    uint64_t mtime() const;
+
+   private:
+    static constexpr uint64_t msip_offset = 0x0;
+    static constexpr uint64_t mtimecmp_offset = 0x4000;
+    static constexpr uint64_t ns_per_tick = 1000;
+
+    EventQueue& events;
+    InterruptLine irq;
+    uint32_t msip;
+    uint64_t mtimecmp;
+    EventQueue::EventId timer_event;
+    bool timer_scheduled;
+
+    void update_timer();
+};
+
+#endif  // CLINT_H_
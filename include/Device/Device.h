@@ -0,0 +1,22 @@
+#ifndef DEVICE_H_
+#define DEVICE_H_
+
+#include <cstdint>
+#include <functional>
+
+// Raises (true) or lowers (false) interrupt line irq of the core.
+using InterruptLine = std::function<void(int irq, bool level)>;
+
+// A memory-mapped device. Memory forwards every access that falls into the
+// device's window, with the offset relative to the window base. Data is
+// 64 bits wide so RV64 cores can make 8-byte accesses.
+class Device
+{
+   public:
+    virtual ~Device() = default;
+
+    virtual uint64_t read(uint64_t offset, int len) = 0;
+    virtual void write(uint64_t offset, uint64_t data, int len) = 0;
+};
+
+#endif  // DEVICE_H_
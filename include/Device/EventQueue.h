@@ -0,0 +1,76 @@
+#ifndef EVENT_QUEUE_H_
+#define EVENT_QUEUE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+
+// Deterministic queue of future work for devices and timers, keyed by
+// virtual time in nanoseconds. By default virtual time advances with the
+// guest instruction count (ns_per_inst per instruction), so a run is
+// reproducible. In realtime mode it follows the host clock instead, which
+// is what interactive guests expect.
+//
+// The run loop asks how many instructions it may execute before the next
+// deadline, runs them uninterrupted and then calls run_due(); nothing is
+// polled per instruction. A device scheduling an earlier event from inside
+// that run (an MMIO write) triggers the deadline hook, so the run loop can
+// end the quantum early.
+class EventQueue
+{
+   public:
+    using Callback = std::function<void()>;
+    using EventId = uint64_t;
+
+    static constexpr uint64_t never = UINT64_MAX;
+
+    EventQueue(std::function<uint64_t()> instruction_count,
+               uint64_t ns_per_inst = 10);
+
+    void set_realtime(bool enable);
+    bool is_realtime() const { return realtime; }
+
+    uint64_t now() const;
+    uint64_t ns_per_instruction() const { return ns_per_inst; }
+
+    EventId schedule_at(uint64_t when, Callback callback);
+    EventId schedule_in(uint64_t delay, Callback callback);
+    void cancel(EventId id);
+    // Called whenever an event is scheduled ahead of the current deadline.
+    void set_deadline_hook(Callback hook);
+
+    uint64_t next_deadline() const;
+    // Instructions that can run before the next deadline, at least 1.
+    uint64_t instructions_to_next() const;
+    // Runs every event whose deadline has passed, ordered by deadline and
+    // then by scheduling order.
+    void run_due();
+
+   private:
+    struct Event
+    {
+        uint64_t when;
+        EventId id;
+        Callback callback;
+    };
+    // std::push_heap builds a max-heap, so "less" means "later".
+    static bool later(const Event& a, const Event& b)
+    {
+        return a.when != b.when ? a.when > b.when : a.id > b.id;
+    }
+
+    std::function<uint64_t()> instruction_count;
+    uint64_t ns_per_inst;
+    bool realtime;
+    std::chrono::steady_clock::time_point host_start;
+    uint64_t host_offset;
+
+    EventId next_id;
+    std::vector<Event> heap;
+    std::unordered_set<EventId> cancelled;
+    Callback deadline_hook;
+};
+
+#endif  // EVENT_QUEUE_H_
@@ -0,0 +1,27 @@
+#ifndef RTC_H_
+#define RTC_H_
+
+#include <cstdint>
+
+#include "Device/Device.h"
+#include "Device/EventQueue.h"
+
+// NEMU's uptime register in microseconds of virtual time. Like NEMU, the
+// 64-bit value is latched when the high word at offset 4 is read, or by an
+// 8-byte read of the whole register.
+class Rtc : public Device
+{
+   public:
+    static constexpr uint64_t size = 8;
+
+    explicit Rtc(EventQueue& events);
+
+    uint64_t read(uint64_t offset, int len) override;
+    void write(uint64_t offset, uint64_t data, int len) override;
+
+   private:
+    EventQueue& events;
+    uint64_t latched_us;
+};
+
+#endif  // RTC_H_
@@ -0,0 +1,37 @@
+#ifndef SERIAL_H_
+#define SERIAL_H_
+
+#include <cstdint>
+#include <cstdio>
+
+#include "Device/Device.h"
+#include "Device/EventQueue.h"
+
+// Transmit-only UART. Offset 0 is the data register used by NEMU's AM
+// putch; offset 5 is a 16550-style line status register whose
+// transmitter-empty bits clear on every write and come back when the
+// transmit-completion event fires tx_delay ns later.
+class Serial : public Device
+{
+   public:
+    static constexpr uint64_t size = 8;
+
+    Serial(EventQueue& events, std::FILE* out = stdout,
+           uint64_t tx_delay = 1000);
+
+    uint64_t read(uint64_t offset, int len) override;
+    void write(uint64_t offset, uint64_t data, int len) override;
+
+   private:
+    static constexpr uint64_t data_offset = 0;
+    static constexpr uint64_t lsr_offset = 5;
+    static constexpr uint8_t lsr_thre = 1 << 5;
+    static constexpr uint8_t lsr_temt = 1 << 6;
+
+    EventQueue& events;
+    std::FILE* out;
+    uint64_t tx_delay;
+    uint8_t lsr;
+};
+
+#endif  // SERIAL_H_
@@ -0,0 +1,81 @@
+#ifndef VGA_H_
+#define VGA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "Device/Device.h"
+
+// NEMU's screen: width x height pixels of 0x00RRGGBB, row by row. Stores
+// mark the 32 x 32 tiles they touch; sync() converts only those tiles to
+// RGB and hands the frame to a headless sink, so a program that redraws a
+// sprite does not pay for the whole screen.
+//
+// The sink is a directory, which gets frame-NNNNNN.ppm for every sync that
+// changed something, numbered by sync, or a file ending in .ppm, which is
+// mapped shared and updated in place. Put the latter in /dev/shm and a
+// viewer polling it sees the screen live.
+class Framebuffer : public Device
+{
+   public:
+    static constexpr uint32_t width = 400;
+    static constexpr uint32_t height = 300;
+    static constexpr uint64_t size = uint64_t(width) * height * 4;
+
+    // nullptr, having logged why, if the sink cannot be set up.
+    static std::unique_ptr<Framebuffer> open(const std::filesystem::path& sink);
+    ~Framebuffer() override;
+    Framebuffer(const Framebuffer&) = delete;
+    Framebuffer& operator=(const Framebuffer&) = delete;
+
+    uint64_t read(uint64_t offset, int len) override;
+    void write(uint64_t offset, uint64_t data, int len) override;
+
+    void sync();
+
+   private:
+    static constexpr uint32_t tile_size = 32;
+    static constexpr uint32_t tile_columns =
+        (width + tile_size - 1) / tile_size;
+    static constexpr uint32_t tile_rows = (height + tile_size - 1) / tile_size;
+
+    // mapping is the shared .ppm file, or nullptr to write frames to
+    // directory.
+    Framebuffer(std::filesystem::path directory, uint8_t* mapping);
+
+    std::vector<uint8_t> pixels;
+    std::vector<uint8_t> dirty;
+    std::vector<uint32_t> dirty_list;
+    // The frame as a P6 PPM file, header first: the shared mapping, or
+    // buffer.
+    uint8_t* ppm;
+    std::vector<uint8_t> buffer;
+    // Empty when ppm is a shared mapping.
+    std::filesystem::path directory;
+    uint64_t syncs = 0;
+    uint64_t frames = 0;
+
+    void mark(uint64_t offset, int len);
+    void convert(uint32_t tile);
+};
+
+// NEMU's VGA control registers. Offset 0 reads width << 16 | height; a
+// non-zero write to offset 4 syncs the screen.
+class VgaControl : public Device
+{
+   public:
+    static constexpr uint64_t size = 8;
+
+    explicit VgaControl(Framebuffer& framebuffer);
+
+    uint64_t read(uint64_t offset, int len) override;
+    void write(uint64_t offset, uint64_t data, int len) override;
+
+   private:
+    Framebuffer& framebuffer;
+};
+
+#endif  // VGA_H_
@@ -23,4 +23,14 @@ class invalid_address : public std::exception
     const char* what() const noexcept override { return "Invalid address"; }
 };
 
+// exit or exit_group of a user-mode program.
+class guest_exit : public std::exception
+{
+   public:
+    explicit guest_exit(int status) : status(status) {}
+    const char* what() const noexcept override { return "Guest exit"; }
+
+    int status;
+};
+
 #endif  // NEMU_EXCEPTION_H_
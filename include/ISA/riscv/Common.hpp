@@ -0,0 +1,217 @@
+#ifndef RISCV_COMMON_H_
+#define RISCV_COMMON_H_
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace RISCV
+{
+
+// Instructions are 32 bits wide whatever XLEN is.
+using inst_t = uint32_t;
+
+constexpr int32_t reg_num = 32;
+
+constexpr std::array<std::string_view, 32> reg_name_list = {
+    "zero", "ra", "sp", "gp", "tp",  "t0",  "t1", "t2", "s0", "s1", "a0",
+    "a1",   "a2", "a3", "a4", "a5",  "a6",  "a7", "s2", "s3", "s4", "s5",
+    "s6",   "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
+
+enum InstructionType
+{
+    R_TYPE,
+    I_TYPE,
+    S_TYPE,
+    B_TYPE,
+    U_TYPE,
+    J_TYPE
+};
+
+template <InstructionType type>
+struct InstructionText;
+
+template <>
+struct InstructionText<R_TYPE>
+{
+    static constexpr InstructionType type = R_TYPE;
+    inst_t opcode : 7;
+    inst_t rd : 5;
+    inst_t funct3 : 3;
+    inst_t rs1 : 5;
+    inst_t rs2 : 5;
+    inst_t funct7 : 7;
+};
+
+template <>
+struct InstructionText<I_TYPE>
+{
+    static constexpr InstructionType type = I_TYPE;
+    inst_t opcode : 7;
+    inst_t rd : 5;
+    inst_t funct3 : 3;
+    inst_t rs1 : 5;
+    int32_t imm : 12;
+};
+
+template <>
+struct InstructionText<S_TYPE>
+{
+    static constexpr InstructionType type = S_TYPE;
+    inst_t opcode : 7;
+    inst_t imm4_0 : 5;
+    inst_t funct3 : 3;
+    inst_t rs1 : 5;
+    inst_t rs2 : 5;
+    inst_t imm11_5 : 7;
+};
+
+template <>
+struct InstructionText<B_TYPE>
+{
+    static constexpr InstructionType type = B_TYPE;
+    inst_t opcode : 7;
+    inst_t imm11 : 1;
+    inst_t imm4_1 : 4;
+    inst_t funct3 : 3;
+    inst_t rs1 : 5;
+    inst_t rs2 : 5;
+    inst_t imm10_5 : 6;
+    inst_t imm12 : 1;
+};
+
+template <>
+struct InstructionText<U_TYPE>
+{
+    static constexpr InstructionType type = U_TYPE;
+    inst_t opcode : 7;
+    inst_t rd : 5;
+    inst_t imm : 20;
+};
+
+template <>
+struct InstructionText<J_TYPE>
+{
+    static constexpr InstructionType type = J_TYPE;
+    inst_t opcode : 7;
+    inst_t rd : 5;
+    inst_t imm19_12 : 8;
+    inst_t imm11 : 1;
+    inst_t imm10_1 : 10;
+    inst_t imm20 : 1;
+};
+
+union UnionInstructionText
+{
+    inst_t inst_text;
+    InstructionText<R_TYPE> r_inst;
+    InstructionText<I_TYPE> i_inst;
+    InstructionText<S_TYPE> s_inst;
+    InstructionText<B_TYPE> b_inst;
+    InstructionText<U_TYPE> u_inst;
+    InstructionText<J_TYPE> j_inst;
+};
+
+enum OpcodeMap
+{
+    LUI = 0b0110111,
+    AUIPC = 0b0010111,
+    JAL = 0b1101111,
+    JALR = 0b1100111,
+    BRANCH = 0b1100011,
+    LOAD = 0b0000011,
+    STORE = 0b0100011,
+    OP_IMM = 0b0010011,
+    OP = 0b0110011,
+    OP_IMM_32 = 0b0011011,
+    OP_32 = 0b0111011,
+    LOAD_FP = 0b0000111,
+    STORE_FP = 0b0100111,
+    MADD = 0b1000011,
+    MSUB = 0b1000111,
+    NMSUB = 0b1001011,
+    NMADD = 0b1001111,
+    OP_FP = 0b1010011,
+    OP_V = 0b1010111,
+    MISC_MEM = 0b0001111,
+    SYSTEM = 0b1110011
+};
+
+enum CSRMap
+{
+    FFLAGS = 0x001,
+    FRM = 0x002,
+    FCSR = 0x003,
+    VSTART = 0x008,
+    VXSAT = 0x009,
+    VXRM = 0x00a,
+    VCSR = 0x00f,
+    MSTATUS = 0x300,
+    MISA = 0x301,
+    MIE = 0x304,
+    MTVEC = 0x305,
+    MSCRATCH = 0x340,
+    MEPC = 0x341,
+    MCAUSE = 0x342,
+    MTVAL = 0x343,
+    MIP = 0x344,
+    MCYCLE = 0xb00,
+    MINSTRET = 0xb02,
+    MCYCLEH = 0xb80,
+    MINSTRETH = 0xb82,
+    CYCLE = 0xc00,
+    TIME = 0xc01,
+    INSTRET = 0xc02,
+    CYCLEH = 0xc80,
+    TIMEH = 0xc81,
+    INSTRETH = 0xc82,
+    VL = 0xc20,
+    VTYPE = 0xc21,
+    VLENB = 0xc22,
+    MVENDORID = 0xf11,
+    MARCHID = 0xf12,
+    MIMPID = 0xf13,
+    MHARTID = 0xf14,
+};
+
+enum MstatusBits : uint32_t
+{
+    MSTATUS_MIE = 1u << 3,
+    MSTATUS_MPIE = 1u << 7,
+    MSTATUS_VS = 3u << 9,
+    MSTATUS_MPP = 3u << 11,
+    MSTATUS_FS = 3u << 13,
+};
+
+// Interrupt numbers, i.e. bit positions in mip/mie and mcause codes.
+enum Interrupt
+{
+    IRQ_M_SOFT = 3,
+    IRQ_M_TIMER = 7,
+    IRQ_M_EXT = 11,
+};
+
+// Synchronous exception codes written to mcause.
+enum TrapCause
+{
+    CAUSE_ILLEGAL_INSTRUCTION = 2,
+    CAUSE_BREAKPOINT = 3,
+    CAUSE_ECALL_M = 11,
+};
+
+// The interrupt flag of mcause is its top bit.
+template <typename word_t>
+constexpr word_t cause_interrupt = word_t(1) << (sizeof(word_t) * 8 - 1);
+
+constexpr std::array<uint32_t, 5> builtin_firmware = {
+    0x00000297,  // auipc t0,0
+    0x00028823,  // sb  zero,16(t0)
+    0x0102c503,  // lbu a0,16(t0)
+    0x00100073,  // ebreak (used as nemu_trap)
+    0xdeadbeef,  // some data
+
+};
+
+}  // namespace RISCV
+
+#endif  // RISCV_COMMON_H_
\ No newline at end of file
@@ -0,0 +1,280 @@
+#ifndef RISCV_COMPRESSED_H_
+#define RISCV_COMPRESSED_H_
+
+#include <cstdint>
+
+#include "ISA/riscv/Common.hpp"
+#include "Utils/Utils.h"
+
+namespace RISCV
+{
+
+// The two low bits of every 32-bit instruction are 0b11; anything else is
+// a 16-bit RVC instruction.
+constexpr bool is_compressed(inst_t inst) { return (inst & 0b11) != 0b11; }
+
+constexpr int instruction_length(inst_t inst)
+{
+    return is_compressed(inst) ? 2 : 4;
+}
+
+namespace rvc
+{
+
+// Encoders for the 32-bit formats the compressed forms expand to.
+constexpr inst_t r_type(inst_t funct7, inst_t rs2, inst_t rs1, inst_t funct3,
+                        inst_t rd, inst_t opcode)
+{
+    return funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7 |
+           opcode;
+}
+
+constexpr inst_t i_type(uint32_t imm, inst_t rs1, inst_t funct3, inst_t rd,
+                        inst_t opcode)
+{
+    return imm << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+
+constexpr inst_t s_type(uint32_t imm, inst_t rs2, inst_t rs1, inst_t funct3,
+                        inst_t opcode)
+{
+    return (imm >> 5 & 0x7f) << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 |
+           (imm & 0x1f) << 7 | opcode;
+}
+
+constexpr inst_t b_type(uint32_t imm, inst_t rs2, inst_t rs1, inst_t funct3)
+{
+    return (imm >> 12 & 1) << 31 | (imm >> 5 & 0x3f) << 25 | rs2 << 20 |
+           rs1 << 15 | funct3 << 12 | (imm >> 1 & 0xf) << 8 |
+           (imm >> 11 & 1) << 7 | OpcodeMap::BRANCH;
+}
+
+constexpr inst_t j_type(uint32_t imm, inst_t rd)
+{
+    return (imm >> 20 & 1) << 31 | (imm >> 1 & 0x3ff) << 21 |
+           (imm >> 11 & 1) << 20 | (imm >> 12 & 0xff) << 12 | rd << 7 |
+           OpcodeMap::JAL;
+}
+
+// Register fields. The primed ones are 3 bits wide and name x8-x15.
+constexpr inst_t rd_full(inst_t c) { return extract_bits(c, 7, 11); }
+constexpr inst_t rs2_full(inst_t c) { return extract_bits(c, 2, 6); }
+constexpr inst_t rs1_prime(inst_t c) { return extract_bits(c, 7, 9) + 8; }
+constexpr inst_t rs2_prime(inst_t c) { return extract_bits(c, 2, 4) + 8; }
+
+// Immediates, named after the instructions that use them.
+constexpr uint32_t ci_imm(inst_t c)
+{
+    return sign_extend(extract_bits(c, 12, 12) << 5 | extract_bits(c, 2, 6),
+                       6);
+}
+
+constexpr uint32_t shamt(inst_t c)
+{
+    return extract_bits(c, 12, 12) << 5 | extract_bits(c, 2, 6);
+}
+
+constexpr uint32_t addi4spn_imm(inst_t c)
+{
+    return extract_bits(c, 11, 12) << 4 | extract_bits(c, 7, 10) << 6 |
+           extract_bits(c, 6, 6) << 2 | extract_bits(c, 5, 5) << 3;
+}
+
+constexpr uint32_t lw_imm(inst_t c)
+{
+    return extract_bits(c, 10, 12) << 3 | extract_bits(c, 6, 6) << 2 |
+           extract_bits(c, 5, 5) << 6;
+}
+
+constexpr uint32_t ld_imm(inst_t c)
+{
+    return extract_bits(c, 10, 12) << 3 | extract_bits(c, 5, 6) << 6;
+}
+
+constexpr uint32_t lwsp_imm(inst_t c)
+{
+    return extract_bits(c, 12, 12) << 5 | extract_bits(c, 4, 6) << 2 |
+           extract_bits(c, 2, 3) << 6;
+}
+
+constexpr uint32_t ldsp_imm(inst_t c)
+{
+    return extract_bits(c, 12, 12) << 5 | extract_bits(c, 5, 6) << 3 |
+           extract_bits(c, 2, 4) << 6;
+}
+
+constexpr uint32_t swsp_imm(inst_t c)
+{
+    return extract_bits(c, 9, 12) << 2 | extract_bits(c, 7, 8) << 6;
+}
+
+constexpr uint32_t sdsp_imm(inst_t c)
+{
+    return extract_bits(c, 10, 12) << 3 | extract_bits(c, 7, 9) << 6;
+}
+
+constexpr uint32_t addi16sp_imm(inst_t c)
+{
+    return sign_extend(
+        extract_bits(c, 12, 12) << 9 | extract_bits(c, 6, 6) << 4 |
+            extract_bits(c, 5, 5) << 6 | extract_bits(c, 3, 4) << 7 |
+            extract_bits(c, 2, 2) << 5,
+        10);
+}
+
+constexpr uint32_t lui_imm(inst_t c)
+{
+    return sign_extend(
+        extract_bits(c, 12, 12) << 17 | extract_bits(c, 2, 6) << 12, 18);
+}
+
+constexpr uint32_t cj_imm(inst_t c)
+{
+    return sign_extend(
+        extract_bits(c, 12, 12) << 11 | extract_bits(c, 11, 11) << 4 |
+            extract_bits(c, 9, 10) << 8 | extract_bits(c, 8, 8) << 10 |
+            extract_bits(c, 7, 7) << 6 | extract_bits(c, 6, 6) << 7 |
+            extract_bits(c, 3, 5) << 1 | extract_bits(c, 2, 2) << 5,
+        12);
+}
+
+constexpr uint32_t cb_imm(inst_t c)
+{
+    return sign_extend(
+        extract_bits(c, 12, 12) << 8 | extract_bits(c, 10, 11) << 3 |
+            extract_bits(c, 5, 6) << 6 | extract_bits(c, 3, 4) << 1 |
+            extract_bits(c, 2, 2) << 5,
+        9);
+}
+
+}  // namespace rvc
+
+// Expands a 16-bit RVC instruction to the 32-bit instruction it is an alias
+// of, so the core decodes and executes both the same way. Returns 0, which
+// is never a valid expansion, for reserved encodings. XLEN picks between
+// the RV32 and RV64 meaning of the encodings they disagree on (c.jal /
+// c.addiw and the c.flw / c.ld family).
+template <int XLEN>
+constexpr inst_t expand_compressed(inst_t c)
+{
+    using namespace rvc;
+    constexpr bool rv64 = XLEN == 64;
+    inst_t rd = rd_full(c);
+    inst_t rs2 = rs2_full(c);
+    inst_t rs1p = rs1_prime(c);
+    inst_t rs2p = rs2_prime(c);
+    switch ((c & 0b11) << 3 | extract_bits(c, 13, 15))
+    {
+        // Quadrant 0
+        case 0b00'000:  // c.addi4spn
+            if (addi4spn_imm(c) == 0) return 0;
+            return i_type(addi4spn_imm(c), 2, 0b000, rs2p, OP_IMM);
+        case 0b00'001:  // c.fld
+            return i_type(ld_imm(c), rs1p, 0b011, rs2p, LOAD_FP);
+        case 0b00'010:  // c.lw
+            return i_type(lw_imm(c), rs1p, 0b010, rs2p, LOAD);
+        case 0b00'011:  // c.ld, c.flw
+            if (!rv64)
+                return i_type(lw_imm(c), rs1p, 0b010, rs2p, LOAD_FP);
+            return i_type(ld_imm(c), rs1p, 0b011, rs2p, LOAD);
+        case 0b00'101:  // c.fsd
+            return s_type(ld_imm(c), rs2p, rs1p, 0b011, STORE_FP);
+        case 0b00'110:  // c.sw
+            return s_type(lw_imm(c), rs2p, rs1p, 0b010, STORE);
+        case 0b00'111:  // c.sd, c.fsw
+            if (!rv64)
+                return s_type(lw_imm(c), rs2p, rs1p, 0b010, STORE_FP);
+            return s_type(ld_imm(c), rs2p, rs1p, 0b011, STORE);
+
+        // Quadrant 1
+        case 0b01'000:  // c.addi, c.nop
+            return i_type(ci_imm(c), rd, 0b000, rd, OP_IMM);
+        case 0b01'001:  // c.jal on RV32, c.addiw on RV64
+            if (!rv64) return j_type(cj_imm(c), 1);
+            if (rd == 0) return 0;
+            return i_type(ci_imm(c), rd, 0b000, rd, OP_IMM_32);
+        case 0b01'010:  // c.li
+            return i_type(ci_imm(c), 0, 0b000, rd, OP_IMM);
+        case 0b01'011:  // c.addi16sp, c.lui
+            if (rd == 2)
+            {
+                if (addi16sp_imm(c) == 0) return 0;
+                return i_type(addi16sp_imm(c), 2, 0b000, 2, OP_IMM);
+            }
+            if (lui_imm(c) == 0) return 0;
+            return lui_imm(c) | rd << 7 | LUI;
+        case 0b01'100:
+            switch (extract_bits(c, 10, 11))
+            {
+                case 0b00:  // c.srli
+                    if (!rv64 && shamt(c) >= 32) return 0;
+                    return i_type(shamt(c), rs1p, 0b101, rs1p, OP_IMM);
+                case 0b01:  // c.srai
+                    if (!rv64 && shamt(c) >= 32) return 0;
+                    return i_type(0x400 | shamt(c), rs1p, 0b101, rs1p,
+                                  OP_IMM);
+                case 0b10:  // c.andi
+                    return i_type(ci_imm(c), rs1p, 0b111, rs1p, OP_IMM);
+                default:
+                {
+                    // c.sub, c.xor, c.or, c.and; c.subw, c.addw on RV64
+                    constexpr inst_t funct3[] = {0b000, 0b100, 0b110, 0b111};
+                    inst_t op = extract_bits(c, 5, 6);
+                    if (extract_bits(c, 12, 12) == 0)
+                        return r_type(op == 0 ? 0x20 : 0, rs2p, rs1p,
+                                      funct3[op], rs1p, OP);
+                    if (!rv64 || op >= 2) return 0;
+                    return r_type(op == 0 ? 0x20 : 0, rs2p, rs1p, 0b000,
+                                  rs1p, OP_32);
+                }
+            }
+        case 0b01'101:  // c.j
+            return j_type(cj_imm(c), 0);
+        case 0b01'110:  // c.beqz
+            return b_type(cb_imm(c), 0, rs1p, 0b000);
+        case 0b01'111:  // c.bnez
+            return b_type(cb_imm(c), 0, rs1p, 0b001);
+
+        // Quadrant 2
+        case 0b10'000:  // c.slli
+            if (!rv64 && shamt(c) >= 32) return 0;
+            return i_type(shamt(c), rd, 0b001, rd, OP_IMM);
+        case 0b10'001:  // c.fldsp
+            return i_type(ldsp_imm(c), 2, 0b011, rd, LOAD_FP);
+        case 0b10'010:  // c.lwsp
+            if (rd == 0) return 0;
+            return i_type(lwsp_imm(c), 2, 0b010, rd, LOAD);
+        case 0b10'011:  // c.ldsp, c.flwsp
+            if (!rv64) return i_type(lwsp_imm(c), 2, 0b010, rd, LOAD_FP);
+            if (rd == 0) return 0;
+            return i_type(ldsp_imm(c), 2, 0b011, rd, LOAD);
+        case 0b10'100:
+            if (extract_bits(c, 12, 12) == 0)
+            {
+                if (rs2 != 0)  // c.mv
+                    return r_type(0, rs2, 0, 0b000, rd, OP);
+                if (rd == 0) return 0;  // c.jr
+                return i_type(0, rd, 0b000, 0, JALR);
+            }
+            if (rs2 != 0)  // c.add
+                return r_type(0, rs2, rd, 0b000, rd, OP);
+            if (rd == 0)  // c.ebreak
+                return 0x00100073;
+            return i_type(0, rd, 0b000, 1, JALR);  // c.jalr
+        case 0b10'101:  // c.fsdsp
+            return s_type(sdsp_imm(c), rs2, 2, 0b011, STORE_FP);
+        case 0b10'110:  // c.swsp
+            return s_type(swsp_imm(c), rs2, 2, 0b010, STORE);
+        case 0b10'111:  // c.sdsp, c.fswsp
+            if (!rv64)
+                return s_type(swsp_imm(c), rs2, 2, 0b010, STORE_FP);
+            return s_type(sdsp_imm(c), rs2, 2, 0b011, STORE);
+
+        default:
+            return 0;
+    }
+}
+
+}  // namespace RISCV
+
+#endif  // RISCV_COMPRESSED_H_
@@ -0,0 +1,122 @@
+#ifndef RISCV_DECODER_H_
+#define RISCV_DECODER_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+#include "ISA/riscv/Common.hpp"
+
+namespace RISCV
+{
+
+// Immediate of each instruction format as a single expression on the
+// instruction word. Immediates are at most 32 bits and always sign-extended,
+// so converting the result to a wider word_t does the RV64 extension.
+template <InstructionType format>
+constexpr int32_t immediate(inst_t inst)
+{
+    auto sinst = static_cast<int32_t>(inst);
+    if constexpr (format == I_TYPE)
+        return sinst >> 20;
+    else if constexpr (format == S_TYPE)
+        return (sinst >> 25 << 5) | (inst >> 7 & 0x1f);
+    else if constexpr (format == B_TYPE)
+        return (sinst >> 31 << 12) | (inst << 4 & 0x800) |
+               (inst >> 20 & 0x7e0) | (inst >> 7 & 0x1e);
+    else if constexpr (format == U_TYPE)
+        return sinst & ~0xfff;
+    else if constexpr (format == J_TYPE)
+        return (sinst >> 31 << 20) | (inst & 0xff000) | (inst >> 9 & 0x800) |
+               (inst >> 20 & 0x7fe);
+    else
+        return 0;
+}
+
+// Indexed by InstructionType.
+constexpr std::array<int32_t (*)(inst_t), 6> immediate_extractors = {
+    immediate<R_TYPE>, immediate<I_TYPE>, immediate<S_TYPE>,
+    immediate<B_TYPE>, immediate<U_TYPE>, immediate<J_TYPE>};
+
+// One row of an instruction table: inst belongs to it iff
+// (inst & mask) == match. semantic is whatever the core builds handlers
+// with.
+template <typename Semantic>
+struct InstSpec
+{
+    std::string_view name;
+    inst_t mask;
+    inst_t match;
+    InstructionType format;
+    Semantic semantic;
+};
+
+// Concatenates instruction tables, e.g. a base ISA and an extension.
+template <typename Spec, size_t N, size_t M>
+constexpr std::array<Spec, N + M> join(const std::array<Spec, N>& first,
+                                       const std::array<Spec, M>& second)
+{
+    std::array<Spec, N + M> joined{};
+    for (size_t i = 0; i < N; i++) joined[i] = first[i];
+    for (size_t i = 0; i < M; i++) joined[N + i] = second[i];
+    return joined;
+}
+
+// Dense index over opcode[6:2], funct3 and funct7, built at compile time
+// from a table of InstSpec. One load gives the first row whose fixed bits
+// agree on those fields; its mask/match has the final say, and the rare
+// rows sharing a slot (ecall/ebreak) are found by scanning on from there.
+template <const auto& table>
+class DecodeIndex
+{
+   public:
+    static constexpr uint16_t invalid = 0xffff;
+
+    static constexpr const auto* find(inst_t inst)
+    {
+        using Spec = std::remove_cvref_t<decltype(table[0])>;
+        for (size_t i = index[key(inst)]; i < table.size(); i++)
+        {
+            if ((inst & table[i].mask) == table[i].match) return &table[i];
+        }
+        return static_cast<const Spec*>(nullptr);
+    }
+
+   private:
+    static constexpr inst_t key_mask = 0xfe00707c;
+
+    static constexpr size_t key(inst_t inst)
+    {
+        return (inst >> 2 & 0x1f) | (inst >> 12 & 0x7) << 5 |
+               (inst >> 25) << 8;
+    }
+
+    static constexpr auto build()
+    {
+        static_assert(table.size() < invalid, "instruction table too big");
+        std::array<uint16_t, 1 << 15> slots{};
+        slots.fill(invalid);
+        // Filled backwards so the first matching row wins. Each row visits
+        // every combination of the key bits its mask leaves open.
+        for (size_t i = table.size(); i-- > 0;)
+        {
+            inst_t fixed = table[i].match & table[i].mask & key_mask;
+            inst_t open = key_mask & ~table[i].mask;
+            inst_t bits = 0;
+            do
+            {
+                slots[key(fixed | bits)] = i;
+                bits = (bits - open) & open;
+            } while (bits != 0);
+        }
+        return slots;
+    }
+
+    static constexpr std::array<uint16_t, 1 << 15> index = build();
+};
+
+}  // namespace RISCV
+
+#endif  // RISCV_DECODER_H_
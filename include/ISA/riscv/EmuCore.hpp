@@ -0,0 +1,242 @@
+#ifndef EMUCORE_H_
+#define EMUCORE_H_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "Core/Core.hpp"
+#include "ISA/riscv/Common.hpp"
+#include "ISA/riscv/Vector.hpp"
+#include "Memory/Memory.h"
+#include "Plugin/Plugin.h"
+#include "Syscall/LinuxSyscalls.h"
+
+namespace RISCV
+{
+
+// An RV32IMFDCV or RV64IMFDCV hart. Both widths share this implementation; XLEN
+// only decides word_t and which rows the instruction table has, so nothing
+// on the execution path looks at the width at run time.
+template <int XLEN>
+class EmuCore : public Core<EmuCore<XLEN>>
+{
+    static_assert(XLEN == 32 || XLEN == 64, "XLEN must be 32 or 64");
+
+   public:
+    using word_t = std::conditional_t<XLEN == 64, uint64_t, uint32_t>;
+    using sword_t = std::make_signed_t<word_t>;
+    constexpr static auto builtin_firmware = RISCV::builtin_firmware;
+    constexpr static std::string_view disasm_triple =
+        XLEN == 64 ? "riscv64-pc-linux-gnu" : "riscv32-pc-linux-gnu";
+
+    EmuCore(Memory& memory);
+    ~EmuCore();
+
+   private:
+    static constexpr word_t pc_init = 0x80000000;
+    static constexpr word_t cause_interrupt = RISCV::cause_interrupt<word_t>;
+    // mstatus.FS and mstatus.VS are hardwired to Dirty, f and v register
+    // writes are not tracked. SD, the top bit, summarizes them.
+    static constexpr word_t mstatus_sd = word_t(1) << (XLEN - 1);
+    // vtype.vill is its top bit too.
+    static constexpr word_t vtype_vill = word_t(1) << (XLEN - 1);
+    using Handler = std::function<void()>;
+
+    friend class Core<EmuCore>;
+    Memory& memory;
+    word_t null_operand;
+    word_t pc;
+    word_t next_pc;
+    word_t reset_pc;
+
+    // The f registers are 64 bits wide for either XLEN, singles are
+    // NaN-boxed in them. The v registers are back to back, so a register
+    // group is contiguous, and aligned for the host's vector loads.
+    struct RegisterFile
+    {
+        std::array<word_t, 32> x;
+        std::array<uint64_t, 32> f;
+        alignas(vlenb) std::array<uint8_t, 32 * vlenb> v;
+        RegisterFile();
+        void reset();
+    } register_file;
+
+    // Machine-mode CSRs. mcycle and minstret are derived from instret, the
+    // offsets hold what software wrote to them.
+    struct CSRFile
+    {
+        word_t mstatus;
+        word_t mie;
+        word_t mip;
+        word_t mtvec;
+        word_t mscratch;
+        word_t mepc;
+        word_t mcause;
+        word_t mtval;
+        uint64_t mcycle_offset;
+        uint64_t minstret_offset;
+        // Accrued exceptions not yet in fflags are in the host FPU's
+        // flags; see HostFPU.
+        uint32_t fflags;
+        uint32_t frm;
+        word_t vstart;
+        uint32_t vxsat;
+        uint32_t vxrm;
+        word_t vl;
+        word_t vtype;
+        CSRFile();
+        void reset();
+    } csr;
+
+    uint64_t instret;
+    // The pcs of the last retired instructions, indexed by instret modulo
+    // their number, for the trace of a bad exit. Those before recent_since
+    // are from before a reset or a restored state.
+    std::array<word_t, 32> recent_pcs;
+    uint64_t recent_since;
+    CoreCounters counters;
+    // Interrupts are only looked at when a quantum starts. Anything that may
+    // make one deliverable sets quantum_left to 0 to end the quantum early.
+    uint64_t quantum_left;
+    bool interrupt_pending;
+    // The address of the last lr, until an sc or a trap. With one hart
+    // nothing else can break a reservation.
+    std::optional<word_t> reservation;
+    // Set by end_quantum(): execute() returns instead of starting the next
+    // quantum.
+    bool quantum_ended;
+
+   public:
+    struct State
+    {
+        RegisterFile register_file;
+        CSRFile csr;
+        word_t pc;
+        uint64_t instret;
+        bool interrupt_pending;
+        std::optional<word_t> reservation;
+    };
+
+   private:
+    // Decoded instructions, direct-mapped by pc. An entry is reused only
+    // while the words it was decoded from are still in memory, which is
+    // checked on every use, so stores to code and restored pages need no
+    // invalidation. Compressed instructions are expanded before decoding;
+    // inst holds them unexpanded and len is 2 for them. If the instruction
+    // at pc and the next one form a common idiom, fused runs both with one
+    // dispatch. It retires the first one itself, so the state is exact if
+    // the second one traps, and it is only used when the quantum has room
+    // for both.
+    struct DecodedInst
+    {
+        bool valid = false;
+        word_t pc;
+        int len;
+        std::array<inst_t, 2> inst;
+        Handler handler;
+        Handler fused;
+    };
+    static constexpr size_t decode_cache_size = 4096;
+    std::vector<DecodedInst> decode_cache;
+    inst_t fetch(word_t pc);
+    DecodedInst& lookup(word_t pc);
+    Handler fuse(word_t inst_pc, inst_t inst, inst_t next);
+
+    // Instructions are described by the table in EmuCore.cpp; Semantics
+    // builds their handlers.
+    template <int>
+    friend struct Semantics;
+    Handler decode(word_t inst_pc, inst_t inst);
+
+    // While instructions execute, the host FPU is the guest's: its sticky
+    // exception flags accrue fflags and its rounding mode is host_rm,
+    // switched only when an instruction asks for another one. HostFPU takes
+    // it over for one call of execute() and hands it back, with the default
+    // rounding mode and the flags moved to fflags, however the call ends.
+    struct HostFPU
+    {
+        explicit HostFPU(EmuCore& core);
+        ~HostFPU();
+        EmuCore& core;
+    };
+    int host_rm;
+    // Sets the host rounding mode for an instruction with rounding mode
+    // field rm, RM_DYN meaning frm, and rmm to whether it is RMM, which the
+    // host runs as RNE. Returns false, changing nothing, if rm is RM_DYN
+    // and frm holds a reserved mode.
+    bool set_rounding(int rm, bool& rmm);
+
+    // V runs on the kernels for the host's instruction set. Scalar operands
+    // are splatted to scratch, which holds the largest register group.
+    const VectorKernels& vector_kernels;
+    alignas(vlenb) std::array<uint8_t, 8 * vlenb> vector_scratch;
+
+    // Guest library functions run on the host, keyed by their entry point.
+    // decode() wraps the handler of the first instruction of each: the call
+    // is done at once on guest RAM and returns to ra, retiring as one
+    // instruction. Only a0 is written; the temporaries the guest code would
+    // have used keep their values, which the calling convention allows.
+    // Whenever the host could not do exactly what the guest code would (a
+    // range that is not all RAM, overlapping memcpy) the guest code runs.
+    enum class HostFunction
+    {
+        MEMCPY,
+        MEMSET,
+        MEMCMP,
+        STRLEN
+    };
+    std::unordered_map<word_t, HostFunction> host_functions;
+    bool host_functions_suspended;
+    // Returns false if the guest code has to run instead.
+    bool call_host_function(HostFunction function);
+
+    // Consulted by decode() only. Instructions with plugin callbacks are
+    // not fused, and none are while plugins are attached, since the second
+    // instruction of a pair would skip its own.
+    PluginManager* plugins;
+    Handler instrument(Handler handler, const InstructionInfo& info,
+                       word_t& base, word_t offset);
+
+    // Set in user mode, where ecall is a Linux system call: a7 holds its
+    // number, a0 to a5 its arguments and a0 gets the result.
+    LinuxSyscalls* syscalls;
+    void system_call();
+
+    // Read by the time CSR; see Core::set_timer.
+    std::function<uint64_t()> mtime;
+    word_t csr_read(word_t addr);
+    void csr_write(word_t addr, word_t data);
+    word_t trap(word_t cause, word_t tval);
+    void take_interrupt();
+    void update_interrupt_pending();
+
+    void reset_impl();
+    void set_reset_pc_impl(uint64_t entry);
+    void set_interrupt_impl(int irq, bool pending);
+    void set_timer_impl(std::function<uint64_t()> mtime);
+    State save_state_impl();
+    void restore_state_impl(const State& state);
+    bool intercept_function_impl(std::string_view name, uint64_t addr);
+    void suspend_interception_impl(bool suspend);
+    void set_plugins_impl(PluginManager* plugins);
+    void enter_user_mode_impl(LinuxSyscalls& syscalls, uint64_t sp);
+    void execute_impl(uint64_t n);
+    void end_quantum_impl();
+    word_t debug_get_pc_impl();
+    std::vector<uint64_t> recent_pcs_impl();
+    word_t debug_get_reg_val_impl(int reg_num);
+    word_t debug_get_reg_index_impl(std::string_view reg_name);
+};
+
+extern template class EmuCore<32>;
+extern template class EmuCore<64>;
+
+}  // namespace RISCV
+
+#endif  // EMUCORE_H_
\ No newline at end of file
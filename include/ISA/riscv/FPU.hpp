@@ -0,0 +1,313 @@
+#ifndef RISCV_FPU_H_
+#define RISCV_FPU_H_
+
+#include <bit>
+#include <cfenv>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace RISCV
+{
+
+// Rounding modes as encoded in frm and in the rm field of instructions.
+enum RoundingMode
+{
+    RM_RNE = 0,
+    RM_RTZ = 1,
+    RM_RDN = 2,
+    RM_RUP = 3,
+    RM_RMM = 4,
+    RM_DYN = 7,
+};
+
+// Accrued exception bits of fflags.
+enum FFlags : uint32_t
+{
+    FFLAG_NX = 1u << 0,
+    FFLAG_UF = 1u << 1,
+    FFLAG_OF = 1u << 2,
+    FFLAG_DZ = 1u << 3,
+    FFLAG_NV = 1u << 4,
+};
+
+// Host rounding direction for rm, -1 for the reserved encodings. The host
+// has no round-to-nearest-max-magnitude, RMM runs as RNE and FPU corrects
+// the ties.
+constexpr int host_rounding(int rm)
+{
+    switch (rm)
+    {
+        case RM_RNE:
+        case RM_RMM:
+            return FE_TONEAREST;
+        case RM_RTZ:
+            return FE_TOWARDZERO;
+        case RM_RDN:
+            return FE_DOWNWARD;
+        case RM_RUP:
+            return FE_UPWARD;
+        default:
+            return -1;
+    }
+}
+
+// The host's sticky exception flags as fflags bits.
+inline uint32_t host_fflags()
+{
+    int raised = std::fetestexcept(FE_ALL_EXCEPT);
+    return (raised & FE_INEXACT ? FFLAG_NX : 0) |
+           (raised & FE_UNDERFLOW ? FFLAG_UF : 0) |
+           (raised & FE_OVERFLOW ? FFLAG_OF : 0) |
+           (raised & FE_DIVBYZERO ? FFLAG_DZ : 0) |
+           (raised & FE_INVALID ? FFLAG_NV : 0);
+}
+
+// F and D operations for F = float and F = double, done by the host FPU
+// in its current rounding mode, which the core keeps equal to the
+// instruction's. The host raises IEEE exception flags like RISC-V does,
+// so they accrue fflags without help; only where RISC-V differs from the
+// host (NaN results, fmin/fmax, saturating conversions, RMM) the work is
+// done here, and flags collects what the host would not raise.
+template <typename F>
+struct FPU
+{
+    using bits_t = std::conditional_t<sizeof(F) == 4, uint32_t, uint64_t>;
+    static constexpr int mantissa_bits = std::numeric_limits<F>::digits - 1;
+    static constexpr bits_t sign_bit = bits_t(1) << (sizeof(F) * 8 - 1);
+    static constexpr bits_t infinity = bits_t(~sign_bit) >> mantissa_bits
+                                       << mantissa_bits;
+    static constexpr bits_t quiet_bit = bits_t(1) << (mantissa_bits - 1);
+    static constexpr bits_t canonical_nan = infinity | quiet_bit;
+
+    static bits_t bits(F x) { return std::bit_cast<bits_t>(x); }
+    static F from_bits(bits_t x) { return std::bit_cast<F>(x); }
+
+    // By bits: comparing a signaling NaN on the host would raise NV.
+    static bool is_nan(F x) { return (bits(x) & ~sign_bit) > infinity; }
+    static bool is_snan(F x) { return is_nan(x) && !(bits(x) & quiet_bit); }
+
+    // The f registers are 64 bits wide. Singles are NaN-boxed in them, and
+    // read as the canonical NaN if they are not.
+    static F unbox(uint64_t reg)
+    {
+        if constexpr (sizeof(F) == 4)
+        {
+            if (reg >> 32 != 0xffffffff) return from_bits(canonical_nan);
+        }
+        return from_bits(static_cast<bits_t>(reg));
+    }
+
+    static uint64_t box(F x)
+    {
+        if constexpr (sizeof(F) == 4)
+            return 0xffffffff00000000ull | bits(x);
+        else
+            return bits(x);
+    }
+
+    // Arithmetic results: any NaN becomes the canonical one, the host would
+    // propagate payloads.
+    static uint64_t result(F x)
+    {
+        return is_nan(x) ? box(from_bits(canonical_nan)) : box(x);
+    }
+
+    // r is the round-to-nearest-even result of an operation whose exact
+    // result is r + err. Returns the RMM result, which differs only if the
+    // exact result lies halfway between r and its neighbour away from zero.
+    template <typename E>
+    static F ties_away(F r, E err)
+    {
+        if (!(r > 0 && err > 0) && !(r < 0 && err < 0)) return r;
+        F next = from_bits(bits(r) + 1);
+        return E(next) - E(r) == err + err ? next : r;
+    }
+
+    static F add(F a, F b, bool rmm)
+    {
+        F r = a + b;
+        if (rmm && std::isfinite(r))
+        {
+            // Two-sum: the rounding error of a + b, exactly.
+            F b_part = r - a;
+            r = ties_away(r, (a - (r - b_part)) + (b - b_part));
+        }
+        return r;
+    }
+
+    static F sub(F a, F b, bool rmm) { return add(a, -b, rmm); }
+
+    // A single product is exact as a double. A double product's rounding
+    // error is exact from fma while it does not underflow, below that ties
+    // round to even.
+    static F mul(F a, F b, bool rmm)
+    {
+        F r = a * b;
+        if (!rmm || !std::isfinite(r)) return r;
+        if constexpr (sizeof(F) == 4)
+            return ties_away(r, double(a) * double(b) - double(r));
+        constexpr F exact_error = std::numeric_limits<F>::min() *
+                                  F(bits_t(1) << mantissa_bits);
+        if (std::fabs(r) < exact_error) return r;
+        return ties_away(r, std::fma(a, b, -r));
+    }
+
+    // Quotients and square roots of floating-point numbers are never
+    // exactly halfway between two of them, so RMM rounds like RNE.
+    static F div(F a, F b, bool) { return a / b; }
+    static F sqrt(F a, bool) { return std::sqrt(a); }
+
+    // RISC-V raises NV for inf * 0 + qNaN, the host does not. Under RMM a
+    // single's tie is found in double, where the product is exact and a
+    // two-sum gives the rest; a double that is exactly halfway still rounds
+    // to even.
+    static F fma(F a, F b, F c, bool rmm, uint32_t& flags)
+    {
+        F r = std::fma(a, b, c);
+        if (is_nan(r) && ((std::isinf(a) && b == 0) ||
+                          (a == 0 && std::isinf(b))))
+            flags |= FFLAG_NV;
+        if constexpr (sizeof(F) == 4)
+        {
+            if (rmm && std::isfinite(r))
+            {
+                double product = double(a) * double(b);
+                double sum = product + c;
+                double product_part = sum - c;
+                double lost = (product - product_part) +
+                              (c - (sum - product_part));
+                if (lost == 0) r = ties_away(r, sum - double(r));
+            }
+        }
+        return r;
+    }
+
+    // -0 is less than +0. A NaN operand is ignored unless both are NaN,
+    // signaling ones raise NV.
+    template <bool is_min>
+    static F min_max(F a, F b, uint32_t& flags)
+    {
+        if (is_snan(a) || is_snan(b)) flags |= FFLAG_NV;
+        if (is_nan(a)) return b;
+        if (is_nan(b)) return a;
+        if (a == b) return std::signbit(a) == is_min ? a : b;
+        return (a < b) == is_min ? a : b;
+    }
+
+    static F min(F a, F b, uint32_t& flags)
+    {
+        return min_max<true>(a, b, flags);
+    }
+
+    static F max(F a, F b, uint32_t& flags)
+    {
+        return min_max<false>(a, b, flags);
+    }
+
+    // feq is quiet, flt and fle signal on any NaN.
+    static bool eq(F a, F b, uint32_t& flags)
+    {
+        if (is_nan(a) || is_nan(b))
+        {
+            if (is_snan(a) || is_snan(b)) flags |= FFLAG_NV;
+            return false;
+        }
+        return a == b;
+    }
+
+    static bool lt(F a, F b, uint32_t& flags)
+    {
+        if (is_nan(a) || is_nan(b))
+        {
+            flags |= FFLAG_NV;
+            return false;
+        }
+        return a < b;
+    }
+
+    static bool le(F a, F b, uint32_t& flags)
+    {
+        if (is_nan(a) || is_nan(b))
+        {
+            flags |= FFLAG_NV;
+            return false;
+        }
+        return a <= b;
+    }
+
+    // fclass: one bit out of ten.
+    static uint32_t classify(F x)
+    {
+        bool negative = bits(x) & sign_bit;
+        if (is_nan(x)) return is_snan(x) ? 1u << 8 : 1u << 9;
+        switch (std::fpclassify(x))
+        {
+            case FP_INFINITE:
+                return negative ? 1u << 0 : 1u << 7;
+            case FP_NORMAL:
+                return negative ? 1u << 1 : 1u << 6;
+            case FP_SUBNORMAL:
+                return negative ? 1u << 2 : 1u << 5;
+            default:
+                return negative ? 1u << 3 : 1u << 4;
+        }
+    }
+
+    // fcvt to the integer type I. Out-of-range values and NaN saturate and
+    // raise NV, where the host would return its "integer indefinite".
+    template <typename I>
+    static I to_int(F x, bool rmm, uint32_t& flags)
+    {
+        using limits = std::numeric_limits<I>;
+        constexpr F lower = F(limits::min());
+        constexpr F upper = F(2) * F(I(1) << (limits::digits - 1));
+        if (is_nan(x))
+        {
+            flags |= FFLAG_NV;
+            return limits::max();
+        }
+        F r = rmm ? std::round(x) : std::nearbyint(x);
+        if (r < lower || r >= upper)
+        {
+            flags |= FFLAG_NV;
+            return r < lower ? limits::min() : limits::max();
+        }
+        if (r != x) flags |= FFLAG_NX;
+        return static_cast<I>(r);
+    }
+
+    // Under RMM the tie is found on the integer: the bits that do not fit
+    // in the mantissa are exactly one half. Converting r back to an integer
+    // to get the error would raise NX in libgcc.
+    template <typename I>
+    static F from_int(I value, bool rmm)
+    {
+        using U = std::make_unsigned_t<I>;
+        F r = static_cast<F>(value);
+        U magnitude = value < 0 ? U(0) - U(value) : U(value);
+        int dropped = std::bit_width(magnitude) - (mantissa_bits + 1);
+        if (!rmm || dropped <= 0) return r;
+        U half = U(1) << (dropped - 1);
+        if ((magnitude & (half + half - 1)) != half) return r;
+        F away = static_cast<F>(magnitude - half) + static_cast<F>(half + half);
+        return value < 0 ? -away : away;
+    }
+
+    // fcvt between single and double.
+    template <typename G>
+    static F convert(G value, bool rmm)
+    {
+        F r = static_cast<F>(value);
+        if constexpr (sizeof(G) > sizeof(F))
+        {
+            if (rmm && std::isfinite(r)) r = ties_away(r, value - G(r));
+        }
+        return r;
+    }
+};
+
+}  // namespace RISCV
+
+#endif  // RISCV_FPU_H_
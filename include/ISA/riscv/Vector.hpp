@@ -0,0 +1,154 @@
+#ifndef RISCV_VECTOR_H_
+#define RISCV_VECTOR_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace RISCV
+{
+
+// The V extension with VLEN = 256, one AVX2 register per vector register,
+// and ELEN = 64.
+constexpr unsigned vlen = 256;
+constexpr size_t vlenb = vlen / 8;
+constexpr unsigned elen = 64;
+
+// vtype fields. SEW and LMUL are kept as log2(SEW / 8) and log2(LMUL), the
+// latter negative for fractional LMUL.
+constexpr unsigned vtype_sew(uint64_t vtype) { return vtype >> 3 & 0b111; }
+
+constexpr int vtype_lmul(uint64_t vtype)
+{
+    return static_cast<int>(vtype & 0b111) << 29 >> 29;
+}
+
+// Reserved vtype values set vill. SEW may not exceed LMUL * ELEN.
+constexpr bool vtype_valid(uint64_t vtype)
+{
+    return vtype >> 8 == 0 && vtype_sew(vtype) <= 3 &&
+           vtype_lmul(vtype) != -4 &&
+           int(vtype_sew(vtype)) <= 3 + vtype_lmul(vtype);
+}
+
+constexpr size_t vtype_vlmax(uint64_t vtype)
+{
+    int lmul = vtype_lmul(vtype);
+    size_t per_register = vlenb >> vtype_sew(vtype);
+    return lmul >= 0 ? per_register << lmul : per_register >> -lmul;
+}
+
+// Registers in a group of 2^lmul; fractional groups take one register.
+constexpr unsigned group_registers(int lmul)
+{
+    return lmul > 0 ? 1u << lmul : 1;
+}
+
+// Operations of the host kernels. The *_COUNT entries size the tables.
+enum VectorBinaryOp
+{
+    VOP_ADD,
+    VOP_SUB,
+    VOP_RSUB,
+    VOP_AND,
+    VOP_OR,
+    VOP_XOR,
+    VOP_MINU,
+    VOP_MIN,
+    VOP_MAXU,
+    VOP_MAX,
+    VOP_SLL,
+    VOP_SRL,
+    VOP_SRA,
+    VOP_MUL,
+    VOP_MULH,
+    VOP_MULHU,
+    VOP_MULHSU,
+    VOP_MOVE,
+    VOP_COUNT
+};
+
+enum VectorCompareOp
+{
+    VCMP_EQ,
+    VCMP_NE,
+    VCMP_LTU,
+    VCMP_LT,
+    VCMP_LEU,
+    VCMP_LE,
+    VCMP_GTU,
+    VCMP_GT,
+    VCMP_COUNT
+};
+
+// In funct6 order.
+enum VectorReduceOp
+{
+    VRED_SUM,
+    VRED_AND,
+    VRED_OR,
+    VRED_XOR,
+    VRED_MINU,
+    VRED_MIN,
+    VRED_MAXU,
+    VRED_MAX,
+    VRED_COUNT
+};
+
+// In funct6 order, vs2 op vs1.
+enum VectorMaskOp
+{
+    VMASK_ANDN,
+    VMASK_AND,
+    VMASK_OR,
+    VMASK_XOR,
+    VMASK_ORN,
+    VMASK_NAND,
+    VMASK_NOR,
+    VMASK_XNOR,
+    VMASK_COUNT
+};
+
+// Kernels on register groups in host memory, one table per host instruction
+// set. They work on the first vl elements; with a mask (v0) only on those
+// whose bit is set. Elements past vl and masked-off ones are left as they
+// are, which the agnostic policies allow too. Tables with an SEW dimension
+// are indexed by log2(SEW / 8).
+struct VectorKernels
+{
+    // vd = op(vs2, vs1). compare writes one bit per element to vd.
+    using Binary = void (*)(uint8_t* vd, const uint8_t* vs2,
+                            const uint8_t* vs1, const uint8_t* mask,
+                            size_t vl);
+    // op over init and the active elements of vs2.
+    using Reduce = uint64_t (*)(const uint8_t* vs2, const uint8_t* mask,
+                                size_t vl, uint64_t init);
+    // Bitwise on the first vl bits.
+    using MaskLogical = void (*)(uint8_t* vd, const uint8_t* vs2,
+                                 const uint8_t* vs1, size_t vl);
+    // splat writes value, index writes value + i, to element i.
+    using Fill = void (*)(uint8_t* vd, uint64_t value, const uint8_t* mask,
+                          size_t vl);
+    // count returns the number of active set bits, first the index of the
+    // first one or vl if there is none.
+    using Scan = size_t (*)(const uint8_t* bits, const uint8_t* mask,
+                            size_t vl);
+
+    const char* name;
+    Binary binary[VOP_COUNT][4];
+    // vd = mask ? vs1 : vs2; the mask is required.
+    Binary merge[4];
+    Binary compare[VCMP_COUNT][4];
+    Reduce reduce[VRED_COUNT][4];
+    MaskLogical mask_logical[VMASK_COUNT];
+    Fill splat[4];
+    Fill index[4];
+    Scan count;
+    Scan first;
+};
+
+// The fastest table the host CPU runs, picked on first use.
+const VectorKernels& host_vector_kernels();
+
+}  // namespace RISCV
+
+#endif  // RISCV_VECTOR_H_
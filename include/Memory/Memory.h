@@ -2,37 +2,164 @@
 #define MEMORY_H_
 
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <span>
 #include <vector>
 
+#include "Device/Device.h"
 #include "Utils/Utils.h"
 
 class Memory
 {
    public:
-    using paddr_t = decltype(MEMORY_BASE + MEMORY_SIZE);
+    using paddr_t = uint64_t;
     using vaddr_t = paddr_t;
 
-    word_t inst_fetch(vaddr_t addr, int len);
-    word_t vread(vaddr_t addr, int len);
-    void vwrite(vaddr_t addr, word_t data, int len);
+    // Data accesses are templated on the register width of the core, W is
+    // uint32_t or uint64_t. Instructions are 32 bits for either.
+    uint32_t inst_fetch(vaddr_t addr, int len);
+    template <typename W>
+    W vread(vaddr_t addr, int len);
+    template <typename W>
+    void vwrite(vaddr_t addr, W data, int len);
 
-    word_t debug_vread(vaddr_t addr, int len);
+    // Copies between RAM and host memory in one go, for accesses wider than
+    // a register. They return false, and do nothing, unless all of the
+    // range is RAM; the caller then goes element by element.
+    bool read_block(vaddr_t addr, std::span<uint8_t> data);
+    bool write_block(vaddr_t addr, std::span<const uint8_t> data);
+    // memmove and memset within RAM, with the same rule.
+    bool move_block(vaddr_t dst, vaddr_t src, size_t len);
+    bool fill_block(vaddr_t dst, uint8_t value, size_t len);
+    // RAM from addr to its end, for reads without a copy; empty if addr is
+    // not in RAM.
+    std::span<const uint8_t> ram_view(vaddr_t addr) const;
+    // [addr, addr + len) of RAM for the host to write into, e.g. by read(2),
+    // counted as written; empty unless all of it is RAM.
+    std::span<uint8_t> ram_span(vaddr_t addr, size_t len);
+
+    template <typename W>
+    W debug_vread(vaddr_t addr, int len);
+    // Whether [addr, addr + len) is plain RAM, i.e. reading it has no side
+    // effects.
+    bool is_ram(paddr_t addr, size_t len) const;
     void load_image(std::vector<uint8_t>& image);
+    void load_segment(paddr_t addr, std::span<const uint8_t> data,
+                      size_t memsz);
+    // Accesses to [base, base + size) outside RAM are forwarded to device.
+    void map_device(paddr_t base, paddr_t size, Device& device);
+    // Makes the start of RAM appear at base as well, for user programs
+    // linked below MEMORY_BASE: [base, base + size) is RAM from its first
+    // byte on. size goes up to the first device above base, MEMORY_BASE or
+    // MEMORY_SIZE, whichever comes first; it is returned, 0 if base is taken.
+    paddr_t alias_ram(paddr_t base);
+
+    // Page-granular write tracking. Until track_writes() is called every page
+    // counts as dirty, so the store path never calls the hook. Afterwards the
+    // hook sees the old contents of a page on its first write since
+    // clear_dirty().
+    static constexpr size_t page_size = 4096;
+    static constexpr size_t page_count = MEMORY_SIZE / page_size;
+    using WriteHook = std::function<void(size_t page, const uint8_t* data)>;
+    void track_writes(WriteHook hook);
+    void clear_dirty();
+    void mark_dirty(size_t page);
+    const std::vector<uint32_t>& dirty_pages() const { return dirty_list; }
+    void restore_page(size_t page, const uint8_t* data);
+
+    // RAM and device read log of a memory, frozen for replicas that replay
+    // parts of its recording on other threads. The RAM is kept in a memory
+    // file that replicas map copy-on-write, so they share its pages until
+    // they write to one.
+    class Image
+    {
+       public:
+        // nullptr, having logged why, if the memory file cannot be set up.
+        static std::unique_ptr<Image> create(const Memory& memory);
+        ~Image();
+        Image(const Image&) = delete;
+        Image& operator=(const Image&) = delete;
+
+       private:
+        friend class Memory;
+        Image(int fd, const Memory& memory);
+        int fd;
+        std::vector<uint64_t> mmio_log;
+        paddr_t alias_base;
+        paddr_t alias_size;
+    };
+
+    // Device reads are the only nondeterministic input from the bus. RECORD
+    // appends every value read to the log, REPLAY serves reads from it and
+    // drops device writes.
+    enum class MMIOMode
+    {
+        LIVE,
+        RECORD,
+        REPLAY
+    };
+    void set_mmio_mode(MMIOMode mode) { mmio_mode = mode; }
+    size_t mmio_log_size() const { return mmio_log.size(); }
+    void seek_mmio_log(size_t pos) { mmio_log_pos = pos; }
+
+    // Data accesses of the guest, for statistics. A block access counts
+    // once; device accesses count in mmio_* as well.
+    struct AccessCounts
+    {
+        uint64_t reads = 0;
+        uint64_t writes = 0;
+        uint64_t mmio_reads = 0;
+        uint64_t mmio_writes = 0;
+    };
+    const AccessCounts& access_counts() const { return counts; }
 
     Memory();
+    // A replica starting from image. Devices are not mapped.
+    explicit Memory(const Image& image);
     ~Memory();
+    Memory(const Memory&) = delete;
+    Memory& operator=(const Memory&) = delete;
 
    private:
     static constexpr paddr_t lower_bound = MEMORY_BASE;
     static constexpr paddr_t upper_bound = MEMORY_BASE + MEMORY_SIZE;
-    constexpr bool in_range(paddr_t addr) const;
+    // See alias_ram(); empty unless it was called.
+    paddr_t alias_base = 0;
+    paddr_t alias_size = 0;
+    // The offset into RAM of addr, MEMORY_SIZE if it is not RAM.
+    paddr_t ram_offset(paddr_t addr) const;
 
-    std::unique_ptr<std::array<uint8_t, MEMORY_SIZE>> physicalMemory;
+    // A private mapping, anonymous or of an Image, so untouched RAM costs
+    // nothing.
+    uint8_t* physicalMemory;
     uint8_t* get_host_memory_addr(paddr_t paddr);
 
-    word_t pread(paddr_t addr, int len);
-    void pwrite(paddr_t addr, word_t data, int len);
+    struct MMIORegion
+    {
+        paddr_t base;
+        paddr_t size;
+        Device* device;
+    };
+    std::vector<MMIORegion> mmio_regions;
+    MMIORegion& find_mmio(paddr_t addr);
+
+    MMIOMode mmio_mode = MMIOMode::LIVE;
+    std::vector<uint64_t> mmio_log;
+    size_t mmio_log_pos = 0;
+    AccessCounts counts;
+
+    std::vector<uint8_t> dirty;
+    std::vector<uint32_t> dirty_list;
+    WriteHook write_hook;
+    void note_write(size_t page);
+    // note_write for the pages of [addr, addr + len) not yet dirty.
+    void note_write_range(paddr_t addr, size_t len);
+
+    template <typename W>
+    W pread(paddr_t addr, int len);
+    template <typename W>
+    void pwrite(paddr_t addr, W data, int len);
 };
 
 #endif  // MEMORY_H_
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Live statistics of one emulator in the Prometheus text format. The
+// emulator thread publishes its counters now and then, an exporter thread
+// writes them every period to a file, together with instructions per
+// second over sliding windows. The file is replaced by a rename, so a
+// scraper such as node_exporter's textfile collector never sees half of it.
+class Metrics
+{
+   public:
+    // Each value has a single writer, the emulator thread, which stores
+    // totals; relaxed atomics are all the exporter needs to read them.
+    struct Counters
+    {
+        std::atomic<uint64_t> instructions{0};
+        std::atomic<uint64_t> decode_misses{0};
+        std::atomic<uint64_t> memory_reads{0};
+        std::atomic<uint64_t> memory_writes{0};
+        std::atomic<uint64_t> mmio_reads{0};
+        std::atomic<uint64_t> mmio_writes{0};
+        // As in CoreCounters.
+        std::array<std::atomic<uint64_t>, 32> traps{};
+    };
+
+    explicit Metrics(std::filesystem::path path,
+                     std::chrono::milliseconds period =
+                         std::chrono::milliseconds(1000));
+    // Writes the file a last time.
+    ~Metrics();
+
+    Counters& counters() { return values; }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+    struct Sample
+    {
+        Clock::time_point time;
+        uint64_t instructions;
+    };
+    static constexpr std::chrono::seconds windows[] = {
+        std::chrono::seconds(1), std::chrono::seconds(10),
+        std::chrono::seconds(60)};
+
+    std::filesystem::path path;
+    std::chrono::milliseconds period;
+    Counters values;
+    // Exporter thread only: instruction counts over the longest window.
+    std::deque<Sample> samples;
+
+    std::mutex mutex;
+    std::condition_variable_any wakeup;
+    std::jthread exporter;
+
+    void run(std::stop_token stop);
+    void write();
+    std::string format();
+};
+
+#endif  // METRICS_H_
@@ -0,0 +1,123 @@
+#ifndef BRANCH_PREDICTOR_H_
+#define BRANCH_PREDICTOR_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// A direction predictor for conditional branches, as used by the "branch"
+// plugin. predict() and update() are called in pairs for every branch
+// executed, in program order.
+class BranchPredictor
+{
+   public:
+    virtual ~BranchPredictor() = default;
+
+    virtual std::string_view name() const = 0;
+    virtual bool predict(uint64_t pc) = 0;
+    virtual void update(uint64_t pc, bool taken) = 0;
+
+    // bimodal, gshare or tage; nullptr for any other name.
+    static std::unique_ptr<BranchPredictor> create(std::string_view name);
+};
+
+// 2-bit saturating counters indexed by pc.
+class BimodalPredictor : public BranchPredictor
+{
+   public:
+    explicit BimodalPredictor(unsigned index_bits = 12);
+
+    std::string_view name() const override { return "bimodal"; }
+    bool predict(uint64_t pc) override;
+    void update(uint64_t pc, bool taken) override;
+
+   private:
+    unsigned index_bits;
+    std::vector<uint8_t> counters;
+};
+
+// 2-bit counters indexed by pc XOR the global history.
+class GsharePredictor : public BranchPredictor
+{
+   public:
+    explicit GsharePredictor(unsigned index_bits = 14);
+
+    std::string_view name() const override { return "gshare"; }
+    bool predict(uint64_t pc) override;
+    void update(uint64_t pc, bool taken) override;
+
+   private:
+    unsigned index_bits;
+    uint64_t history = 0;
+    std::vector<uint8_t> counters;
+};
+
+// A small TAGE: a bimodal base and four tagged tables over geometrically
+// longer global histories. The longest matching table provides the
+// prediction; a misprediction allocates an entry in a longer table.
+class TagePredictor : public BranchPredictor
+{
+   public:
+    TagePredictor();
+
+    std::string_view name() const override { return "tage"; }
+    bool predict(uint64_t pc) override;
+    void update(uint64_t pc, bool taken) override;
+
+   private:
+    static constexpr unsigned tables = 4;
+    static constexpr unsigned index_bits = 10;
+    static constexpr unsigned tag_bits = 9;
+    static constexpr std::array<unsigned, tables> history_lengths = {5, 15, 44,
+                                                                     130};
+    // useful is halved every this many updates, so stale entries go.
+    static constexpr uint64_t useful_period = 1 << 18;
+
+    struct Entry
+    {
+        uint16_t tag = 0;
+        // -4 to 3, taken if not negative.
+        int8_t counter = 0;
+        // 0 to 3.
+        uint8_t useful = 0;
+    };
+
+    BimodalPredictor base;
+    std::array<std::vector<Entry>, tables> entries;
+    // Bit 0 of history[0] is the newest outcome.
+    std::array<uint64_t, 4> history{};
+    uint64_t updates = 0;
+
+    // Set by predict() for update().
+    std::array<uint32_t, tables> index{};
+    std::array<uint16_t, tables> tag{};
+    int provider = -1;
+    int alternate = -1;
+    bool provider_prediction = false;
+    bool alternate_prediction = false;
+
+    // The newest length bits of the history, XORed together in width-bit
+    // chunks.
+    uint32_t fold(unsigned length, unsigned width) const;
+};
+
+// Predicts returns from the calls before them. Overflow drops the oldest
+// entry, underflow predicts nothing.
+class ReturnStack
+{
+   public:
+    void push(uint64_t return_pc);
+    // 0 if the stack is empty.
+    uint64_t pop();
+
+   private:
+    static constexpr size_t depth = 16;
+    std::array<uint64_t, depth> entries{};
+    size_t top = 0;
+    size_t size = 0;
+};
+
+#endif  // BRANCH_PREDICTOR_H_
@@ -0,0 +1,84 @@
+#ifndef BRANCH_PROFILER_H_
+#define BRANCH_PROFILER_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Plugin/BranchPredictor.h"
+#include "Plugin/Plugin.h"
+#include "Utils/ElfParser.h"
+
+// Built-in plugin "branch": profiles conditional branches, returns and
+// indirect jumps and runs them through predictor models. When the program
+// halts it reports misprediction rates in total and per function, the
+// branches the last model mispredicts most, and where indirect jumps went.
+//
+// args are a comma-separated list of
+//     models=NAME[:NAME...]   bimodal, gshare and tage (all of them)
+//     top=N                   functions and branches to report (10)
+//
+// Returns are predicted by a return stack fed by calls, other indirect
+// jumps by the target they took last.
+class BranchProfiler : public Plugin
+{
+   public:
+    // nullptr, having logged why, if args are invalid.
+    static std::unique_ptr<BranchProfiler> create(
+        std::string_view args, const std::filesystem::path& image);
+
+    void translate(const InstructionInfo& inst,
+                   Instrumentation& instrumentation) override;
+    void halt(uint64_t pc, bool good) override;
+    // Adds up the counts of next; the predictors of each interval start
+    // cold.
+    bool merge(Plugin& next) override;
+
+   private:
+    static constexpr size_t max_models = 3;
+
+    enum class SiteKind : uint8_t
+    {
+        CONDITIONAL,
+        RETURN,
+        INDIRECT
+    };
+    // A static branch. Callbacks find theirs by slot, its index in sites.
+    struct Site
+    {
+        uint64_t pc;
+        const SymbolInfo* function;
+        SiteKind kind;
+        uint64_t executed = 0;
+        uint64_t taken = 0;
+        // By model for conditional branches, else by the return stack or
+        // the last target.
+        std::array<uint64_t, max_models> mispredicted{};
+        uint64_t last_target = 0;
+        // INDIRECT only.
+        std::unordered_map<uint64_t, uint64_t> targets;
+    };
+
+    BranchProfiler(std::vector<std::unique_ptr<BranchPredictor>> models,
+                   size_t top, std::optional<ElfFile> elf);
+
+    std::vector<std::unique_ptr<BranchPredictor>> models;
+    size_t top;
+    std::optional<ElfFile> elf;
+    ReturnStack returns;
+    std::vector<Site> sites;
+    // Used when decoding only: an instruction decoded again keeps its slot.
+    std::unordered_map<uint64_t, uint32_t> slots;
+
+    uint32_t slot(uint64_t pc, SiteKind kind);
+    void conditional(Site& site, bool taken);
+    void report();
+};
+
+#endif  // BRANCH_PROFILER_H_
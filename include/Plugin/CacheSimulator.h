@@ -0,0 +1,172 @@
+#ifndef CACHE_SIMULATOR_H_
+#define CACHE_SIMULATOR_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "Plugin/Plugin.h"
+#include "Utils/ElfParser.h"
+#include "Utils/SPSCRingBuffer.h"
+
+// Built-in plugin "cache": runs the program's memory accesses through split
+// L1 instruction and data caches backed by a unified L2, and reports hits,
+// misses and evictions per level and per function when the program halts.
+//
+// args are a comma-separated list of
+//     l1i=SIZE:WAYS:LINE:POLICY   (32k:8:64:lru)
+//     l1d=SIZE:WAYS:LINE:POLICY   (32k:8:64:lru)
+//     l2=SIZE:WAYS:LINE:POLICY    (1m:16:64:lru)
+//     thread                      simulate on a thread of its own
+//     top=N                       functions to report (20)
+// with POLICY one of lru, fifo and random. Each level is write-back and
+// write-allocate; an access is taken to touch only the line of its first
+// byte.
+//
+// Instructions are fetched once per L1 line they enter, by falling into
+// it, jumping into it or trapping into it, rather than once per
+// instruction. The callbacks only append records to a batch, which is
+// simulated when it fills up, here or on the simulator thread.
+class CacheSimulator : public Plugin
+{
+   public:
+    enum class Policy
+    {
+        LRU,
+        FIFO,
+        RANDOM
+    };
+
+    struct Geometry
+    {
+        uint64_t size;
+        unsigned ways;
+        unsigned line;
+        Policy policy;
+    };
+
+    struct Stats
+    {
+        uint64_t accesses = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    // One level: sets of ways, each line tagged with its line address.
+    class Cache
+    {
+       public:
+        explicit Cache(const Geometry& geometry);
+
+        struct Result
+        {
+            bool hit;
+            // The line given up for the access, if a valid one was.
+            std::optional<uint64_t> victim;
+            bool victim_dirty;
+        };
+        Result access(uint64_t addr, bool write);
+        unsigned line_size() const { return line; }
+
+       private:
+        struct Line
+        {
+            uint64_t tag = 0;
+            // Last use for LRU, fill for FIFO.
+            uint64_t stamp = 0;
+            bool valid = false;
+            bool dirty = false;
+        };
+
+        unsigned line;
+        unsigned ways;
+        uint64_t sets;
+        Policy policy;
+        uint64_t clock = 0;
+        uint64_t random = 0x2545f4914f6cdd1d;
+        std::vector<Line> lines;
+    };
+
+    // nullptr, having logged why, if args are invalid.
+    static std::unique_ptr<CacheSimulator> create(
+        std::string_view args, const std::filesystem::path& image);
+    // Stops the simulator thread.
+    ~CacheSimulator() override;
+
+    void translate(const InstructionInfo& inst,
+                   Instrumentation& instrumentation) override;
+    void trap(uint64_t pc, uint64_t cause, uint64_t tval,
+              uint64_t handler) override;
+    void halt(uint64_t pc, bool good) override;
+    // Adds up the statistics of next. Each interval starts with cold
+    // caches, so misses come out somewhat high.
+    bool merge(Plugin& next) override;
+
+   private:
+    enum class AccessType : uint8_t
+    {
+        FETCH,
+        READ,
+        WRITE
+    };
+    struct Access
+    {
+        uint64_t addr;
+        // Index into functions, 0 for code outside any; jump targets are
+        // looked up by the simulator.
+        uint32_t function;
+        AccessType type;
+    };
+    static constexpr uint32_t unresolved = UINT32_MAX;
+    enum Level
+    {
+        L1I,
+        L1D,
+        L2,
+        LEVELS
+    };
+    using FunctionStats = std::array<Stats, LEVELS>;
+
+    static constexpr size_t batch_size = 1024;
+
+    CacheSimulator(const std::array<Geometry, LEVELS>& geometry,
+                   bool threaded, size_t top,
+                   std::optional<ElfFile> elf);
+
+    std::array<Cache, LEVELS> caches;
+    size_t top;
+    std::optional<ElfFile> elf;
+    // Indexed like elf->symbols(), plus 1.
+    std::vector<FunctionStats> functions;
+    FunctionStats totals{};
+    // Dirty lines written back from L2.
+    uint64_t writebacks = 0;
+
+    std::array<Access, batch_size> batch;
+    size_t batched = 0;
+    // With thread in args: full batches go to simulator.
+    std::unique_ptr<SPSCRingBuffer<Access, 1 << 16>> queue;
+    std::jthread simulator;
+
+    uint32_t function_of(uint64_t pc) const;
+    // A fetch at addr, after a jump or trap to it.
+    void enter(uint64_t addr);
+    void record(uint64_t addr, uint32_t function, AccessType type)
+    {
+        batch[batched++] = Access{addr, function, type};
+        if (batched == batch_size) flush();
+    }
+    void flush();
+    void finish();
+    void simulate(const Access* accesses, size_t n);
+    void count(Level level, uint32_t function, const Cache::Result& result);
+    void report();
+};
+
+#endif  // CACHE_SIMULATOR_H_
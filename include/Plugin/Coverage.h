@@ -0,0 +1,88 @@
+#ifndef COVERAGE_H_
+#define COVERAGE_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Plugin/Plugin.h"
+
+// Built-in plugin "coverage": which instructions of the program ran and
+// which way its branches went. args name a coverage file, which collects
+// the runs of any number of images: each run ORs its bitmaps into the
+// record of its image, and FILE.json reports every image in the file per
+// function and per address. Runs writing the same file at once take turns
+// through a lock on FILE.lock.
+//
+// Executed code is marked a basic block at a time, from where control
+// arrived to the jump, branch, trap or halt that leaves it, so
+// straight-line code costs nothing.
+class Coverage : public Plugin
+{
+   public:
+    // One bit per halfword of the executable sections, the granularity of
+    // compressed instructions.
+    struct Bitmap
+    {
+        std::vector<uint64_t> words;
+
+        explicit Bitmap(uint64_t bits = 0) : words((bits + 63) / 64) {}
+        bool test(uint64_t bit) const
+        {
+            return words[bit / 64] >> (bit % 64) & 1;
+        }
+        void set(uint64_t bit) { words[bit / 64] |= uint64_t(1) << (bit % 64); }
+        // Bits [first, last).
+        void set(uint64_t first, uint64_t last);
+        void merge(const Bitmap& other);
+    };
+
+    // The coverage of one image.
+    struct Record
+    {
+        std::string image;
+        uint64_t begin;
+        uint64_t end;
+        // Of the code, to tell a rebuilt image from the one recorded.
+        uint64_t checksum;
+        // Bits at the halfwords that ran, at branches that were taken and at
+        // branches that fell through.
+        Bitmap executed;
+        Bitmap taken;
+        Bitmap not_taken;
+    };
+
+    // nullptr, having logged why, if the image has no code to cover.
+    static std::unique_ptr<Coverage> create(const std::filesystem::path& image,
+                                            std::filesystem::path file);
+    // Writes the coverage if the program did not halt.
+    ~Coverage() override;
+
+    void translate(const InstructionInfo& inst,
+                   Instrumentation& instrumentation) override;
+    void trap(uint64_t pc, uint64_t cause, uint64_t tval,
+              uint64_t handler) override;
+    void halt(uint64_t pc, bool good) override;
+    // The coverage of next is written with this one's; next writes none.
+    bool merge(Plugin& next) override;
+
+   private:
+    Coverage(Record record, std::filesystem::path file);
+
+    Record record;
+    std::filesystem::path file;
+    // Where the running block began, once the first instruction is decoded,
+    // and where the first one did.
+    uint64_t block = 0;
+    uint64_t entry = 0;
+    bool started = false;
+    bool written = false;
+
+    // Marks [block, end) executed and starts the next block.
+    void leave(uint64_t end, uint64_t next);
+    void write();
+};
+
+#endif  // COVERAGE_H_
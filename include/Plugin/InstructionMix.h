@@ -0,0 +1,30 @@
+#ifndef INSTRUCTION_MIX_H_
+#define INSTRUCTION_MIX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+#include "Plugin/Plugin.h"
+
+// Built-in plugin "mix": counts executed instructions by mnemonic and logs
+// the most frequent ones when the program halts, all of them unless args
+// give a limit.
+class InstructionMix : public Plugin
+{
+   public:
+    explicit InstructionMix(size_t limit);
+
+    void translate(const InstructionInfo& inst,
+                   Instrumentation& instrumentation) override;
+    void halt(uint64_t pc, bool good) override;
+    bool merge(Plugin& next) override;
+
+   private:
+    size_t limit;
+    // Node-based, so the counters the callbacks point to stay put.
+    std::unordered_map<std::string_view, uint64_t> counts;
+};
+
+#endif  // INSTRUCTION_MIX_H_
@@ -0,0 +1,130 @@
+#ifndef PLUGIN_H_
+#define PLUGIN_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// What an instruction does, as far as plugins are concerned. Vector loads
+// and stores are OTHER; mret and calls run on the host (--hle) are
+// INDIRECT_JUMP.
+enum class InstructionKind
+{
+    OTHER,
+    LOAD,
+    STORE,
+    BRANCH,
+    JUMP,
+    INDIRECT_JUMP
+};
+
+// An instruction being decoded. Compressed instructions are expanded, inst
+// is the 32-bit form and len is 2 for them.
+struct InstructionInfo
+{
+    uint64_t pc;
+    uint32_t inst;
+    int len;
+    std::string_view name;
+    InstructionKind kind;
+    // Bytes accessed by a LOAD or STORE.
+    int access_size;
+};
+
+// The callbacks an instruction carries, collected from all plugins when it
+// is decoded.
+struct Instrumentation
+{
+    // Before the instruction runs.
+    using Execute = std::function<void()>;
+    // Before a LOAD or STORE accesses memory, with the address.
+    using MemoryAccess = std::function<void(uint64_t addr)>;
+    // After the instruction ran, with the pc it continues at; a branch is
+    // taken if that is not pc + len.
+    using Control = std::function<void(uint64_t next_pc)>;
+
+    std::vector<Execute> execute;
+    std::vector<MemoryAccess> memory;
+    std::vector<Control> control;
+
+    bool empty() const
+    {
+        return execute.empty() && memory.empty() && control.empty();
+    }
+};
+
+// An analysis tool. Plugins subscribe per instruction when it is decoded,
+// so instructions nobody subscribes to run exactly as without plugins. An
+// instruction is decoded again whenever it drops out of the decode cache,
+// translate() has to expect the same pc more than once.
+//
+// There is no basic-block event: the core decodes and caches single
+// instructions, and a block is only known once control leaves it. A plugin
+// that needs blocks follows them with control callbacks on the branches
+// and jumps and with trap(), as Coverage does.
+class Plugin
+{
+   public:
+    virtual ~Plugin() = default;
+
+    virtual void translate(const InstructionInfo& inst,
+                           Instrumentation& instrumentation)
+    {
+    }
+    // Traps and interrupts, with the pc they are taken at and the handler
+    // the program continues in.
+    virtual void trap(uint64_t pc, uint64_t cause, uint64_t tval,
+                      uint64_t handler)
+    {
+    }
+    // The program ended, good or not.
+    virtual void halt(uint64_t pc, bool good) {}
+    // Interval simulation runs a copy of each plugin on every interval of
+    // the program and folds them into the first, in program order: next saw
+    // the interval right after the ones this one has. Returns false, the
+    // default, if the plugin cannot be combined.
+    virtual bool merge(Plugin& next) { return false; }
+};
+
+// A shared-object plugin exports
+//     extern "C" Plugin* nemu_plugin_create(const char* args);
+// returning a plugin allocated with new, or nullptr if args are invalid.
+using PluginFactory = Plugin* (*)(const char* args);
+
+class PluginManager
+{
+   public:
+    PluginManager() = default;
+    PluginManager(const PluginManager&) = delete;
+    PluginManager& operator=(const PluginManager&) = delete;
+    ~PluginManager();
+
+    // spec is NAME[,ARGS] for a built-in plugin or PATH[,ARGS] for a shared
+    // object, told apart by a '/' in it. Returns false, and logs why, if
+    // the plugin cannot be loaded.
+    bool load(std::string_view spec);
+    // The ELF file of the program, for built-in plugins that need its
+    // sections or symbols. Set it before load().
+    void set_image(std::filesystem::path image);
+    void add(std::unique_ptr<Plugin> plugin);
+    bool empty() const { return plugins.empty(); }
+
+    Instrumentation translate(const InstructionInfo& inst);
+    void trap(uint64_t pc, uint64_t cause, uint64_t tval, uint64_t handler);
+    void halt(uint64_t pc, bool good);
+    // Merges the plugins of next into these, one by one; next must have
+    // been loaded from the same specs. Returns false, having logged why, if
+    // one of them cannot be merged.
+    bool merge(PluginManager& next);
+
+   private:
+    std::filesystem::path image;
+    std::vector<std::unique_ptr<Plugin>> plugins;
+    // dlopen handles, closed after the plugins are gone.
+    std::vector<void*> libraries;
+};
+
+#endif  // PLUGIN_H_
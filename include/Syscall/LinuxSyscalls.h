@@ -0,0 +1,93 @@
+#ifndef LINUX_SYSCALLS_H_
+#define LINUX_SYSCALLS_H_
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "Memory/Memory.h"
+#include "Utils/ElfParser.h"
+
+// The Linux system calls a statically linked RISC-V user program needs,
+// run on the host. Buffers are passed to the host calls where they lie in
+// guest RAM, without a copy. Guest file descriptors map to host ones; 0, 1
+// and 2 are the emulator's own, which the guest cannot close.
+//
+// The program's segments are loaded at their virtual addresses. One linked
+// below RAM gets a view of RAM from its lowest page up to the first device
+// above it (see Memory::alias_ram()); with the CLINT at 0x2000000, that
+// bounds the image and heap of one linked at 0x10000 to about 32 MiB. The
+// stack takes the top stack_size bytes of RAM, mmap() hands out memory
+// downwards from below it, and brk() grows the heap upwards from the end
+// of the highest segment. There are no threads and no signals.
+class LinuxSyscalls
+{
+   public:
+    static constexpr uint64_t stack_size = 8 << 20;
+
+    LinuxSyscalls(Memory& memory, int xlen);
+    // Closes the files the guest left open.
+    ~LinuxSyscalls();
+    LinuxSyscalls(const LinuxSyscalls&) = delete;
+    LinuxSyscalls& operator=(const LinuxSyscalls&) = delete;
+
+    // Lays out argc, argv, an empty environment and the auxiliary vector
+    // on the stack, as exec does, and returns the stack pointer; 0, having
+    // logged why, if they do not fit. args[0] is the program name.
+    uint64_t setup(const ElfFile& elf, std::span<const std::string> args);
+    // Runs system call number with arguments a0 to a5 and returns the
+    // value for a0, a negative errno on failure. exit and exit_group throw
+    // guest_exit.
+    int64_t call(uint64_t number, const std::array<uint64_t, 6>& args);
+
+   private:
+    Memory& memory;
+    int xlen;
+    // Indexed by guest descriptor, -1 where closed.
+    std::vector<int> fds;
+    uint64_t brk_start = 0;
+    uint64_t brk_end = 0;
+    // Where the RAM the heap is in starts, and where it ends.
+    uint64_t heap_base = 0;
+    uint64_t heap_limit = 0;
+    // The lowest address mmap() has handed out.
+    uint64_t mmap_end = 0;
+    // System calls already reported as unsupported.
+    std::unordered_set<uint64_t> unsupported;
+
+    // The address at or above MEMORY_BASE of heap address addr, to compare
+    // it with mmap_end.
+    uint64_t high(uint64_t addr) const
+    {
+        return addr - heap_base + MEMORY_BASE;
+    }
+
+    int host_fd(uint64_t fd) const;
+    // dirfd of the *at calls, which may be AT_FDCWD.
+    int host_dirfd(uint64_t fd) const;
+    int guest_fd(int fd);
+    std::optional<std::string> string_at(uint64_t addr) const;
+    std::optional<uint64_t> word_at(uint64_t addr);
+
+    int64_t openat(uint64_t dirfd, uint64_t path, uint64_t flags,
+                   uint64_t mode);
+    int64_t close(uint64_t fd);
+    int64_t lseek(const std::array<uint64_t, 6>& args);
+    int64_t read(uint64_t fd, uint64_t buf, uint64_t count);
+    int64_t write(uint64_t fd, uint64_t buf, uint64_t count);
+    int64_t vector_io(uint64_t fd, uint64_t iov, uint64_t count, bool write);
+    int64_t brk(uint64_t addr);
+    int64_t mmap(const std::array<uint64_t, 6>& args);
+    int64_t munmap(uint64_t addr, uint64_t len);
+    int64_t clock_gettime(uint64_t clock, uint64_t tp);
+    int64_t uname(uint64_t buf);
+    int64_t statx(const std::array<uint64_t, 6>& args);
+    int64_t getrandom(uint64_t buf, uint64_t len, uint64_t flags);
+};
+
+#endif  // LINUX_SYSCALLS_H_
@@ -2,9 +2,92 @@
 #define DISASM_H_
 
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
-void init_disasm(const char *triple);
-std::string disassemble(uint64_t pc, uint8_t *code, int nbyte);
+#include "Utils/ElfParser.h"
 
-#endif
\ No newline at end of file
+// Disassembly service. Each instance owns its backend (LLVM MC or the
+// built-in RV32/RV64 IMFDC decoder), which is created on the first cache miss,
+// and a cache of printed instructions keyed by (instruction word,
+// pc-relative).
+// Instructions whose text depends on the pc (branches and jumps) are cached
+// without their target, which is filled in per call. All public members may
+// be called from several threads.
+class Disassembler
+{
+   public:
+    explicit Disassembler(std::string_view triple);
+    ~Disassembler();
+
+    // "0x80000000: 00 00 02 97 \tauipc\tt0, 0"
+    std::string disassemble(uint64_t pc, const uint8_t* code, int nbyte);
+    // Only the instruction text, without address and encoding.
+    std::string instruction_text(uint64_t pc, const uint8_t* code, int nbyte);
+    // One line per instruction of code, which starts at pc. If symbols is
+    // given, a "<name>:" label is emitted before the first instruction of
+    // every symbol.
+    std::vector<std::string> disassemble_range(
+        uint64_t pc, std::span<const uint8_t> code,
+        const SymbolTable* symbols = nullptr);
+
+    size_t cache_size();
+
+    // Length in bytes of the instruction starting at code, 2 for RVC.
+    static int instruction_length(const uint8_t* code);
+
+    class Backend
+    {
+       public:
+        virtual ~Backend() = default;
+        virtual std::string print(uint64_t pc, const uint8_t* code,
+                                  int nbyte) = 0;
+
+       protected:
+        // "\t.insn\t4, 0x0000000b", for words a backend cannot decode.
+        static std::string raw_word(const uint8_t* code, int nbyte);
+    };
+
+   private:
+    static std::unique_ptr<Backend> create_backend(const std::string& triple);
+
+    struct CacheKey
+    {
+        uint32_t inst;
+        bool pc_relative;
+        bool operator==(const CacheKey&) const = default;
+    };
+    struct CacheKeyHash
+    {
+        size_t operator()(const CacheKey& key) const
+        {
+            return std::hash<uint64_t>()(
+                (static_cast<uint64_t>(key.inst) << 1) | key.pc_relative);
+        }
+    };
+    struct CacheEntry
+    {
+        // For pc-relative entries, text ends right before the target operand.
+        std::string text;
+        int64_t offset;
+    };
+
+    std::string triple;
+    std::once_flag backend_init;
+    std::unique_ptr<Backend> backend;
+    std::mutex backend_mutex;
+
+    std::shared_mutex cache_mutex;
+    std::unordered_map<CacheKey, CacheEntry, CacheKeyHash> cache;
+
+    CacheEntry render(uint32_t inst, const uint8_t* code, int nbyte,
+                      bool pc_relative, int64_t offset);
+};
+
+#endif
@@ -1,21 +1,101 @@
 #ifndef ELF_PARSER_H_
 #define ELF_PARSER_H_
 
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
 #include <optional>
-#include <string>
+#include <span>
+#include <string_view>
 #include <vector>
 
 #include "Utils.h"
 
+enum class SymbolType
+{
+    FUNC,
+    OBJECT
+};
+
+// name points into the string table of the mapped ELF file, so a symbol is
+// only valid as long as the ElfFile it came from.
 struct SymbolInfo
 {
-    std::string name;
-    word_t addr;
-    word_t size;
+    std::string_view name;
+    uint64_t addr;
+    uint64_t size;
+    SymbolType type;
 };
 
+// Sorted by address.
 using SymbolTable = std::vector<SymbolInfo>;
 
-std::optional<SymbolTable> getFunctionSymbol(const std::string& file_path);
+struct SectionInfo
+{
+    std::string_view name;
+    uint64_t addr;
+    uint64_t size;
+};
+
+// A PT_LOAD segment: data is copied to paddr, the rest up to memsz is zeroed.
+// A user-mode program is loaded at vaddr instead.
+struct SegmentInfo
+{
+    uint64_t paddr;
+    uint64_t vaddr;
+    std::span<const uint8_t> data;
+    uint64_t memsz;
+};
+
+// ELF32/ELF64 image mapped read-only into memory. Headers, segments,
+// sections and symbols are indexed once in open(); nothing is copied out of
+// the mapping.
+class ElfFile
+{
+   public:
+    static bool is_elf(const std::filesystem::path& file_path);
+    static std::optional<ElfFile> open(const std::filesystem::path& file_path);
+
+    ElfFile(ElfFile&& other) noexcept;
+    ElfFile& operator=(ElfFile&& other) noexcept;
+    ElfFile(const ElfFile&) = delete;
+    ElfFile& operator=(const ElfFile&) = delete;
+    ~ElfFile();
+
+    bool is_elf64() const { return elf64; }
+    uint64_t entry() const { return entry_pc; }
+    const std::vector<SegmentInfo>& segments() const { return segment_list; }
+    const std::vector<SectionInfo>& sections() const { return section_list; }
+    const SymbolTable& symbols() const { return symbol_table; }
+    // The program header table in the file and the size of an entry, for
+    // the auxiliary vector of a user-mode program.
+    std::span<const uint8_t> program_headers() const { return phdr_table; }
+    size_t program_header_size() const { return phdr_size; }
+
+    std::optional<SectionInfo> section(std::string_view name) const;
+    // The symbol whose [addr, addr + size) contains addr.
+    const SymbolInfo* find_symbol(uint64_t addr) const;
+    const SymbolInfo* find_symbol(std::string_view name) const;
+    // The function containing addr, where one without a size, as in
+    // assembly sources, runs up to the next symbol.
+    const SymbolInfo* find_function(uint64_t addr) const;
+
+   private:
+    ElfFile() = default;
+
+    template <typename Ehdr, typename Phdr, typename Shdr, typename Sym>
+    bool parse();
+
+    const uint8_t* base = nullptr;
+    size_t length = 0;
+
+    bool elf64 = false;
+    uint64_t entry_pc = 0;
+    std::span<const uint8_t> phdr_table;
+    size_t phdr_size = 0;
+    std::vector<SegmentInfo> segment_list;
+    std::vector<SectionInfo> section_list;
+    SymbolTable symbol_table;
+};
 
-#endif  // ELF_PARSER_H_
\ No newline at end of file
+#endif  // ELF_PARSER_H_
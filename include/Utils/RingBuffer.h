@@ -28,8 +28,19 @@ class RingBuffer
 
     bool empty() const { return head == tail; }
 
+    void clear() { head = tail = 0; }
+
     bool full() const { return (head + 1) % N == tail; }
 
+    template <typename F>
+    void for_each(F&& f) const
+    {
+        for (size_t i = tail; i != head; i = (i + 1) % N)
+        {
+            f(buffer[i]);
+        }
+    }
+
     void print()
     {
         for (size_t i = tail; i != head; i = (i + 1) % N)
@@ -0,0 +1,152 @@
+#ifndef SPSC_RING_BUFFER_H_
+#define SPSC_RING_BUFFER_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Lock-free single-producer/single-consumer queue for handing events from
+// the execution thread to a consumer on another core. Unlike RingBuffer it
+// never overwrites: a full queue makes push fail, so the producer never
+// waits. Indices run freely and are masked on access, so all N slots are
+// usable. head is only written by the producer and tail by the consumer;
+// each side caches the other's index and only reloads it when the cached
+// value says full (or empty).
+template <typename T, size_t N>
+class SPSCRingBuffer
+{
+    static_assert(N != 0 && (N & (N - 1)) == 0,
+                  "SPSCRingBuffer capacity must be a power of two");
+
+   public:
+    static constexpr size_t capacity() { return N; }
+
+    // Producer side.
+    bool try_push(T item)
+    {
+        auto h = head.load(std::memory_order_relaxed);
+        if (h - producer.tail_cache == N)
+        {
+            producer.tail_cache = tail.load(std::memory_order_acquire);
+            if (h - producer.tail_cache == N) return false;
+        }
+        buffer[h & mask] = std::move(item);
+        publish(h + 1);
+        return true;
+    }
+
+    // Pushes as many of items[0, n) as fit and returns how many did.
+    size_t push_n(const T* items, size_t n)
+    {
+        auto h = head.load(std::memory_order_relaxed);
+        if (N - (h - producer.tail_cache) < n)
+            producer.tail_cache = tail.load(std::memory_order_acquire);
+        n = std::min(n, N - (h - producer.tail_cache));
+        if (n == 0) return 0;
+        auto first = std::min(n, N - (h & mask));
+        std::copy_n(items, first, buffer.begin() + (h & mask));
+        std::copy_n(items + first, n - first, buffer.begin());
+        publish(h + n);
+        return n;
+    }
+
+    // Wakes a consumer blocked in wait_pop_n() for good; what was pushed
+    // before can still be popped.
+    void close()
+    {
+        is_closed.store(true, std::memory_order_release);
+        wake();
+    }
+
+    // Consumer side, non-blocking.
+    bool try_pop(T& item) { return pop_n(&item, 1) == 1; }
+
+    size_t pop_n(T* items, size_t n)
+    {
+        auto t = tail.load(std::memory_order_relaxed);
+        if (consumer.head_cache - t < n)
+            consumer.head_cache = head.load(std::memory_order_acquire);
+        n = std::min(n, consumer.head_cache - t);
+        if (n == 0) return 0;
+        auto first = std::min(n, N - (t & mask));
+        std::move(buffer.begin() + (t & mask),
+                  buffer.begin() + (t & mask) + first, items);
+        std::move(buffer.begin(), buffer.begin() + (n - first), items + first);
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer side, blocking: waits until at least one item is available
+    // and pops up to n. Returns 0 only once the queue is closed and drained.
+    size_t wait_pop_n(T* items, size_t n)
+    {
+        while (true)
+        {
+            if (auto popped = pop_n(items, n)) return popped;
+            if (is_closed.load(std::memory_order_acquire))
+                return pop_n(items, n);
+
+            auto ticket = wake_count.load(std::memory_order_acquire);
+            waiting.store(true, std::memory_order_relaxed);
+            // Pairs with the fence in publish(): either the producer sees
+            // waiting, or this load sees its new head.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (head.load(std::memory_order_relaxed) ==
+                    tail.load(std::memory_order_relaxed) &&
+                !is_closed.load(std::memory_order_acquire))
+                wake_count.wait(ticket, std::memory_order_acquire);
+            waiting.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    bool wait_pop(T& item) { return wait_pop_n(&item, 1) == 1; }
+
+    // Either side; only a snapshot while the other side runs.
+    size_t size() const
+    {
+        return head.load(std::memory_order_acquire) -
+               tail.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+    bool closed() const { return is_closed.load(std::memory_order_acquire); }
+
+   private:
+    static constexpr size_t mask = N - 1;
+    static constexpr size_t cache_line = 64;
+
+    void publish(size_t new_head)
+    {
+        head.store(new_head, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed)) wake();
+    }
+
+    void wake()
+    {
+        wake_count.fetch_add(1, std::memory_order_release);
+        wake_count.notify_one();
+    }
+
+    alignas(cache_line) std::atomic<size_t> head{0};
+    alignas(cache_line) struct
+    {
+        size_t tail_cache = 0;
+    } producer;
+
+    alignas(cache_line) std::atomic<size_t> tail{0};
+    alignas(cache_line) struct
+    {
+        size_t head_cache = 0;
+    } consumer;
+
+    alignas(cache_line) std::atomic<bool> waiting{false};
+    std::atomic<bool> is_closed{false};
+    std::atomic<uint32_t> wake_count{0};
+
+    alignas(cache_line) std::array<T, N> buffer;
+};
+
+#endif  // SPSC_RING_BUFFER_H_
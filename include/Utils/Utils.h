@@ -3,16 +3,6 @@
 
 #include <cstdint>
 
-#ifdef ISA_64
-using word_t = uint64_t;
-using sword_t = int64_t;
-#define FMT_WORD "0x%016lx"
-#else
-using word_t = uint32_t;
-using sword_t = int32_t;
-#define FMT_WORD "0x%08x"
-#endif
-
 template <typename T>
 constexpr T extract_bits(T data, int start, int end)
 {
@@ -1,7 +1,23 @@
 #ifndef CORE_DECL_H_
 #define CORE_DECL_H_
 
+#include <array>
+#include <cstdint>
+#include <functional>
 #include <string_view>
+#include <vector>
+
+class LinuxSyscalls;
+class PluginManager;
+
+// Events a core counts for statistics, besides retired instructions.
+struct CoreCounters
+{
+    uint64_t decode_misses = 0;
+    // Indexed by exception code, interrupts by 16 + their code.
+    std::array<uint64_t, 32> traps{};
+};
+
 template <typename T>
 class Core
 {
@@ -10,14 +26,46 @@ class Core
     ~Core();
 
     void execute_one_inst();
+    // Executes n instructions. Pending interrupts are taken between
+    // instructions, but only checked when the core's quantum allows it.
+    void execute(uint64_t n);
+    // Makes execute() return after the current instruction, e.g. because a
+    // device needs control back before the quantum is over.
+    void end_quantum();
     void reset();
+    // Moves the reset vector (and the current pc) to entry, e.g. the entry
+    // point of a loaded ELF image.
+    void set_reset_pc(uint64_t entry);
+    // Raises or lowers an interrupt line (a bit in mip).
+    void set_interrupt(int irq, bool pending);
+    // The source of the time CSR, the platform timer's mtime. Without one,
+    // reading time is an illegal instruction.
+    void set_timer(std::function<uint64_t()> mtime);
+    // Copies out / puts back the architectural state (registers, pc, CSRs,
+    // instret) as a T::State value.
+    auto save_state();
+    template <typename S>
+    void restore_state(const S& state);
+    // Runs calls to the guest function at addr as the host library function
+    // name (memcpy, memset, ...) instead. Returns false if the core does not
+    // know name. While suspended, e.g. for watchpoints, the guest code runs.
+    bool intercept_function(std::string_view name, uint64_t addr);
+    void suspend_interception(bool suspend);
+    // Instructions decoded from now on carry the callbacks plugins subscribe
+    // to; nullptr detaches them.
+    void set_plugins(PluginManager* plugins);
+    // Runs ecall as a Linux system call on syscalls instead of trapping, for
+    // a user-mode program whose stack starts at sp.
+    void enter_user_mode(LinuxSyscalls& syscalls, uint64_t sp);
 
     auto debug_get_reg_index(std::string_view reg_num);
     auto debug_get_reg_val(int reg_num);
     auto debug_get_pc();
-
-   private:
-    void single_instruction();
+    // The pcs of the last retired instructions, at most 31, oldest first.
+    // Together with the current pc they make the trace of a bad exit.
+    std::vector<uint64_t> recent_pcs();
+    uint64_t get_instret();
+    const CoreCounters& get_counters();
 };
 
 template <typename T>
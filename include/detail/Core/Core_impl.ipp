@@ -1,6 +1,8 @@
 #ifndef CORE_IMPL_IPP_
 #define CORE_IMPL_IPP_
 
+#include <utility>
+
 #include "detail/Core/Core_decl.hpp"
 
 template <typename T>
@@ -16,7 +18,19 @@ Core<T>::~Core()
 template <typename T>
 void Core<T>::execute_one_inst()
 {
-    single_instruction();
+    execute(1);
+}
+
+template <typename T>
+void Core<T>::execute(uint64_t n)
+{
+    static_cast<T*>(this)->execute_impl(n);
+}
+
+template <typename T>
+void Core<T>::end_quantum()
+{
+    static_cast<T*>(this)->end_quantum_impl();
 }
 
 template <typename T>
@@ -26,9 +40,58 @@ void Core<T>::reset()
 }
 
 template <typename T>
-void Core<T>::single_instruction()
+void Core<T>::set_reset_pc(uint64_t entry)
 {
-    static_cast<T*>(this)->single_instruction_impl();
+    static_cast<T*>(this)->set_reset_pc_impl(entry);
+}
+
+template <typename T>
+void Core<T>::set_interrupt(int irq, bool pending)
+{
+    static_cast<T*>(this)->set_interrupt_impl(irq, pending);
+}
+
+template <typename T>
+void Core<T>::set_timer(std::function<uint64_t()> mtime)
+{
+    static_cast<T*>(this)->set_timer_impl(std::move(mtime));
+}
+
+template <typename T>
+auto Core<T>::save_state()
+{
+    return static_cast<T*>(this)->save_state_impl();
+}
+
+template <typename T>
+template <typename S>
+void Core<T>::restore_state(const S& state)
+{
+    static_cast<T*>(this)->restore_state_impl(state);
+}
+
+template <typename T>
+bool Core<T>::intercept_function(std::string_view name, uint64_t addr)
+{
+    return static_cast<T*>(this)->intercept_function_impl(name, addr);
+}
+
+template <typename T>
+void Core<T>::suspend_interception(bool suspend)
+{
+    static_cast<T*>(this)->suspend_interception_impl(suspend);
+}
+
+template <typename T>
+void Core<T>::set_plugins(PluginManager* plugins)
+{
+    static_cast<T*>(this)->set_plugins_impl(plugins);
+}
+
+template <typename T>
+void Core<T>::enter_user_mode(LinuxSyscalls& syscalls, uint64_t sp)
+{
+    static_cast<T*>(this)->enter_user_mode_impl(syscalls, sp);
 }
 
 template <typename T>
@@ -43,6 +106,24 @@ auto Core<T>::debug_get_pc()
     return static_cast<T*>(this)->pc;
 }
 
+template <typename T>
+std::vector<uint64_t> Core<T>::recent_pcs()
+{
+    return static_cast<T*>(this)->recent_pcs_impl();
+}
+
+template <typename T>
+uint64_t Core<T>::get_instret()
+{
+    return static_cast<T*>(this)->instret;
+}
+
+template <typename T>
+const CoreCounters& Core<T>::get_counters()
+{
+    return static_cast<T*>(this)->counters;
+}
+
 template <typename T>
 auto Core<T>::debug_get_reg_index(std::string_view reg_name)
 {
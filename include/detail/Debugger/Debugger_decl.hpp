@@ -4,16 +4,19 @@
 #include <regex.h>
 
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <cstdio>
 #include <list>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <vector>
 
 #include "Monitor/Monitor.hpp"
+#include "Utils/Disasm.h"
 #include "Utils/ElfParser.h"
-#include "Utils/RingBuffer.h"
 
 enum TOKEN_TYPE
 {
@@ -49,9 +52,18 @@ class Debugger
     int run(bool is_batch_mode = false);
 
    private:
+    using word_t = typename T::word_t;
+
     Monitor<T>& monitor;
-    RingBuffer<std::string, 32> instruction_buffer;
-    std::string_view latest_instrution;
+    Disassembler disassembler;
+
+    // A raw instruction; it is only disassembled when printed.
+    struct InstRecord
+    {
+        word_t pc;
+        uint32_t inst;
+    };
+    InstRecord latest_instrution;
 
     struct Command
     {
@@ -70,12 +82,16 @@ class Debugger
     std::list<int> watchpoint_free_list;
     std::list<int> watchpoint_used_list;
 
-    std::unique_ptr<SymbolTable> symbols;
+    std::optional<ElfFile> elf;
 
     int cmd_c();
     int cmd_info();
     int cmd_si();
+    int cmd_rsi();
+    int cmd_rc();
     int cmd_x();
+    int cmd_x_i();
+    int cmd_disas();
     int cmd_p();
     int cmd_q();
     int cmd_w();
@@ -85,8 +101,40 @@ class Debugger
     int cmd_handler(char* cmd);
 
     bool check_watchpoint();
-
-    void execute(uint64_t step);
+    std::vector<int> watchpoint_values();
+    void print_current_instruction();
+    // The instruction at pc, or that it cannot be read, e.g. after a jump
+    // to an unmapped address.
+    void print_instruction_at(word_t pc);
+    std::string disassemble_record(const InstRecord& record);
+    // The instructions in [begin, end).
+    void print_disassembly(word_t begin, word_t end);
+    // count instructions from begin, RVC ones taking two bytes.
+    void print_instructions(word_t begin, int count);
+    void print_code(word_t begin, std::span<const uint8_t> code);
+
+    // Most words or instructions one x or x/i prints.
+    static constexpr int max_examine = 4096;
+    // Most bytes one disas prints, enough for the .text of most programs.
+    static constexpr uint64_t max_disassembly = 1 << 20;
+    // Parses the count of x or x/i, printing why if it is not in
+    // [1, max_examine].
+    bool parse_count(const char* arg, const char* cmd, int& count);
+    // Parses the count of rsi, printing why if it is not a whole number of
+    // at least 1.
+    bool parse_steps(const char* arg, const char* cmd, uint64_t& steps);
+
+    // Whether execute() has to stop after every instruction: for si to show
+    // it or to check watchpoints. Otherwise the whole budget goes to the
+    // monitor at once, which also lets fused pairs run.
+    bool needs_single_step(uint64_t step) const;
+    // Returns false if Ctrl-C stopped the run.
+    bool execute(uint64_t step);
+    // While execute() runs, Ctrl-C asks interrupt_target to stop and brings
+    // the prompt back. A second one before it has stopped kills the process
+    // as usual.
+    static inline std::atomic<Monitor<T>*> interrupt_target = nullptr;
+    static void interrupt_handler(int signal);
     uint32_t eval(int p, int q, std::vector<Token> tokens);
     uint32_t evaluate(std::string expr, bool& success);
 };
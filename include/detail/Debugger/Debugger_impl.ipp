@@ -3,8 +3,12 @@
 
 #include <sys/types.h>
 
+#include <csignal>
+#include <cctype>
+#include <cerrno>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <filesystem>
 #include <memory>
@@ -176,12 +180,22 @@ static inline char* rl_gets()
 template <typename T>
 Debugger<T>::Debugger(Monitor<T>& monitor, std::filesystem::path elf_file)
     : monitor(monitor),
+      disassembler(T::disasm_triple),
       commands({
           {"c", "Continue", &Debugger<T>::cmd_c},
           {"info", "Print information: r for register; w for watchpoint",
            &Debugger<T>::cmd_info},
           {"si", "Single instruction", &Debugger<T>::cmd_si},
+          {"rsi", "Reverse step [N] instructions (needs --record)",
+           &Debugger<T>::cmd_rsi},
+          {"rc",
+           "Reverse continue to the last watchpoint change (needs --record)",
+           &Debugger<T>::cmd_rc},
           {"x", "Examine memory", &Debugger<T>::cmd_x},
+          {"x/i", "Examine memory as instructions", &Debugger<T>::cmd_x_i},
+          {"disas",
+           "Disassemble [begin end]; the whole .text section if omitted",
+           &Debugger<T>::cmd_disas},
           {"p", "Print expression", &Debugger<T>::cmd_p},
           {"q", "Quit", &Debugger<T>::cmd_q},
           {"w", "Set watchpoint", &Debugger<T>::cmd_w},
@@ -197,8 +211,7 @@ Debugger<T>::Debugger(Monitor<T>& monitor, std::filesystem::path elf_file)
 
     if (std::filesystem::exists(elf_file))
     {
-        symbols =
-            std::make_unique<SymbolTable>(getFunctionSymbol(elf_file).value());
+        elf = ElfFile::open(elf_file);
     }
 }
 
@@ -232,26 +245,161 @@ bool Debugger<T>::check_watchpoint()
 }
 
 template <typename T>
-void Debugger<T>::execute(uint64_t step)
+std::vector<int> Debugger<T>::watchpoint_values()
 {
+    std::vector<int> values;
+    for (auto wp : watchpoint_used_list)
+    {
+        bool flag;
+        values.push_back(evaluate(watchpoint_pool[wp].expr, flag));
+    }
+    return values;
+}
+
+template <typename T>
+std::string Debugger<T>::disassemble_record(const InstRecord& record)
+{
+    auto inst = record.inst;
+    auto bytes = reinterpret_cast<uint8_t*>(&inst);
+    return disassembler.disassemble(
+        record.pc, bytes, Disassembler::instruction_length(bytes));
+}
+
+template <typename T>
+void Debugger<T>::print_disassembly(word_t begin, word_t end)
+{
+    std::vector<uint8_t> code;
+    code.reserve(end - begin);
+    for (auto addr = begin; end - addr >= 2; addr += 2)
+    {
+        uint16_t half = monitor.mem_read(addr, 2);
+        auto bytes = reinterpret_cast<uint8_t*>(&half);
+        code.insert(code.end(), bytes, bytes + 2);
+    }
+    print_code(begin, code);
+}
+
+template <typename T>
+void Debugger<T>::print_instructions(word_t begin, int count)
+{
+    std::vector<uint8_t> code;
+    word_t addr = begin;
+    for (int i = 0; i < count; i++)
+    {
+        uint16_t half = monitor.mem_read(addr, 2);
+        auto bytes = reinterpret_cast<uint8_t*>(&half);
+        code.insert(code.end(), bytes, bytes + 2);
+        if (Disassembler::instruction_length(bytes) == 4)
+        {
+            half = monitor.mem_read(addr + 2, 2);
+            code.insert(code.end(), bytes, bytes + 2);
+            addr += 2;
+        }
+        addr += 2;
+    }
+    print_code(begin, code);
+}
+
+template <typename T>
+void Debugger<T>::print_code(word_t begin, std::span<const uint8_t> code)
+{
+    for (const auto& line :
+         disassembler.disassemble_range(begin, code,
+                                        elf ? &elf->symbols() : nullptr))
+    {
+        std::print("{}\n", line);
+    }
+}
+
+template <typename T>
+bool Debugger<T>::parse_count(const char* arg, const char* cmd, int& count)
+{
+    char* end;
+    long value = strtol(arg, &end, 0);
+    if (*end != '\0' || value < 1 || value > max_examine)
+    {
+        printf("Count for command '%s' must be between 1 and %d\n", cmd,
+               max_examine);
+        return false;
+    }
+    count = value;
+    return true;
+}
+
+template <typename T>
+bool Debugger<T>::parse_steps(const char* arg, const char* cmd,
+                              uint64_t& steps)
+{
+    // strtoull would take a sign, and -1 as UINT64_MAX.
+    char* end = nullptr;
+    errno = 0;
+    if (isdigit(static_cast<unsigned char>(*arg)))
+        steps = strtoull(arg, &end, 0);
+    if (end == nullptr || *end != '\0' || errno != 0 || steps == 0)
+    {
+        printf("Count for command '%s' must be a number of at least 1\n",
+               cmd);
+        return false;
+    }
+    return true;
+}
+
+template <typename T>
+void Debugger<T>::interrupt_handler(int signal)
+{
+    if (interrupt_target.load()->request_stop())
+    {
+        std::signal(signal, SIG_DFL);
+        std::raise(signal);
+    }
+}
+
+template <typename T>
+bool Debugger<T>::needs_single_step(uint64_t step) const
+{
+    // si shows the instruction it ran.
+    if (step == 1) return true;
+#ifdef CHECK_WATCHPOINT
+    if (!watchpoint_used_list.empty()) return true;
+#endif
+    return false;
+}
+
+template <typename T>
+bool Debugger<T>::execute(uint64_t step)
+{
+    bool finished = true;
+    struct sigaction action = {}, previous;
+    action.sa_handler = interrupt_handler;
+    sigemptyset(&action.sa_mask);
+    interrupt_target = &monitor;
+    sigaction(SIGINT, &action, &previous);
     try
     {
-        while (step--)
+        if (needs_single_step(step))
         {
-            word_t pc = monitor.get_reg_val("pc");
-            word_t inst = monitor.mem_read(pc, 4);
-            latest_instrution = instruction_buffer.push(
-                disassemble(pc, (uint8_t*)&inst, sizeof(typename T::word_t)));
-            monitor.execute(1);
+            while (step--)
+            {
+                auto pc = monitor.get_reg_val("pc");
+                uint32_t inst = monitor.mem_read(pc, 4);
+                latest_instrution = InstRecord{pc, inst};
+                if (!(finished = monitor.execute(1))) break;
 #ifdef CHECK_WATCHPOINT
-            if (check_watchpoint()) break;
+                if (check_watchpoint()) break;
 #endif
+            }
+        }
+        else
+        {
+            finished = monitor.execute(step);
         }
     }
     catch (program_halt& e)
     {
         spdlog::info("Program halted");
     }
+    sigaction(SIGINT, &previous, nullptr);
+    return finished;
 }
 
 template <typename T>
@@ -307,11 +455,113 @@ int Debugger<T>::cmd_si()
     execute(1);
 #ifdef TRACE_INSTRUCTION
     std::print("Current instruction: \n");
-    std::print("{}\n", latest_instrution);
+    std::print("{}\n", disassemble_record(latest_instrution));
 #endif
     return 0;
 }
 
+template <typename T>
+void Debugger<T>::print_current_instruction()
+{
+    auto pc = monitor.get_reg_val("pc");
+    uint32_t inst = monitor.mem_read(pc, 4);
+    std::print("{}\n", disassemble_record(InstRecord{pc, inst}));
+}
+
+template <typename T>
+void Debugger<T>::print_instruction_at(word_t pc)
+{
+    try
+    {
+        uint32_t inst = monitor.mem_read(pc, 4);
+        std::print("{}\n", disassemble_record(InstRecord{pc, inst}));
+    }
+    catch (invalid_address& e)
+    {
+        std::print("0x{:08x}: cannot access memory\n", pc);
+    }
+}
+
+template <typename T>
+int Debugger<T>::cmd_rsi()
+{
+    if (!monitor.is_recording())
+    {
+        printf("Not recording, restart with --record\n");
+        return 1;
+    }
+    auto args = strtok(nullptr, " ");
+    uint64_t n = 1;
+    if (args != nullptr && !parse_steps(args, "rsi", n)) return 1;
+    if (strtok(nullptr, " ") != nullptr)
+    {
+        printf("Command 'rsi' accepts at most one argument\n");
+        return 1;
+    }
+    auto pos = monitor.position();
+    if (!monitor.seek(pos - std::min(n, pos)))
+    {
+        printf("Target is older than the oldest snapshot\n");
+        return 1;
+    }
+    std::print("Instruction count: {}\n", monitor.position());
+    print_current_instruction();
+    return 0;
+}
+
+// Walks back one snapshot interval at a time. Each interval is replayed
+// forward while the watchpoints are evaluated, and the last instruction that
+// changed one of them is where execution stops, before it runs again.
+template <typename T>
+int Debugger<T>::cmd_rc()
+{
+    if (!monitor.is_recording())
+    {
+        printf("Not recording, restart with --record\n");
+        return 1;
+    }
+    if (strtok(nullptr, " ") != nullptr)
+    {
+        printf("Command 'rc' does not accept any arguments\n");
+        return 1;
+    }
+
+    auto end = monitor.position();
+    bool stopped = false;
+    while (auto begin = monitor.snapshot_before(end))
+    {
+        monitor.seek(*begin);
+        std::optional<uint64_t> change;
+        auto values = watchpoint_values();
+        while (!values.empty() && monitor.position() < end)
+        {
+            auto pos = monitor.position();
+            monitor.execute(1);
+            auto next = watchpoint_values();
+            if (next != values) change = pos;
+            values = std::move(next);
+        }
+        if (change)
+        {
+            monitor.seek(*change);
+            values = watchpoint_values();
+            int i = 0;
+            for (auto wp : watchpoint_used_list)
+            {
+                watchpoint_pool[wp].value = values[i++];
+            }
+            printf("Stopped before a watchpoint change\n");
+            stopped = true;
+            break;
+        }
+        end = *begin;
+    }
+    if (!stopped) monitor.seek(end);
+    std::print("Instruction count: {}\n", monitor.position());
+    print_current_instruction();
+    return 0;
+}
+
 template <typename T>
 int Debugger<T>::cmd_x()
 {
@@ -321,7 +571,8 @@ int Debugger<T>::cmd_x()
         printf("Invalid first argument for command 'x'\n");
         return 1;
     }
-    int n = atoi(args);
+    int n;
+    if (!parse_count(args, "x", n)) return 1;
     args = strtok(nullptr, " ");
     if (args == nullptr)
     {
@@ -338,12 +589,84 @@ int Debugger<T>::cmd_x()
     }
     for (int i = 0; i < n; i++)
     {
-        word_t result = monitor.mem_read(address, 4);
-        printf("%08x: %08x\n", address, result);
+        uint32_t result = monitor.mem_read(address, 4);
+        std::print("{:08x}: {:08x}\n", address, result);
         address += 4;
     }
     return 0;
 }
+
+template <typename T>
+int Debugger<T>::cmd_x_i()
+{
+    auto args = strtok(nullptr, " ");
+    if (args == nullptr)
+    {
+        printf("Invalid first argument for command 'x/i'\n");
+        return 1;
+    }
+    int n;
+    if (!parse_count(args, "x/i", n)) return 1;
+    args = strtok(nullptr, " ");
+    if (args == nullptr)
+    {
+        printf("Invalid second argument for command 'x/i'\n");
+        return 1;
+    }
+    bool flag;
+    word_t address = evaluate(args, flag);
+    if (!flag)
+    {
+        printf("Invalid expression\n");
+        return 1;
+    }
+    print_instructions(address, n);
+    return 0;
+}
+
+template <typename T>
+int Debugger<T>::cmd_disas()
+{
+    word_t begin = 0, end = 0;
+    auto args = strtok(nullptr, " ");
+    if (args == nullptr)
+    {
+        auto text = elf ? elf->section(".text") : std::nullopt;
+        if (!text)
+        {
+            printf("No .text section loaded, give a range: disas BEGIN END\n");
+            return 1;
+        }
+        begin = text->addr;
+        end = text->addr + text->size;
+    }
+    else
+    {
+        bool flag;
+        begin = evaluate(args, flag);
+        args = strtok(nullptr, " ");
+        if (!flag || args == nullptr)
+        {
+            printf("Invalid arguments for command 'disas'\n");
+            return 1;
+        }
+        end = evaluate(args, flag);
+        if (!flag || end < begin)
+        {
+            printf("Invalid arguments for command 'disas'\n");
+            return 1;
+        }
+    }
+    if (end - begin > max_disassembly)
+    {
+        std::print("Range for command 'disas' must be at most {} bytes\n",
+                   max_disassembly);
+        return 1;
+    }
+    print_disassembly(begin, end);
+    return 0;
+}
+
 template <typename T>
 int Debugger<T>::cmd_p()
 {
@@ -402,6 +725,7 @@ int Debugger<T>::cmd_w()
     watchpoint_used_list.push_back(wp_id);
     watchpoint_pool[wp_id].expr = args;
     watchpoint_pool[wp_id].value = res;
+    monitor.suspend_interception(true);
 
     printf("Set watchpoint %d: %s\n", wp_id, args);
 
@@ -447,6 +771,7 @@ int Debugger<T>::cmd_d()
     else
     {
         watchpoint_free_list.push_back(wp_id);
+        if (watchpoint_used_list.empty()) monitor.suspend_interception(false);
         printf("Delete watchpoint %d\n", wp_id);
     }
     return 0;
@@ -475,10 +800,18 @@ int Debugger<T>::cmd_handler(char* cmd)
     auto arg = strtok(cmd, " ");
     for (const auto& c : commands)
     {
-        if (strcmp(arg, c.cmd) == 0)
+        if (strcmp(arg, c.cmd) != 0) continue;
+        // Examining an address nothing is mapped at is a user error; the
+        // machine is untouched and the prompt comes back.
+        try
         {
             return (this->*c.func)();
         }
+        catch (invalid_address& e)
+        {
+            printf("Cannot access memory there\n");
+            return 1;
+        }
     }
     printf("Invalid command\n");
     return 1;
@@ -489,7 +822,8 @@ int Debugger<T>::run(bool is_batch_mode)
 {
     if (is_batch_mode)
     {
-        execute(-1);
+        // Stopped with Ctrl-C: exit like a process killed by SIGINT.
+        if (!execute(-1)) return 128 + SIGINT;
     }
     else
         try
@@ -511,7 +845,10 @@ int Debugger<T>::run(bool is_batch_mode)
     bool is_bad_status = monitor.is_bad_status();
     if (is_bad_status)
     {
-        instruction_buffer.print();
+        // The core keeps the pcs of the last instructions; their words are
+        // read back from memory here.
+        for (auto pc : monitor.recent_pcs()) print_instruction_at(pc);
+        print_instruction_at(monitor.get_reg_val("pc"));
     }
     return is_bad_status;
 }
@@ -1,13 +1,30 @@
 #ifndef MONITOR_DECL_HPP_
 #define MONITOR_DECL_HPP_
 
+#include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <deque>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
 #include <string_view>
+#include <vector>
 
 #include "Core/Core.hpp"
+#include "Device/BlockDevice.h"
+#include "Device/Clint.h"
+#include "Device/EventQueue.h"
+#include "Device/Rtc.h"
+#include "Device/Serial.h"
+#include "Device/Vga.h"
 #include "Memory/Memory.h"
+#include "Syscall/LinuxSyscalls.h"
+#include "Metrics/Metrics.h"
+#include "Plugin/Plugin.h"
 
 template <CoreType T>
 class Monitor
@@ -16,20 +33,83 @@ class Monitor
     using sword_t = typename T::sword_t;
 
    public:
+    // With user_mode the image is left for start_user_mode() to load.
     Monitor(Core<T> &core, Memory &memory,
-            std::filesystem::path custom_firmware_file = "");
+            std::filesystem::path custom_firmware_file = "",
+            bool user_mode = false);
     ~Monitor();
 
-    void execute(uint64_t n);
+    // Returns false if a stop request ended it early, the machine is then
+    // stopped between two instructions.
+    bool execute(uint64_t n);
+    // Asks a running execute() to return; it looks between quanta. Safe in
+    // a signal handler and from other threads. Returns whether a request
+    // was pending already.
+    bool request_stop()
+    {
+        return stop_requested.exchange(true, std::memory_order_relaxed);
+    }
     void quit();
+    // Ties virtual time to the host clock instead of the instruction count.
+    void set_realtime(bool enable);
+    // Host functions would skip the guest's loads and stores, so watchpoints
+    // suspend them.
+    void suspend_interception(bool suspend)
+    {
+        core.suspend_interception(suspend);
+    }
+    // Attaches plugins to the core; they are also told when the program
+    // halts.
+    void set_plugins(PluginManager &plugins);
+    // Exports live statistics to path; see Metrics.
+    void enable_metrics(std::filesystem::path path);
+    // Maps the disk image at BLOCK_MMIO; see BlockDevice. Returns false if
+    // it cannot be opened.
+    bool attach_disk(const std::filesystem::path &path, bool copy_on_write);
+    // Maps the screen at VGACTL_MMIO and FB_MMIO, frames going to sink; see
+    // Framebuffer. Returns false if the sink cannot be set up.
+    bool attach_screen(const std::filesystem::path &sink);
+    // Loads ELF image and runs it as a Linux user program with arguments args,
+    // args[0] being its name; see LinuxSyscalls. Returns false if it cannot
+    // be set up.
+    bool start_user_mode(const std::filesystem::path &image,
+                         std::span<const std::string> args);
+
+    // Record mode logs device reads and interrupts, and every interval
+    // instructions snapshots the core together with the old contents of the
+    // pages written since the previous snapshot. Any recorded point can then
+    // be reached again by restoring the nearest snapshot and replaying.
+    // Only the newest max_snapshots are kept, unless keep_all is set.
+    void start_recording(uint64_t interval = 100000, bool keep_all = false);
+    bool is_recording() const { return recording; }
+    uint64_t position() { return core.get_instret(); }
+    // Newest snapshot strictly before position, if it is still kept.
+    std::optional<uint64_t> snapshot_before(uint64_t position) const;
+    // Moves to instruction count target, clamped to the end of the
+    // recording. Fails if target is older than the oldest snapshot.
+    bool seek(uint64_t target);
+    // Replays a finished recording, kept whole, on threads with plugins:
+    // each interval between two snapshots runs on a core and RAM of its own
+    // with a fresh set of plugins from load_plugins, and the sets are then
+    // merged in program order and told that the program halted.
+    // prepare_core sets up each core as the recorded one was, e.g. with its
+    // intercepted functions. Returns false, having logged why, if the
+    // recording or the plugins do not allow it.
+    bool run_intervals(unsigned threads,
+                       std::function<bool(PluginManager &)> load_plugins,
+                       std::function<void(T &)> prepare_core);
     void print_registers();
     auto get_reg_val(std::string_view reg_name);
     auto mem_read(word_t addr, size_t len);
+    std::vector<uint64_t> recent_pcs() { return core.recent_pcs(); }
 
     void invalid_inst_handler(word_t pc);
     void ebreak_handler(word_t pc);
+    void exit_handler(word_t pc, int status);
 
     bool is_bad_status();
+    // What a user-mode program passed to exit, 0 until it did.
+    int get_exit_status() const { return exit_status; }
 
    private:
     enum State
@@ -43,11 +123,86 @@ class Monitor
 
     Core<T> &core;
     Memory &memory;
+
+    EventQueue events;
+    Clint clint;
+    Serial serial;
+    Rtc rtc;
+    std::unique_ptr<BlockDevice> disk;
+    std::unique_ptr<Framebuffer> framebuffer;
+    std::unique_ptr<VgaControl> vga;
+    std::unique_ptr<LinuxSyscalls> syscalls;
+    int exit_status = 0;
+
     word_t halt_pc;
     word_t halt_ret;
+    // Host time spent in execute(), in total.
     std::chrono::nanoseconds timer;
     uint64_t inst_count;
 
+    // Quanta are capped so that stop requests are seen within a few ms.
+    static constexpr uint64_t max_quantum = 1 << 20;
+    static_assert(std::atomic<bool>::is_always_lock_free);
+    std::atomic<bool> stop_requested{false};
+
+    PluginManager *plugins = nullptr;
+    // Counters are published every metrics_interval_ns of virtual time,
+    // which also bounds the quanta, and once the guest halts or is stopped.
+    static constexpr uint64_t metrics_interval_ns = 10'000'000;
+    std::unique_ptr<Metrics> metrics;
+    void schedule_metrics();
+    void publish_metrics();
+
+    struct Snapshot
+    {
+        uint64_t instret;
+        typename T::State core_state;
+        size_t mmio_log_pos;
+        size_t irq_log_pos;
+        // Pages written before the next snapshot, as they were at this one.
+        std::vector<uint32_t> pages;
+        std::vector<uint8_t> page_data;
+    };
+    struct IRQRecord
+    {
+        uint64_t instret;
+        int irq;
+        bool level;
+    };
+    static constexpr size_t max_snapshots = 1024;
+    bool recording = false;
+    bool keep_all_snapshots = false;
+    // Set while behind the end of the recording: devices are not run and
+    // their inputs come from the logs instead.
+    bool replaying = false;
+    uint64_t snapshot_interval;
+    uint64_t record_end;
+    std::deque<Snapshot> snapshots;
+    std::vector<IRQRecord> irq_log;
+    size_t irq_replay_pos;
+    // Set while the core runs a quantum of execute(), so an interrupt raised
+    // then comes from the instruction being executed.
+    bool executing = false;
+
+    void raise_interrupt(int irq, bool level);
+    // The time CSR reads the CLINT's mtime as a device read, so recordings
+    // log it and replays serve it like any other.
+    static uint64_t read_mtime(Memory &memory);
+    void take_snapshot();
+    uint64_t live_quantum(uint64_t n);
+    // Raises on target the logged interrupts due at its instruction count,
+    // from log entry next on. Returns how many instructions it may run
+    // before the next one is due.
+    uint64_t replay_interrupts(Core<T> &target, size_t &next) const;
+    uint64_t replay_quantum(uint64_t n);
+    void leave_replay();
+    // Brings copy, which holds RAM as at snapshot from, back to snapshot
+    // to <= from; snapshots.size() stands for the end of the recording.
+    void undo_snapshots(Memory &copy, size_t from, size_t to) const;
+    // Replays interval k on replica, whose RAM is as at snapshot k. Returns
+    // false if it did not end where the recorded run did.
+    bool replay_interval(T &replica, Memory &copy, size_t k) const;
+
     void statistics();
 };
 
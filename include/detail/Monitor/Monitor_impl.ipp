@@ -3,26 +3,59 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <exception>
 #include <fstream>
 #include <print>
+#include <stdexcept>
 #include <string_view>
+#include <thread>
 #include <vector>
 
 #include "Exception/NEMUException.hpp"
 #include "Monitor_decl.hpp"
+#include "Utils/ElfParser.h"
 
 template <CoreType T>
 Monitor<T>::Monitor(Core<T> &core, Memory &memory,
-                    std::filesystem::path custom_firmware_file)
-    : core(core), memory(memory)
+                    std::filesystem::path custom_firmware_file,
+                    bool user_mode)
+    : core(core),
+      memory(memory),
+      events([this]() { return this->core.get_instret(); }),
+      clint(events, [this](int irq, bool level)
+            { this->raise_interrupt(irq, level); }),
+      serial(events),
+      rtc(events)
 {
     state = State::STOP;
     inst_count = 0;
     timer = std::chrono::nanoseconds(0);
+    events.set_deadline_hook([this]() { this->core.end_quantum(); });
+    core.set_timer([this]() { return read_mtime(this->memory); });
 
-    if (std::filesystem::exists(custom_firmware_file))
+    memory.map_device(CLINT_MMIO, Clint::size, clint);
+    memory.map_device(SERIAL_MMIO, Serial::size, serial);
+    memory.map_device(RTC_MMIO, Rtc::size, rtc);
+
+    // start_user_mode() loads the program itself.
+    if (user_mode) return;
+    if (std::filesystem::exists(custom_firmware_file) &&
+        ElfFile::is_elf(custom_firmware_file))
+    {
+        spdlog::info("Loading ELF firmware: {}", custom_firmware_file.string());
+        auto elf = ElfFile::open(custom_firmware_file);
+        if (!elf) throw std::runtime_error("Failed to load ELF firmware");
+        for (const auto &segment : elf->segments())
+        {
+            memory.load_segment(segment.paddr, segment.data, segment.memsz);
+        }
+        core.set_reset_pc(elf->entry());
+        spdlog::info("Entry point: 0x{:x}", elf->entry());
+    }
+    else if (std::filesystem::exists(custom_firmware_file))
     {
         spdlog::info("Loading custom firmware: {}",
                      custom_firmware_file.string());
@@ -51,7 +84,7 @@ Monitor<T>::~Monitor()
 template <CoreType T>
 void Monitor<T>::invalid_inst_handler(word_t pc)
 {
-    word_t inst = memory.inst_fetch(pc, sizeof(word_t));
+    auto inst = memory.inst_fetch(pc, 4);
     spdlog::error("Invalid instruction at PC = {0:x}", pc);
     spdlog::error("Instrution: \n BIN:{0:b}\n HEX:{0:x}", inst);
     halt_pc = pc;
@@ -67,6 +100,16 @@ void Monitor<T>::ebreak_handler(word_t pc)
     state = halt_ret == 0 ? State::END : State::ABORT;
 }
 
+template <CoreType T>
+void Monitor<T>::exit_handler(word_t pc, int status)
+{
+    halt_pc = pc;
+    halt_ret = status;
+    exit_status = status;
+    spdlog::info("Exit with status {} at PC = {:x}", status, pc);
+    state = State::END;
+}
+
 template <CoreType T>
 void Monitor<T>::statistics()
 {
@@ -81,7 +124,7 @@ void Monitor<T>::statistics()
 }
 
 template <CoreType T>
-void Monitor<T>::execute(uint64_t n)
+bool Monitor<T>::execute(uint64_t n)
 {
     if (state == State::STOP)
     {
@@ -93,43 +136,436 @@ void Monitor<T>::execute(uint64_t n)
     }
 
     auto start = std::chrono::steady_clock::now();
+    auto start_instret = core.get_instret();
+    bool stopped = false;
 
-    for (uint64_t i = 0; i < n; i++)
+    try
     {
-        try
+        // Devices only get control back when their next event is due.
+        while (n > 0)
         {
-            core.execute_one_inst();
+            if (stop_requested.load(std::memory_order_relaxed)) [[unlikely]]
+            {
+                stop_requested.store(false, std::memory_order_relaxed);
+                spdlog::info("Stopped at PC = {0:x}", core.debug_get_pc());
+                stopped = true;
+                break;
+            }
+            if (replaying && core.get_instret() == record_end) leave_replay();
+            uint64_t quantum = replaying ? replay_quantum(n) : live_quantum(n);
+            quantum = std::min(quantum, max_quantum);
+            auto before = core.get_instret();
+            executing = true;
+            core.execute(quantum);
+            executing = false;
+            n -= core.get_instret() - before;
         }
-        catch (invalid_instruction &e)
-        {
-            invalid_inst_handler(core.debug_get_pc());
-            break;
-        }
-        catch (ebreak_exception &e)
-        {
-            ebreak_handler(core.debug_get_pc());
-            break;
-        }
-        catch (std::exception &e)
-        {
-            spdlog::error("Exception: {}", e.what());
-            state = State::ABORT;
-            break;
-        }
-        inst_count++;
     }
+    catch (invalid_instruction &e)
+    {
+        invalid_inst_handler(core.debug_get_pc());
+    }
+    catch (ebreak_exception &e)
+    {
+        ebreak_handler(core.debug_get_pc());
+    }
+    catch (guest_exit &e)
+    {
+        exit_handler(core.debug_get_pc(), e.status);
+    }
+    catch (std::exception &e)
+    {
+        spdlog::error("Exception: {}", e.what());
+        state = State::ABORT;
+    }
+    executing = false;
+    inst_count += core.get_instret() - start_instret;
+    if (recording && !replaying) record_end = core.get_instret();
 
     auto end = std::chrono::steady_clock::now();
 
-    timer = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+    timer += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+    bool halted = state == State::END || state == State::ABORT;
+    if (metrics && (stopped || halted)) publish_metrics();
 
     if (state == State::RUNNING)
         state = State::STOP;
-    else if (state == State::END || state == State::ABORT)
+    else if (halted)
     {
+        if (plugins) plugins->halt(halt_pc, state == State::END);
         statistics();
         throw program_halt();
     }
+    return !stopped;
+}
+
+template <CoreType T>
+void Monitor<T>::set_plugins(PluginManager &plugins)
+{
+    this->plugins = &plugins;
+    core.set_plugins(&plugins);
+}
+
+template <CoreType T>
+void Monitor<T>::enable_metrics(std::filesystem::path path)
+{
+    if (metrics) return;
+    metrics = std::make_unique<Metrics>(std::move(path));
+    publish_metrics();
+    schedule_metrics();
+}
+
+template <CoreType T>
+bool Monitor<T>::attach_disk(const std::filesystem::path &path,
+                             bool copy_on_write)
+{
+    if (disk) return false;
+    disk = BlockDevice::open(memory, path, copy_on_write);
+    if (!disk) return false;
+    memory.map_device(BLOCK_MMIO, BlockDevice::size, *disk);
+    return true;
+}
+
+template <CoreType T>
+bool Monitor<T>::attach_screen(const std::filesystem::path &sink)
+{
+    if (framebuffer) return false;
+    framebuffer = Framebuffer::open(sink);
+    if (!framebuffer) return false;
+    vga = std::make_unique<VgaControl>(*framebuffer);
+    memory.map_device(VGACTL_MMIO, VgaControl::size, *vga);
+    memory.map_device(FB_MMIO, Framebuffer::size, *framebuffer);
+    return true;
+}
+
+template <CoreType T>
+bool Monitor<T>::start_user_mode(const std::filesystem::path &image,
+                                 std::span<const std::string> args)
+{
+    if (syscalls) return false;
+    auto elf = ElfFile::open(image);
+    if (!elf)
+    {
+        spdlog::error("User mode needs an ELF image");
+        return false;
+    }
+    syscalls = std::make_unique<LinuxSyscalls>(memory, sizeof(word_t) * 8);
+    auto sp = syscalls->setup(*elf, args);
+    if (sp == 0) return false;
+    core.set_reset_pc(elf->entry());
+    spdlog::info("Entry point: 0x{:x}", elf->entry());
+    core.enter_user_mode(*syscalls, sp);
+    spdlog::info("User mode, stack at 0x{:x}", sp);
+    return true;
+}
+
+template <CoreType T>
+void Monitor<T>::schedule_metrics()
+{
+    events.schedule_in(metrics_interval_ns,
+                       [this]()
+                       {
+                           publish_metrics();
+                           schedule_metrics();
+                       });
+}
+
+template <CoreType T>
+void Monitor<T>::publish_metrics()
+{
+    constexpr auto relaxed = std::memory_order_relaxed;
+    auto &values = metrics->counters();
+    const auto &core_counters = core.get_counters();
+    const auto &access = memory.access_counts();
+    values.instructions.store(core.get_instret(), relaxed);
+    values.decode_misses.store(core_counters.decode_misses, relaxed);
+    for (size_t i = 0; i < core_counters.traps.size(); i++)
+        values.traps[i].store(core_counters.traps[i], relaxed);
+    values.memory_reads.store(access.reads, relaxed);
+    values.memory_writes.store(access.writes, relaxed);
+    values.mmio_reads.store(access.mmio_reads, relaxed);
+    values.mmio_writes.store(access.mmio_writes, relaxed);
+}
+
+template <CoreType T>
+void Monitor<T>::set_realtime(bool enable)
+{
+    events.set_realtime(enable);
+}
+
+template <CoreType T>
+void Monitor<T>::raise_interrupt(int irq, bool level)
+{
+    // One raised by an instruction, a store to the CLINT, is taken once that
+    // instruction has retired.
+    if (recording)
+    {
+        auto instret = core.get_instret() + (executing ? 1 : 0);
+        irq_log.push_back(IRQRecord{instret, irq, level});
+    }
+    core.set_interrupt(irq, level);
+}
+
+template <CoreType T>
+uint64_t Monitor<T>::read_mtime(Memory &memory)
+{
+    return memory.vread<uint64_t>(CLINT_MMIO + Clint::mtime_offset, 8);
+}
+
+template <CoreType T>
+uint64_t Monitor<T>::live_quantum(uint64_t n)
+{
+    events.run_due();
+    n = std::min(n, events.instructions_to_next());
+    if (!recording) return n;
+    auto pos = core.get_instret();
+    if (pos - snapshots.back().instret >= snapshot_interval) take_snapshot();
+    return std::min(n, snapshots.back().instret + snapshot_interval - pos);
+}
+
+template <CoreType T>
+uint64_t Monitor<T>::replay_interrupts(Core<T> &target, size_t &next) const
+{
+    auto pos = target.get_instret();
+    for (; next < irq_log.size() && irq_log[next].instret == pos; next++)
+        target.set_interrupt(irq_log[next].irq, irq_log[next].level);
+    if (next == irq_log.size()) return UINT64_MAX;
+    return irq_log[next].instret - pos;
+}
+
+template <CoreType T>
+uint64_t Monitor<T>::replay_quantum(uint64_t n)
+{
+    n = std::min(n, replay_interrupts(core, irq_replay_pos));
+    return std::min(n, record_end - core.get_instret());
+}
+
+template <CoreType T>
+void Monitor<T>::leave_replay()
+{
+    replay_quantum(0);
+    replaying = false;
+    memory.set_mmio_mode(Memory::MMIOMode::RECORD);
+    // The newest snapshot keeps collecting the pages it does not hold yet.
+    memory.clear_dirty();
+    for (auto page : snapshots.back().pages) memory.mark_dirty(page);
+}
+
+template <CoreType T>
+void Monitor<T>::take_snapshot()
+{
+    snapshots.push_back(Snapshot{core.get_instret(), core.save_state(),
+                                 memory.mmio_log_size(), irq_log.size(), {},
+                                 {}});
+    if (!keep_all_snapshots && snapshots.size() > max_snapshots)
+        snapshots.pop_front();
+    memory.clear_dirty();
+}
+
+template <CoreType T>
+void Monitor<T>::start_recording(uint64_t interval, bool keep_all)
+{
+    if (recording) return;
+    recording = true;
+    keep_all_snapshots = keep_all;
+    snapshot_interval = std::max<uint64_t>(interval, 1);
+    record_end = core.get_instret();
+    memory.set_mmio_mode(Memory::MMIOMode::RECORD);
+    memory.track_writes(
+        [this](size_t page, const uint8_t *data)
+        {
+            if (replaying) return;
+            auto &snapshot = snapshots.back();
+            snapshot.pages.push_back(page);
+            snapshot.page_data.insert(snapshot.page_data.end(), data,
+                                      data + Memory::page_size);
+        });
+    take_snapshot();
+    spdlog::info("Recording, snapshot every {} instructions",
+                 snapshot_interval);
+    if (disk)
+        spdlog::warn("Disk transfers are not recorded, replay may differ");
+    if (syscalls)
+        spdlog::warn("System calls are not recorded, replay may differ");
+}
+
+template <CoreType T>
+std::optional<uint64_t> Monitor<T>::snapshot_before(uint64_t position) const
+{
+    for (auto it = snapshots.rbegin(); it != snapshots.rend(); ++it)
+    {
+        if (it->instret < position) return it->instret;
+    }
+    return std::nullopt;
+}
+
+template <CoreType T>
+bool Monitor<T>::seek(uint64_t target)
+{
+    if (!recording) return false;
+    target = std::min(target, record_end);
+    auto after = [](uint64_t instret, const Snapshot &snapshot)
+    { return instret < snapshot.instret; };
+    auto dest = std::upper_bound(snapshots.begin(), snapshots.end(), target,
+                                 after);
+    if (dest == snapshots.begin()) return false;
+    --dest;
+
+    // A replay that is not past target yet just goes on.
+    if (!replaying || target < core.get_instret())
+    {
+        // Replay is deterministic, so every page written since *dest,
+        // whether by the recorded run or by a replay, is held by one of
+        // [dest, from). Undoing newest first leaves each page as it was at
+        // *dest.
+        auto from = std::upper_bound(snapshots.begin(), snapshots.end(),
+                                     core.get_instret(), after);
+        while (from != dest)
+        {
+            --from;
+            for (size_t i = 0; i < from->pages.size(); i++)
+            {
+                memory.restore_page(
+                    from->pages[i],
+                    from->page_data.data() + i * Memory::page_size);
+            }
+        }
+        core.restore_state(dest->core_state);
+        memory.seek_mmio_log(dest->mmio_log_pos);
+        memory.set_mmio_mode(Memory::MMIOMode::REPLAY);
+        irq_replay_pos = dest->irq_log_pos;
+        replaying = true;
+    }
+    state = State::STOP;
+
+    auto n = target - core.get_instret();
+    while (n > 0)
+    {
+        uint64_t quantum = replay_quantum(n);
+        auto before = core.get_instret();
+        core.execute(quantum);
+        n -= core.get_instret() - before;
+    }
+    if (core.get_instret() == record_end) leave_replay();
+    return true;
+}
+
+template <CoreType T>
+bool Monitor<T>::run_intervals(
+    unsigned threads, std::function<bool(PluginManager &)> load_plugins,
+    std::function<void(T &)> prepare_core)
+{
+    if (!recording || !keep_all_snapshots)
+    {
+        spdlog::error("Interval replay needs the whole recording");
+        return false;
+    }
+    if ((state != State::END && state != State::ABORT) ||
+        core.get_instret() != record_end)
+    {
+        spdlog::error("Interval replay needs a program that has halted");
+        return false;
+    }
+    size_t count = snapshots.size();
+    std::vector<std::unique_ptr<PluginManager>> managers(count);
+    for (auto &manager : managers)
+    {
+        manager = std::make_unique<PluginManager>();
+        if (!load_plugins(*manager)) return false;
+    }
+    threads = std::clamp<size_t>(threads, 1, count);
+
+    // The final RAM is shared by all threads; each one only holds the pages
+    // it restores or writes.
+    auto start = std::chrono::steady_clock::now();
+    auto image = Memory::Image::create(memory);
+    if (!image) return false;
+    // Newest first: each thread's RAM then only has to go back over the
+    // pages of the intervals since the one it ran last.
+    std::atomic<size_t> taken = 0;
+    std::vector<uint8_t> replayed(count);
+    {
+        std::vector<std::jthread> workers;
+        for (unsigned i = 0; i < threads; i++)
+        {
+            workers.emplace_back(
+                [&]()
+                {
+                    Memory copy(*image);
+                    T replica(copy);
+                    replica.set_timer([&copy]() { return read_mtime(copy); });
+                    prepare_core(replica);
+                    size_t at = count;
+                    for (size_t i; (i = taken.fetch_add(1)) < count;)
+                    {
+                        size_t k = count - 1 - i;
+                        undo_snapshots(copy, at, k);
+                        replica.set_plugins(managers[k].get());
+                        replayed[k] = replay_interval(replica, copy, k);
+                        at = k + 1;
+                    }
+                });
+        }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    spdlog::info("Replayed {} intervals on {} threads in {} ms", count,
+                 threads, elapsed.count());
+
+    for (size_t k = 0; k < count; k++)
+    {
+        if (!replayed[k])
+            spdlog::warn("Interval {} did not replay as recorded", k);
+        if (k > 0 && !managers[0]->merge(*managers[k])) return false;
+    }
+    managers[0]->halt(halt_pc, state == State::END);
+    return true;
+}
+
+template <CoreType T>
+void Monitor<T>::undo_snapshots(Memory &copy, size_t from, size_t to) const
+{
+    while (from > to)
+    {
+        const auto &snapshot = snapshots[--from];
+        for (size_t i = 0; i < snapshot.pages.size(); i++)
+        {
+            const uint8_t *data =
+                snapshot.page_data.data() + i * Memory::page_size;
+            copy.restore_page(snapshot.pages[i], data);
+        }
+    }
+}
+
+// Like seek(), with the logs of the recording; the last interval goes on
+// to the instruction that ended the program.
+template <CoreType T>
+bool Monitor<T>::replay_interval(T &replica, Memory &copy, size_t k) const
+{
+    const auto &snapshot = snapshots[k];
+    bool last = k + 1 == snapshots.size();
+    uint64_t end = last ? record_end : snapshots[k + 1].instret;
+    replica.restore_state(snapshot.core_state);
+    copy.seek_mmio_log(snapshot.mmio_log_pos);
+    copy.set_mmio_mode(Memory::MMIOMode::REPLAY);
+    size_t irq = snapshot.irq_log_pos;
+    try
+    {
+        for (auto pos = snapshot.instret; pos < end;
+             pos = replica.get_instret())
+        {
+            uint64_t n = replay_interrupts(replica, irq);
+            replica.execute(std::min(n, end - pos));
+        }
+        if (!last)
+            return replica.debug_get_pc() == snapshots[k + 1].core_state.pc;
+        replica.execute(1);
+    }
+    catch (std::exception &e)
+    {
+        return last && replica.get_instret() == end;
+    }
+    return false;
 }
 
 template <CoreType T>
@@ -163,7 +599,7 @@ auto Monitor<T>::get_reg_val(std::string_view reg_name)
 template <CoreType T>
 auto Monitor<T>::mem_read(word_t addr, size_t len)
 {
-    return memory.debug_vread(addr, len);
+    return memory.debug_vread<word_t>(addr, len);
 }
 
 template <CoreType T>
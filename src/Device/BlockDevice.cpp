@@ -0,0 +1,135 @@
+#include "Device/BlockDevice.h"
+
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <span>
+
+namespace
+{
+
+// Updates the low or high word of reg, or all of it.
+void write_half(uint64_t& reg, uint64_t offset, uint64_t data, int len)
+{
+    if (len == 8)
+        reg = data;
+    else if (offset % 8 == 0)
+        reg = (reg & ~uint64_t(0xffffffff)) | (data & 0xffffffff);
+    else
+        reg = (reg & 0xffffffff) | data << 32;
+}
+
+}  // namespace
+
+std::unique_ptr<BlockDevice> BlockDevice::open(
+    Memory& memory, const std::filesystem::path& path, bool copy_on_write)
+{
+    int fd = ::open(path.c_str(), copy_on_write ? O_RDONLY : O_RDWR);
+    if (fd < 0)
+    {
+        spdlog::error("Cannot open disk image {}: {}", path.string(),
+                      std::strerror(errno));
+        return nullptr;
+    }
+    struct stat st;
+    void* image = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= off_t(sector_size))
+    {
+        image = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+                     copy_on_write ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (image == MAP_FAILED)
+    {
+        spdlog::error("Cannot map disk image {}, it needs at least one "
+                      "sector",
+                      path.string());
+        return nullptr;
+    }
+    spdlog::info("Disk image {}: {} sectors{}", path.string(),
+                 st.st_size / sector_size,
+                 copy_on_write ? ", copy-on-write" : "");
+    return std::unique_ptr<BlockDevice>(
+        new BlockDevice(memory, static_cast<uint8_t*>(image), st.st_size,
+                        copy_on_write));
+}
+
+BlockDevice::BlockDevice(Memory& memory, uint8_t* image, size_t length,
+                         bool copy_on_write)
+    : memory(memory),
+      image(image),
+      length(length),
+      copy_on_write(copy_on_write),
+      sector(0),
+      addr(0),
+      count(0),
+      status(0)
+{
+}
+
+BlockDevice::~BlockDevice() { munmap(image, length); }
+
+uint64_t BlockDevice::read(uint64_t offset, int len)
+{
+    uint64_t value = 0;
+    switch (offset & ~uint64_t(7))
+    {
+        case capacity_offset:
+            value = length / sector_size;
+            break;
+        case sector_offset:
+            value = sector;
+            break;
+        case addr_offset:
+            value = addr;
+            break;
+        case count_offset:
+            return offset == count_offset ? count : 0;
+        case status_offset:
+            return offset == status_offset ? status : 0;
+        default:
+            return 0;
+    }
+    return offset % 8 == 0 ? value : value >> 32;
+}
+
+void BlockDevice::write(uint64_t offset, uint64_t data, int len)
+{
+    switch (offset)
+    {
+        case sector_offset:
+        case sector_offset + 4:
+            write_half(sector, offset, data, len);
+            break;
+        case addr_offset:
+        case addr_offset + 4:
+            write_half(addr, offset, data, len);
+            break;
+        case count_offset:
+            count = data;
+            break;
+        case command_offset:
+            status = execute(data) ? 0 : 1;
+            break;
+    }
+}
+
+bool BlockDevice::execute(uint32_t command)
+{
+    uint64_t sectors = length / sector_size;
+    if (command == FLUSH)
+        return copy_on_write || msync(image, length, MS_SYNC) == 0;
+    if ((command != READ && command != WRITE) || sector > sectors ||
+        count > sectors - sector)
+        return false;
+
+    std::span<uint8_t> data(image + sector * sector_size,
+                            uint64_t(count) * sector_size);
+    return command == READ ? memory.write_block(addr, data)
+                           : memory.read_block(addr, data);
+}
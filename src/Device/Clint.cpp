@@ -0,0 +1,98 @@
+#include "Device/Clint.h"
+
+#include <spdlog/spdlog.h>
+
+#include <utility>
+
+#include "Exception/NEMUException.hpp"
+
+// Interrupt numbers of machine software and timer interrupts in mip.
+static constexpr int irq_m_soft = 3;
+static constexpr int irq_m_timer = 7;
+
+Clint::Clint(EventQueue& events, InterruptLine irq)
+    : events(events),
+      irq(std::move(irq)),
+      msip(0),
+      mtimecmp(UINT64_MAX),
+      timer_event(0),
+      timer_scheduled(false)
+{
+}
+
+uint64_t Clint::mtime() const { return events.now() / ns_per_tick; }
+
+uint64_t Clint::read(uint64_t offset, int len)
+{
+    switch (offset)
+    {
+        case msip_offset:
+            return msip;
+        case mtimecmp_offset:
+            return mtimecmp;
+        case mtimecmp_offset + 4:
+            return mtimecmp >> 32;
+        case mtime_offset:
+            return mtime();
+        case mtime_offset + 4:
+            return mtime() >> 32;
+        default:
+            spdlog::error("CLINT: invalid read at offset 0x{:x}", offset);
+            throw invalid_address();
+    }
+}
+
+void Clint::write(uint64_t offset, uint64_t data, int len)
+{
+    switch (offset)
+    {
+        case msip_offset:
+            msip = data & 1;
+            irq(irq_m_soft, msip != 0);
+            break;
+        case mtimecmp_offset:
+            if (len == 8)
+                mtimecmp = data;
+            else
+                mtimecmp =
+                    (mtimecmp & 0xffffffff00000000ull) | uint32_t(data);
+            update_timer();
+            break;
+        case mtimecmp_offset + 4:
+            mtimecmp = (mtimecmp & 0xffffffffull) | (uint64_t(data) << 32);
+            update_timer();
+            break;
+        case mtime_offset:
+        case mtime_offset + 4:
+            // mtime follows virtual time and cannot be set.
+            break;
+        default:
+            spdlog::error("CLINT: invalid write at offset 0x{:x}", offset);
+            throw invalid_address();
+    }
+}
+
+void Clint::update_timer()
+{
+    if (timer_scheduled)
+    {
+        events.cancel(timer_event);
+        timer_scheduled = false;
+    }
+    if (mtimecmp <= mtime())
+    {
+        irq(irq_m_timer, true);
+        return;
+    }
+    irq(irq_m_timer, false);
+    // A deadline past what virtual time can count up to never comes; the
+    // product would wrap to an early one.
+    if (mtimecmp >= EventQueue::never / ns_per_tick) return;
+    timer_event = events.schedule_at(mtimecmp * ns_per_tick,
+                                     [this]()
+                                     {
+                                         timer_scheduled = false;
+                                         irq(irq_m_timer, true);
+                                     });
+    timer_scheduled = true;
+}
@@ -0,0 +1,92 @@
+#include "Device/EventQueue.h"
+
+#include <algorithm>
+#include <utility>
+
+// Caps a quantum in realtime mode, so a guest slower than ns_per_inst does
+// not overshoot a host-time deadline by much.
+static constexpr uint64_t realtime_max_quantum = 10000;
+
+EventQueue::EventQueue(std::function<uint64_t()> instruction_count,
+                       uint64_t ns_per_inst)
+    : instruction_count(std::move(instruction_count)),
+      ns_per_inst(ns_per_inst),
+      realtime(false),
+      host_offset(0),
+      next_id(0)
+{
+}
+
+void EventQueue::set_realtime(bool enable)
+{
+    // Keep time monotonic across the switch.
+    uint64_t current = now();
+    realtime = enable;
+    host_start = std::chrono::steady_clock::now();
+    host_offset = current;
+}
+
+uint64_t EventQueue::now() const
+{
+    if (!realtime) return instruction_count() * ns_per_inst;
+    auto elapsed = std::chrono::steady_clock::now() - host_start;
+    return host_offset +
+           std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+               .count();
+}
+
+EventQueue::EventId EventQueue::schedule_at(uint64_t when, Callback callback)
+{
+    EventId id = next_id++;
+    bool earlier = when < next_deadline();
+    heap.push_back(Event{when, id, std::move(callback)});
+    std::push_heap(heap.begin(), heap.end(), later);
+    if (earlier && deadline_hook) deadline_hook();
+    return id;
+}
+
+EventQueue::EventId EventQueue::schedule_in(uint64_t delay, Callback callback)
+{
+    return schedule_at(now() + delay, std::move(callback));
+}
+
+void EventQueue::cancel(EventId id) { cancelled.insert(id); }
+
+void EventQueue::set_deadline_hook(Callback hook)
+{
+    deadline_hook = std::move(hook);
+}
+
+uint64_t EventQueue::next_deadline() const
+{
+    return heap.empty() ? never : heap.front().when;
+}
+
+uint64_t EventQueue::instructions_to_next() const
+{
+    uint64_t deadline = next_deadline();
+    uint64_t quantum = never;
+    if (deadline != never)
+    {
+        uint64_t current = now();
+        quantum = deadline > current
+                      ? (deadline - current + ns_per_inst - 1) / ns_per_inst
+                      : 1;
+    }
+    if (realtime) quantum = std::min(quantum, realtime_max_quantum);
+    return std::max<uint64_t>(quantum, 1);
+}
+
+void EventQueue::run_due()
+{
+    if (heap.empty()) return;
+    uint64_t current = now();
+    while (!heap.empty() && heap.front().when <= current)
+    {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        Event event = std::move(heap.back());
+        heap.pop_back();
+        if (cancelled.erase(event.id) != 0) continue;
+        event.callback();
+    }
+}
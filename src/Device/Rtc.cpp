@@ -0,0 +1,11 @@
+#include "Device/Rtc.h"
+
+Rtc::Rtc(EventQueue& events) : events(events), latched_us(0) {}
+
+uint64_t Rtc::read(uint64_t offset, int len)
+{
+    if (offset == 4 || len == 8) latched_us = events.now() / 1000;
+    return offset == 4 ? latched_us >> 32 : latched_us;
+}
+
+void Rtc::write(uint64_t offset, uint64_t data, int len) {}
@@ -0,0 +1,24 @@
+#include "Device/Serial.h"
+
+Serial::Serial(EventQueue& events, std::FILE* out, uint64_t tx_delay)
+    : events(events), out(out), tx_delay(tx_delay), lsr(lsr_thre | lsr_temt)
+{
+}
+
+uint64_t Serial::read(uint64_t offset, int len)
+{
+    if (offset == lsr_offset) return lsr;
+    return 0;
+}
+
+void Serial::write(uint64_t offset, uint64_t data, int len)
+{
+    if (offset != data_offset) return;
+    std::fputc(data & 0xff, out);
+    if ((data & 0xff) == '\n') std::fflush(out);
+    if (lsr & lsr_temt)
+    {
+        lsr = 0;
+        events.schedule_in(tx_delay, [this]() { lsr = lsr_thre | lsr_temt; });
+    }
+}
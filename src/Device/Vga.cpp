@@ -0,0 +1,163 @@
+#include "Device/Vga.h"
+
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <string>
+#include <utility>
+
+namespace
+{
+
+const std::string header = std::format("P6\n{} {}\n255\n", Framebuffer::width,
+                                       Framebuffer::height);
+constexpr size_t rgb_size =
+    size_t(Framebuffer::width) * Framebuffer::height * 3;
+
+}  // namespace
+
+std::unique_ptr<Framebuffer> Framebuffer::open(
+    const std::filesystem::path& sink)
+{
+    std::error_code error;
+    if (std::filesystem::is_directory(sink, error))
+    {
+        spdlog::info("Writing frames to {}", sink.string());
+        return std::unique_ptr<Framebuffer>(new Framebuffer(sink, nullptr));
+    }
+    if (sink.extension() != ".ppm")
+    {
+        spdlog::error("Screen sink {} is neither a directory nor a .ppm file",
+                      sink.string());
+        return nullptr;
+    }
+
+    size_t length = header.size() + rgb_size;
+    int fd = ::open(sink.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    void* mapping = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, length) == 0)
+    {
+        mapping =
+            mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int saved_errno = errno;
+    if (fd >= 0) ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        spdlog::error("Cannot map screen {}: {}", sink.string(),
+                      std::strerror(saved_errno));
+        return nullptr;
+    }
+    spdlog::info("Mapping the screen to {}", sink.string());
+    return std::unique_ptr<Framebuffer>(
+        new Framebuffer({}, static_cast<uint8_t*>(mapping)));
+}
+
+Framebuffer::Framebuffer(std::filesystem::path directory, uint8_t* mapping)
+    : pixels(size),
+      dirty(tile_columns * tile_rows),
+      ppm(mapping),
+      directory(std::move(directory))
+{
+    if (ppm == nullptr)
+    {
+        buffer.resize(header.size() + rgb_size);
+        ppm = buffer.data();
+    }
+    std::memcpy(ppm, header.data(), header.size());
+}
+
+Framebuffer::~Framebuffer()
+{
+    spdlog::info("Screen: {} frames in {} syncs", frames, syncs);
+    if (directory.empty()) munmap(ppm, header.size() + rgb_size);
+}
+
+uint64_t Framebuffer::read(uint64_t offset, int len)
+{
+    if (offset + len > size) return 0;
+    uint64_t value = 0;
+    std::memcpy(&value, &pixels[offset], len);
+    return value;
+}
+
+void Framebuffer::write(uint64_t offset, uint64_t data, int len)
+{
+    if (offset + len > size) return;
+    std::memcpy(&pixels[offset], &data, len);
+    mark(offset, len);
+}
+
+void Framebuffer::mark(uint64_t offset, int len)
+{
+    // An 8-byte store may cover two pixels, possibly in different rows.
+    for (uint64_t pixel : {offset / 4, (offset + len - 1) / 4})
+    {
+        uint32_t x = pixel % width;
+        uint32_t y = pixel / width;
+        uint32_t tile = y / tile_size * tile_columns + x / tile_size;
+        if (!dirty[tile])
+        {
+            dirty[tile] = 1;
+            dirty_list.push_back(tile);
+        }
+    }
+}
+
+void Framebuffer::convert(uint32_t tile)
+{
+    uint32_t x0 = tile % tile_columns * tile_size;
+    uint32_t y0 = tile / tile_columns * tile_size;
+    uint32_t x1 = std::min(x0 + tile_size, width);
+    uint32_t y1 = std::min(y0 + tile_size, height);
+    uint8_t* rgb = ppm + header.size();
+    for (uint32_t y = y0; y < y1; y++)
+    {
+        const uint8_t* in = &pixels[(size_t(y) * width + x0) * 4];
+        uint8_t* out = rgb + (size_t(y) * width + x0) * 3;
+        for (uint32_t x = x0; x < x1; x++, in += 4, out += 3)
+        {
+            out[0] = in[2];
+            out[1] = in[1];
+            out[2] = in[0];
+        }
+    }
+}
+
+void Framebuffer::sync()
+{
+    syncs++;
+    if (dirty_list.empty()) return;
+    for (auto tile : dirty_list)
+    {
+        convert(tile);
+        dirty[tile] = 0;
+    }
+    dirty_list.clear();
+    frames++;
+    if (directory.empty()) return;
+
+    auto path = directory / std::format("frame-{:06}.ppm", syncs);
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(ppm), buffer.size());
+    if (!file) spdlog::error("Cannot write frame {}", path.string());
+}
+
+VgaControl::VgaControl(Framebuffer& framebuffer) : framebuffer(framebuffer) {}
+
+uint64_t VgaControl::read(uint64_t offset, int len)
+{
+    return offset == 0 ? Framebuffer::width << 16 | Framebuffer::height : 0;
+}
+
+void VgaControl::write(uint64_t offset, uint64_t data, int len)
+{
+    if (offset == 4 && data != 0) framebuffer.sync();
+}
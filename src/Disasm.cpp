@@ -1,123 +1,200 @@
-/***************************************************************************************
- * Copyright (c) 2014-2022 Zihao Yu, Nanjing University
- *
- * NEMU is licensed under Mulan PSL v2.
- * You can use this software according to the terms and conditions of the Mulan
- *PSL v2. You may obtain a copy of Mulan PSL v2 at:
- *          http://license.coscl.org.cn/MulanPSL2
- *
- * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
- *KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
- *NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
- *
- * See the Mulan PSL v2 for more details.
- ***************************************************************************************/
-
-#if defined(__GNUC__) && !defined(__clang__)
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
-#endif
-
-#include "llvm/MC/MCAsmInfo.h"
-#include "llvm/MC/MCContext.h"
-#include "llvm/MC/MCDisassembler/MCDisassembler.h"
-#include "llvm/MC/MCInstPrinter.h"
-#if LLVM_VERSION_MAJOR >= 14
-#include "llvm/MC/TargetRegistry.h"
-#if LLVM_VERSION_MAJOR >= 15
-#include "llvm/MC/MCSubtargetInfo.h"
-#endif
-#else
-#include "llvm/Support/TargetRegistry.h"
-#endif
-#include "llvm/Support/TargetSelect.h"
-
-#if defined(__GNUC__) && !defined(__clang__)
-#pragma GCC diagnostic pop
-#endif
-
-#if LLVM_VERSION_MAJOR < 11
-#error Please use LLVM with major version >= 11
-#endif
-
-using namespace llvm;
-
-static llvm::MCDisassembler *gDisassembler = nullptr;
-static llvm::MCSubtargetInfo *gSTI = nullptr;
-static llvm::MCInstPrinter *gIP = nullptr;
-
-void init_disasm(const char *triple)
+#include "Utils/Disasm.h"
+
+#include <algorithm>
+#include <format>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+
+#include "Utils/Utils.h"
+
+namespace
 {
-    llvm::InitializeAllTargetInfos();
-    llvm::InitializeAllTargetMCs();
-    llvm::InitializeAllAsmParsers();
-    llvm::InitializeAllDisassemblers();
-
-    std::string errstr;
-    std::string gTriple(triple);
-
-    llvm::MCInstrInfo *gMII = nullptr;
-    llvm::MCRegisterInfo *gMRI = nullptr;
-    auto target = llvm::TargetRegistry::lookupTarget(gTriple, errstr);
-    if (!target)
+
+// c.j, c.jal (RV32 only, it is c.addiw on RV64), c.beqz and c.bnez.
+bool compressed_pc_relative_offset(uint32_t inst, bool rv64, int64_t& offset)
+{
+    if (extract_bits(inst, 0, 1) != 0b01) return false;
+    switch (extract_bits(inst, 13, 15))
     {
-        llvm::errs() << "Can't find target for " << gTriple << ": " << errstr
-                     << "\n";
-        assert(0);
+        case 0b001:
+            if (rv64) return false;
+            [[fallthrough]];
+        case 0b101:
+            offset = static_cast<int32_t>(
+                sign_extend((extract_bits(inst, 12, 12) << 11) |
+                                (extract_bits(inst, 11, 11) << 4) |
+                                (extract_bits(inst, 9, 10) << 8) |
+                                (extract_bits(inst, 8, 8) << 10) |
+                                (extract_bits(inst, 7, 7) << 6) |
+                                (extract_bits(inst, 6, 6) << 7) |
+                                (extract_bits(inst, 3, 5) << 1) |
+                                (extract_bits(inst, 2, 2) << 5),
+                            12));
+            return true;
+        case 0b110:
+        case 0b111:
+            offset = static_cast<int32_t>(
+                sign_extend((extract_bits(inst, 12, 12) << 8) |
+                                (extract_bits(inst, 10, 11) << 3) |
+                                (extract_bits(inst, 5, 6) << 6) |
+                                (extract_bits(inst, 3, 4) << 1) |
+                                (extract_bits(inst, 2, 2) << 5),
+                            9));
+            return true;
+        default:
+            return false;
     }
+}
 
-    MCTargetOptions MCOptions;
-    gSTI = target->createMCSubtargetInfo(gTriple, "", "");
-    std::string isa = target->getName();
-    if (isa == "riscv32" || isa == "riscv64")
+// Branches and jal print an absolute target, so their text depends on pc.
+bool pc_relative_offset(uint32_t inst, int nbyte, bool rv64, int64_t& offset)
+{
+    if (nbyte == 2) return compressed_pc_relative_offset(inst, rv64, offset);
+    if (nbyte != 4) return false;
+    switch (extract_bits(inst, 0, 6))
     {
-        gSTI->ApplyFeatureFlag("+m");
-        gSTI->ApplyFeatureFlag("+a");
-        gSTI->ApplyFeatureFlag("+c");
-        gSTI->ApplyFeatureFlag("+f");
-        gSTI->ApplyFeatureFlag("+d");
+        case 0b1100011:  // BRANCH, funct3 010 and 011 are not branches
+            if ((extract_bits(inst, 13, 14)) == 0b01) return false;
+            offset = static_cast<int32_t>(
+                sign_extend((extract_bits(inst, 31, 31) << 12) |
+                                (extract_bits(inst, 7, 7) << 11) |
+                                (extract_bits(inst, 25, 30) << 5) |
+                                (extract_bits(inst, 8, 11) << 1),
+                            13));
+            return true;
+        case 0b1101111:  // JAL
+            offset = static_cast<int32_t>(
+                sign_extend((extract_bits(inst, 31, 31) << 20) |
+                                (extract_bits(inst, 21, 30) << 1) |
+                                (extract_bits(inst, 20, 20) << 11) |
+                                (extract_bits(inst, 12, 19) << 12),
+                            21));
+            return true;
+        default:
+            return false;
     }
-    gMII = target->createMCInstrInfo();
-    gMRI = target->createMCRegInfo(gTriple);
-    auto AsmInfo = target->createMCAsmInfo(*gMRI, gTriple, MCOptions);
-#if LLVM_VERSION_MAJOR >= 13
-    auto llvmTripleTwine = Twine(triple);
-    auto llvmtriple = llvm::Triple(llvmTripleTwine);
-    auto Ctx = new llvm::MCContext(llvmtriple, AsmInfo, gMRI, nullptr);
-#else
-    auto Ctx = new llvm::MCContext(AsmInfo, gMRI, nullptr);
-#endif
-    gDisassembler = target->createMCDisassembler(*gSTI, *Ctx);
-    gIP = target->createMCInstPrinter(llvm::Triple(gTriple),
-                                      AsmInfo->getAssemblerDialect(), *AsmInfo,
-                                      *gMII, *gMRI);
-    gIP->setPrintImmHex(true);
-    gIP->setPrintBranchImmAsAddress(true);
-    if (isa == "riscv32" || isa == "riscv64")
-        gIP->applyTargetSpecificCLOption("no-aliases");
 }
 
-std::string disassemble(uint64_t pc, uint8_t *code, int nbyte)
+}  // namespace
+
+Disassembler::Disassembler(std::string_view triple) : triple(triple) {}
+
+Disassembler::~Disassembler() {}
+
+std::string Disassembler::Backend::raw_word(const uint8_t* code, int nbyte)
+{
+    uint32_t inst = 0;
+    for (int i = nbyte - 1; i >= 0; i--) inst = (inst << 8) | code[i];
+    return std::format("\t.insn\t{}, 0x{:0{}x}", nbyte, inst, nbyte * 2);
+}
+
+int Disassembler::instruction_length(const uint8_t* code)
+{
+    return (code[0] & 0b11) == 0b11 ? 4 : 2;
+}
+
+Disassembler::CacheEntry Disassembler::render(uint32_t inst,
+                                              const uint8_t* code, int nbyte,
+                                              bool pc_relative, int64_t offset)
 {
-    std::string ret;
-    raw_string_ostream os(ret);
-    os << format_hex(pc, 2) << ":";
+    std::call_once(backend_init,
+                   [this]() { backend = create_backend(triple); });
+
+    std::string text;
+    {
+        std::lock_guard lock(backend_mutex);
+        text = backend->print(0, code, nbyte);
+    }
+    if (pc_relative)
+    {
+        auto pos = text.find_last_of(" \t");
+        if (pos != std::string::npos) text.resize(pos + 1);
+    }
+    return CacheEntry{std::move(text), offset};
+}
+
+std::string Disassembler::instruction_text(uint64_t pc, const uint8_t* code,
+                                           int nbyte)
+{
+    uint32_t inst = 0;
+    for (int i = std::min(nbyte, 4) - 1; i >= 0; i--)
+        inst = (inst << 8) | code[i];
+
+    int64_t offset = 0;
+    bool pc_relative = pc_relative_offset(
+        inst, nbyte, triple.starts_with("riscv64"), offset);
+    CacheKey key{inst, pc_relative};
+
+    const CacheEntry* entry = nullptr;
+    {
+        std::shared_lock lock(cache_mutex);
+        auto it = cache.find(key);
+        if (it != cache.end()) entry = &it->second;
+    }
+    if (entry == nullptr)
+    {
+        auto rendered = render(inst, code, nbyte, pc_relative, offset);
+        std::unique_lock lock(cache_mutex);
+        entry = &cache.try_emplace(key, std::move(rendered)).first->second;
+    }
+
+    if (!pc_relative) return entry->text;
+    uint64_t target = pc + entry->offset;
+    if (!triple.starts_with("riscv64")) target &= 0xffffffff;
+    return std::format("{}0x{:x}", entry->text, target);
+}
+
+std::string Disassembler::disassemble(uint64_t pc, const uint8_t* code,
+                                      int nbyte)
+{
+    std::string ret = std::format("0x{:x}:", pc);
     for (int i = nbyte - 1; i >= 0; i--)
     {
-        os << format(" %02x", code[i]);
+        ret += std::format(" {:02x}", code[i]);
     }
     int ilen_max = 4;
     int space_len = ilen_max - nbyte;
     if (space_len < 0) space_len = 0;
     space_len = space_len * 3 + 1;
-    os << std::string(space_len, ' ');
-
-    MCInst inst;
-    llvm::ArrayRef<uint8_t> arr(code, nbyte);
-    uint64_t dummy_size = 0;
-    gDisassembler->getInstruction(inst, dummy_size, arr, pc, llvm::nulls());
+    ret += std::string(space_len, ' ');
+    ret += instruction_text(pc, code, nbyte);
+    return ret;
+}
 
-    gIP->printInst(&inst, pc, "", *gSTI, os);
+std::vector<std::string> Disassembler::disassemble_range(
+    uint64_t pc, std::span<const uint8_t> code, const SymbolTable* symbols)
+{
+    std::vector<std::string> lines;
+    lines.reserve(code.size() / 4);
+    SymbolTable::const_iterator sym;
+    if (symbols != nullptr)
+    {
+        sym = std::lower_bound(symbols->begin(), symbols->end(), pc,
+                               [](const SymbolInfo& sym, uint64_t addr)
+                               { return sym.addr < addr; });
+    }
+    for (size_t off = 0; off + 2 <= code.size();)
+    {
+        uint64_t addr = pc + off;
+        int nbyte = instruction_length(code.data() + off);
+        if (off + nbyte > code.size()) break;
+        if (symbols != nullptr)
+        {
+            for (; sym != symbols->end() && sym->addr < addr + nbyte; ++sym)
+            {
+                if (!lines.empty()) lines.emplace_back();
+                lines.push_back(std::format("<{}>:", sym->name));
+            }
+        }
+        lines.push_back(disassemble(addr, code.data() + off, nbyte));
+        off += nbyte;
+    }
+    return lines;
+}
 
-    return os.str();
+size_t Disassembler::cache_size()
+{
+    std::shared_lock lock(cache_mutex);
+    return cache.size();
 }
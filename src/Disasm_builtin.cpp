@@ -0,0 +1,746 @@
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "Utils/Disasm.h"
+#include "Utils/Utils.h"
+
+// Lightweight RISC-V disassembler used when the tree is built without LLVM.
+// It decodes RV32I/RV64I with M, Zicsr, F, D and C, following the triple,
+// and prints them the way the LLVM printer configured in Disasm_llvm.cpp
+// does: no aliases, decimal immediates (the RISC-V printer ignores the hex
+// option), branch targets as absolute addresses and the rounding mode of
+// every F/D instruction that has one, dyn included. CSRs the emulator does
+// not implement are printed as numbers. V and any other instruction it
+// cannot decode are printed as a raw ".insn" directive rather than guessed
+// at.
+
+namespace
+{
+
+constexpr std::string_view reg_name[32] = {
+    "zero", "ra", "sp", "gp", "tp",  "t0",  "t1", "t2", "s0", "s1", "a0",
+    "a1",   "a2", "a3", "a4", "a5",  "a6",  "a7", "s2", "s3", "s4", "s5",
+    "s6",   "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
+
+constexpr std::string_view freg_name[32] = {
+    "ft0", "ft1", "ft2",  "ft3",  "ft4", "ft5", "ft6",  "ft7",
+    "fs0", "fs1", "fa0",  "fa1",  "fa2", "fa3", "fa4",  "fa5",
+    "fa6", "fa7", "fs2",  "fs3",  "fs4", "fs5", "fs6",  "fs7",
+    "fs8", "fs9", "fs10", "fs11", "ft8", "ft9", "ft10", "ft11"};
+
+std::string_view csr_name(uint32_t csr, bool rv64)
+{
+    switch (csr)
+    {
+        case 0x001:
+            return "fflags";
+        case 0x002:
+            return "frm";
+        case 0x003:
+            return "fcsr";
+        case 0x008:
+            return "vstart";
+        case 0x009:
+            return "vxsat";
+        case 0x00a:
+            return "vxrm";
+        case 0x00f:
+            return "vcsr";
+        case 0x300:
+            return "mstatus";
+        case 0x301:
+            return "misa";
+        case 0x304:
+            return "mie";
+        case 0x305:
+            return "mtvec";
+        case 0x340:
+            return "mscratch";
+        case 0x341:
+            return "mepc";
+        case 0x342:
+            return "mcause";
+        case 0x343:
+            return "mtval";
+        case 0x344:
+            return "mip";
+        case 0xb00:
+            return "mcycle";
+        case 0xb02:
+            return "minstret";
+        case 0xc00:
+            return "cycle";
+        case 0xc01:
+            return "time";
+        case 0xc02:
+            return "instret";
+        case 0xc20:
+            return "vl";
+        case 0xc21:
+            return "vtype";
+        case 0xc22:
+            return "vlenb";
+        case 0xf11:
+            return "mvendorid";
+        case 0xf12:
+            return "marchid";
+        case 0xf13:
+            return "mimpid";
+        case 0xf14:
+            return "mhartid";
+    }
+    // The upper halves of the counters only exist on RV32.
+    if (rv64) return {};
+    switch (csr)
+    {
+        case 0xb80:
+            return "mcycleh";
+        case 0xb82:
+            return "minstreth";
+        case 0xc80:
+            return "cycleh";
+        case 0xc81:
+            return "timeh";
+        case 0xc82:
+            return "instreth";
+        default:
+            return {};
+    }
+}
+
+std::string csr_operand(uint32_t csr, bool rv64)
+{
+    auto name = csr_name(csr, rv64);
+    if (!name.empty()) return std::string(name);
+    return std::format("{}", csr);
+}
+
+// Empty for the reserved modes 5 and 6.
+std::string_view rounding_mode(uint32_t rm)
+{
+    constexpr std::string_view names[8] = {"rne", "rtz", "rdn", "rup",
+                                           "rmm", "",    "",    "dyn"};
+    return names[rm];
+}
+
+std::string fence_set(uint32_t bits)
+{
+    std::string ret;
+    if (bits & 0b1000) ret += 'i';
+    if (bits & 0b0100) ret += 'o';
+    if (bits & 0b0010) ret += 'r';
+    if (bits & 0b0001) ret += 'w';
+    return ret.empty() ? "unknown" : ret;
+}
+
+class BuiltinBackend : public Disassembler::Backend
+{
+   public:
+    explicit BuiltinBackend(bool rv64) : rv64(rv64) {}
+
+    std::string print(uint64_t pc, const uint8_t *code, int nbyte) override
+    {
+        uint32_t inst = 0;
+        for (int i = nbyte - 1; i >= 0; i--)
+        {
+            inst = (inst << 8) | code[i];
+        }
+        auto text = nbyte == 2 ? compressed(pc, inst) : standard(pc, inst);
+        return text.empty() ? raw_word(code, nbyte) : text;
+    }
+
+   private:
+    bool rv64;
+
+    std::string target(uint64_t pc, int64_t offset) const
+    {
+        uint64_t addr = pc + offset;
+        if (!rv64) addr &= 0xffffffff;
+        return std::format("0x{:x}", addr);
+    }
+
+    // Returns an empty string for instructions it cannot decode.
+    std::string standard(uint64_t pc, uint32_t inst) const;
+    std::string compressed(uint64_t pc, uint32_t inst) const;
+    // The F and D computational instructions (OP-FP and the fused
+    // multiply-adds).
+    std::string floating_point(uint32_t inst) const;
+};
+
+std::string BuiltinBackend::standard(uint64_t pc, uint32_t inst) const
+{
+    uint32_t opcode = extract_bits(inst, 0, 6);
+    uint32_t rd = extract_bits(inst, 7, 11);
+    uint32_t funct3 = extract_bits(inst, 12, 14);
+    uint32_t rs1 = extract_bits(inst, 15, 19);
+    uint32_t rs2 = extract_bits(inst, 20, 24);
+    uint32_t funct7 = extract_bits(inst, 25, 31);
+
+    int32_t imm_i = sign_extend(extract_bits(inst, 20, 31), 12);
+    int32_t imm_s = sign_extend(
+        (extract_bits(inst, 25, 31) << 5) | extract_bits(inst, 7, 11), 12);
+    int32_t imm_b = sign_extend((extract_bits(inst, 31, 31) << 12) |
+                                    (extract_bits(inst, 7, 7) << 11) |
+                                    (extract_bits(inst, 25, 30) << 5) |
+                                    (extract_bits(inst, 8, 11) << 1),
+                                13);
+    int32_t imm_j = sign_extend((extract_bits(inst, 31, 31) << 20) |
+                                    (extract_bits(inst, 21, 30) << 1) |
+                                    (extract_bits(inst, 20, 20) << 11) |
+                                    (extract_bits(inst, 12, 19) << 12),
+                                21);
+    uint32_t imm_u = extract_bits(inst, 12, 31);
+    uint32_t shamt = extract_bits(inst, 20, 25);
+
+    auto rd_s = reg_name[rd];
+    auto rs1_s = reg_name[rs1];
+    auto rs2_s = reg_name[rs2];
+
+    switch (opcode)
+    {
+        case 0b0110111:
+            return std::format("\tlui\t{}, {}", rd_s, imm_u);
+        case 0b0010111:
+            return std::format("\tauipc\t{}, {}", rd_s, imm_u);
+        case 0b1101111:
+            return std::format("\tjal\t{}, {}", rd_s, target(pc, imm_j));
+        case 0b1100111:
+            if (funct3 != 0) break;
+            return std::format("\tjalr\t{}, {}({})", rd_s, imm_i, rs1_s);
+        case 0b1100011:
+        {
+            constexpr std::string_view names[8] = {
+                "beq", "bne", "", "", "blt", "bge", "bltu", "bgeu"};
+            if (names[funct3].empty()) break;
+            return std::format("\t{}\t{}, {}, {}", names[funct3], rs1_s,
+                               rs2_s, target(pc, imm_b));
+        }
+        case 0b0000011:
+        {
+            constexpr std::string_view names[8] = {"lb",  "lh",  "lw",  "ld",
+                                                   "lbu", "lhu", "lwu", ""};
+            // ld and lwu are RV64 only.
+            bool wide = funct3 == 0b011 || funct3 == 0b110;
+            if (names[funct3].empty() || (wide && !rv64)) break;
+            return std::format("\t{}\t{}, {}({})", names[funct3], rd_s,
+                               imm_i, rs1_s);
+        }
+        case 0b0100011:
+        {
+            constexpr std::string_view names[8] = {"sb", "sh", "sw", "sd",
+                                                   "",   "",   "",   ""};
+            if (names[funct3].empty() || (!rv64 && funct3 == 0b011)) break;
+            return std::format("\t{}\t{}, {}({})", names[funct3], rs2_s,
+                               imm_s, rs1_s);
+        }
+        case 0b0000111:
+            // The other widths are vector loads.
+            if (funct3 == 0b010)
+                return std::format("\tflw\t{}, {}({})", freg_name[rd], imm_i,
+                                   rs1_s);
+            if (funct3 == 0b011)
+                return std::format("\tfld\t{}, {}({})", freg_name[rd], imm_i,
+                                   rs1_s);
+            break;
+        case 0b0100111:
+            if (funct3 == 0b010)
+                return std::format("\tfsw\t{}, {}({})", freg_name[rs2],
+                                   imm_s, rs1_s);
+            if (funct3 == 0b011)
+                return std::format("\tfsd\t{}, {}({})", freg_name[rs2],
+                                   imm_s, rs1_s);
+            break;
+        case 0b1000011:
+        case 0b1000111:
+        case 0b1001011:
+        case 0b1001111:
+        case 0b1010011:
+            return floating_point(inst);
+        case 0b0010011:
+        {
+            constexpr std::string_view names[8] = {
+                "addi", "slli", "slti", "sltiu", "xori", "srli", "ori", "andi"};
+            if (funct3 == 0b001 || funct3 == 0b101)
+            {
+                auto name = names[funct3];
+                uint32_t funct6 = funct7 >> 1;
+                if (funct3 == 0b101 && funct6 == 0b010000)
+                    name = "srai";
+                else if (funct6 != 0)
+                    break;
+                return std::format("\t{}\t{}, {}, {}", name, rd_s, rs1_s,
+                                   shamt);
+            }
+            return std::format("\t{}\t{}, {}, {}", names[funct3], rd_s, rs1_s,
+                               imm_i);
+        }
+        case 0b0110011:
+        {
+            constexpr std::string_view base[8] = {"add", "sll", "slt", "sltu",
+                                                  "xor", "srl", "or",  "and"};
+            constexpr std::string_view mext[8] = {
+                "mul", "mulh", "mulhsu", "mulhu", "div", "divu", "rem", "remu"};
+            std::string_view name;
+            if (funct7 == 0b0000000)
+                name = base[funct3];
+            else if (funct7 == 0b0000001)
+                name = mext[funct3];
+            else if (funct7 == 0b0100000 && funct3 == 0b000)
+                name = "sub";
+            else if (funct7 == 0b0100000 && funct3 == 0b101)
+                name = "sra";
+            else
+                break;
+            return std::format("\t{}\t{}, {}, {}", name, rd_s, rs1_s, rs2_s);
+        }
+        case 0b0011011:
+        {
+            if (!rv64) break;
+            if (funct3 == 0b000)
+                return std::format("\taddiw\t{}, {}, {}", rd_s, rs1_s, imm_i);
+            std::string_view name;
+            if (funct3 == 0b001 && funct7 == 0b0000000)
+                name = "slliw";
+            else if (funct3 == 0b101 && funct7 == 0b0000000)
+                name = "srliw";
+            else if (funct3 == 0b101 && funct7 == 0b0100000)
+                name = "sraiw";
+            else
+                break;
+            return std::format("\t{}\t{}, {}, {}", name, rd_s, rs1_s, rs2);
+        }
+        case 0b0111011:
+        {
+            if (!rv64) break;
+            constexpr std::string_view base[8] = {"addw", "sllw", "", "",
+                                                  "",     "srlw", "", ""};
+            constexpr std::string_view mext[8] = {
+                "mulw", "", "", "", "divw", "divuw", "remw", "remuw"};
+            std::string_view name;
+            if (funct7 == 0b0000000)
+                name = base[funct3];
+            else if (funct7 == 0b0000001)
+                name = mext[funct3];
+            else if (funct7 == 0b0100000 && funct3 == 0b000)
+                name = "subw";
+            else if (funct7 == 0b0100000 && funct3 == 0b101)
+                name = "sraw";
+            if (name.empty()) break;
+            return std::format("\t{}\t{}, {}, {}", name, rd_s, rs1_s, rs2_s);
+        }
+        case 0b0101111:
+        {
+            // funct7 is funct5, aq and rl.
+            constexpr std::string_view names[32] = {
+                "amoadd",  "amoswap", "lr", "sc", "amoxor",  "", "", "",
+                "amoor",   "",        "",   "",   "amoand",  "", "", "",
+                "amomin",  "",        "",   "",   "amomax",  "", "", "",
+                "amominu", "",        "",   "",   "amomaxu", "", "", ""};
+            auto name = names[funct7 >> 2];
+            if (name.empty() || (funct3 != 0b010 && funct3 != 0b011) ||
+                (funct3 == 0b011 && !rv64) || (name == "lr" && rs2 != 0))
+                break;
+            constexpr std::string_view order[4] = {"", ".rl", ".aq", ".aqrl"};
+            auto mnemonic = std::format("{}.{}{}", name,
+                                        funct3 == 0b010 ? "w" : "d",
+                                        order[funct7 & 0b11]);
+            if (name == "lr")
+                return std::format("\t{}\t{}, ({})", mnemonic, rd_s, rs1_s);
+            return std::format("\t{}\t{}, {}, ({})", mnemonic, rd_s, rs2_s,
+                               rs1_s);
+        }
+        case 0b0001111:
+            // rd, rs1 and, but for fence.tso, fm are reserved and zero.
+            if (rd != 0 || rs1 != 0) break;
+            if (funct3 == 0b001)
+                return imm_i == 0 ? "\tfence.i\t" : std::string();
+            if (funct3 != 0b000) break;
+            if (extract_bits(inst, 20, 31) == 0x833) return "\tfence.tso\t";
+            if (extract_bits(inst, 28, 31) != 0) break;
+            return std::format("\tfence\t{}, {}",
+                               fence_set(extract_bits(inst, 24, 27)),
+                               fence_set(extract_bits(inst, 20, 23)));
+        case 0b1110011:
+        {
+            uint32_t csr = extract_bits(inst, 20, 31);
+            auto csr_s = csr_operand(csr, rv64);
+            switch (funct3)
+            {
+                case 0b000:
+                    if (inst == 0x00000073) return "\tecall\t";
+                    if (inst == 0x00100073) return "\tebreak\t";
+                    if (inst == 0x30200073) return "\tmret\t";
+                    if (inst == 0x10500073) return "\twfi\t";
+                    break;
+                case 0b001:
+                    return std::format("\tcsrrw\t{}, {}, {}", rd_s, csr_s,
+                                       rs1_s);
+                case 0b010:
+                    return std::format("\tcsrrs\t{}, {}, {}", rd_s, csr_s,
+                                       rs1_s);
+                case 0b011:
+                    return std::format("\tcsrrc\t{}, {}, {}", rd_s, csr_s,
+                                       rs1_s);
+                case 0b101:
+                    return std::format("\tcsrrwi\t{}, {}, {}", rd_s, csr_s,
+                                       rs1);
+                case 0b110:
+                    return std::format("\tcsrrsi\t{}, {}, {}", rd_s, csr_s,
+                                       rs1);
+                case 0b111:
+                    return std::format("\tcsrrci\t{}, {}, {}", rd_s, csr_s,
+                                       rs1);
+            }
+            break;
+        }
+    }
+    return {};
+}
+
+std::string BuiltinBackend::floating_point(uint32_t inst) const
+{
+    uint32_t opcode = extract_bits(inst, 0, 6);
+    uint32_t rd = extract_bits(inst, 7, 11);
+    uint32_t rm = extract_bits(inst, 12, 14);
+    uint32_t rs1 = extract_bits(inst, 15, 19);
+    uint32_t rs2 = extract_bits(inst, 20, 24);
+    uint32_t fmt = extract_bits(inst, 25, 26);
+    uint32_t funct5 = extract_bits(inst, 27, 31);
+    auto round = rounding_mode(rm);
+    // Single or double precision; other formats are not implemented.
+    if (fmt > 1 || round.empty()) return {};
+    std::string_view suffix = fmt == 0 ? "s" : "d";
+
+    if (opcode != 0b1010011)
+    {
+        constexpr std::string_view names[4] = {"fmadd", "fmsub", "fnmsub",
+                                               "fnmadd"};
+        return std::format("\t{}.{}\t{}, {}, {}, {}, {}",
+                           names[extract_bits(inst, 2, 3)], suffix,
+                           freg_name[rd], freg_name[rs1], freg_name[rs2],
+                           freg_name[funct5], round);
+    }
+
+    // Integer width of a conversion, by rs2 (or, for fmv, by fmt).
+    constexpr std::string_view int_names[4] = {"w", "wu", "l", "lu"};
+    bool wide_int = rs2 >= 2;
+    switch (funct5)
+    {
+        case 0b00000:
+        case 0b00001:
+        case 0b00010:
+        case 0b00011:
+        {
+            constexpr std::string_view names[4] = {"fadd", "fsub", "fmul",
+                                                   "fdiv"};
+            return std::format("\t{}.{}\t{}, {}, {}, {}", names[funct5],
+                               suffix, freg_name[rd], freg_name[rs1],
+                               freg_name[rs2], round);
+        }
+        case 0b01011:
+            if (rs2 != 0) break;
+            return std::format("\tfsqrt.{}\t{}, {}, {}", suffix, freg_name[rd],
+                               freg_name[rs1], round);
+        case 0b00100:
+        case 0b00101:
+        {
+            constexpr std::string_view names[2][3] = {
+                {"fsgnj", "fsgnjn", "fsgnjx"}, {"fmin", "fmax", ""}};
+            if (rm > 2 || names[funct5 & 1][rm].empty()) break;
+            return std::format("\t{}.{}\t{}, {}, {}", names[funct5 & 1][rm],
+                               suffix, freg_name[rd], freg_name[rs1],
+                               freg_name[rs2]);
+        }
+        case 0b01000:
+            // fcvt.s.d rounds, fcvt.d.s is exact and takes no mode.
+            if (fmt == 0 && rs2 == 1)
+                return std::format("\tfcvt.s.d\t{}, {}, {}", freg_name[rd],
+                                   freg_name[rs1], round);
+            if (fmt == 1 && rs2 == 0 && rm == 0)
+                return std::format("\tfcvt.d.s\t{}, {}", freg_name[rd],
+                                   freg_name[rs1]);
+            break;
+        case 0b10100:
+        {
+            constexpr std::string_view names[3] = {"fle", "flt", "feq"};
+            if (rm > 2) break;
+            return std::format("\t{}.{}\t{}, {}, {}", names[rm], suffix,
+                               reg_name[rd], freg_name[rs1], freg_name[rs2]);
+        }
+        case 0b11000:
+            if (rs2 > 3 || (wide_int && !rv64)) break;
+            return std::format("\tfcvt.{}.{}\t{}, {}, {}", int_names[rs2],
+                               suffix, reg_name[rd], freg_name[rs1], round);
+        case 0b11010:
+            if (rs2 > 3 || (wide_int && !rv64)) break;
+            // Every 32-bit integer is exact as a double.
+            if (fmt == 1 && !wide_int)
+            {
+                if (rm != 0) break;
+                return std::format("\tfcvt.d.{}\t{}, {}", int_names[rs2],
+                                   freg_name[rd], reg_name[rs1]);
+            }
+            return std::format("\tfcvt.{}.{}\t{}, {}, {}", suffix,
+                               int_names[rs2], freg_name[rd], reg_name[rs1],
+                               round);
+        case 0b11100:
+            if (rs2 != 0) break;
+            if (rm == 0b001)
+                return std::format("\tfclass.{}\t{}, {}", suffix, reg_name[rd],
+                                   freg_name[rs1]);
+            if (rm != 0b000 || (fmt == 1 && !rv64)) break;
+            return std::format("\tfmv.x.{}\t{}, {}", fmt == 0 ? "w" : "d",
+                               reg_name[rd], freg_name[rs1]);
+        case 0b11110:
+            if (rs2 != 0 || rm != 0 || (fmt == 1 && !rv64)) break;
+            return std::format("\tfmv.{}.x\t{}, {}", fmt == 0 ? "w" : "d",
+                               freg_name[rd], reg_name[rs1]);
+    }
+    return {};
+}
+
+std::string BuiltinBackend::compressed(uint64_t pc, uint32_t inst) const
+{
+    uint32_t funct3 = extract_bits(inst, 13, 15);
+    uint32_t rd = extract_bits(inst, 7, 11);
+    uint32_t rs2 = extract_bits(inst, 2, 6);
+    // The 3-bit register fields name x8..x15 (f8..f15).
+    uint32_t rd_c = 8 + extract_bits(inst, 2, 4);
+    uint32_t rs1_c = 8 + extract_bits(inst, 7, 9);
+    int32_t imm6 = sign_extend(
+        (extract_bits(inst, 12, 12) << 5) | extract_bits(inst, 2, 6), 6);
+    uint32_t shamt =
+        (extract_bits(inst, 12, 12) << 5) | extract_bits(inst, 2, 6);
+    // Offsets of the word and doubleword forms.
+    uint32_t uimm_w = (extract_bits(inst, 10, 12) << 3) |
+                      (extract_bits(inst, 6, 6) << 2) |
+                      (extract_bits(inst, 5, 5) << 6);
+    uint32_t uimm_d =
+        (extract_bits(inst, 10, 12) << 3) | (extract_bits(inst, 5, 6) << 6);
+    uint32_t uimm_lwsp = (extract_bits(inst, 12, 12) << 5) |
+                         (extract_bits(inst, 4, 6) << 2) |
+                         (extract_bits(inst, 2, 3) << 6);
+    uint32_t uimm_ldsp = (extract_bits(inst, 12, 12) << 5) |
+                         (extract_bits(inst, 5, 6) << 3) |
+                         (extract_bits(inst, 2, 4) << 6);
+    uint32_t uimm_swsp =
+        (extract_bits(inst, 9, 12) << 2) | (extract_bits(inst, 7, 8) << 6);
+    uint32_t uimm_sdsp =
+        (extract_bits(inst, 10, 12) << 3) | (extract_bits(inst, 7, 9) << 6);
+
+    auto mem = [](std::string_view name, std::string_view reg, uint32_t imm,
+                  std::string_view base)
+    { return std::format("\t{}\t{}, {}({})", name, reg, imm, base); };
+
+    switch (extract_bits(inst, 0, 1))
+    {
+        case 0b00:
+            switch (funct3)
+            {
+                case 0b000:
+                {
+                    uint32_t nzuimm = (extract_bits(inst, 11, 12) << 4) |
+                                      (extract_bits(inst, 7, 10) << 6) |
+                                      (extract_bits(inst, 6, 6) << 2) |
+                                      (extract_bits(inst, 5, 5) << 3);
+                    if (inst == 0) return "\tc.unimp\t";
+                    if (nzuimm == 0) break;
+                    return std::format("\tc.addi4spn\t{}, sp, {}",
+                                       reg_name[rd_c], nzuimm);
+                }
+                case 0b001:
+                    return mem("c.fld", freg_name[rd_c], uimm_d,
+                               reg_name[rs1_c]);
+                case 0b010:
+                    return mem("c.lw", reg_name[rd_c], uimm_w,
+                               reg_name[rs1_c]);
+                case 0b011:
+                    if (rv64)
+                        return mem("c.ld", reg_name[rd_c], uimm_d,
+                                   reg_name[rs1_c]);
+                    return mem("c.flw", freg_name[rd_c], uimm_w,
+                               reg_name[rs1_c]);
+                case 0b101:
+                    return mem("c.fsd", freg_name[rd_c], uimm_d,
+                               reg_name[rs1_c]);
+                case 0b110:
+                    return mem("c.sw", reg_name[rd_c], uimm_w,
+                               reg_name[rs1_c]);
+                case 0b111:
+                    if (rv64)
+                        return mem("c.sd", reg_name[rd_c], uimm_d,
+                                   reg_name[rs1_c]);
+                    return mem("c.fsw", freg_name[rd_c], uimm_w,
+                               reg_name[rs1_c]);
+            }
+            break;
+        case 0b01:
+            switch (funct3)
+            {
+                case 0b000:
+                    if (rd == 0 && imm6 == 0) return "\tc.nop\t";
+                    if (rd == 0) return std::format("\tc.nop\t{}", imm6);
+                    return std::format("\tc.addi\t{}, {}", reg_name[rd], imm6);
+                case 0b001:
+                    if (rv64)
+                    {
+                        if (rd == 0) break;
+                        return std::format("\tc.addiw\t{}, {}", reg_name[rd],
+                                           imm6);
+                    }
+                    [[fallthrough]];
+                case 0b101:
+                {
+                    int32_t offset = sign_extend(
+                        (extract_bits(inst, 12, 12) << 11) |
+                            (extract_bits(inst, 11, 11) << 4) |
+                            (extract_bits(inst, 9, 10) << 8) |
+                            (extract_bits(inst, 8, 8) << 10) |
+                            (extract_bits(inst, 7, 7) << 6) |
+                            (extract_bits(inst, 6, 6) << 7) |
+                            (extract_bits(inst, 3, 5) << 1) |
+                            (extract_bits(inst, 2, 2) << 5),
+                        12);
+                    return std::format("\t{}\t{}",
+                                       funct3 == 0b001 ? "c.jal" : "c.j",
+                                       target(pc, offset));
+                }
+                case 0b010:
+                    return std::format("\tc.li\t{}, {}", reg_name[rd], imm6);
+                case 0b011:
+                    if (rd == 2)
+                    {
+                        int32_t nzimm = sign_extend(
+                            (extract_bits(inst, 12, 12) << 9) |
+                                (extract_bits(inst, 6, 6) << 4) |
+                                (extract_bits(inst, 5, 5) << 6) |
+                                (extract_bits(inst, 3, 4) << 7) |
+                                (extract_bits(inst, 2, 2) << 5),
+                            10);
+                        if (nzimm == 0) break;
+                        return std::format("\tc.addi16sp\tsp, {}", nzimm);
+                    }
+                    // With rd = x0 (a hint) the immediate prints signed.
+                    if (rd == 0)
+                        return std::format("\tc.lui\tzero, {}", imm6);
+                    return std::format("\tc.lui\t{}, {}", reg_name[rd],
+                                       uint32_t(imm6) & 0xfffff);
+                case 0b100:
+                    switch (extract_bits(inst, 10, 11))
+                    {
+                        case 0b00:
+                        case 0b01:
+                        {
+                            auto name = extract_bits(inst, 10, 11) ? "c.srai"
+                                                                   : "c.srli";
+                            // A zero shift amount is the 128-bit form.
+                            if (shamt == 0)
+                                return std::format("\t{}64\t{}", name,
+                                                   reg_name[rs1_c]);
+                            return std::format("\t{}\t{}, {}", name,
+                                               reg_name[rs1_c], shamt);
+                        }
+                        case 0b10:
+                            return std::format("\tc.andi\t{}, {}",
+                                               reg_name[rs1_c], imm6);
+                        case 0b11:
+                        {
+                            constexpr std::string_view names[8] = {
+                                "c.sub",  "c.xor", "c.or", "c.and",
+                                "c.subw", "c.addw", "",    ""};
+                            uint32_t op = (extract_bits(inst, 12, 12) << 2) |
+                                          extract_bits(inst, 5, 6);
+                            if (names[op].empty() || (!rv64 && op >= 4))
+                                break;
+                            return std::format("\t{}\t{}, {}", names[op],
+                                               reg_name[rs1_c],
+                                               reg_name[rd_c]);
+                        }
+                    }
+                    break;
+                case 0b110:
+                case 0b111:
+                {
+                    int32_t offset = sign_extend(
+                        (extract_bits(inst, 12, 12) << 8) |
+                            (extract_bits(inst, 10, 11) << 3) |
+                            (extract_bits(inst, 5, 6) << 6) |
+                            (extract_bits(inst, 3, 4) << 1) |
+                            (extract_bits(inst, 2, 2) << 5),
+                        9);
+                    return std::format("\t{}\t{}, {}",
+                                       funct3 == 0b110 ? "c.beqz" : "c.bnez",
+                                       reg_name[rs1_c], target(pc, offset));
+                }
+            }
+            break;
+        case 0b10:
+            switch (funct3)
+            {
+                case 0b000:
+                    if (shamt == 0)
+                        return std::format("\tc.slli64\t{}", reg_name[rd]);
+                    return std::format("\tc.slli\t{}, {}", reg_name[rd],
+                                       shamt);
+                case 0b001:
+                    return mem("c.fldsp", freg_name[rd], uimm_ldsp, "sp");
+                case 0b010:
+                    if (rd == 0) break;
+                    return mem("c.lwsp", reg_name[rd], uimm_lwsp, "sp");
+                case 0b011:
+                    if (!rv64)
+                        return mem("c.flwsp", freg_name[rd], uimm_lwsp, "sp");
+                    if (rd == 0) break;
+                    return mem("c.ldsp", reg_name[rd], uimm_ldsp, "sp");
+                case 0b100:
+                    if (extract_bits(inst, 12, 12) == 0)
+                    {
+                        if (rs2 != 0)
+                            return std::format("\tc.mv\t{}, {}", reg_name[rd],
+                                               reg_name[rs2]);
+                        if (rd == 0) break;
+                        return std::format("\tc.jr\t{}", reg_name[rd]);
+                    }
+                    if (rs2 != 0)
+                        return std::format("\tc.add\t{}, {}", reg_name[rd],
+                                           reg_name[rs2]);
+                    if (rd == 0) return "\tc.ebreak\t";
+                    return std::format("\tc.jalr\t{}", reg_name[rd]);
+                case 0b101:
+                    return mem("c.fsdsp", freg_name[rs2], uimm_sdsp, "sp");
+                case 0b110:
+                    return mem("c.swsp", reg_name[rs2], uimm_swsp, "sp");
+                case 0b111:
+                    if (rv64)
+                        return mem("c.sdsp", reg_name[rs2], uimm_sdsp, "sp");
+                    return mem("c.fswsp", freg_name[rs2], uimm_swsp, "sp");
+            }
+            break;
+    }
+    return {};
+}
+
+// Prints every instruction as a raw word, for triples other than RISC-V.
+class RawBackend : public Disassembler::Backend
+{
+   public:
+    std::string print(uint64_t, const uint8_t *code, int nbyte) override
+    {
+        return raw_word(code, nbyte);
+    }
+};
+
+}  // namespace
+
+std::unique_ptr<Disassembler::Backend> Disassembler::create_backend(
+    const std::string &triple)
+{
+    if (triple.starts_with("riscv64"))
+        return std::make_unique<BuiltinBackend>(true);
+    if (triple.starts_with("riscv32"))
+        return std::make_unique<BuiltinBackend>(false);
+    return std::make_unique<RawBackend>();
+}
@@ -0,0 +1,157 @@
+/***************************************************************************************
+ * Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+ *
+ * NEMU is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan
+ *PSL v2. You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
+ *KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+ *NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the Mulan PSL v2 for more details.
+ ***************************************************************************************/
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCDisassembler/MCDisassembler.h"
+#include "llvm/MC/MCInstPrinter.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#if LLVM_VERSION_MAJOR >= 14
+#include "llvm/MC/TargetRegistry.h"
+#if LLVM_VERSION_MAJOR >= 15
+#include "llvm/MC/MCSubtargetInfo.h"
+#endif
+#else
+#include "llvm/Support/TargetRegistry.h"
+#endif
+#include "llvm/Support/TargetSelect.h"
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "Utils/Disasm.h"
+
+#if LLVM_VERSION_MAJOR < 11
+#error Please use LLVM with major version >= 11
+#endif
+
+using namespace llvm;
+
+namespace
+{
+
+class LLVMBackend : public Disassembler::Backend
+{
+   public:
+    explicit LLVMBackend(const std::string &triple);
+    std::string print(uint64_t pc, const uint8_t *code, int nbyte) override;
+
+   private:
+    std::unique_ptr<llvm::MCSubtargetInfo> STI;
+    std::unique_ptr<llvm::MCInstrInfo> MII;
+    std::unique_ptr<llvm::MCRegisterInfo> MRI;
+    std::unique_ptr<llvm::MCAsmInfo> AsmInfo;
+    std::unique_ptr<llvm::MCContext> Ctx;
+    std::unique_ptr<llvm::MCDisassembler> DisAsm;
+    std::unique_ptr<llvm::MCInstPrinter> IP;
+};
+
+// Only the RISC-V part of the MC layer is registered. The target registry is
+// process-wide in LLVM, every other piece of state belongs to a backend.
+void register_riscv_target()
+{
+    static std::once_flag flag;
+    std::call_once(flag,
+                   []()
+                   {
+                       LLVMInitializeRISCVTargetInfo();
+                       LLVMInitializeRISCVTargetMC();
+                       LLVMInitializeRISCVDisassembler();
+                   });
+}
+
+LLVMBackend::LLVMBackend(const std::string &triple)
+{
+    register_riscv_target();
+
+    std::string errstr;
+    auto target = llvm::TargetRegistry::lookupTarget(triple, errstr);
+    if (!target)
+    {
+        llvm::errs() << "Can't find target for " << triple << ": " << errstr
+                     << "\n";
+        assert(0);
+    }
+
+    MCTargetOptions MCOptions;
+    STI.reset(target->createMCSubtargetInfo(triple, "", ""));
+    std::string isa = target->getName();
+    if (isa == "riscv32" || isa == "riscv64")
+    {
+        STI->ApplyFeatureFlag("+m");
+        STI->ApplyFeatureFlag("+a");
+        STI->ApplyFeatureFlag("+c");
+        STI->ApplyFeatureFlag("+f");
+        STI->ApplyFeatureFlag("+d");
+        STI->ApplyFeatureFlag("+v");
+    }
+    MII.reset(target->createMCInstrInfo());
+    MRI.reset(target->createMCRegInfo(triple));
+    AsmInfo.reset(target->createMCAsmInfo(*MRI, triple, MCOptions));
+#if LLVM_VERSION_MAJOR >= 13
+    auto llvmTripleTwine = Twine(triple);
+    auto llvmtriple = llvm::Triple(llvmTripleTwine);
+    Ctx = std::make_unique<llvm::MCContext>(llvmtriple, AsmInfo.get(),
+                                            MRI.get(), nullptr);
+#else
+    Ctx = std::make_unique<llvm::MCContext>(AsmInfo.get(), MRI.get(), nullptr);
+#endif
+    DisAsm.reset(target->createMCDisassembler(*STI, *Ctx));
+    IP.reset(target->createMCInstPrinter(llvm::Triple(triple),
+                                         AsmInfo->getAssemblerDialect(),
+                                         *AsmInfo, *MII, *MRI));
+    IP->setPrintImmHex(true);
+    IP->setPrintBranchImmAsAddress(true);
+    if (isa == "riscv32" || isa == "riscv64")
+        IP->applyTargetSpecificCLOption("no-aliases");
+}
+
+std::string LLVMBackend::print(uint64_t pc, const uint8_t *code, int nbyte)
+{
+    std::string ret;
+    raw_string_ostream os(ret);
+
+    MCInst inst;
+    llvm::ArrayRef<uint8_t> arr(code, nbyte);
+    uint64_t size = 0;
+    // A failed decode leaves inst empty, which the printer cannot take.
+    if (DisAsm->getInstruction(inst, size, arr, pc, llvm::nulls()) !=
+            MCDisassembler::Success ||
+        size != uint64_t(nbyte))
+        return raw_word(code, nbyte);
+
+    IP->printInst(&inst, pc, "", *STI, os);
+
+    return os.str();
+}
+
+}  // namespace
+
+std::unique_ptr<Disassembler::Backend> Disassembler::create_backend(
+    const std::string &triple)
+{
+    return std::make_unique<LLVMBackend>(triple);
+}
@@ -1,127 +1,263 @@
 #include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 #include <iostream>
-#include <memory>
 #include <optional>
 #include <string>
+#include <utility>
 
 #include "Utils/ElfParser.h"
 
-std::optional<SymbolTable> getFunctionSymbol(const std::string &file_path)
+namespace
 {
-    std::fstream elf_file(file_path, std::ios::in | std::ios::binary);
-    if (!elf_file.is_open())
+
+std::string_view string_at(const uint8_t* base, size_t length,
+                           const uint8_t* table, size_t table_size,
+                           size_t offset)
+{
+    if (table < base || table + table_size > base + length ||
+        offset >= table_size)
+        return {};
+    auto str = reinterpret_cast<const char*>(table + offset);
+    return std::string_view(str, strnlen(str, table_size - offset));
+}
+
+}  // namespace
+
+bool ElfFile::is_elf(const std::filesystem::path& file_path)
+{
+    std::ifstream elf_file(file_path, std::ios::in | std::ios::binary);
+    char e_ident[SELFMAG];
+    if (!elf_file.read(e_ident, SELFMAG)) return false;
+    return std::strncmp(e_ident, ELFMAG, SELFMAG) == 0;
+}
+
+std::optional<ElfFile> ElfFile::open(const std::filesystem::path& file_path)
+{
+    int fd = ::open(file_path.c_str(), O_RDONLY);
+    if (fd < 0)
     {
         std::cerr << "Failed to open file: " << file_path << std::endl;
         return std::nullopt;
     }
-
-    char e_ident[EI_NIDENT];
-    elf_file.read(e_ident, EI_NIDENT);
-    if (std::strncmp(e_ident, ELFMAG, SELFMAG) != 0)
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < EI_NIDENT)
     {
         std::cerr << "Not an ELF file: " << file_path << std::endl;
+        ::close(fd);
+        return std::nullopt;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+        std::cerr << "Failed to map file: " << file_path << std::endl;
         return std::nullopt;
     }
 
-    SymbolTable symbols;
-    if (e_ident[EI_CLASS] == ELFCLASS32)
+    ElfFile elf;
+    elf.base = static_cast<const uint8_t*>(map);
+    elf.length = st.st_size;
+
+    auto e_ident = elf.base;
+    if (std::memcmp(e_ident, ELFMAG, SELFMAG) != 0)
     {
-        Elf32_Ehdr header;
-        elf_file.seekg(0);
-        elf_file.read(reinterpret_cast<char *>(&header), sizeof(header));
-
-        Elf32_Shdr section_header;
-        for (int i = 0; i < header.e_shnum; i++)
-        {
-            elf_file.seekg(header.e_shoff + i * header.e_shentsize);
-            elf_file.read(reinterpret_cast<char *>(&section_header),
-                          sizeof(section_header));
-            if (section_header.sh_type == SHT_SYMTAB)
-            {
-                Elf32_Shdr strtab_header;
-                elf_file.seekg(header.e_shoff +
-                               section_header.sh_link * header.e_shentsize);
-                elf_file.read(reinterpret_cast<char *>(&strtab_header),
-                              sizeof(strtab_header));
-
-                elf_file.seekg(strtab_header.sh_offset);
-                std::unique_ptr<char[]> strtab(new char[strtab_header.sh_size]);
-                elf_file.read(strtab.get(), strtab_header.sh_size);
-
-                Elf32_Sym symbol;
-                for (auto j = 0u;
-                     j < section_header.sh_size / section_header.sh_entsize;
-                     j++)
-                {
-                    elf_file.seekg(section_header.sh_offset +
-                                   j * section_header.sh_entsize);
-                    elf_file.read(reinterpret_cast<char *>(&symbol),
-                                  sizeof(symbol));
-                    if (ELF32_ST_TYPE(symbol.st_info) == STT_FUNC)
-                    {
-                        SymbolInfo info;
-                        info.name = &strtab[symbol.st_name];
-                        info.addr = symbol.st_value;
-                        info.size = symbol.st_size;
-                        symbols.push_back(info);
-                    }
-                }
-            }
-        }
+        std::cerr << "Not an ELF file: " << file_path << std::endl;
+        return std::nullopt;
     }
+
+    bool ok;
+    if (e_ident[EI_CLASS] == ELFCLASS32)
+        ok = elf.parse<Elf32_Ehdr, Elf32_Phdr, Elf32_Shdr, Elf32_Sym>();
     else if (e_ident[EI_CLASS] == ELFCLASS64)
     {
-        Elf64_Ehdr header;
-        elf_file.seekg(0);
-        elf_file.read(reinterpret_cast<char *>(&header), sizeof(header));
-
-        Elf64_Shdr section_header;
-        for (int i = 0; i < header.e_shnum; i++)
-        {
-            elf_file.seekg(header.e_shoff + i * header.e_shentsize);
-            elf_file.read(reinterpret_cast<char *>(&section_header),
-                          sizeof(section_header));
-            if (section_header.sh_type == SHT_SYMTAB)
-            {
-                Elf64_Shdr strtab_header;
-                elf_file.seekg(header.e_shoff +
-                               section_header.sh_link * header.e_shentsize);
-                elf_file.read(reinterpret_cast<char *>(&strtab_header),
-                              sizeof(strtab_header));
-
-                elf_file.seekg(strtab_header.sh_offset);
-                std::unique_ptr<char[]> strtab(new char[strtab_header.sh_size]);
-                elf_file.read(strtab.get(), strtab_header.sh_size);
-
-                Elf64_Sym symbol;
-                for (auto j = 0u;
-                     j < section_header.sh_size / section_header.sh_entsize;
-                     j++)
-                {
-                    elf_file.seekg(section_header.sh_offset +
-                                   j * section_header.sh_entsize);
-                    elf_file.read(reinterpret_cast<char *>(&symbol),
-                                  sizeof(symbol));
-                    if (ELF64_ST_TYPE(symbol.st_info) == STT_FUNC)
-                    {
-                        SymbolInfo info;
-                        info.name = &strtab[symbol.st_name];
-                        info.addr = symbol.st_value;
-                        info.size = symbol.st_size;
-                        symbols.push_back(info);
-                    }
-                }
-            }
-        }
+        elf.elf64 = true;
+        ok = elf.parse<Elf64_Ehdr, Elf64_Phdr, Elf64_Shdr, Elf64_Sym>();
     }
     else
     {
-        std::cerr << "Unknown ELF class: " << e_ident[EI_CLASS] << std::endl;
+        std::cerr << "Unknown ELF class: " << int(e_ident[EI_CLASS])
+                  << std::endl;
         return std::nullopt;
     }
+    if (!ok)
+    {
+        std::cerr << "Malformed ELF file: " << file_path << std::endl;
+        return std::nullopt;
+    }
+    return elf;
+}
 
-    return symbols;
-}
\ No newline at end of file
+template <typename Ehdr, typename Phdr, typename Shdr, typename Sym>
+bool ElfFile::parse()
+{
+    auto in_file = [this](uint64_t offset, uint64_t size)
+    { return offset <= length && size <= length - offset; };
+
+    if (!in_file(0, sizeof(Ehdr))) return false;
+    auto header = reinterpret_cast<const Ehdr*>(base);
+    entry_pc = header->e_entry;
+
+    // Entries are read as whole structs, so none may be shorter than one.
+    if (header->e_phnum != 0 &&
+        (header->e_phentsize < sizeof(Phdr) ||
+         !in_file(header->e_phoff,
+                  uint64_t(header->e_phnum) * header->e_phentsize)))
+        return false;
+    phdr_table = std::span<const uint8_t>(
+        base + header->e_phoff,
+        uint64_t(header->e_phnum) * header->e_phentsize);
+    phdr_size = header->e_phentsize;
+    for (int i = 0; i < header->e_phnum; i++)
+    {
+        auto phdr = reinterpret_cast<const Phdr*>(
+            base + header->e_phoff + i * header->e_phentsize);
+        if (phdr->p_type != PT_LOAD || phdr->p_memsz == 0) continue;
+        if (!in_file(phdr->p_offset, phdr->p_filesz) ||
+            phdr->p_filesz > phdr->p_memsz)
+            return false;
+        segment_list.push_back(SegmentInfo{
+            phdr->p_paddr,
+            phdr->p_vaddr,
+            std::span<const uint8_t>(base + phdr->p_offset, phdr->p_filesz),
+            phdr->p_memsz});
+    }
+
+    if (header->e_shnum == 0) return true;
+    if (header->e_shentsize < sizeof(Shdr) ||
+        !in_file(header->e_shoff,
+                 uint64_t(header->e_shnum) * header->e_shentsize))
+        return false;
+    auto section_header = [this, header](size_t index)
+    {
+        return reinterpret_cast<const Shdr*>(base + header->e_shoff +
+                                             index * header->e_shentsize);
+    };
+
+    const Shdr* shstrtab = header->e_shstrndx < header->e_shnum
+                               ? section_header(header->e_shstrndx)
+                               : nullptr;
+    const Shdr* symtab = nullptr;
+    for (int i = 0; i < header->e_shnum; i++)
+    {
+        auto shdr = section_header(i);
+        std::string_view name;
+        if (shstrtab != nullptr)
+            name = string_at(base, length, base + shstrtab->sh_offset,
+                             shstrtab->sh_size, shdr->sh_name);
+        section_list.push_back(SectionInfo{name, shdr->sh_addr, shdr->sh_size});
+        if (shdr->sh_type == SHT_SYMTAB ||
+            (shdr->sh_type == SHT_DYNSYM && symtab == nullptr))
+            symtab = shdr;
+    }
+
+    if (symtab == nullptr) return true;
+    if (symtab->sh_entsize < sizeof(Sym)) return false;
+    if (symtab->sh_link >= header->e_shnum ||
+        !in_file(symtab->sh_offset, symtab->sh_size))
+        return true;
+    auto strtab = section_header(symtab->sh_link);
+    auto count = symtab->sh_size / symtab->sh_entsize;
+    symbol_table.reserve(count);
+    for (uint64_t j = 0; j < count; j++)
+    {
+        auto symbol = reinterpret_cast<const Sym*>(
+            base + symtab->sh_offset + j * symtab->sh_entsize);
+        auto type = symbol->st_info & 0xf;
+        if (type != STT_FUNC && type != STT_OBJECT) continue;
+        symbol_table.push_back(SymbolInfo{
+            string_at(base, length, base + strtab->sh_offset,
+                      strtab->sh_size, symbol->st_name),
+            symbol->st_value, symbol->st_size,
+            type == STT_FUNC ? SymbolType::FUNC : SymbolType::OBJECT});
+    }
+    std::sort(symbol_table.begin(), symbol_table.end(),
+              [](const SymbolInfo& a, const SymbolInfo& b)
+              { return a.addr < b.addr; });
+    return true;
+}
+
+ElfFile::ElfFile(ElfFile&& other) noexcept
+    : base(std::exchange(other.base, nullptr)),
+      length(std::exchange(other.length, 0)),
+      elf64(other.elf64),
+      entry_pc(other.entry_pc),
+      phdr_table(other.phdr_table),
+      phdr_size(other.phdr_size),
+      segment_list(std::move(other.segment_list)),
+      section_list(std::move(other.section_list)),
+      symbol_table(std::move(other.symbol_table))
+{
+}
+
+ElfFile& ElfFile::operator=(ElfFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (base != nullptr) munmap(const_cast<uint8_t*>(base), length);
+        base = std::exchange(other.base, nullptr);
+        length = std::exchange(other.length, 0);
+        elf64 = other.elf64;
+        entry_pc = other.entry_pc;
+        phdr_table = other.phdr_table;
+        phdr_size = other.phdr_size;
+        segment_list = std::move(other.segment_list);
+        section_list = std::move(other.section_list);
+        symbol_table = std::move(other.symbol_table);
+    }
+    return *this;
+}
+
+ElfFile::~ElfFile()
+{
+    if (base != nullptr) munmap(const_cast<uint8_t*>(base), length);
+}
+
+std::optional<SectionInfo> ElfFile::section(std::string_view name) const
+{
+    for (const auto& sec : section_list)
+        if (sec.name == name) return sec;
+    return std::nullopt;
+}
+
+const SymbolInfo* ElfFile::find_symbol(uint64_t addr) const
+{
+    auto it = std::upper_bound(symbol_table.begin(), symbol_table.end(), addr,
+                               [](uint64_t addr, const SymbolInfo& sym)
+                               { return addr < sym.addr; });
+    while (it != symbol_table.begin())
+    {
+        --it;
+        if (addr < it->addr + std::max<uint64_t>(it->size, 1)) return &*it;
+        if (it->size != 0) break;
+    }
+    return nullptr;
+}
+
+const SymbolInfo* ElfFile::find_function(uint64_t addr) const
+{
+    auto it = std::upper_bound(symbol_table.begin(), symbol_table.end(), addr,
+                               [](uint64_t addr, const SymbolInfo& sym)
+                               { return addr < sym.addr; });
+    while (it != symbol_table.begin())
+    {
+        --it;
+        if (it->type != SymbolType::FUNC) continue;
+        if (it->size != 0 && addr >= it->addr + it->size) return nullptr;
+        return &*it;
+    }
+    return nullptr;
+}
+
+const SymbolInfo* ElfFile::find_symbol(std::string_view name) const
+{
+    for (const auto& sym : symbol_table)
+        if (sym.name == name) return &sym;
+    return nullptr;
+}
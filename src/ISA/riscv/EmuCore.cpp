@@ -0,0 +1,2336 @@
+#include "ISA/riscv/EmuCore.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cfenv>
+#include <cstring>
+#include <limits>
+#include <print>
+#include <utility>
+
+#include "Exception/NEMUException.hpp"
+#include "ISA/riscv/Common.hpp"
+#include "ISA/riscv/Compressed.hpp"
+#include "ISA/riscv/Decoder.hpp"
+#include "ISA/riscv/FPU.hpp"
+#include "Utils/Utils.h"
+
+namespace RISCV
+{
+
+// Operations shared by the register and immediate forms, on registers of
+// type W. The RV64 *W instructions use ALU<uint32_t>.
+template <typename W>
+struct ALU
+{
+    using S = std::make_signed_t<W>;
+    // Twice as wide as W, for the high half of products.
+    using wide_t = std::conditional_t<sizeof(W) == 4, int64_t, __int128>;
+    using uwide_t =
+        std::conditional_t<sizeof(W) == 4, uint64_t, unsigned __int128>;
+    static constexpr int bits = sizeof(W) * 8;
+
+    static constexpr W add(W a, W b) { return a + b; }
+    static constexpr W sub(W a, W b) { return a - b; }
+    // Register shift amounts are the low log2(bits) bits of rs2.
+    static constexpr W sll(W a, W b) { return a << (b & (bits - 1)); }
+    static constexpr W srl(W a, W b) { return a >> (b & (bits - 1)); }
+    static constexpr W sra(W a, W b) { return S(a) >> (b & (bits - 1)); }
+    static constexpr W slt(W a, W b) { return S(a) < S(b); }
+    static constexpr W sltu(W a, W b) { return a < b; }
+    static constexpr W bit_xor(W a, W b) { return a ^ b; }
+    static constexpr W bit_or(W a, W b) { return a | b; }
+    static constexpr W bit_and(W a, W b) { return a & b; }
+
+    static constexpr W mul(W a, W b) { return a * b; }
+    static constexpr W mulh(W a, W b)
+    {
+        return wide_t(S(a)) * wide_t(S(b)) >> bits;
+    }
+    static constexpr W mulhsu(W a, W b)
+    {
+        return wide_t(S(a)) * wide_t(b) >> bits;
+    }
+    static constexpr W mulhu(W a, W b)
+    {
+        return uwide_t(a) * uwide_t(b) >> bits;
+    }
+    // Division does not trap: by zero the quotient is all ones and the
+    // remainder the dividend, and the overflowing most negative / -1 gives
+    // the dividend and 0.
+    static constexpr bool overflows(W a, W b)
+    {
+        return S(a) == std::numeric_limits<S>::min() && S(b) == -1;
+    }
+    static constexpr W div(W a, W b)
+    {
+        if (b == 0) return ~W(0);
+        return overflows(a, b) ? a : W(S(a) / S(b));
+    }
+    static constexpr W divu(W a, W b) { return b == 0 ? ~W(0) : a / b; }
+    static constexpr W rem(W a, W b)
+    {
+        if (b == 0) return a;
+        return overflows(a, b) ? 0 : W(S(a) % S(b));
+    }
+    static constexpr W remu(W a, W b) { return b == 0 ? a : a % b; }
+
+    // The A extension's amoswap, amomin and amomax.
+    static constexpr W swap(W, W b) { return b; }
+    static constexpr W min(W a, W b) { return S(a) < S(b) ? a : b; }
+    static constexpr W max(W a, W b) { return S(a) < S(b) ? b : a; }
+    static constexpr W minu(W a, W b) { return a < b ? a : b; }
+    static constexpr W maxu(W a, W b) { return a < b ? b : a; }
+
+    static constexpr bool eq(W a, W b) { return a == b; }
+    static constexpr bool ne(W a, W b) { return a != b; }
+    static constexpr bool lt(W a, W b) { return S(a) < S(b); }
+    static constexpr bool ge(W a, W b) { return S(a) >= S(b); }
+    static constexpr bool ltu(W a, W b) { return a < b; }
+    static constexpr bool geu(W a, W b) { return a >= b; }
+};
+
+// Handler builders for the instruction table. Everything an instruction
+// needs is resolved when it is decoded; handlers are cached per pc, so pc
+// dependent values (link addresses, branch targets) are constants.
+// Compressed instructions arrive expanded, len tells them apart.
+template <int XLEN>
+struct Semantics
+{
+    using Hart = EmuCore<XLEN>;
+    using word_t = typename Hart::word_t;
+    using sword_t = typename Hart::sword_t;
+    using Handler = typename Hart::Handler;
+
+    struct Operands
+    {
+        word_t& rd;
+        word_t& rs1;
+        word_t& rs2;
+        word_t imm;
+        word_t pc;
+        inst_t inst;
+        int len;
+    };
+
+    using Builder = Handler (*)(Hart& core, const Operands& op);
+
+    static Handler lui(Hart&, const Operands& op)
+    {
+        return [&rd = op.rd, imm = op.imm]() { rd = imm; };
+    }
+
+    static Handler auipc(Hart&, const Operands& op)
+    {
+        return [&rd = op.rd, value = op.pc + op.imm]() { rd = value; };
+    }
+
+    static Handler jal(Hart& core, const Operands& op)
+    {
+        return [&core, &rd = op.rd, link = op.pc + op.len,
+                target = op.pc + op.imm]()
+        {
+            rd = link;
+            core.next_pc = target;
+        };
+    }
+
+    static Handler jalr(Hart& core, const Operands& op)
+    {
+        return [&core, &rd = op.rd, &rs1 = op.rs1, imm = op.imm,
+                link = op.pc + op.len]()
+        {
+            word_t target = (rs1 + imm) & ~word_t(1);
+            rd = link;
+            core.next_pc = target;
+        };
+    }
+
+    template <auto taken>
+    static Handler branch(Hart& core, const Operands& op)
+    {
+        return [&core, &rs1 = op.rs1, &rs2 = op.rs2, target = op.pc + op.imm]()
+        {
+            if (taken(rs1, rs2)) core.next_pc = target;
+        };
+    }
+
+    // T is the type loaded, its signedness decides the extension.
+    template <typename T>
+    static Handler load(Hart& core, const Operands& op)
+    {
+        return [&memory = core.memory, &rd = op.rd, &rs1 = op.rs1,
+                imm = op.imm]()
+        {
+            rd = static_cast<T>(
+                memory.template vread<word_t>(rs1 + imm, sizeof(T)));
+        };
+    }
+
+    template <int len>
+    static Handler store(Hart& core, const Operands& op)
+    {
+        return [&memory = core.memory, &rs1 = op.rs1, &rs2 = op.rs2,
+                imm = op.imm]() { memory.vwrite(rs1 + imm, rs2, len); };
+    }
+
+    template <auto f>
+    static Handler reg_imm(Hart&, const Operands& op)
+    {
+        return [&rd = op.rd, &rs1 = op.rs1, imm = op.imm]()
+        { rd = f(rs1, imm); };
+    }
+
+    // Shift amount is the low log2(XLEN) bits of the immediate.
+    template <auto f>
+    static Handler shift_imm(Hart&, const Operands& op)
+    {
+        return [&rd = op.rd, &rs1 = op.rs1, shamt = op.imm & (XLEN - 1)]()
+        { rd = f(rs1, shamt); };
+    }
+
+    template <auto f>
+    static Handler reg_reg(Hart&, const Operands& op)
+    {
+        return [&rd = op.rd, &rs1 = op.rs1, &rs2 = op.rs2]()
+        { rd = f(rs1, rs2); };
+    }
+
+    // RV64 *W forms: f works on the low 32 bits, the result is
+    // sign-extended.
+    template <auto f>
+    static Handler reg_imm_w(Hart&, const Operands& op)
+    {
+        return [&rd = op.rd, &rs1 = op.rs1, imm = uint32_t(op.imm)]()
+        { rd = int32_t(f(uint32_t(rs1), imm)); };
+    }
+
+    template <auto f>
+    static Handler shift_imm_w(Hart&, const Operands& op)
+    {
+        return [&rd = op.rd, &rs1 = op.rs1, shamt = uint32_t(op.imm & 0x1f)]()
+        { rd = int32_t(f(uint32_t(rs1), shamt)); };
+    }
+
+    template <auto f>
+    static Handler reg_reg_w(Hart&, const Operands& op)
+    {
+        return [&rd = op.rd, &rs1 = op.rs1, &rs2 = op.rs2]()
+        { rd = int32_t(f(uint32_t(rs1), uint32_t(rs2))); };
+    }
+
+    static Handler ecall(Hart& core, const Operands&)
+    {
+        return [&core]()
+        {
+            if (core.syscalls != nullptr)
+                core.system_call();
+            else
+                core.next_pc = core.trap(CAUSE_ECALL_M, 0);
+        };
+    }
+
+    static Handler ebreak(Hart&, const Operands&)
+    {
+        return []() { throw ebreak_exception(); };
+    }
+
+    static Handler mret(Hart& core, const Operands&)
+    {
+        return [&core]()
+        {
+            auto& csr = core.csr;
+            auto mpie = csr.mstatus & MSTATUS_MPIE;
+            csr.mstatus &= ~MSTATUS_MIE;
+            if (mpie) csr.mstatus |= MSTATUS_MIE;
+            csr.mstatus |= MSTATUS_MPIE;
+            core.next_pc = csr.mepc;
+            core.update_interrupt_pending();
+        };
+    }
+
+    static Handler wfi(Hart&, const Operands&)
+    {
+        return []() {};
+    }
+
+    // lr and sc; T is int32_t or int64_t. sc writes 0 to rd on success.
+    template <typename T>
+    static Handler load_reserved(Hart& core, const Operands& op)
+    {
+        return [&core, &rd = op.rd, &rs1 = op.rs1]()
+        {
+            word_t addr = rs1;
+            rd = static_cast<T>(
+                core.memory.template vread<word_t>(addr, sizeof(T)));
+            core.reservation = addr;
+        };
+    }
+
+    template <typename T>
+    static Handler store_conditional(Hart& core, const Operands& op)
+    {
+        return [&core, &rd = op.rd, &rs1 = op.rs1, &rs2 = op.rs2]()
+        {
+            bool reserved = core.reservation == rs1;
+            core.reservation.reset();
+            if (reserved) core.memory.vwrite(rs1, rs2, sizeof(T));
+            rd = !reserved;
+        };
+    }
+
+    // amo*.w and amo*.d: rd gets the old value, sign-extended, and f of it
+    // and rs2 is stored. W is uint32_t or uint64_t.
+    template <typename W, auto f>
+    static Handler amo(Hart& core, const Operands& op)
+    {
+        return [&memory = core.memory, &rd = op.rd, &rs1 = op.rs1,
+                &rs2 = op.rs2]()
+        {
+            word_t addr = rs1;
+            auto old = W(memory.template vread<word_t>(addr, sizeof(W)));
+            memory.vwrite(addr, word_t(f(old, W(rs2))), sizeof(W));
+            rd = std::make_signed_t<W>(old);
+        };
+    }
+
+    // One hart without caches sees its memory accesses in order. fence.i
+    // needs nothing either: the decode cache checks the instruction word on
+    // every fetch.
+    static Handler fence(Hart&, const Operands&)
+    {
+        return []() {};
+    }
+
+    // Raises an illegal instruction exception in the guest, the way ecall
+    // raises its own, with the instruction in mtval.
+    static Handler illegal(Hart& core, const Operands& op)
+    {
+        return [&core, inst = op.inst]()
+        { core.next_pc = core.trap(CAUSE_ILLEGAL_INSTRUCTION, inst); };
+    }
+
+    // csrrw/csrrs/csrrc and their immediate forms. Writes to read-only CSRs
+    // (addr[11:10] == 0b11) are illegal, but csrrs and csrrc with x0 / a zero
+    // immediate do not write at all. csrrw with rd = x0 does not read.
+    // Illegal accesses, including to CSRs this core does not have, trap.
+    enum CSROp
+    {
+        CSR_WRITE,
+        CSR_SET,
+        CSR_CLEAR
+    };
+
+    template <CSROp csr_op, bool immediate>
+    static Handler csr(Hart& core, const Operands& op)
+    {
+        word_t csr_addr = op.inst >> 20;
+        word_t rd = extract_bits(op.inst, 7, 11);
+        word_t rs1 = extract_bits(op.inst, 15, 19);
+        bool writes = csr_op == CSR_WRITE || rs1 != 0;
+        bool read_only = extract_bits(csr_addr, 10, 11) == 0b11;
+        if (read_only && writes) return illegal(core, op);
+        bool reads = csr_op != CSR_WRITE || rd != 0;
+        // The immediate forms take the rs1 field itself as the value.
+        return [&core, &rd = op.rd, &src = op.rs1, csr_addr, rs1, reads,
+                writes, inst = op.inst]()
+        {
+            word_t value = immediate ? rs1 : src;
+            word_t old = 0;
+            try
+            {
+                if (reads) old = core.csr_read(csr_addr);
+                if (writes)
+                {
+                    if constexpr (csr_op == CSR_SET) value = old | value;
+                    if constexpr (csr_op == CSR_CLEAR) value = old & ~value;
+                    core.csr_write(csr_addr, value);
+                }
+            }
+            catch (invalid_instruction&)
+            {
+                core.next_pc = core.trap(CAUSE_ILLEGAL_INSTRUCTION, inst);
+                return;
+            }
+            rd = old;
+        };
+    }
+
+    // F and D. Operands only has the x registers, the f registers come
+    // from the instruction. Reserved static rounding modes are illegal
+    // here; a reserved frm is only illegal once an instruction uses it.
+    static uint64_t& freg(Hart& core, inst_t inst, int lsb)
+    {
+        return core.register_file.f[inst >> lsb & 0x1f];
+    }
+
+    static int rounding_mode(inst_t inst)
+    {
+        int rm = extract_bits(inst, 12, 14);
+        if (rm != RM_DYN && host_rounding(rm) < 0)
+            throw invalid_instruction();
+        return rm;
+    }
+
+    // Sets the rounding mode rm of inst for its handler, which returns at
+    // once if this fails: inst has then trapped on a reserved frm.
+    static bool set_rounding(Hart& core, int rm, inst_t inst, bool& rmm)
+    {
+        if (core.set_rounding(rm, rmm)) [[likely]]
+            return true;
+        core.next_pc = core.trap(CAUSE_ILLEGAL_INSTRUCTION, inst);
+        return false;
+    }
+
+    template <typename F>
+    static Handler fp_load(Hart& core, const Operands& op)
+    {
+        using fpu = FPU<F>;
+        return [&memory = core.memory, &rd = freg(core, op.inst, 7),
+                &rs1 = op.rs1, imm = op.imm]()
+        {
+            auto bits = memory.template vread<uint64_t>(rs1 + imm, sizeof(F));
+            rd = fpu::box(
+                fpu::from_bits(static_cast<typename fpu::bits_t>(bits)));
+        };
+    }
+
+    template <typename F>
+    static Handler fp_store(Hart& core, const Operands& op)
+    {
+        return [&memory = core.memory, &rs1 = op.rs1,
+                &rs2 = freg(core, op.inst, 20),
+                imm = op.imm]() { memory.vwrite(rs1 + imm, rs2, sizeof(F)); };
+    }
+
+    template <typename F, auto f>
+    static Handler fp_arith(Hart& core, const Operands& op)
+    {
+        using fpu = FPU<F>;
+        return [&core, &rd = freg(core, op.inst, 7),
+                &rs1 = freg(core, op.inst, 15), &rs2 = freg(core, op.inst, 20),
+                rm = rounding_mode(op.inst), inst = op.inst]()
+        {
+            bool rmm;
+            if (!set_rounding(core, rm, inst, rmm)) return;
+            rd = fpu::result(f(fpu::unbox(rs1), fpu::unbox(rs2), rmm));
+        };
+    }
+
+    template <typename F>
+    static Handler fp_sqrt(Hart& core, const Operands& op)
+    {
+        using fpu = FPU<F>;
+        return [&core, &rd = freg(core, op.inst, 7),
+                &rs1 = freg(core, op.inst, 15),
+                rm = rounding_mode(op.inst), inst = op.inst]()
+        {
+            bool rmm;
+            if (!set_rounding(core, rm, inst, rmm)) return;
+            rd = fpu::result(fpu::sqrt(fpu::unbox(rs1), rmm));
+        };
+    }
+
+    // fmadd, fmsub, fnmsub and fnmadd: +-(rs1 * rs2) +- rs3.
+    template <typename F, bool negate_product, bool negate_addend>
+    static Handler fp_fma(Hart& core, const Operands& op)
+    {
+        using fpu = FPU<F>;
+        return [&core, &rd = freg(core, op.inst, 7),
+                &rs1 = freg(core, op.inst, 15), &rs2 = freg(core, op.inst, 20),
+                &rs3 = freg(core, op.inst, 27),
+                rm = rounding_mode(op.inst), inst = op.inst]()
+        {
+            bool rmm;
+            if (!set_rounding(core, rm, inst, rmm)) return;
+            F a = fpu::unbox(rs1);
+            F c = fpu::unbox(rs3);
+            rd = fpu::result(fpu::fma(negate_product ? -a : a,
+                                      fpu::unbox(rs2),
+                                      negate_addend ? -c : c, rmm,
+                                      core.csr.fflags));
+        };
+    }
+
+    template <typename F, auto f>
+    static Handler fp_min_max(Hart& core, const Operands& op)
+    {
+        using fpu = FPU<F>;
+        return [&core, &rd = freg(core, op.inst, 7),
+                &rs1 = freg(core, op.inst, 15),
+                &rs2 = freg(core, op.inst, 20)]()
+        {
+            rd = fpu::result(
+                f(fpu::unbox(rs1), fpu::unbox(rs2), core.csr.fflags));
+        };
+    }
+
+    template <typename F, auto f>
+    static Handler fp_compare(Hart& core, const Operands& op)
+    {
+        using fpu = FPU<F>;
+        return [&core, &rd = op.rd, &rs1 = freg(core, op.inst, 15),
+                &rs2 = freg(core, op.inst, 20)]()
+        { rd = f(fpu::unbox(rs1), fpu::unbox(rs2), core.csr.fflags); };
+    }
+
+    // fsgnj, fsgnjn and fsgnjx only move bits, NaNs included.
+    enum SignOp
+    {
+        SIGN_COPY,
+        SIGN_NEGATE,
+        SIGN_XOR
+    };
+
+    template <typename F, SignOp sign_op>
+    static Handler fp_sign(Hart& core, const Operands& op)
+    {
+        using fpu = FPU<F>;
+        return [&rd = freg(core, op.inst, 7), &rs1 = freg(core, op.inst, 15),
+                &rs2 = freg(core, op.inst, 20)]()
+        {
+            auto magnitude = fpu::bits(fpu::unbox(rs1));
+            auto sign = fpu::bits(fpu::unbox(rs2));
+            if constexpr (sign_op == SIGN_NEGATE) sign = ~sign;
+            if constexpr (sign_op == SIGN_XOR) sign ^= magnitude;
+            rd = fpu::box(fpu::from_bits((magnitude & ~fpu::sign_bit) |
+                                         (sign & fpu::sign_bit)));
+        };
+    }
+
+    template <typename F>
+    static Handler fp_classify(Hart& core, const Operands& op)
+    {
+        using fpu = FPU<F>;
+        return [&rd = op.rd, &rs1 = freg(core, op.inst, 15)]()
+        { rd = fpu::classify(fpu::unbox(rs1)); };
+    }
+
+    // fcvt to the integer type I; 32-bit results are sign-extended on RV64
+    // whatever the signedness of I.
+    template <typename F, typename I>
+    static Handler fp_to_int(Hart& core, const Operands& op)
+    {
+        using fpu = FPU<F>;
+        return [&core, &rd = op.rd, &rs1 = freg(core, op.inst, 15),
+                rm = rounding_mode(op.inst), inst = op.inst]()
+        {
+            bool rmm;
+            if (!set_rounding(core, rm, inst, rmm)) return;
+            I value = fpu::template to_int<I>(fpu::unbox(rs1), rmm,
+                                              core.csr.fflags);
+            rd = static_cast<std::make_signed_t<I>>(value);
+        };
+    }
+
+    template <typename F, typename I>
+    static Handler fp_from_int(Hart& core, const Operands& op)
+    {
+        using fpu = FPU<F>;
+        return [&core, &rd = freg(core, op.inst, 7), &rs1 = op.rs1,
+                rm = rounding_mode(op.inst), inst = op.inst]()
+        {
+            bool rmm;
+            if (!set_rounding(core, rm, inst, rmm)) return;
+            rd = fpu::box(fpu::template from_int<I>(static_cast<I>(rs1), rmm));
+        };
+    }
+
+    // fcvt.s.d and fcvt.d.s: to F from G.
+    template <typename F, typename G>
+    static Handler fp_convert(Hart& core, const Operands& op)
+    {
+        using fpu = FPU<F>;
+        return [&core, &rd = freg(core, op.inst, 7),
+                &rs1 = freg(core, op.inst, 15),
+                rm = rounding_mode(op.inst), inst = op.inst]()
+        {
+            bool rmm;
+            if (!set_rounding(core, rm, inst, rmm)) return;
+            rd = fpu::result(
+                fpu::template convert<G>(FPU<G>::unbox(rs1), rmm));
+        };
+    }
+
+    // fmv.x.w sign-extends the raw low bits, fmv.w.x NaN-boxes them.
+    template <typename F>
+    static Handler fp_move_to_int(Hart& core, const Operands& op)
+    {
+        using bits_t = typename FPU<F>::bits_t;
+        return [&rd = op.rd, &rs1 = freg(core, op.inst, 15)]()
+        { rd = static_cast<std::make_signed_t<bits_t>>(rs1); };
+    }
+
+    template <typename F>
+    static Handler fp_move_from_int(Hart& core, const Operands& op)
+    {
+        using fpu = FPU<F>;
+        return [&rd = freg(core, op.inst, 7), &rs1 = op.rs1]()
+        {
+            rd = fpu::box(
+                fpu::from_bits(static_cast<typename fpu::bits_t>(rs1)));
+        };
+    }
+
+
+    // V. Vector operands are register numbers in the instruction; vtype
+    // and vl are only known when it runs, so that is when register groups
+    // are checked and the kernel for SEW is picked.
+    static uint8_t* vreg(Hart& core, unsigned reg)
+    {
+        return core.register_file.v.data() + reg * vlenb;
+    }
+
+    static unsigned vreg_field(inst_t inst, int lsb)
+    {
+        return inst >> lsb & 0x1f;
+    }
+
+    // v0 for a masked instruction (vm = 0), nullptr otherwise.
+    static const uint8_t* vmask(Hart& core, inst_t inst)
+    {
+        return inst >> 25 & 1 ? nullptr : vreg(core, 0);
+    }
+
+    // Sets sew to log2(SEW / 8) of vtype for the handler of inst, which
+    // returns at once if this fails: inst has then trapped. It is illegal
+    // with vill set, with vstart != 0, which no instruction here leaves
+    // behind, and when a register group does not start at a multiple of its
+    // size; groups is the OR of the register numbers that start one.
+    static bool vector_sew(Hart& core, unsigned groups, inst_t inst,
+                           unsigned& sew)
+    {
+        word_t vtype = core.csr.vtype;
+        if ((vtype & Hart::vtype_vill) || core.csr.vstart != 0 ||
+            (groups & (group_registers(vtype_lmul(vtype)) - 1))) [[unlikely]]
+        {
+            core.next_pc = core.trap(CAUSE_ILLEGAL_INSTRUCTION, inst);
+            return false;
+        }
+        sew = vtype_sew(vtype);
+        return true;
+    }
+
+    // Element 0 of a register, sign-extended from SEW, and its inverse.
+    static uint64_t velement(const uint8_t* reg, unsigned sew)
+    {
+        uint64_t value = 0;
+        std::memcpy(&value, reg, size_t(1) << sew);
+        int shift = 64 - (8 << sew);
+        return uint64_t(int64_t(value << shift) >> shift);
+    }
+
+    static void set_velement(uint8_t* reg, unsigned sew, uint64_t value)
+    {
+        std::memcpy(reg, &value, size_t(1) << sew);
+    }
+
+    // The second operand of OPIVV / OPMVV, OPIVX / OPMVX and OPIVI forms.
+    // Scalars are sign-extended to 64 bits, SEW truncates them.
+    enum VectorSource
+    {
+        VV,
+        VX,
+        VI
+    };
+
+    // The immediate of the VI forms: simm5, or uimm5 for shifts.
+    static uint64_t vimm(inst_t inst, bool is_unsigned)
+    {
+        uint32_t imm = extract_bits(inst, 15, 19);
+        return is_unsigned ? imm : int64_t(int32_t(sign_extend(imm, 5)));
+    }
+
+    // A vector of vl elements holding the scalar or immediate operand.
+    template <VectorSource source>
+    static const uint8_t* vsource(Hart& core, const uint8_t* vs1,
+                                  const word_t& rs1, uint64_t imm,
+                                  unsigned sew)
+    {
+        if constexpr (source == VV) return vs1;
+        uint64_t value = source == VX ? uint64_t(sword_t(rs1)) : imm;
+        core.vector_kernels.splat[sew](core.vector_scratch.data(), value,
+                                       nullptr, core.csr.vl);
+        return core.vector_scratch.data();
+    }
+
+    // vd = vs2 op vs1 / rs1 / imm. A masked instruction may not overwrite
+    // the mask.
+    template <VectorBinaryOp operation, VectorSource source>
+    static Handler vector_binary(Hart& core, const Operands& op)
+    {
+        constexpr bool shift = operation == VOP_SLL ||
+                               operation == VOP_SRL || operation == VOP_SRA;
+        unsigned vd = vreg_field(op.inst, 7);
+        unsigned vs1 = vreg_field(op.inst, 15);
+        unsigned vs2 = vreg_field(op.inst, 20);
+        const uint8_t* mask = vmask(core, op.inst);
+        if (mask && vd == 0) return illegal(core, op);
+        unsigned groups = vd | vs2 | (source == VV ? vs1 : 0);
+        return [&core, &rs1 = op.rs1, d = vreg(core, vd), s1 = vreg(core, vs1),
+                s2 = vreg(core, vs2), mask, groups,
+                imm = vimm(op.inst, shift), inst = op.inst]()
+        {
+            unsigned sew;
+            if (!vector_sew(core, groups, inst, sew)) return;
+            auto src = vsource<source>(core, s1, rs1, imm, sew);
+            core.vector_kernels.binary[operation][sew](d, s2, src, mask,
+                                                       core.csr.vl);
+        };
+    }
+
+    // vmerge (vm = 0) and vmv.v (vm = 1, vs2 = 0).
+    template <VectorSource source>
+    static Handler vector_merge(Hart& core, const Operands& op)
+    {
+        unsigned vd = vreg_field(op.inst, 7);
+        unsigned vs1 = vreg_field(op.inst, 15);
+        unsigned vs2 = vreg_field(op.inst, 20);
+        const uint8_t* mask = vmask(core, op.inst);
+        if (mask ? vd == 0 : vs2 != 0) return illegal(core, op);
+        unsigned groups = vd | vs2 | (source == VV ? vs1 : 0);
+        return [&core, &rs1 = op.rs1, d = vreg(core, vd), s1 = vreg(core, vs1),
+                s2 = vreg(core, vs2), mask, groups,
+                imm = vimm(op.inst, false), inst = op.inst]()
+        {
+            unsigned sew;
+            if (!vector_sew(core, groups, inst, sew)) return;
+            auto& kernels = core.vector_kernels;
+            auto src = vsource<source>(core, s1, rs1, imm, sew);
+            if (mask)
+                kernels.merge[sew](d, s2, src, mask, core.csr.vl);
+            else
+                kernels.binary[VOP_MOVE][sew](d, s2, src, nullptr,
+                                              core.csr.vl);
+        };
+    }
+
+    // vms*: one mask bit per element in vd.
+    template <VectorCompareOp operation, VectorSource source>
+    static Handler vector_compare(Hart& core, const Operands& op)
+    {
+        unsigned vs1 = vreg_field(op.inst, 15);
+        unsigned vs2 = vreg_field(op.inst, 20);
+        unsigned groups = vs2 | (source == VV ? vs1 : 0);
+        return [&core, &rs1 = op.rs1, d = vreg(core, vreg_field(op.inst, 7)),
+                s1 = vreg(core, vs1), s2 = vreg(core, vs2),
+                mask = vmask(core, op.inst), groups,
+                imm = vimm(op.inst, false), inst = op.inst]()
+        {
+            unsigned sew;
+            if (!vector_sew(core, groups, inst, sew)) return;
+            auto src = vsource<source>(core, s1, rs1, imm, sew);
+            core.vector_kernels.compare[operation][sew](d, s2, src, mask,
+                                                        core.csr.vl);
+        };
+    }
+
+    // vred*: vd[0] = vs1[0] op the active elements of vs2. Nothing is
+    // written if vl = 0.
+    template <VectorReduceOp operation>
+    static Handler vector_reduce(Hart& core, const Operands& op)
+    {
+        unsigned vs2 = vreg_field(op.inst, 20);
+        return [&core, d = vreg(core, vreg_field(op.inst, 7)),
+                s1 = vreg(core, vreg_field(op.inst, 15)), s2 = vreg(core, vs2),
+                mask = vmask(core, op.inst), vs2, inst = op.inst]()
+        {
+            unsigned sew;
+            if (!vector_sew(core, vs2, inst, sew)) return;
+            if (core.csr.vl == 0) return;
+            uint64_t result = core.vector_kernels.reduce[operation][sew](
+                s2, mask, core.csr.vl, velement(s1, sew));
+            set_velement(d, sew, result);
+        };
+    }
+
+    // vmand and friends; they are never masked.
+    template <VectorMaskOp operation>
+    static Handler vector_mask_logical(Hart& core, const Operands& op)
+    {
+        if (vmask(core, op.inst)) return illegal(core, op);
+        return [&core, d = vreg(core, vreg_field(op.inst, 7)),
+                s1 = vreg(core, vreg_field(op.inst, 15)),
+                s2 = vreg(core, vreg_field(op.inst, 20)), inst = op.inst]()
+        {
+            unsigned sew;
+            if (!vector_sew(core, 0, inst, sew)) return;
+            core.vector_kernels.mask_logical[operation](d, s2, s1,
+                                                        core.csr.vl);
+        };
+    }
+
+    // vmv.x.s ignores vl, vmv.s.x writes element 0 only if vl > 0.
+    static Handler vector_move_to_int(Hart& core, const Operands& op)
+    {
+        return [&core, &rd = op.rd, s2 = vreg(core, vreg_field(op.inst, 20)),
+                inst = op.inst]()
+        {
+            unsigned sew;
+            if (vector_sew(core, 0, inst, sew)) rd = velement(s2, sew);
+        };
+    }
+
+    static Handler vector_move_from_int(Hart& core, const Operands& op)
+    {
+        return [&core, &rs1 = op.rs1, d = vreg(core, vreg_field(op.inst, 7)),
+                inst = op.inst]()
+        {
+            unsigned sew;
+            if (!vector_sew(core, 0, inst, sew)) return;
+            if (core.csr.vl > 0) set_velement(d, sew, sword_t(rs1));
+        };
+    }
+
+    // vcpop.m and vfirst.m, the latter -1 if no active bit is set.
+    template <bool first>
+    static Handler vector_scan(Hart& core, const Operands& op)
+    {
+        return [&core, &rd = op.rd, s2 = vreg(core, vreg_field(op.inst, 20)),
+                mask = vmask(core, op.inst), inst = op.inst]()
+        {
+            unsigned sew;
+            if (!vector_sew(core, 0, inst, sew)) return;
+            auto& kernels = core.vector_kernels;
+            size_t vl = core.csr.vl;
+            if constexpr (first)
+            {
+                size_t index = kernels.first(s2, mask, vl);
+                rd = index == vl ? word_t(-1) : word_t(index);
+            }
+            else
+            {
+                rd = kernels.count(s2, mask, vl);
+            }
+        };
+    }
+
+    static Handler vector_id(Hart& core, const Operands& op)
+    {
+        unsigned vd = vreg_field(op.inst, 7);
+        const uint8_t* mask = vmask(core, op.inst);
+        if (mask && vd == 0) return illegal(core, op);
+        return [&core, d = vreg(core, vd), mask, vd, inst = op.inst]()
+        {
+            unsigned sew;
+            if (!vector_sew(core, vd, inst, sew)) return;
+            core.vector_kernels.index[sew](d, 0, mask, core.csr.vl);
+        };
+    }
+
+    // vsetvli, vsetivli and vsetvl. The AVL is rs1, the immediate for
+    // vsetivli, VLMAX if rs1 is x0 and rd is not, and the current vl if
+    // both are x0. An unsupported vtype sets vill and vl = 0.
+    enum VsetForm
+    {
+        VSETVLI,
+        VSETIVLI,
+        VSETVL
+    };
+
+    template <VsetForm form>
+    static Handler vsetvl(Hart& core, const Operands& op)
+    {
+        word_t zimm = form == VSETVLI    ? extract_bits(op.inst, 20, 30)
+                      : form == VSETIVLI ? extract_bits(op.inst, 20, 29)
+                                         : 0;
+        word_t uimm = extract_bits(op.inst, 15, 19);
+        bool rs1_zero = extract_bits(op.inst, 15, 19) == 0;
+        bool rd_zero = extract_bits(op.inst, 7, 11) == 0;
+        return [&core, &rd = op.rd, &rs1 = op.rs1, &rs2 = op.rs2, zimm, uimm,
+                rs1_zero, rd_zero]()
+        {
+            auto& csr = core.csr;
+            word_t vtype = form == VSETVL ? rs2 : zimm;
+            if (!vtype_valid(vtype))
+            {
+                csr.vtype = Hart::vtype_vill;
+                csr.vl = 0;
+                rd = 0;
+                return;
+            }
+            word_t vlmax = vtype_vlmax(vtype);
+            word_t avl = form == VSETIVLI ? uimm
+                         : !rs1_zero      ? rs1
+                         : !rd_zero       ? vlmax
+                                          : csr.vl;
+            csr.vtype = vtype;
+            csr.vl = std::min(avl, vlmax);
+            rd = csr.vl;
+        };
+    }
+
+    // Vector loads and stores. The width field gives EEW, -1 for a
+    // reserved one; the data of register groups spans EMUL = EEW / SEW *
+    // LMUL registers.
+    static int vmem_eew(inst_t inst)
+    {
+        switch (extract_bits(inst, 12, 14))
+        {
+            case 0b000:
+                return 0;
+            case 0b101:
+                return 1;
+            case 0b110:
+                return 2;
+            case 0b111:
+                return 3;
+            default:
+                return -1;
+        }
+    }
+
+    // Checks the vector state as vector_sew does, for a group of EMUL
+    // registers starting at reg.
+    static bool vmem_check(Hart& core, unsigned eew, unsigned reg, inst_t inst)
+    {
+        unsigned sew;
+        if (!vector_sew(core, 0, inst, sew)) return false;
+        int emul = int(eew) - int(sew) + vtype_lmul(core.csr.vtype);
+        if (emul < -3 || emul > 3 || (reg & (group_registers(emul) - 1)))
+            [[unlikely]]
+        {
+            core.next_pc = core.trap(CAUSE_ILLEGAL_INSTRUCTION, inst);
+            return false;
+        }
+        return true;
+    }
+
+    // Element by element, active elements only, for strided accesses and
+    // for those not entirely in RAM.
+    static void vload_elements(Hart& core, uint8_t* d, word_t addr,
+                               word_t stride, unsigned eew,
+                               const uint8_t* mask, size_t vl)
+    {
+        size_t size = size_t(1) << eew;
+        for (size_t i = 0; i < vl; i++)
+        {
+            if (mask && !(mask[i / 8] >> (i % 8) & 1)) continue;
+            uint64_t value = core.memory.template vread<uint64_t>(
+                word_t(addr + i * stride), size);
+            std::memcpy(d + i * size, &value, size);
+        }
+    }
+
+    static void vstore_elements(Hart& core, const uint8_t* s, word_t addr,
+                                word_t stride, unsigned eew,
+                                const uint8_t* mask, size_t vl)
+    {
+        size_t size = size_t(1) << eew;
+        for (size_t i = 0; i < vl; i++)
+        {
+            if (mask && !(mask[i / 8] >> (i % 8) & 1)) continue;
+            uint64_t value = 0;
+            std::memcpy(&value, s + i * size, size);
+            core.memory.vwrite(word_t(addr + i * stride), value, size);
+        }
+    }
+
+    // vle<eew>: one copy from RAM. Masked loads copy to scratch and take the
+    // active elements from there; reading the inactive ones is harmless in
+    // RAM.
+    static Handler vector_load(Hart& core, const Operands& op)
+    {
+        unsigned vd = vreg_field(op.inst, 7);
+        const uint8_t* mask = vmask(core, op.inst);
+        int eew = vmem_eew(op.inst);
+        if ((mask && vd == 0) || eew < 0) return illegal(core, op);
+        return [&core, &rs1 = op.rs1, d = vreg(core, vd), mask, vd,
+                eew = unsigned(eew), inst = op.inst]()
+        {
+            if (!vmem_check(core, eew, vd, inst)) return;
+            size_t vl = core.csr.vl;
+            size_t bytes = vl << eew;
+            uint8_t* buffer = mask ? core.vector_scratch.data() : d;
+            if (!core.memory.read_block(rs1, {buffer, bytes}))
+                return vload_elements(core, d, rs1, word_t(1) << eew, eew,
+                                      mask, vl);
+            if (mask)
+                core.vector_kernels.binary[VOP_MOVE][eew](d, d, buffer, mask,
+                                                          vl);
+        };
+    }
+
+    // vse<eew>: one copy to RAM unless masked.
+    static Handler vector_store(Hart& core, const Operands& op)
+    {
+        unsigned vs3 = vreg_field(op.inst, 7);
+        int eew = vmem_eew(op.inst);
+        if (eew < 0) return illegal(core, op);
+        return [&core, &rs1 = op.rs1, s = vreg(core, vs3),
+                mask = vmask(core, op.inst), vs3, eew = unsigned(eew),
+                inst = op.inst]()
+        {
+            if (!vmem_check(core, eew, vs3, inst)) return;
+            size_t vl = core.csr.vl;
+            if (mask || !core.memory.write_block(rs1, {s, vl << eew}))
+                vstore_elements(core, s, rs1, word_t(1) << eew, eew, mask,
+                                vl);
+        };
+    }
+
+    // vlse<eew> and vsse<eew>, stride in rs2.
+    static Handler vector_load_strided(Hart& core, const Operands& op)
+    {
+        unsigned vd = vreg_field(op.inst, 7);
+        const uint8_t* mask = vmask(core, op.inst);
+        int eew = vmem_eew(op.inst);
+        if ((mask && vd == 0) || eew < 0) return illegal(core, op);
+        return [&core, &rs1 = op.rs1, &rs2 = op.rs2, d = vreg(core, vd), mask,
+                vd, eew = unsigned(eew), inst = op.inst]()
+        {
+            if (!vmem_check(core, eew, vd, inst)) return;
+            vload_elements(core, d, rs1, rs2, eew, mask, core.csr.vl);
+        };
+    }
+
+    static Handler vector_store_strided(Hart& core, const Operands& op)
+    {
+        unsigned vs3 = vreg_field(op.inst, 7);
+        int eew = vmem_eew(op.inst);
+        if (eew < 0) return illegal(core, op);
+        return [&core, &rs1 = op.rs1, &rs2 = op.rs2, s = vreg(core, vs3),
+                mask = vmask(core, op.inst), vs3, eew = unsigned(eew),
+                inst = op.inst]()
+        {
+            if (!vmem_check(core, eew, vs3, inst)) return;
+            vstore_elements(core, s, rs1, rs2, eew, mask, core.csr.vl);
+        };
+    }
+
+    // vlm.v and vsm.v: ceil(vl / 8) bytes of mask.
+    template <bool is_store>
+    static Handler vector_mask_memory(Hart& core, const Operands& op)
+    {
+        return [&core, &rs1 = op.rs1,
+                reg = vreg(core, vreg_field(op.inst, 7)), inst = op.inst]()
+        {
+            unsigned sew;
+            if (!vector_sew(core, 0, inst, sew)) return;
+            size_t bytes = (core.csr.vl + 7) / 8;
+            bool done = is_store ? core.memory.write_block(rs1, {reg, bytes})
+                                 : core.memory.read_block(rs1, {reg, bytes});
+            if (done) return;
+            if constexpr (is_store)
+                vstore_elements(core, reg, rs1, 1, 0, nullptr, bytes);
+            else
+                vload_elements(core, reg, rs1, 1, 0, nullptr, bytes);
+        };
+    }
+
+    // vl<nf>re<eew>.v and vs<nf>r.v copy nf whole registers whatever vtype
+    // and vl are.
+    template <bool is_store>
+    static Handler vector_whole_registers(Hart& core, const Operands& op)
+    {
+        unsigned count = extract_bits(op.inst, 29, 31) + 1;
+        unsigned reg = vreg_field(op.inst, 7);
+        // Loads name an element width, which only has to be a valid one.
+        if ((!is_store && vmem_eew(op.inst) < 0) || (count & (count - 1)) ||
+            (reg & (count - 1)))
+            return illegal(core, op);
+        return [&core, &rs1 = op.rs1, data = vreg(core, reg),
+                bytes = count * vlenb]()
+        {
+            bool done = is_store ? core.memory.write_block(rs1, {data, bytes})
+                                 : core.memory.read_block(rs1, {data, bytes});
+            if (done) return;
+            if constexpr (is_store)
+                vstore_elements(core, data, rs1, 1, 0, nullptr, bytes);
+            else
+                vload_elements(core, data, rs1, 1, 0, nullptr, bytes);
+        };
+    }
+
+    static constexpr auto table();
+};
+
+// The decoder's single source of truth: one row per instruction. RV64
+// widens slli/srli/srai to a 6-bit shamt and adds the rows after RV32D;
+// both end with V.
+template <int XLEN>
+constexpr auto Semantics<XLEN>::table()
+{
+    using S = Semantics;
+    using alu = ALU<word_t>;
+    using alu32 = ALU<uint32_t>;
+    using fs = FPU<float>;
+    using fd = FPU<double>;
+    using Spec = InstSpec<Builder>;
+    constexpr inst_t shift_mask = XLEN == 64 ? 0xfc00707f : 0xfe00707f;
+    auto rv32 = std::to_array<Spec>({
+        // RV32I
+        {"lui", 0x0000007f, 0x00000037, U_TYPE, S::lui},
+        {"auipc", 0x0000007f, 0x00000017, U_TYPE, S::auipc},
+        {"jal", 0x0000007f, 0x0000006f, J_TYPE, S::jal},
+        {"jalr", 0x0000707f, 0x00000067, I_TYPE, S::jalr},
+        {"beq", 0x0000707f, 0x00000063, B_TYPE, S::branch<alu::eq>},
+        {"bne", 0x0000707f, 0x00001063, B_TYPE, S::branch<alu::ne>},
+        {"blt", 0x0000707f, 0x00004063, B_TYPE, S::branch<alu::lt>},
+        {"bge", 0x0000707f, 0x00005063, B_TYPE, S::branch<alu::ge>},
+        {"bltu", 0x0000707f, 0x00006063, B_TYPE, S::branch<alu::ltu>},
+        {"bgeu", 0x0000707f, 0x00007063, B_TYPE, S::branch<alu::geu>},
+        {"lb", 0x0000707f, 0x00000003, I_TYPE, S::load<int8_t>},
+        {"lh", 0x0000707f, 0x00001003, I_TYPE, S::load<int16_t>},
+        {"lw", 0x0000707f, 0x00002003, I_TYPE, S::load<int32_t>},
+        {"lbu", 0x0000707f, 0x00004003, I_TYPE, S::load<uint8_t>},
+        {"lhu", 0x0000707f, 0x00005003, I_TYPE, S::load<uint16_t>},
+        {"sb", 0x0000707f, 0x00000023, S_TYPE, S::store<1>},
+        {"sh", 0x0000707f, 0x00001023, S_TYPE, S::store<2>},
+        {"sw", 0x0000707f, 0x00002023, S_TYPE, S::store<4>},
+        {"addi", 0x0000707f, 0x00000013, I_TYPE, S::reg_imm<alu::add>},
+        {"slti", 0x0000707f, 0x00002013, I_TYPE, S::reg_imm<alu::slt>},
+        {"sltiu", 0x0000707f, 0x00003013, I_TYPE, S::reg_imm<alu::sltu>},
+        {"xori", 0x0000707f, 0x00004013, I_TYPE, S::reg_imm<alu::bit_xor>},
+        {"ori", 0x0000707f, 0x00006013, I_TYPE, S::reg_imm<alu::bit_or>},
+        {"andi", 0x0000707f, 0x00007013, I_TYPE, S::reg_imm<alu::bit_and>},
+        {"slli", shift_mask, 0x00001013, I_TYPE, S::shift_imm<alu::sll>},
+        {"srli", shift_mask, 0x00005013, I_TYPE, S::shift_imm<alu::srl>},
+        {"srai", shift_mask, 0x40005013, I_TYPE, S::shift_imm<alu::sra>},
+        {"add", 0xfe00707f, 0x00000033, R_TYPE, S::reg_reg<alu::add>},
+        {"sub", 0xfe00707f, 0x40000033, R_TYPE, S::reg_reg<alu::sub>},
+        {"sll", 0xfe00707f, 0x00001033, R_TYPE, S::reg_reg<alu::sll>},
+        {"slt", 0xfe00707f, 0x00002033, R_TYPE, S::reg_reg<alu::slt>},
+        {"sltu", 0xfe00707f, 0x00003033, R_TYPE, S::reg_reg<alu::sltu>},
+        {"xor", 0xfe00707f, 0x00004033, R_TYPE, S::reg_reg<alu::bit_xor>},
+        {"srl", 0xfe00707f, 0x00005033, R_TYPE, S::reg_reg<alu::srl>},
+        {"sra", 0xfe00707f, 0x40005033, R_TYPE, S::reg_reg<alu::sra>},
+        {"or", 0xfe00707f, 0x00006033, R_TYPE, S::reg_reg<alu::bit_or>},
+        {"and", 0xfe00707f, 0x00007033, R_TYPE, S::reg_reg<alu::bit_and>},
+        {"fence.tso", 0xffffffff, 0x8330000f, I_TYPE, S::fence},
+        {"fence", 0x0000707f, 0x0000000f, I_TYPE, S::fence},
+        {"fence.i", 0x0000707f, 0x0000100f, I_TYPE, S::fence},
+        {"ecall", 0xffffffff, 0x00000073, I_TYPE, S::ecall},
+        {"ebreak", 0xffffffff, 0x00100073, I_TYPE, S::ebreak},
+        {"mret", 0xffffffff, 0x30200073, I_TYPE, S::mret},
+        {"wfi", 0xffffffff, 0x10500073, I_TYPE, S::wfi},
+        {"csrrw", 0x0000707f, 0x00001073, I_TYPE, S::csr<CSR_WRITE, false>},
+        {"csrrs", 0x0000707f, 0x00002073, I_TYPE, S::csr<CSR_SET, false>},
+        {"csrrc", 0x0000707f, 0x00003073, I_TYPE, S::csr<CSR_CLEAR, false>},
+        {"csrrwi", 0x0000707f, 0x00005073, I_TYPE, S::csr<CSR_WRITE, true>},
+        {"csrrsi", 0x0000707f, 0x00006073, I_TYPE, S::csr<CSR_SET, true>},
+        {"csrrci", 0x0000707f, 0x00007073, I_TYPE, S::csr<CSR_CLEAR, true>},
+        // RV32M
+        {"mul", 0xfe00707f, 0x02000033, R_TYPE, S::reg_reg<alu::mul>},
+        {"mulh", 0xfe00707f, 0x02001033, R_TYPE, S::reg_reg<alu::mulh>},
+        {"mulhsu", 0xfe00707f, 0x02002033, R_TYPE, S::reg_reg<alu::mulhsu>},
+        {"mulhu", 0xfe00707f, 0x02003033, R_TYPE, S::reg_reg<alu::mulhu>},
+        {"div", 0xfe00707f, 0x02004033, R_TYPE, S::reg_reg<alu::div>},
+        {"divu", 0xfe00707f, 0x02005033, R_TYPE, S::reg_reg<alu::divu>},
+        {"rem", 0xfe00707f, 0x02006033, R_TYPE, S::reg_reg<alu::rem>},
+        {"remu", 0xfe00707f, 0x02007033, R_TYPE, S::reg_reg<alu::remu>},
+        // RV32A; aq and rl are open, accesses are in order anyway.
+        {"lr.w", 0xf9f0707f, 0x1000202f, R_TYPE, S::load_reserved<int32_t>},
+        {"sc.w", 0xf800707f, 0x1800202f, R_TYPE,
+         S::store_conditional<int32_t>},
+        {"amoswap.w", 0xf800707f, 0x0800202f, R_TYPE,
+         S::amo<uint32_t, alu32::swap>},
+        {"amoadd.w", 0xf800707f, 0x0000202f, R_TYPE,
+         S::amo<uint32_t, alu32::add>},
+        {"amoxor.w", 0xf800707f, 0x2000202f, R_TYPE,
+         S::amo<uint32_t, alu32::bit_xor>},
+        {"amoand.w", 0xf800707f, 0x6000202f, R_TYPE,
+         S::amo<uint32_t, alu32::bit_and>},
+        {"amoor.w", 0xf800707f, 0x4000202f, R_TYPE,
+         S::amo<uint32_t, alu32::bit_or>},
+        {"amomin.w", 0xf800707f, 0x8000202f, R_TYPE,
+         S::amo<uint32_t, alu32::min>},
+        {"amomax.w", 0xf800707f, 0xa000202f, R_TYPE,
+         S::amo<uint32_t, alu32::max>},
+        {"amominu.w", 0xf800707f, 0xc000202f, R_TYPE,
+         S::amo<uint32_t, alu32::minu>},
+        {"amomaxu.w", 0xf800707f, 0xe000202f, R_TYPE,
+         S::amo<uint32_t, alu32::maxu>},
+        // RV32F
+        {"flw", 0x0000707f, 0x00002007, I_TYPE, S::fp_load<float>},
+        {"fsw", 0x0000707f, 0x00002027, S_TYPE, S::fp_store<float>},
+        {"fmadd.s", 0x0600007f, 0x00000043, R_TYPE,
+         S::fp_fma<float, false, false>},
+        {"fmsub.s", 0x0600007f, 0x00000047, R_TYPE,
+         S::fp_fma<float, false, true>},
+        {"fnmsub.s", 0x0600007f, 0x0000004b, R_TYPE,
+         S::fp_fma<float, true, false>},
+        {"fnmadd.s", 0x0600007f, 0x0000004f, R_TYPE,
+         S::fp_fma<float, true, true>},
+        {"fadd.s", 0xfe00007f, 0x00000053, R_TYPE, S::fp_arith<float, fs::add>},
+        {"fsub.s", 0xfe00007f, 0x08000053, R_TYPE, S::fp_arith<float, fs::sub>},
+        {"fmul.s", 0xfe00007f, 0x10000053, R_TYPE, S::fp_arith<float, fs::mul>},
+        {"fdiv.s", 0xfe00007f, 0x18000053, R_TYPE, S::fp_arith<float, fs::div>},
+        {"fsqrt.s", 0xfff0007f, 0x58000053, R_TYPE, S::fp_sqrt<float>},
+        {"fsgnj.s", 0xfe00707f, 0x20000053, R_TYPE,
+         S::fp_sign<float, S::SIGN_COPY>},
+        {"fsgnjn.s", 0xfe00707f, 0x20001053, R_TYPE,
+         S::fp_sign<float, S::SIGN_NEGATE>},
+        {"fsgnjx.s", 0xfe00707f, 0x20002053, R_TYPE,
+         S::fp_sign<float, S::SIGN_XOR>},
+        {"fmin.s", 0xfe00707f, 0x28000053, R_TYPE,
+         S::fp_min_max<float, fs::min>},
+        {"fmax.s", 0xfe00707f, 0x28001053, R_TYPE,
+         S::fp_min_max<float, fs::max>},
+        {"fcvt.w.s", 0xfff0007f, 0xc0000053, R_TYPE,
+         S::fp_to_int<float, int32_t>},
+        {"fcvt.wu.s", 0xfff0007f, 0xc0100053, R_TYPE,
+         S::fp_to_int<float, uint32_t>},
+        {"fmv.x.w", 0xfff0707f, 0xe0000053, R_TYPE, S::fp_move_to_int<float>},
+        {"feq.s", 0xfe00707f, 0xa0002053, R_TYPE, S::fp_compare<float, fs::eq>},
+        {"flt.s", 0xfe00707f, 0xa0001053, R_TYPE, S::fp_compare<float, fs::lt>},
+        {"fle.s", 0xfe00707f, 0xa0000053, R_TYPE, S::fp_compare<float, fs::le>},
+        {"fclass.s", 0xfff0707f, 0xe0001053, R_TYPE, S::fp_classify<float>},
+        {"fcvt.s.w", 0xfff0007f, 0xd0000053, R_TYPE,
+         S::fp_from_int<float, int32_t>},
+        {"fcvt.s.wu", 0xfff0007f, 0xd0100053, R_TYPE,
+         S::fp_from_int<float, uint32_t>},
+        {"fmv.w.x", 0xfff0707f, 0xf0000053, R_TYPE,
+         S::fp_move_from_int<float>},
+        // RV32D
+        {"fld", 0x0000707f, 0x00003007, I_TYPE, S::fp_load<double>},
+        {"fsd", 0x0000707f, 0x00003027, S_TYPE, S::fp_store<double>},
+        {"fmadd.d", 0x0600007f, 0x02000043, R_TYPE,
+         S::fp_fma<double, false, false>},
+        {"fmsub.d", 0x0600007f, 0x02000047, R_TYPE,
+         S::fp_fma<double, false, true>},
+        {"fnmsub.d", 0x0600007f, 0x0200004b, R_TYPE,
+         S::fp_fma<double, true, false>},
+        {"fnmadd.d", 0x0600007f, 0x0200004f, R_TYPE,
+         S::fp_fma<double, true, true>},
+        {"fadd.d", 0xfe00007f, 0x02000053, R_TYPE,
+         S::fp_arith<double, fd::add>},
+        {"fsub.d", 0xfe00007f, 0x0a000053, R_TYPE,
+         S::fp_arith<double, fd::sub>},
+        {"fmul.d", 0xfe00007f, 0x12000053, R_TYPE,
+         S::fp_arith<double, fd::mul>},
+        {"fdiv.d", 0xfe00007f, 0x1a000053, R_TYPE,
+         S::fp_arith<double, fd::div>},
+        {"fsqrt.d", 0xfff0007f, 0x5a000053, R_TYPE, S::fp_sqrt<double>},
+        {"fsgnj.d", 0xfe00707f, 0x22000053, R_TYPE,
+         S::fp_sign<double, S::SIGN_COPY>},
+        {"fsgnjn.d", 0xfe00707f, 0x22001053, R_TYPE,
+         S::fp_sign<double, S::SIGN_NEGATE>},
+        {"fsgnjx.d", 0xfe00707f, 0x22002053, R_TYPE,
+         S::fp_sign<double, S::SIGN_XOR>},
+        {"fmin.d", 0xfe00707f, 0x2a000053, R_TYPE,
+         S::fp_min_max<double, fd::min>},
+        {"fmax.d", 0xfe00707f, 0x2a001053, R_TYPE,
+         S::fp_min_max<double, fd::max>},
+        {"fcvt.s.d", 0xfff0007f, 0x40100053, R_TYPE,
+         S::fp_convert<float, double>},
+        {"fcvt.d.s", 0xfff0007f, 0x42000053, R_TYPE,
+         S::fp_convert<double, float>},
+        {"feq.d", 0xfe00707f, 0xa2002053, R_TYPE,
+         S::fp_compare<double, fd::eq>},
+        {"flt.d", 0xfe00707f, 0xa2001053, R_TYPE,
+         S::fp_compare<double, fd::lt>},
+        {"fle.d", 0xfe00707f, 0xa2000053, R_TYPE,
+         S::fp_compare<double, fd::le>},
+        {"fclass.d", 0xfff0707f, 0xe2001053, R_TYPE, S::fp_classify<double>},
+        {"fcvt.w.d", 0xfff0007f, 0xc2000053, R_TYPE,
+         S::fp_to_int<double, int32_t>},
+        {"fcvt.wu.d", 0xfff0007f, 0xc2100053, R_TYPE,
+         S::fp_to_int<double, uint32_t>},
+        {"fcvt.d.w", 0xfff0007f, 0xd2000053, R_TYPE,
+         S::fp_from_int<double, int32_t>},
+        {"fcvt.d.wu", 0xfff0007f, 0xd2100053, R_TYPE,
+         S::fp_from_int<double, uint32_t>},
+    });
+    // V, integer subset, for either XLEN.
+    auto rvv = std::to_array<Spec>({
+        {"vsetvli", 0x8000707f, 0x00007057, R_TYPE, S::vsetvl<S::VSETVLI>},
+        {"vsetivli", 0xc000707f, 0xc0007057, R_TYPE, S::vsetvl<S::VSETIVLI>},
+        {"vsetvl", 0xfe00707f, 0x80007057, R_TYPE, S::vsetvl<S::VSETVL>},
+        {"vle8.v", 0xfdf0707f, 0x00000007, R_TYPE, S::vector_load},
+        {"vle16.v", 0xfdf0707f, 0x00005007, R_TYPE, S::vector_load},
+        {"vle32.v", 0xfdf0707f, 0x00006007, R_TYPE, S::vector_load},
+        {"vle64.v", 0xfdf0707f, 0x00007007, R_TYPE, S::vector_load},
+        {"vse8.v", 0xfdf0707f, 0x00000027, R_TYPE, S::vector_store},
+        {"vse16.v", 0xfdf0707f, 0x00005027, R_TYPE, S::vector_store},
+        {"vse32.v", 0xfdf0707f, 0x00006027, R_TYPE, S::vector_store},
+        {"vse64.v", 0xfdf0707f, 0x00007027, R_TYPE, S::vector_store},
+        {"vlse8.v", 0xfc00707f, 0x08000007, R_TYPE, S::vector_load_strided},
+        {"vlse16.v", 0xfc00707f, 0x08005007, R_TYPE, S::vector_load_strided},
+        {"vlse32.v", 0xfc00707f, 0x08006007, R_TYPE, S::vector_load_strided},
+        {"vlse64.v", 0xfc00707f, 0x08007007, R_TYPE, S::vector_load_strided},
+        {"vsse8.v", 0xfc00707f, 0x08000027, R_TYPE, S::vector_store_strided},
+        {"vsse16.v", 0xfc00707f, 0x08005027, R_TYPE, S::vector_store_strided},
+        {"vsse32.v", 0xfc00707f, 0x08006027, R_TYPE, S::vector_store_strided},
+        {"vsse64.v", 0xfc00707f, 0x08007027, R_TYPE, S::vector_store_strided},
+        {"vlm.v", 0xfff0707f, 0x02b00007, R_TYPE, S::vector_mask_memory<false>},
+        {"vsm.v", 0xfff0707f, 0x02b00027, R_TYPE, S::vector_mask_memory<true>},
+        {"vl<nf>re<eew>.v", 0x1ff0007f, 0x02800007, R_TYPE,
+         S::vector_whole_registers<false>},
+        {"vs<nf>r.v", 0x1ff0707f, 0x02800027, R_TYPE,
+         S::vector_whole_registers<true>},
+        {"vadd.vv", 0xfc00707f, 0x00000057, R_TYPE,
+         S::vector_binary<VOP_ADD, S::VV>},
+        {"vadd.vx", 0xfc00707f, 0x00004057, R_TYPE,
+         S::vector_binary<VOP_ADD, S::VX>},
+        {"vadd.vi", 0xfc00707f, 0x00003057, R_TYPE,
+         S::vector_binary<VOP_ADD, S::VI>},
+        {"vsub.vv", 0xfc00707f, 0x08000057, R_TYPE,
+         S::vector_binary<VOP_SUB, S::VV>},
+        {"vsub.vx", 0xfc00707f, 0x08004057, R_TYPE,
+         S::vector_binary<VOP_SUB, S::VX>},
+        {"vrsub.vx", 0xfc00707f, 0x0c004057, R_TYPE,
+         S::vector_binary<VOP_RSUB, S::VX>},
+        {"vrsub.vi", 0xfc00707f, 0x0c003057, R_TYPE,
+         S::vector_binary<VOP_RSUB, S::VI>},
+        {"vminu.vv", 0xfc00707f, 0x10000057, R_TYPE,
+         S::vector_binary<VOP_MINU, S::VV>},
+        {"vminu.vx", 0xfc00707f, 0x10004057, R_TYPE,
+         S::vector_binary<VOP_MINU, S::VX>},
+        {"vmin.vv", 0xfc00707f, 0x14000057, R_TYPE,
+         S::vector_binary<VOP_MIN, S::VV>},
+        {"vmin.vx", 0xfc00707f, 0x14004057, R_TYPE,
+         S::vector_binary<VOP_MIN, S::VX>},
+        {"vmaxu.vv", 0xfc00707f, 0x18000057, R_TYPE,
+         S::vector_binary<VOP_MAXU, S::VV>},
+        {"vmaxu.vx", 0xfc00707f, 0x18004057, R_TYPE,
+         S::vector_binary<VOP_MAXU, S::VX>},
+        {"vmax.vv", 0xfc00707f, 0x1c000057, R_TYPE,
+         S::vector_binary<VOP_MAX, S::VV>},
+        {"vmax.vx", 0xfc00707f, 0x1c004057, R_TYPE,
+         S::vector_binary<VOP_MAX, S::VX>},
+        {"vand.vv", 0xfc00707f, 0x24000057, R_TYPE,
+         S::vector_binary<VOP_AND, S::VV>},
+        {"vand.vx", 0xfc00707f, 0x24004057, R_TYPE,
+         S::vector_binary<VOP_AND, S::VX>},
+        {"vand.vi", 0xfc00707f, 0x24003057, R_TYPE,
+         S::vector_binary<VOP_AND, S::VI>},
+        {"vor.vv", 0xfc00707f, 0x28000057, R_TYPE,
+         S::vector_binary<VOP_OR, S::VV>},
+        {"vor.vx", 0xfc00707f, 0x28004057, R_TYPE,
+         S::vector_binary<VOP_OR, S::VX>},
+        {"vor.vi", 0xfc00707f, 0x28003057, R_TYPE,
+         S::vector_binary<VOP_OR, S::VI>},
+        {"vxor.vv", 0xfc00707f, 0x2c000057, R_TYPE,
+         S::vector_binary<VOP_XOR, S::VV>},
+        {"vxor.vx", 0xfc00707f, 0x2c004057, R_TYPE,
+         S::vector_binary<VOP_XOR, S::VX>},
+        {"vxor.vi", 0xfc00707f, 0x2c003057, R_TYPE,
+         S::vector_binary<VOP_XOR, S::VI>},
+        {"vsll.vv", 0xfc00707f, 0x94000057, R_TYPE,
+         S::vector_binary<VOP_SLL, S::VV>},
+        {"vsll.vx", 0xfc00707f, 0x94004057, R_TYPE,
+         S::vector_binary<VOP_SLL, S::VX>},
+        {"vsll.vi", 0xfc00707f, 0x94003057, R_TYPE,
+         S::vector_binary<VOP_SLL, S::VI>},
+        {"vsrl.vv", 0xfc00707f, 0xa0000057, R_TYPE,
+         S::vector_binary<VOP_SRL, S::VV>},
+        {"vsrl.vx", 0xfc00707f, 0xa0004057, R_TYPE,
+         S::vector_binary<VOP_SRL, S::VX>},
+        {"vsrl.vi", 0xfc00707f, 0xa0003057, R_TYPE,
+         S::vector_binary<VOP_SRL, S::VI>},
+        {"vsra.vv", 0xfc00707f, 0xa4000057, R_TYPE,
+         S::vector_binary<VOP_SRA, S::VV>},
+        {"vsra.vx", 0xfc00707f, 0xa4004057, R_TYPE,
+         S::vector_binary<VOP_SRA, S::VX>},
+        {"vsra.vi", 0xfc00707f, 0xa4003057, R_TYPE,
+         S::vector_binary<VOP_SRA, S::VI>},
+        {"vmerge.vvm", 0xfc00707f, 0x5c000057, R_TYPE, S::vector_merge<S::VV>},
+        {"vmerge.vxm", 0xfc00707f, 0x5c004057, R_TYPE, S::vector_merge<S::VX>},
+        {"vmerge.vim", 0xfc00707f, 0x5c003057, R_TYPE, S::vector_merge<S::VI>},
+        {"vmseq.vv", 0xfc00707f, 0x60000057, R_TYPE,
+         S::vector_compare<VCMP_EQ, S::VV>},
+        {"vmseq.vx", 0xfc00707f, 0x60004057, R_TYPE,
+         S::vector_compare<VCMP_EQ, S::VX>},
+        {"vmseq.vi", 0xfc00707f, 0x60003057, R_TYPE,
+         S::vector_compare<VCMP_EQ, S::VI>},
+        {"vmsne.vv", 0xfc00707f, 0x64000057, R_TYPE,
+         S::vector_compare<VCMP_NE, S::VV>},
+        {"vmsne.vx", 0xfc00707f, 0x64004057, R_TYPE,
+         S::vector_compare<VCMP_NE, S::VX>},
+        {"vmsne.vi", 0xfc00707f, 0x64003057, R_TYPE,
+         S::vector_compare<VCMP_NE, S::VI>},
+        {"vmsltu.vv", 0xfc00707f, 0x68000057, R_TYPE,
+         S::vector_compare<VCMP_LTU, S::VV>},
+        {"vmsltu.vx", 0xfc00707f, 0x68004057, R_TYPE,
+         S::vector_compare<VCMP_LTU, S::VX>},
+        {"vmslt.vv", 0xfc00707f, 0x6c000057, R_TYPE,
+         S::vector_compare<VCMP_LT, S::VV>},
+        {"vmslt.vx", 0xfc00707f, 0x6c004057, R_TYPE,
+         S::vector_compare<VCMP_LT, S::VX>},
+        {"vmsleu.vv", 0xfc00707f, 0x70000057, R_TYPE,
+         S::vector_compare<VCMP_LEU, S::VV>},
+        {"vmsleu.vx", 0xfc00707f, 0x70004057, R_TYPE,
+         S::vector_compare<VCMP_LEU, S::VX>},
+        {"vmsleu.vi", 0xfc00707f, 0x70003057, R_TYPE,
+         S::vector_compare<VCMP_LEU, S::VI>},
+        {"vmsle.vv", 0xfc00707f, 0x74000057, R_TYPE,
+         S::vector_compare<VCMP_LE, S::VV>},
+        {"vmsle.vx", 0xfc00707f, 0x74004057, R_TYPE,
+         S::vector_compare<VCMP_LE, S::VX>},
+        {"vmsle.vi", 0xfc00707f, 0x74003057, R_TYPE,
+         S::vector_compare<VCMP_LE, S::VI>},
+        {"vmsgtu.vx", 0xfc00707f, 0x78004057, R_TYPE,
+         S::vector_compare<VCMP_GTU, S::VX>},
+        {"vmsgtu.vi", 0xfc00707f, 0x78003057, R_TYPE,
+         S::vector_compare<VCMP_GTU, S::VI>},
+        {"vmsgt.vx", 0xfc00707f, 0x7c004057, R_TYPE,
+         S::vector_compare<VCMP_GT, S::VX>},
+        {"vmsgt.vi", 0xfc00707f, 0x7c003057, R_TYPE,
+         S::vector_compare<VCMP_GT, S::VI>},
+        {"vmulhu.vv", 0xfc00707f, 0x90002057, R_TYPE,
+         S::vector_binary<VOP_MULHU, S::VV>},
+        {"vmulhu.vx", 0xfc00707f, 0x90006057, R_TYPE,
+         S::vector_binary<VOP_MULHU, S::VX>},
+        {"vmul.vv", 0xfc00707f, 0x94002057, R_TYPE,
+         S::vector_binary<VOP_MUL, S::VV>},
+        {"vmul.vx", 0xfc00707f, 0x94006057, R_TYPE,
+         S::vector_binary<VOP_MUL, S::VX>},
+        {"vmulhsu.vv", 0xfc00707f, 0x98002057, R_TYPE,
+         S::vector_binary<VOP_MULHSU, S::VV>},
+        {"vmulhsu.vx", 0xfc00707f, 0x98006057, R_TYPE,
+         S::vector_binary<VOP_MULHSU, S::VX>},
+        {"vmulh.vv", 0xfc00707f, 0x9c002057, R_TYPE,
+         S::vector_binary<VOP_MULH, S::VV>},
+        {"vmulh.vx", 0xfc00707f, 0x9c006057, R_TYPE,
+         S::vector_binary<VOP_MULH, S::VX>},
+        {"vredsum.vs", 0xfc00707f, 0x00002057, R_TYPE,
+         S::vector_reduce<VRED_SUM>},
+        {"vredand.vs", 0xfc00707f, 0x04002057, R_TYPE,
+         S::vector_reduce<VRED_AND>},
+        {"vredor.vs", 0xfc00707f, 0x08002057, R_TYPE,
+         S::vector_reduce<VRED_OR>},
+        {"vredxor.vs", 0xfc00707f, 0x0c002057, R_TYPE,
+         S::vector_reduce<VRED_XOR>},
+        {"vredminu.vs", 0xfc00707f, 0x10002057, R_TYPE,
+         S::vector_reduce<VRED_MINU>},
+        {"vredmin.vs", 0xfc00707f, 0x14002057, R_TYPE,
+         S::vector_reduce<VRED_MIN>},
+        {"vredmaxu.vs", 0xfc00707f, 0x18002057, R_TYPE,
+         S::vector_reduce<VRED_MAXU>},
+        {"vredmax.vs", 0xfc00707f, 0x1c002057, R_TYPE,
+         S::vector_reduce<VRED_MAX>},
+        {"vmandn.mm", 0xfc00707f, 0x60002057, R_TYPE,
+         S::vector_mask_logical<VMASK_ANDN>},
+        {"vmand.mm", 0xfc00707f, 0x64002057, R_TYPE,
+         S::vector_mask_logical<VMASK_AND>},
+        {"vmor.mm", 0xfc00707f, 0x68002057, R_TYPE,
+         S::vector_mask_logical<VMASK_OR>},
+        {"vmxor.mm", 0xfc00707f, 0x6c002057, R_TYPE,
+         S::vector_mask_logical<VMASK_XOR>},
+        {"vmorn.mm", 0xfc00707f, 0x70002057, R_TYPE,
+         S::vector_mask_logical<VMASK_ORN>},
+        {"vmnand.mm", 0xfc00707f, 0x74002057, R_TYPE,
+         S::vector_mask_logical<VMASK_NAND>},
+        {"vmnor.mm", 0xfc00707f, 0x78002057, R_TYPE,
+         S::vector_mask_logical<VMASK_NOR>},
+        {"vmxnor.mm", 0xfc00707f, 0x7c002057, R_TYPE,
+         S::vector_mask_logical<VMASK_XNOR>},
+        {"vmv.x.s", 0xfe0ff07f, 0x42002057, R_TYPE, S::vector_move_to_int},
+        {"vcpop.m", 0xfc0ff07f, 0x40082057, R_TYPE, S::vector_scan<false>},
+        {"vfirst.m", 0xfc0ff07f, 0x4008a057, R_TYPE, S::vector_scan<true>},
+        {"vmv.s.x", 0xfff0707f, 0x42006057, R_TYPE, S::vector_move_from_int},
+        {"vid.v", 0xfdfff07f, 0x5008a057, R_TYPE, S::vector_id},
+    });
+    if constexpr (XLEN == 32)
+    {
+        return join(rv32, rvv);
+    }
+    else
+    {
+        using alu64 = ALU<uint64_t>;
+        auto rv64 = std::to_array<Spec>({
+            // RV64I
+            {"lwu", 0x0000707f, 0x00006003, I_TYPE, S::load<uint32_t>},
+            {"ld", 0x0000707f, 0x00003003, I_TYPE, S::load<uint64_t>},
+            {"sd", 0x0000707f, 0x00003023, S_TYPE, S::store<8>},
+            {"addiw", 0x0000707f, 0x0000001b, I_TYPE,
+             S::reg_imm_w<alu32::add>},
+            {"slliw", 0xfe00707f, 0x0000101b, I_TYPE,
+             S::shift_imm_w<alu32::sll>},
+            {"srliw", 0xfe00707f, 0x0000501b, I_TYPE,
+             S::shift_imm_w<alu32::srl>},
+            {"sraiw", 0xfe00707f, 0x4000501b, I_TYPE,
+             S::shift_imm_w<alu32::sra>},
+            {"addw", 0xfe00707f, 0x0000003b, R_TYPE, S::reg_reg_w<alu32::add>},
+            {"subw", 0xfe00707f, 0x4000003b, R_TYPE, S::reg_reg_w<alu32::sub>},
+            {"sllw", 0xfe00707f, 0x0000103b, R_TYPE, S::reg_reg_w<alu32::sll>},
+            {"srlw", 0xfe00707f, 0x0000503b, R_TYPE, S::reg_reg_w<alu32::srl>},
+            {"sraw", 0xfe00707f, 0x4000503b, R_TYPE, S::reg_reg_w<alu32::sra>},
+            // RV64M
+            {"mulw", 0xfe00707f, 0x0200003b, R_TYPE, S::reg_reg_w<alu32::mul>},
+            {"divw", 0xfe00707f, 0x0200403b, R_TYPE, S::reg_reg_w<alu32::div>},
+            {"divuw", 0xfe00707f, 0x0200503b, R_TYPE,
+             S::reg_reg_w<alu32::divu>},
+            {"remw", 0xfe00707f, 0x0200603b, R_TYPE, S::reg_reg_w<alu32::rem>},
+            {"remuw", 0xfe00707f, 0x0200703b, R_TYPE,
+             S::reg_reg_w<alu32::remu>},
+            // RV64A
+            {"lr.d", 0xf9f0707f, 0x1000302f, R_TYPE,
+             S::load_reserved<int64_t>},
+            {"sc.d", 0xf800707f, 0x1800302f, R_TYPE,
+             S::store_conditional<int64_t>},
+            {"amoswap.d", 0xf800707f, 0x0800302f, R_TYPE,
+             S::amo<uint64_t, alu64::swap>},
+            {"amoadd.d", 0xf800707f, 0x0000302f, R_TYPE,
+             S::amo<uint64_t, alu64::add>},
+            {"amoxor.d", 0xf800707f, 0x2000302f, R_TYPE,
+             S::amo<uint64_t, alu64::bit_xor>},
+            {"amoand.d", 0xf800707f, 0x6000302f, R_TYPE,
+             S::amo<uint64_t, alu64::bit_and>},
+            {"amoor.d", 0xf800707f, 0x4000302f, R_TYPE,
+             S::amo<uint64_t, alu64::bit_or>},
+            {"amomin.d", 0xf800707f, 0x8000302f, R_TYPE,
+             S::amo<uint64_t, alu64::min>},
+            {"amomax.d", 0xf800707f, 0xa000302f, R_TYPE,
+             S::amo<uint64_t, alu64::max>},
+            {"amominu.d", 0xf800707f, 0xc000302f, R_TYPE,
+             S::amo<uint64_t, alu64::minu>},
+            {"amomaxu.d", 0xf800707f, 0xe000302f, R_TYPE,
+             S::amo<uint64_t, alu64::maxu>},
+            // RV64F
+            {"fcvt.l.s", 0xfff0007f, 0xc0200053, R_TYPE,
+             S::fp_to_int<float, int64_t>},
+            {"fcvt.lu.s", 0xfff0007f, 0xc0300053, R_TYPE,
+             S::fp_to_int<float, uint64_t>},
+            {"fcvt.s.l", 0xfff0007f, 0xd0200053, R_TYPE,
+             S::fp_from_int<float, int64_t>},
+            {"fcvt.s.lu", 0xfff0007f, 0xd0300053, R_TYPE,
+             S::fp_from_int<float, uint64_t>},
+            // RV64D
+            {"fcvt.l.d", 0xfff0007f, 0xc2200053, R_TYPE,
+             S::fp_to_int<double, int64_t>},
+            {"fcvt.lu.d", 0xfff0007f, 0xc2300053, R_TYPE,
+             S::fp_to_int<double, uint64_t>},
+            {"fmv.x.d", 0xfff0707f, 0xe2000053, R_TYPE,
+             S::fp_move_to_int<double>},
+            {"fcvt.d.l", 0xfff0007f, 0xd2200053, R_TYPE,
+             S::fp_from_int<double, int64_t>},
+            {"fcvt.d.lu", 0xfff0007f, 0xd2300053, R_TYPE,
+             S::fp_from_int<double, uint64_t>},
+            {"fmv.d.x", 0xfff0707f, 0xf2000053, R_TYPE,
+             S::fp_move_from_int<double>},
+        });
+        return join(join(rv32, rv64), rvv);
+    }
+}
+
+template <int XLEN>
+constexpr auto inst_table = Semantics<XLEN>::table();
+template <int XLEN>
+using InstIndex = DecodeIndex<inst_table<XLEN>>;
+
+namespace
+{
+
+// An expanded instruction as plugins see it.
+InstructionInfo describe(uint64_t pc, inst_t inst, int len,
+                         std::string_view name)
+{
+    InstructionInfo info{pc, inst, len, name, InstructionKind::OTHER, 0};
+    unsigned funct3 = inst >> 12 & 0b111;
+    switch (inst & 0x7f)
+    {
+        case OpcodeMap::LOAD:
+            info.kind = InstructionKind::LOAD;
+            info.access_size = 1 << (funct3 & 0b11);
+            break;
+        case OpcodeMap::STORE:
+            info.kind = InstructionKind::STORE;
+            info.access_size = 1 << (funct3 & 0b11);
+            break;
+        // The other widths are vector loads and stores.
+        case OpcodeMap::LOAD_FP:
+        case OpcodeMap::STORE_FP:
+            if (funct3 != 0b010 && funct3 != 0b011) break;
+            info.kind = (inst & 0x7f) == OpcodeMap::LOAD_FP
+                            ? InstructionKind::LOAD
+                            : InstructionKind::STORE;
+            info.access_size = 1 << funct3;
+            break;
+        case OpcodeMap::BRANCH:
+            info.kind = InstructionKind::BRANCH;
+            break;
+        case OpcodeMap::JAL:
+            info.kind = InstructionKind::JUMP;
+            break;
+        case OpcodeMap::JALR:
+            info.kind = InstructionKind::INDIRECT_JUMP;
+            break;
+        case OpcodeMap::SYSTEM:
+            if (inst == 0x30200073) info.kind = InstructionKind::INDIRECT_JUMP;
+            break;
+    }
+    return info;
+}
+
+}  // namespace
+
+template <int XLEN>
+EmuCore<XLEN>::RegisterFile::RegisterFile() { reset(); }
+
+template <int XLEN>
+void EmuCore<XLEN>::RegisterFile::reset()
+{
+    x.fill(0);
+    f.fill(0);
+    v.fill(0);
+}
+
+template <int XLEN>
+EmuCore<XLEN>::CSRFile::CSRFile() { reset(); }
+
+template <int XLEN>
+void EmuCore<XLEN>::CSRFile::reset()
+{
+    mstatus = MSTATUS_MPP | MSTATUS_FS | MSTATUS_VS | mstatus_sd;
+    mie = 0;
+    mip = 0;
+    mtvec = 0;
+    mscratch = 0;
+    mepc = 0;
+    mcause = 0;
+    mtval = 0;
+    mcycle_offset = 0;
+    minstret_offset = 0;
+    fflags = 0;
+    frm = RM_RNE;
+    vstart = 0;
+    vxsat = 0;
+    vxrm = 0;
+    vl = 0;
+    vtype = vtype_vill;
+}
+
+template <int XLEN>
+EmuCore<XLEN>::EmuCore(Memory& memory)
+    : memory(memory),
+      null_operand(0),
+      pc(pc_init),
+      next_pc(pc_init),
+      reset_pc(pc_init),
+      instret(0),
+      recent_pcs{},
+      recent_since(0),
+      quantum_left(0),
+      interrupt_pending(false),
+      quantum_ended(false),
+      decode_cache(decode_cache_size),
+      host_rm(RM_RNE),
+      vector_kernels(host_vector_kernels()),
+      host_functions_suspended(false),
+      plugins(nullptr),
+      syscalls(nullptr)
+{
+}
+
+template <int XLEN>
+EmuCore<XLEN>::~EmuCore() {}
+
+template <int XLEN>
+auto EmuCore<XLEN>::decode(word_t inst_pc, inst_t inst) -> Handler
+{
+    // Reserved compressed encodings expand to 0, which no row matches.
+    int len = instruction_length(inst);
+    if (is_compressed(inst)) inst = expand_compressed<XLEN>(inst);
+    auto spec = InstIndex<XLEN>::find(inst);
+    // Unknown instructions, and those a builder rejects (e.g. a reserved
+    // static rounding mode), are the guest's to handle.
+    auto illegal = [this, inst]()
+    { next_pc = trap(CAUSE_ILLEGAL_INSTRUCTION, inst); };
+    if (spec == nullptr) return illegal;
+    auto& x = register_file.x;
+    word_t imm = immediate_extractors[spec->format](inst);
+    typename Semantics<XLEN>::Operands operands{
+        x[inst >> 7 & 0x1f], x[inst >> 15 & 0x1f], x[inst >> 20 & 0x1f],
+        imm, inst_pc, inst, len};
+    Handler handler;
+    try
+    {
+        handler = spec->semantic(*this, operands);
+    }
+    catch (invalid_instruction&)
+    {
+        return illegal;
+    }
+    auto host_function = host_functions.find(inst_pc);
+    if (host_function != host_functions.end())
+    {
+        handler = [this, function = host_function->second,
+                   guest = std::move(handler)]
+        {
+            if (host_functions_suspended || !call_host_function(function))
+                guest();
+        };
+    }
+    if (plugins != nullptr)
+    {
+        auto info = describe(inst_pc, inst, len, spec->name);
+        // A call run on the host returns to ra.
+        if (host_function != host_functions.end())
+            info.kind = InstructionKind::INDIRECT_JUMP;
+        handler = instrument(std::move(handler), info, operands.rs1, imm);
+    }
+    return handler;
+}
+
+// Wraps handler in the callbacks plugins subscribe to for the instruction.
+// Loads and stores report x[rs1] + imm, read before the instruction may
+// overwrite rs1.
+template <int XLEN>
+auto EmuCore<XLEN>::instrument(Handler handler, const InstructionInfo& info,
+                               word_t& base, word_t offset) -> Handler
+{
+    auto probes = plugins->translate(info);
+    if (info.kind != InstructionKind::LOAD &&
+        info.kind != InstructionKind::STORE)
+        probes.memory.clear();
+    if (probes.empty()) return handler;
+    return [this, handler = std::move(handler), probes = std::move(probes),
+            &base, offset]()
+    {
+        for (auto& callback : probes.execute) callback();
+        if (!probes.memory.empty())
+        {
+            word_t addr = base + offset;
+            for (auto& callback : probes.memory) callback(addr);
+        }
+        handler();
+        for (auto& callback : probes.control) callback(next_pc);
+    };
+}
+
+// Reads the instruction at pc, 16 or 32 bits. In RAM a single 4-byte read
+// covers both parcels, also for an instruction straddling a word boundary;
+// the parcels are only read one by one next to the end of RAM or in MMIO.
+template <int XLEN>
+auto EmuCore<XLEN>::fetch(word_t pc) -> inst_t
+{
+    if (memory.is_ram(pc, 4))
+    {
+        auto inst = memory.inst_fetch(pc, 4);
+        return is_compressed(inst) ? inst & 0xffff : inst;
+    }
+    auto low = memory.inst_fetch(pc, 2);
+    if (is_compressed(low)) return low;
+    return low | memory.inst_fetch(pc + 2, 2) << 16;
+}
+
+template <int XLEN>
+auto EmuCore<XLEN>::lookup(word_t pc) -> DecodedInst&
+{
+    // Word-aligned pcs use the whole cache. The upper halfword of a word
+    // maps to the opposite half, so a compressed instruction does not evict
+    // its neighbour.
+    size_t index = (pc >> 2) ^ (pc >> 1 & 1) * (decode_cache_size / 2);
+    auto& entry = decode_cache[index & (decode_cache_size - 1)];
+    auto inst = fetch(pc);
+    if (entry.valid && entry.pc == pc && entry.inst[0] == inst &&
+        (!entry.fused || fetch(pc + 4) == entry.inst[1]))
+        return entry;
+
+    counters.decode_misses++;
+    entry.valid = false;
+    entry.handler = decode(pc, inst);
+    entry.fused = nullptr;
+    entry.pc = pc;
+    entry.len = instruction_length(inst);
+    entry.inst[0] = inst;
+    // Only pairs of 32-bit instructions are fused, and not the entry of a
+    // host function.
+    if (entry.len == 4 && memory.is_ram(pc + 4, 4) &&
+        !host_functions.contains(pc) && plugins == nullptr)
+    {
+        entry.inst[1] = fetch(pc + 4);
+        if (!is_compressed(entry.inst[1]))
+            entry.fused = fuse(pc, inst, entry.inst[1]);
+    }
+    entry.valid = true;
+    return entry;
+}
+
+// Fuses lui+addi and auipc+addi (constants and addresses), lui+addiw on
+// RV64, auipc+jalr (far calls), auipc+lw (global loads) and
+// slt[u]+beqz/bnez. Returns nullptr for anything else.
+template <int XLEN>
+auto EmuCore<XLEN>::fuse(word_t inst_pc, inst_t inst, inst_t next) -> Handler
+{
+    UnionInstructionText first({.inst_text = inst});
+    UnionInstructionText second({.inst_text = next});
+    auto opcode = first.r_inst.opcode;
+    auto next_opcode = second.r_inst.opcode;
+    auto rd = first.r_inst.rd;
+    if (rd == 0 || second.r_inst.rs1 != rd) return nullptr;
+
+    auto& x = register_file.x;
+    auto& dest = x[rd];
+    if (opcode == OpcodeMap::LUI || opcode == OpcodeMap::AUIPC)
+    {
+        word_t upper = immediate<U_TYPE>(inst);
+        if (opcode == OpcodeMap::AUIPC) upper += inst_pc;
+        auto& dest2 = x[second.i_inst.rd];
+        word_t lower = immediate<I_TYPE>(next);
+        bool addi = next_opcode == OpcodeMap::OP_IMM &&
+                    second.i_inst.funct3 == 0b000;
+        bool addiw = XLEN == 64 && opcode == OpcodeMap::LUI &&
+                     next_opcode == OpcodeMap::OP_IMM_32 &&
+                     second.i_inst.funct3 == 0b000;
+        bool lw = opcode == OpcodeMap::AUIPC &&
+                  next_opcode == OpcodeMap::LOAD &&
+                  second.i_inst.funct3 == 0b010;
+        bool jalr = opcode == OpcodeMap::AUIPC &&
+                    next_opcode == OpcodeMap::JALR &&
+                    second.i_inst.funct3 == 0b000;
+        if (addi)
+        {
+            return [this, &dest, &dest2, upper, lower]()
+            {
+                dest = upper;
+                pc += 4;
+                instret++;
+                dest2 = upper + lower;
+            };
+        }
+        if (addiw)
+        {
+            return [this, &dest, &dest2, upper, lower]()
+            {
+                dest = upper;
+                pc += 4;
+                instret++;
+                dest2 = int32_t(upper + lower);
+            };
+        }
+        if (lw)
+        {
+            return [this, &dest, &dest2, upper, lower]()
+            {
+                dest = upper;
+                pc += 4;
+                instret++;
+                dest2 = int32_t(memory.vread<uint32_t>(upper + lower, 4));
+            };
+        }
+        if (jalr)
+        {
+            word_t target = (upper + lower) & ~word_t(1);
+            word_t link = inst_pc + 8;
+            return [this, &dest, &dest2, upper, target, link]()
+            {
+                dest = upper;
+                pc += 4;
+                instret++;
+                dest2 = link;
+                next_pc = target;
+            };
+        }
+        return nullptr;
+    }
+
+    // slt[u] rd, rs1, rs2 followed by beq/bne rd, x0.
+    bool slt = opcode == OpcodeMap::OP && first.r_inst.funct7 == 0 &&
+               (first.r_inst.funct3 == 0b010 || first.r_inst.funct3 == 0b011);
+    bool branch = next_opcode == OpcodeMap::BRANCH &&
+                  second.b_inst.rs2 == 0 &&
+                  (second.b_inst.funct3 == 0b000 ||
+                   second.b_inst.funct3 == 0b001);
+    if (!slt || !branch) return nullptr;
+    auto& src1 = x[first.r_inst.rs1];
+    auto& src2 = x[first.r_inst.rs2];
+    word_t target = inst_pc + 4 + immediate<B_TYPE>(next);
+    // The branch is taken when the comparison equals taken_if.
+    bool taken_if = second.b_inst.funct3 == 0b001;
+    if (first.r_inst.funct3 == 0b010)
+    {
+        return [this, &dest, &src1, &src2, target, taken_if]()
+        {
+            bool less =
+                static_cast<sword_t>(src1) < static_cast<sword_t>(src2);
+            dest = less;
+            pc += 4;
+            instret++;
+            if (less == taken_if) next_pc = target;
+        };
+    }
+    return [this, &dest, &src1, &src2, target, taken_if]()
+    {
+        bool less = src1 < src2;
+        dest = less;
+        pc += 4;
+        instret++;
+        if (less == taken_if) next_pc = target;
+    };
+}
+
+template <int XLEN>
+auto EmuCore<XLEN>::csr_read(word_t addr) -> word_t
+{
+    uint64_t mcycle = instret + csr.mcycle_offset;
+    uint64_t minstret = instret + csr.minstret_offset;
+    switch (addr)
+    {
+        case FFLAGS:
+            return csr.fflags | host_fflags();
+        case FRM:
+            return csr.frm;
+        case FCSR:
+            return csr.frm << 5 | csr.fflags | host_fflags();
+        case VSTART:
+            return csr.vstart;
+        case VXSAT:
+            return csr.vxsat;
+        case VXRM:
+            return csr.vxrm;
+        case VCSR:
+            return csr.vxrm << 1 | csr.vxsat;
+        case VL:
+            return csr.vl;
+        case VTYPE:
+            return csr.vtype;
+        case VLENB:
+            return vlenb;
+        case MSTATUS:
+            return csr.mstatus;
+        case MISA:
+            // MXL = 1 (32 bit) or 2 (64 bit), extensions A, C, D, F, I, M
+            // and V
+            return word_t(XLEN / 32) << (XLEN - 2) | (1u << ('A' - 'A')) |
+                   (1u << ('C' - 'A')) | (1u << ('D' - 'A')) |
+                   (1u << ('F' - 'A')) | (1u << ('I' - 'A')) |
+                   (1u << ('M' - 'A')) | (1u << ('V' - 'A'));
+        case MIE:
+            return csr.mie;
+        case MIP:
+            return csr.mip;
+        case MTVEC:
+            return csr.mtvec;
+        case MSCRATCH:
+            return csr.mscratch;
+        case MEPC:
+            return csr.mepc;
+        case MCAUSE:
+            return csr.mcause;
+        case MTVAL:
+            return csr.mtval;
+        case MCYCLE:
+        case CYCLE:
+            return mcycle;
+        case MCYCLEH:
+        case CYCLEH:
+            if (XLEN == 64) throw invalid_instruction();
+            return mcycle >> 32;
+        case TIME:
+            if (!mtime) throw invalid_instruction();
+            return mtime();
+        case TIMEH:
+            if (XLEN == 64 || !mtime) throw invalid_instruction();
+            return mtime() >> 32;
+        case MINSTRET:
+        case INSTRET:
+            return minstret;
+        case MINSTRETH:
+        case INSTRETH:
+            if (XLEN == 64) throw invalid_instruction();
+            return minstret >> 32;
+        case MVENDORID:
+        case MARCHID:
+        case MIMPID:
+        case MHARTID:
+            return 0;
+        default:
+            throw invalid_instruction();
+    }
+}
+
+template <int XLEN>
+void EmuCore<XLEN>::csr_write(word_t addr, word_t data)
+{
+    constexpr word_t irq_mask =
+        (1u << IRQ_M_SOFT) | (1u << IRQ_M_TIMER) | (1u << IRQ_M_EXT);
+    // The instruction doing the write has not retired yet.
+    uint64_t next_instret = instret + 1;
+    // On RV32 writing the low half of a counter keeps the high half.
+    constexpr uint64_t high_half = XLEN == 64 ? 0 : 0xffffffff00000000ull;
+    switch (addr)
+    {
+        case FFLAGS:
+            csr.fflags = data & 0x1f;
+            std::feclearexcept(FE_ALL_EXCEPT);
+            break;
+        case FRM:
+            csr.frm = data & 0x7;
+            break;
+        case FCSR:
+            csr.fflags = data & 0x1f;
+            csr.frm = data >> 5 & 0x7;
+            std::feclearexcept(FE_ALL_EXCEPT);
+            break;
+        case VSTART:
+            csr.vstart = data & (vlen - 1);
+            break;
+        case VXSAT:
+            csr.vxsat = data & 0x1;
+            break;
+        case VXRM:
+            csr.vxrm = data & 0x3;
+            break;
+        case VCSR:
+            csr.vxsat = data & 0x1;
+            csr.vxrm = data >> 1 & 0x3;
+            break;
+        case MSTATUS:
+            csr.mstatus = (data & (MSTATUS_MIE | MSTATUS_MPIE)) |
+                          MSTATUS_MPP | MSTATUS_FS | MSTATUS_VS | mstatus_sd;
+            update_interrupt_pending();
+            break;
+        case MISA:
+            break;
+        case MIE:
+            csr.mie = data & irq_mask;
+            update_interrupt_pending();
+            break;
+        case MIP:
+            // MSIP, MTIP and MEIP are driven by devices, not by software.
+            break;
+        case MTVEC:
+            csr.mtvec = data & ~word_t(0b10);
+            break;
+        case MSCRATCH:
+            csr.mscratch = data;
+            break;
+        case MEPC:
+            // IALIGN is 16 with C, so only bit 0 is clear.
+            csr.mepc = data & ~word_t(1);
+            break;
+        case MCAUSE:
+            csr.mcause = data;
+            break;
+        case MTVAL:
+            csr.mtval = data;
+            break;
+        case MCYCLE:
+        {
+            uint64_t value = (instret + csr.mcycle_offset) & high_half;
+            csr.mcycle_offset = (value | data) - next_instret;
+            break;
+        }
+        case MCYCLEH:
+        {
+            if (XLEN == 64) throw invalid_instruction();
+            uint64_t value = (instret + csr.mcycle_offset) & 0xffffffffull;
+            csr.mcycle_offset =
+                (value | (uint64_t(data) << 32)) - next_instret;
+            break;
+        }
+        case MINSTRET:
+        {
+            uint64_t value = (instret + csr.minstret_offset) & high_half;
+            csr.minstret_offset = (value | data) - next_instret;
+            break;
+        }
+        case MINSTRETH:
+        {
+            if (XLEN == 64) throw invalid_instruction();
+            uint64_t value = (instret + csr.minstret_offset) & 0xffffffffull;
+            csr.minstret_offset =
+                (value | (uint64_t(data) << 32)) - next_instret;
+            break;
+        }
+        default:
+            throw invalid_instruction();
+    }
+}
+
+// Enters the trap handler with pc as the faulting / interrupted instruction.
+// Returns the address of the handler.
+template <int XLEN>
+auto EmuCore<XLEN>::trap(word_t cause, word_t tval) -> word_t
+{
+    word_t code = cause & ~cause_interrupt;
+    if (code < 16) counters.traps[(cause & cause_interrupt ? 16 : 0) + code]++;
+    csr.mepc = pc;
+    csr.mcause = cause;
+    csr.mtval = tval;
+    csr.mstatus &= ~MSTATUS_MPIE;
+    if (csr.mstatus & MSTATUS_MIE) csr.mstatus |= MSTATUS_MPIE;
+    csr.mstatus &= ~MSTATUS_MIE;
+    csr.mstatus |= MSTATUS_MPP;
+    interrupt_pending = false;
+    reservation.reset();
+
+    word_t handler = csr.mtvec & ~word_t(0b11);
+    bool vectored = (csr.mtvec & 0b11) == 1;
+    if (vectored && (cause & cause_interrupt))
+        handler += 4 * (cause & ~cause_interrupt);
+    if (plugins != nullptr) plugins->trap(pc, cause, tval, handler);
+    return handler;
+}
+
+template <int XLEN>
+void EmuCore<XLEN>::take_interrupt()
+{
+    word_t pending = csr.mip & csr.mie;
+    for (auto irq : {IRQ_M_EXT, IRQ_M_SOFT, IRQ_M_TIMER})
+    {
+        if (pending & (1u << irq))
+        {
+            pc = trap(cause_interrupt | word_t(irq), 0);
+            return;
+        }
+    }
+}
+
+template <int XLEN>
+void EmuCore<XLEN>::update_interrupt_pending()
+{
+    interrupt_pending =
+        (csr.mstatus & MSTATUS_MIE) && (csr.mip & csr.mie) != 0;
+    if (interrupt_pending) quantum_left = 0;
+}
+
+template <int XLEN>
+void EmuCore<XLEN>::reset_impl()
+{
+    pc = reset_pc;
+    register_file.reset();
+    csr.reset();
+    instret = 0;
+    recent_since = 0;
+    interrupt_pending = false;
+    reservation.reset();
+}
+
+template <int XLEN>
+void EmuCore<XLEN>::set_interrupt_impl(int irq, bool pending)
+{
+    if (pending)
+        csr.mip |= 1u << irq;
+    else
+        csr.mip &= ~(1u << irq);
+    update_interrupt_pending();
+}
+
+template <int XLEN>
+void EmuCore<XLEN>::set_timer_impl(std::function<uint64_t()> mtime)
+{
+    this->mtime = std::move(mtime);
+}
+
+template <int XLEN>
+auto EmuCore<XLEN>::save_state_impl() -> State
+{
+    return State{register_file, csr, pc, instret, interrupt_pending,
+                 reservation};
+}
+
+template <int XLEN>
+void EmuCore<XLEN>::restore_state_impl(const State& state)
+{
+    register_file = state.register_file;
+    csr = state.csr;
+    pc = state.pc;
+    instret = state.instret;
+    recent_since = instret;
+    interrupt_pending = state.interrupt_pending;
+    reservation = state.reservation;
+}
+
+template <int XLEN>
+bool EmuCore<XLEN>::intercept_function_impl(std::string_view name,
+                                            uint64_t addr)
+{
+    using Name = std::pair<std::string_view, HostFunction>;
+    static constexpr Name names[] = {
+        {"memcpy", HostFunction::MEMCPY},
+        {"memset", HostFunction::MEMSET},
+        {"memcmp", HostFunction::MEMCMP},
+        {"strlen", HostFunction::STRLEN},
+    };
+    auto it = std::ranges::find(names, name, &Name::first);
+    if (it == std::end(names)) return false;
+    host_functions[static_cast<word_t>(addr)] = it->second;
+    // The entry point may be decoded, or fused with its successor, already.
+    for (auto& entry : decode_cache) entry.valid = false;
+    return true;
+}
+
+template <int XLEN>
+void EmuCore<XLEN>::suspend_interception_impl(bool suspend)
+{
+    host_functions_suspended = suspend;
+}
+
+template <int XLEN>
+void EmuCore<XLEN>::set_plugins_impl(PluginManager* plugins)
+{
+    this->plugins = plugins;
+    for (auto& entry : decode_cache) entry.valid = false;
+}
+
+template <int XLEN>
+void EmuCore<XLEN>::enter_user_mode_impl(LinuxSyscalls& syscalls, uint64_t sp)
+{
+    this->syscalls = &syscalls;
+    register_file.x[2] = static_cast<word_t>(sp);
+}
+
+template <int XLEN>
+void EmuCore<XLEN>::system_call()
+{
+    auto& x = register_file.x;
+    x[10] = static_cast<word_t>(
+        syscalls->call(x[17], {x[10], x[11], x[12], x[13], x[14], x[15]}));
+}
+
+template <int XLEN>
+bool EmuCore<XLEN>::call_host_function(HostFunction function)
+{
+    auto& x = register_file.x;
+    word_t dst = x[10];
+    word_t src = x[11];
+    word_t len = x[12];
+    switch (function)
+    {
+        case HostFunction::MEMCPY:
+            // Overlapping memcpy is undefined; what the guest code does
+            // then depends on its copy order.
+            if (len != 0 && dst < src + len && src < dst + len) return false;
+            if (!memory.move_block(dst, src, len)) return false;
+            break;
+        case HostFunction::MEMSET:
+            if (!memory.fill_block(dst, uint8_t(src), len)) return false;
+            break;
+        case HostFunction::MEMCMP:
+        {
+            if (!memory.is_ram(dst, len) || !memory.is_ram(src, len))
+                return false;
+            auto a = memory.ram_view(dst).first(len);
+            auto b = memory.ram_view(src).first(len);
+            auto [i, j] = std::ranges::mismatch(a, b);
+            // The difference of the first differing bytes, as the generic C
+            // versions of newlib and picolibc return.
+            x[10] = i == a.end() ? 0 : word_t(sword_t(int(*i) - int(*j)));
+            break;
+        }
+        case HostFunction::STRLEN:
+        {
+            auto s = memory.ram_view(dst);
+            auto nul = std::ranges::find(s, uint8_t(0));
+            if (nul == s.end()) return false;
+            x[10] = word_t(nul - s.begin());
+            break;
+        }
+    }
+    next_pc = x[1] & ~word_t(1);
+    return true;
+}
+
+template <int XLEN>
+EmuCore<XLEN>::HostFPU::HostFPU(EmuCore& core) : core(core)
+{
+    std::feclearexcept(FE_ALL_EXCEPT);
+}
+
+template <int XLEN>
+EmuCore<XLEN>::HostFPU::~HostFPU()
+{
+    core.csr.fflags |= host_fflags();
+    std::feclearexcept(FE_ALL_EXCEPT);
+    if (core.host_rm != RM_RNE)
+    {
+        std::fesetround(FE_TONEAREST);
+        core.host_rm = RM_RNE;
+    }
+}
+
+template <int XLEN>
+bool EmuCore<XLEN>::set_rounding(int rm, bool& rmm)
+{
+    if (rm == RM_DYN) rm = csr.frm;
+    if (rm != host_rm) [[unlikely]]
+    {
+        int mode = host_rounding(rm);
+        if (mode < 0) return false;
+        std::fesetround(mode);
+        host_rm = rm;
+    }
+    rmm = rm == RM_RMM;
+    return true;
+}
+
+template <int XLEN>
+void EmuCore<XLEN>::execute_impl(uint64_t n)
+{
+    HostFPU host_fpu(*this);
+    quantum_ended = false;
+    while (n > 0 && !quantum_ended)
+    {
+        if (interrupt_pending) take_interrupt();
+        quantum_left = n;
+        while (quantum_left > 0)
+        {
+            auto& entry = lookup(pc);
+            // An instruction that throws does not retire, so its entry is
+            // not read back; pc still points at it.
+            recent_pcs[instret % recent_pcs.size()] = pc;
+            if (entry.fused && quantum_left >= 2)
+            {
+                quantum_left -= 2;
+                n -= 2;
+                next_pc = pc + 8;
+                recent_pcs[(instret + 1) % recent_pcs.size()] = pc + 4;
+                entry.fused();
+            }
+            else
+            {
+                quantum_left--;
+                n--;
+                next_pc = pc + entry.len;
+                entry.handler();
+            }
+            pc = next_pc;
+            register_file.x[0] = 0;
+            instret++;
+        }
+    }
+}
+
+template <int XLEN>
+void EmuCore<XLEN>::end_quantum_impl()
+{
+    quantum_left = 0;
+    quantum_ended = true;
+}
+
+template <int XLEN>
+void EmuCore<XLEN>::set_reset_pc_impl(uint64_t entry)
+{
+    reset_pc = static_cast<word_t>(entry);
+    pc = reset_pc;
+}
+
+template <int XLEN>
+auto EmuCore<XLEN>::debug_get_reg_val_impl(int reg_num) -> word_t
+{
+    return register_file.x.at(reg_num);
+}
+
+template <int XLEN>
+auto EmuCore<XLEN>::debug_get_pc_impl() -> word_t { return pc; }
+
+template <int XLEN>
+std::vector<uint64_t> EmuCore<XLEN>::recent_pcs_impl()
+{
+    // The entry at instret may belong to an instruction that threw.
+    uint64_t first = instret - std::min<uint64_t>(instret - recent_since,
+                                                   recent_pcs.size() - 1);
+    std::vector<uint64_t> pcs;
+    for (uint64_t i = first; i < instret; i++)
+        pcs.push_back(recent_pcs[i % recent_pcs.size()]);
+    return pcs;
+}
+
+template <int XLEN>
+auto EmuCore<XLEN>::debug_get_reg_index_impl(std::string_view reg_name)
+    -> word_t
+{
+    for (int i = 0; i < 32; i++)
+        if (reg_name == reg_name_list[i]) return i;
+    return -1;
+}
+
+template class EmuCore<32>;
+template class EmuCore<64>;
+
+}  // namespace RISCV
\ No newline at end of file
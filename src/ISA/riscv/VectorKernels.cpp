@@ -0,0 +1,45 @@
+#include <spdlog/spdlog.h>
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "ISA/riscv/Vector.hpp"
+
+namespace RISCV
+{
+
+namespace
+{
+#include "VectorKernels.ipp"
+}  // namespace
+
+// The baseline build: SSE2 on x86-64, whatever the compiler targets
+// elsewhere.
+extern const VectorKernels vector_kernels_baseline;
+const VectorKernels vector_kernels_baseline = make_kernels("baseline");
+
+#ifdef NEMU_VECTOR_AVX2
+// In VectorKernelsAVX2.cpp.
+extern const VectorKernels vector_kernels_avx2;
+#endif
+
+const VectorKernels& host_vector_kernels()
+{
+    static const VectorKernels& kernels = []() -> const VectorKernels&
+    {
+#ifdef NEMU_VECTOR_AVX2
+        if (__builtin_cpu_supports("avx2")) return vector_kernels_avx2;
+#endif
+        return vector_kernels_baseline;
+    }();
+    static bool logged = false;
+    if (!logged)
+    {
+        spdlog::info("Vector kernels: {}", kernels.name);
+        logged = true;
+    }
+    return kernels;
+}
+
+}  // namespace RISCV
@@ -0,0 +1,502 @@
+// Host kernels for the V extension, written with GCC vector extensions so
+// one source serves every host instruction set. A VectorKernels*.cpp
+// includes this inside an unnamed namespace and compiles it with its own
+// target flags, so the copies never meet at link time. For the same reason
+// nothing here calls inline library code: an instantiation compiled for
+// AVX2 could be the one the linker keeps for the baseline build.
+
+// Functions taking or returning vectors are always inlined, so no vector
+// crosses a call and GCC's note on the ABI of passing them does not apply.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+// One host vector holds one vector register. The typedefs are members of a
+// class template: GCC drops the attribute from a plain alias template when
+// the type is used as a template argument.
+template <typename T>
+struct VectorOf
+{
+    typedef T type [[gnu::vector_size(vlenb)]];
+    typedef T wide [[gnu::vector_size(2 * vlenb)]];
+};
+template <typename T>
+using vec = typename VectorOf<T>::type;
+template <typename T>
+using wide_vec = typename VectorOf<T>::wide;
+
+template <typename U>
+constexpr size_t lanes = vlenb / sizeof(U);
+
+template <typename U, typename = std::make_index_sequence<lanes<U>>>
+struct Iota;
+
+template <typename U, size_t... i>
+struct Iota<U, std::index_sequence<i...>>
+{
+    static constexpr vec<U> value = {U(i)...};
+};
+
+// 0, 1, 2, ... in the lanes.
+template <typename U>
+constexpr vec<U> iota = Iota<U>::value;
+
+template <typename U>
+[[gnu::always_inline]] inline vec<U> splat(U value)
+{
+    return vec<U>{} + value;
+}
+
+// The first n elements at p; the remaining lanes are zero.
+template <typename U>
+[[gnu::always_inline]] inline vec<U> load(const uint8_t* p, size_t n)
+{
+    vec<U> x{};
+    if (n == lanes<U>)
+        __builtin_memcpy(&x, p, vlenb);
+    else
+        __builtin_memcpy(&x, p, n * sizeof(U));
+    return x;
+}
+
+template <typename U>
+[[gnu::always_inline]] inline void store(uint8_t* p, vec<U> x, size_t n)
+{
+    if (n == lanes<U>)
+        __builtin_memcpy(p, &x, vlenb);
+    else
+        __builtin_memcpy(p, &x, n * sizeof(U));
+}
+
+// All ones in the lanes of elements first, first + 1, ... whose mask bit is
+// set. first is a multiple of lanes<U>, so the bits start on a byte boundary
+// except for the nibbles of 64-bit elements.
+template <typename U>
+[[gnu::always_inline]] inline vec<U> active(const uint8_t* mask, size_t first)
+{
+    if constexpr (sizeof(U) == 1)
+    {
+        // Spread mask byte j over lanes 8j to 8j + 7, then test one bit each.
+        uint32_t word;
+        __builtin_memcpy(&word, mask + first / 8, 4);
+        auto bytes = (vec<uint8_t>)(vec<uint32_t>{} + word);
+        bytes = __builtin_shuffle(bytes, iota<uint8_t> / 8);
+        return (vec<U>)((bytes & (1 << (iota<uint8_t> & 7))) != 0);
+    }
+    else
+    {
+        U bits;
+        if constexpr (lanes<U> >= 8)
+        {
+            uint16_t word = 0;
+            __builtin_memcpy(&word, mask + first / 8, lanes<U> / 8);
+            bits = word;
+        }
+        else
+        {
+            bits = mask[first / 8] >> (first % 8);
+        }
+        return (vec<U>)((splat(bits) & (U(1) << iota<U>)) != 0);
+    }
+}
+
+// One bit per lane of a comparison result, lane 0 in bit 0.
+template <typename U>
+[[gnu::always_inline]] inline uint32_t to_bits(vec<U> lanes_set)
+{
+    if constexpr (sizeof(U) == 1)
+    {
+        // Each group of 8 lanes holds distinct bits; summing its bytes with a
+        // multiply collects them in the top byte.
+        auto bits = lanes_set & (1 << (iota<uint8_t> & 7));
+        auto groups = (vec<uint64_t>)bits * 0x0101010101010101ull >> 56;
+        return groups[0] | groups[1] << 8 | groups[2] << 16 |
+               groups[3] << 24;
+    }
+    else
+    {
+        auto bits = lanes_set & (U(1) << iota<U>);
+        uint32_t result = 0;
+        for (size_t i = 0; i < lanes<U>; i++) result |= bits[i];
+        return result;
+    }
+}
+
+// Replaces the n bits of bits starting at first by value where which is
+// set.
+template <typename U>
+void put_bits(uint8_t* bits, size_t first, uint32_t value, uint32_t which)
+{
+    constexpr size_t len = lanes<U> >= 8 ? lanes<U> / 8 : 1;
+    uint32_t word = 0;
+    unsigned shift = first % 8;
+    __builtin_memcpy(&word, bits + first / 8, len);
+    word = (word & ~(which << shift)) | (value & which) << shift;
+    __builtin_memcpy(bits + first / 8, &word, len);
+}
+
+// The element operations, on a vector or on a single element; U is the
+// element type either way.
+template <VectorBinaryOp op, typename U, typename T>
+[[gnu::always_inline]] inline T apply(T a, T b)
+{
+    using S = std::make_signed_t<U>;
+    using TS = std::conditional_t<sizeof(T) == sizeof(U), S, vec<S>>;
+    constexpr U shift_mask = sizeof(U) * 8 - 1;
+    if constexpr (op == VOP_ADD) return T(a + b);
+    if constexpr (op == VOP_SUB) return T(a - b);
+    if constexpr (op == VOP_RSUB) return T(b - a);
+    if constexpr (op == VOP_AND) return T(a & b);
+    if constexpr (op == VOP_OR) return T(a | b);
+    if constexpr (op == VOP_XOR) return T(a ^ b);
+    if constexpr (op == VOP_MINU) return a < b ? a : b;
+    if constexpr (op == VOP_MIN) return TS(a) < TS(b) ? a : b;
+    if constexpr (op == VOP_MAXU) return a > b ? a : b;
+    if constexpr (op == VOP_MAX) return TS(a) > TS(b) ? a : b;
+    if constexpr (op == VOP_SLL) return T(a << (b & shift_mask));
+    if constexpr (op == VOP_SRL) return T(a >> (b & shift_mask));
+    if constexpr (op == VOP_SRA) return T(TS(a) >> TS(b & shift_mask));
+    if constexpr (op == VOP_MUL) return T(a * b);
+    if constexpr (op == VOP_MOVE) return b;
+}
+
+// High halves of products: a signed for mulh and mulhsu, b for mulh. Below
+// 64 bits the lanes are widened, 64-bit ones go one by one.
+template <bool signed_a, bool signed_b, typename U>
+[[gnu::always_inline]] inline vec<U> mul_high(vec<U> a, vec<U> b)
+{
+    using S = std::make_signed_t<U>;
+    constexpr int bits = sizeof(U) * 8;
+    if constexpr (sizeof(U) < 8)
+    {
+        using W = std::conditional_t<
+            sizeof(U) == 1, int16_t,
+            std::conditional_t<sizeof(U) == 2, int32_t, int64_t>>;
+        wide_vec<W> wa, wb;
+        if constexpr (signed_a)
+            wa = __builtin_convertvector((vec<S>)a, wide_vec<W>);
+        else
+            wa = __builtin_convertvector(a, wide_vec<W>);
+        if constexpr (signed_b)
+            wb = __builtin_convertvector((vec<S>)b, wide_vec<W>);
+        else
+            wb = __builtin_convertvector(b, wide_vec<W>);
+        // Unsigned products may use the sign bit of W; shift them unsigned.
+        using UW = std::make_unsigned_t<W>;
+        auto product = (wide_vec<UW>)(wa * wb) >> bits;
+        return __builtin_convertvector(product, vec<U>);
+    }
+    else
+    {
+        vec<U> result;
+        for (size_t i = 0; i < lanes<U>; i++)
+        {
+            __int128 x = signed_a ? __int128(S(a[i])) : __int128(a[i]);
+            __int128 y = signed_b ? __int128(S(b[i])) : __int128(b[i]);
+            result[i] = U(static_cast<unsigned __int128>(x * y) >> bits);
+        }
+        return result;
+    }
+}
+
+template <VectorBinaryOp op, typename U>
+[[gnu::always_inline]] inline vec<U> apply_vector(vec<U> a, vec<U> b)
+{
+    if constexpr (op == VOP_MULH) return mul_high<true, true, U>(a, b);
+    if constexpr (op == VOP_MULHU) return mul_high<false, false, U>(a, b);
+    if constexpr (op == VOP_MULHSU) return mul_high<true, false, U>(a, b);
+    if constexpr (op != VOP_MULH && op != VOP_MULHU && op != VOP_MULHSU)
+        return apply<op, U>(a, b);
+}
+
+template <VectorBinaryOp op, typename U>
+void binary_kernel(uint8_t* vd, const uint8_t* vs2, const uint8_t* vs1,
+                   const uint8_t* mask, size_t vl)
+{
+    for (size_t i = 0; i < vl; i += lanes<U>)
+    {
+        size_t n = vl - i < lanes<U> ? vl - i : lanes<U>;
+        size_t offset = i * sizeof(U);
+        auto result = apply_vector<op, U>(load<U>(vs2 + offset, n),
+                                          load<U>(vs1 + offset, n));
+        if (mask)
+        {
+            auto old = load<U>(vd + offset, n);
+            auto m = active<U>(mask, i);
+            result = (result & m) | (old & ~m);
+        }
+        store<U>(vd + offset, result, n);
+    }
+}
+
+template <typename U>
+void merge_kernel(uint8_t* vd, const uint8_t* vs2, const uint8_t* vs1,
+                  const uint8_t* mask, size_t vl)
+{
+    for (size_t i = 0; i < vl; i += lanes<U>)
+    {
+        size_t n = vl - i < lanes<U> ? vl - i : lanes<U>;
+        size_t offset = i * sizeof(U);
+        auto m = active<U>(mask, i);
+        auto result =
+            (load<U>(vs1 + offset, n) & m) | (load<U>(vs2 + offset, n) & ~m);
+        store<U>(vd + offset, result, n);
+    }
+}
+
+template <VectorCompareOp op, typename U>
+[[gnu::always_inline]] inline vec<U> compare(vec<U> a, vec<U> b)
+{
+    using VS = vec<std::make_signed_t<U>>;
+    if constexpr (op == VCMP_EQ) return (vec<U>)(a == b);
+    if constexpr (op == VCMP_NE) return (vec<U>)(a != b);
+    if constexpr (op == VCMP_LTU) return (vec<U>)(a < b);
+    if constexpr (op == VCMP_LT) return (vec<U>)((VS)a < (VS)b);
+    if constexpr (op == VCMP_LEU) return (vec<U>)(a <= b);
+    if constexpr (op == VCMP_LE) return (vec<U>)((VS)a <= (VS)b);
+    if constexpr (op == VCMP_GTU) return (vec<U>)(a > b);
+    if constexpr (op == VCMP_GT) return (vec<U>)((VS)a > (VS)b);
+}
+
+template <VectorCompareOp op, typename U>
+void compare_kernel(uint8_t* vd, const uint8_t* vs2, const uint8_t* vs1,
+                    const uint8_t* mask, size_t vl)
+{
+    for (size_t i = 0; i < vl; i += lanes<U>)
+    {
+        size_t n = vl - i < lanes<U> ? vl - i : lanes<U>;
+        size_t offset = i * sizeof(U);
+        auto result = compare<op, U>(load<U>(vs2 + offset, n),
+                                     load<U>(vs1 + offset, n));
+        uint32_t which = n == 32 ? ~0u : (1u << n) - 1;
+        if (mask) which &= to_bits<U>(active<U>(mask, i));
+        put_bits<U>(vd, i, to_bits<U>(result), which);
+    }
+}
+
+template <VectorReduceOp op>
+constexpr VectorBinaryOp reduce_op = op == VRED_SUM    ? VOP_ADD
+                                     : op == VRED_AND  ? VOP_AND
+                                     : op == VRED_OR   ? VOP_OR
+                                     : op == VRED_XOR  ? VOP_XOR
+                                     : op == VRED_MINU ? VOP_MINU
+                                     : op == VRED_MIN  ? VOP_MIN
+                                     : op == VRED_MAXU ? VOP_MAXU
+                                                       : VOP_MAX;
+
+// The value inactive lanes take so that they do not change the result.
+template <VectorReduceOp op, typename U>
+constexpr U identity()
+{
+    constexpr U all = U(~U(0));
+    if constexpr (op == VRED_AND || op == VRED_MINU) return all;
+    if constexpr (op == VRED_MIN) return U(all >> 1);
+    if constexpr (op == VRED_MAX) return U(~(all >> 1));
+    return 0;
+}
+
+template <VectorReduceOp op, typename U>
+uint64_t reduce_kernel(const uint8_t* vs2, const uint8_t* mask, size_t vl,
+                       uint64_t init)
+{
+    constexpr auto binary_op = reduce_op<op>;
+    auto accumulator = splat(identity<op, U>());
+    for (size_t i = 0; i < vl; i += lanes<U>)
+    {
+        size_t n = vl - i < lanes<U> ? vl - i : lanes<U>;
+        auto m = (vec<U>)(iota<U> < U(n));
+        if (mask) m &= active<U>(mask, i);
+        auto x = load<U>(vs2 + i * sizeof(U), n);
+        x = (x & m) | (~m & splat(identity<op, U>()));
+        accumulator = apply<binary_op, U>(accumulator, x);
+    }
+    U result = U(init);
+    for (size_t i = 0; i < lanes<U>; i++)
+        result = apply<binary_op, U>(result, U(accumulator[i]));
+    return result;
+}
+
+template <VectorMaskOp op>
+[[gnu::always_inline]] inline vec<uint8_t> mask_logical(vec<uint8_t> a,
+                                                        vec<uint8_t> b)
+{
+    if constexpr (op == VMASK_ANDN) return a & ~b;
+    if constexpr (op == VMASK_AND) return a & b;
+    if constexpr (op == VMASK_OR) return a | b;
+    if constexpr (op == VMASK_XOR) return a ^ b;
+    if constexpr (op == VMASK_ORN) return a | ~b;
+    if constexpr (op == VMASK_NAND) return ~(a & b);
+    if constexpr (op == VMASK_NOR) return ~(a | b);
+    if constexpr (op == VMASK_XNOR) return ~(a ^ b);
+}
+
+template <VectorMaskOp op>
+void mask_logical_kernel(uint8_t* vd, const uint8_t* vs2, const uint8_t* vs1,
+                         size_t vl)
+{
+    size_t bytes = (vl + 7) / 8;
+    // Bits past vl in the last byte keep their value.
+    uint8_t last = bytes ? vd[bytes - 1] : 0;
+    for (size_t i = 0; i < bytes; i += vlenb)
+    {
+        size_t n = bytes - i < vlenb ? bytes - i : vlenb;
+        auto result = mask_logical<op>(load<uint8_t>(vs2 + i, n),
+                                       load<uint8_t>(vs1 + i, n));
+        store<uint8_t>(vd + i, result, n);
+    }
+    if (vl % 8)
+    {
+        uint8_t keep = 0xff << (vl % 8);
+        vd[bytes - 1] = (vd[bytes - 1] & ~keep) | (last & keep);
+    }
+}
+
+template <bool index, typename U>
+void fill_kernel(uint8_t* vd, uint64_t value, const uint8_t* mask, size_t vl)
+{
+    for (size_t i = 0; i < vl; i += lanes<U>)
+    {
+        size_t n = vl - i < lanes<U> ? vl - i : lanes<U>;
+        size_t offset = i * sizeof(U);
+        auto result = splat(U(value));
+        if constexpr (index) result += iota<U> + U(i);
+        if (mask)
+        {
+            auto m = active<U>(mask, i);
+            result = (result & m) | (load<U>(vd + offset, n) & ~m);
+        }
+        store<U>(vd + offset, result, n);
+    }
+}
+
+// The active bits among the first vl, 64 at a time.
+template <typename Visit>
+void scan_bits(const uint8_t* bits, const uint8_t* mask, size_t vl,
+               Visit visit)
+{
+    for (size_t i = 0; i < vl; i += 64)
+    {
+        uint64_t word = 0, enabled = ~0ull;
+        size_t n = vl - i < 64 ? vl - i : 64;
+        __builtin_memcpy(&word, bits + i / 8, (n + 7) / 8);
+        if (mask) __builtin_memcpy(&enabled, mask + i / 8, (n + 7) / 8);
+        if (n < 64) enabled &= (1ull << n) - 1;
+        if (!visit(i, word & enabled)) return;
+    }
+}
+
+size_t count_kernel(const uint8_t* bits, const uint8_t* mask, size_t vl)
+{
+    size_t count = 0;
+    scan_bits(bits, mask, vl,
+              [&](size_t, uint64_t word)
+              {
+                  count += __builtin_popcountll(word);
+                  return true;
+              });
+    return count;
+}
+
+size_t first_kernel(const uint8_t* bits, const uint8_t* mask, size_t vl)
+{
+    size_t first = vl;
+    scan_bits(bits, mask, vl,
+              [&](size_t i, uint64_t word)
+              {
+                  if (word == 0) return true;
+                  first = i + __builtin_ctzll(word);
+                  return false;
+              });
+    return first;
+}
+
+using Elements = std::tuple<uint8_t, uint16_t, uint32_t, uint64_t>;
+
+template <template <typename> typename Kernel, typename Entry>
+constexpr void fill_by_sew(Entry (&entries)[4])
+{
+    [&]<size_t... sew>(std::index_sequence<sew...>)
+    {
+        ((entries[sew] = Kernel<std::tuple_element_t<sew, Elements>>::value),
+         ...);
+    }(std::make_index_sequence<4>{});
+}
+
+template <VectorBinaryOp op>
+struct BinaryEntry
+{
+    template <typename U>
+    struct of
+    {
+        static constexpr auto value = binary_kernel<op, U>;
+    };
+};
+
+template <VectorCompareOp op>
+struct CompareEntry
+{
+    template <typename U>
+    struct of
+    {
+        static constexpr auto value = compare_kernel<op, U>;
+    };
+};
+
+template <VectorReduceOp op>
+struct ReduceEntry
+{
+    template <typename U>
+    struct of
+    {
+        static constexpr auto value = reduce_kernel<op, U>;
+    };
+};
+
+template <typename U>
+struct MergeEntry
+{
+    static constexpr auto value = merge_kernel<U>;
+};
+
+template <bool index>
+struct FillEntry
+{
+    template <typename U>
+    struct of
+    {
+        static constexpr auto value = fill_kernel<index, U>;
+    };
+};
+
+constexpr VectorKernels make_kernels(const char* name)
+{
+    VectorKernels kernels{};
+    kernels.name = name;
+    [&]<size_t... op>(std::index_sequence<op...>)
+    {
+        (fill_by_sew<BinaryEntry<VectorBinaryOp(op)>::template of>(
+             kernels.binary[op]),
+         ...);
+    }(std::make_index_sequence<VOP_COUNT>{});
+    [&]<size_t... op>(std::index_sequence<op...>)
+    {
+        (fill_by_sew<CompareEntry<VectorCompareOp(op)>::template of>(
+             kernels.compare[op]),
+         ...);
+    }(std::make_index_sequence<VCMP_COUNT>{});
+    [&]<size_t... op>(std::index_sequence<op...>)
+    {
+        (fill_by_sew<ReduceEntry<VectorReduceOp(op)>::template of>(
+             kernels.reduce[op]),
+         ...);
+    }(std::make_index_sequence<VRED_COUNT>{});
+    [&]<size_t... op>(std::index_sequence<op...>)
+    {
+        ((kernels.mask_logical[op] = mask_logical_kernel<VectorMaskOp(op)>),
+         ...);
+    }(std::make_index_sequence<VMASK_COUNT>{});
+    fill_by_sew<MergeEntry>(kernels.merge);
+    fill_by_sew<FillEntry<false>::template of>(kernels.splat);
+    fill_by_sew<FillEntry<true>::template of>(kernels.index);
+    kernels.count = count_kernel;
+    kernels.first = first_kernel;
+    return kernels;
+}
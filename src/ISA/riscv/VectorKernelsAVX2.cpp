@@ -0,0 +1,20 @@
+// The vector kernels again, built with -mavx2 -mpopcnt. Only called after
+// the host CPU has been checked for AVX2.
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "ISA/riscv/Vector.hpp"
+
+namespace RISCV
+{
+
+namespace
+{
+#include "VectorKernels.ipp"
+}  // namespace
+
+extern const VectorKernels vector_kernels_avx2;
+const VectorKernels vector_kernels_avx2 = make_kernels("AVX2");
+
+}  // namespace RISCV
@@ -0,0 +1,565 @@
+#include "Syscall/LinuxSyscalls.h"
+
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <utility>
+
+#include "Exception/NEMUException.hpp"
+
+namespace
+{
+
+// The generic table of asm-generic/unistd.h, which RISC-V uses. Numbers
+// that differ between RV32 and RV64 are marked.
+enum Syscall : uint64_t
+{
+    IOCTL = 29,
+    FACCESSAT = 48,
+    OPENAT = 56,
+    CLOSE = 57,
+    LSEEK = 62,  // _llseek on RV32
+    READ = 63,
+    WRITE = 64,
+    READV = 65,
+    WRITEV = 66,
+    EXIT = 93,
+    EXIT_GROUP = 94,
+    SET_TID_ADDRESS = 96,
+    SET_ROBUST_LIST = 99,
+    CLOCK_GETTIME = 113,  // RV64 only
+    RT_SIGACTION = 134,
+    RT_SIGPROCMASK = 135,
+    UNAME = 160,
+    GETPID = 172,
+    GETPPID = 173,
+    GETUID = 174,
+    GETEUID = 175,
+    GETGID = 176,
+    GETEGID = 177,
+    GETTID = 178,
+    BRK = 214,
+    MUNMAP = 215,
+    MMAP = 222,  // mmap2 on RV32
+    MPROTECT = 226,
+    MADVISE = 233,
+    GETRANDOM = 278,
+    STATX = 291,
+    CLOCK_GETTIME64 = 403,  // RV32 only
+};
+
+enum AuxType : uint64_t
+{
+    AT_NULL = 0,
+    AT_PHDR = 3,
+    AT_PHENT = 4,
+    AT_PHNUM = 5,
+    AT_PAGESZ = 6,
+    AT_ENTRY = 9,
+    AT_UID = 11,
+    AT_EUID = 12,
+    AT_GID = 13,
+    AT_EGID = 14,
+    AT_HWCAP = 16,
+    AT_CLKTCK = 17,
+    AT_SECURE = 23,
+    AT_RANDOM = 25,
+    AT_EXECFN = 31,
+};
+
+constexpr uint64_t page_size = 4096;
+constexpr int guest_at_fdcwd = -100;
+constexpr uint64_t guest_map_fixed = 0x10;
+constexpr uint64_t guest_map_anonymous = 0x20;
+constexpr uint64_t iov_max = 1024;
+
+// Open flags of the guest, which are those of asm-generic/fcntl.h, and the
+// host's; the access mode is the same everywhere.
+constexpr std::pair<uint64_t, int> open_flags[] = {
+    {00000100, O_CREAT},
+    {00000200, O_EXCL},
+    {00000400, O_NOCTTY},
+    {00001000, O_TRUNC},
+    {00002000, O_APPEND},
+    {00004000, O_NONBLOCK},
+    {00010000, O_DSYNC},
+    {00200000, O_DIRECTORY},
+    {00400000, O_NOFOLLOW},
+    {02000000, O_CLOEXEC},
+    {04010000, O_SYNC},
+    {010000000, O_PATH},
+};
+
+// The letters of the extensions the core implements, as in misa.
+constexpr uint64_t hwcap = 1 << ('I' - 'A') | 1 << ('M' - 'A') |
+                           1 << ('A' - 'A') | 1 << ('F' - 'A') |
+                           1 << ('D' - 'A') | 1 << ('C' - 'A') |
+                           1 << ('V' - 'A');
+
+uint64_t align_up(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// The return value of a host call that sets errno on failure.
+int64_t result(int64_t value) { return value < 0 ? -errno : value; }
+
+}  // namespace
+
+LinuxSyscalls::LinuxSyscalls(Memory& memory, int xlen)
+    : memory(memory), xlen(xlen), fds{0, 1, 2}
+{
+}
+
+LinuxSyscalls::~LinuxSyscalls()
+{
+    for (size_t fd = 3; fd < fds.size(); fd++)
+        if (fds[fd] >= 0) ::close(fds[fd]);
+}
+
+uint64_t LinuxSyscalls::setup(const ElfFile& elf,
+                              std::span<const std::string> args)
+{
+    constexpr uint64_t top = MEMORY_BASE + MEMORY_SIZE;
+    if (elf.segments().empty())
+    {
+        spdlog::error("The program has no segments to load");
+        return 0;
+    }
+    uint64_t image_start = UINT64_MAX;
+    uint64_t image_end = 0;
+    for (const auto& segment : elf.segments())
+    {
+        image_start = std::min(image_start, segment.vaddr);
+        image_end = std::max(image_end, segment.vaddr + segment.memsz);
+    }
+    // A program linked below RAM, as at the usual 0x10000, gets RAM from
+    // its first page on.
+    heap_base = MEMORY_BASE;
+    heap_limit = top;
+    if (image_start < MEMORY_BASE)
+    {
+        heap_base = image_start & ~uint64_t(page_size - 1);
+        heap_limit = heap_base + memory.alias_ram(heap_base);
+    }
+    if (image_start < heap_base || image_end > heap_limit ||
+        high(align_up(image_end, page_size)) > top - stack_size)
+    {
+        spdlog::error("The program at [0x{:x}, 0x{:x}) does not fit in RAM",
+                      image_start, image_end);
+        return 0;
+    }
+    for (const auto& segment : elf.segments())
+        memory.load_segment(segment.vaddr, segment.data, segment.memsz);
+    brk_start = brk_end = align_up(image_end, page_size);
+    mmap_end = top - stack_size;
+
+    // The kernel maps the program headers with the first segment, which
+    // holds the start of the file.
+    auto phdrs = elf.program_headers();
+    uint64_t phdr_addr = 0;
+    for (const auto& segment : elf.segments())
+    {
+        if (phdrs.data() >= segment.data.data() &&
+            phdrs.data() + phdrs.size() <=
+                segment.data.data() + segment.data.size())
+        {
+            phdr_addr = segment.vaddr + (phdrs.data() - segment.data.data());
+        }
+    }
+
+    // Strings and the random bytes go at the top, the tables below them.
+    uint64_t sp = top;
+    std::vector<uint64_t> argv;
+    for (const auto& arg : args)
+    {
+        sp -= arg.size() + 1;
+        auto bytes = reinterpret_cast<const uint8_t*>(arg.c_str());
+        memory.write_block(sp, std::span(bytes, arg.size() + 1));
+        argv.push_back(sp);
+    }
+    uint64_t execfn = argv.empty() ? 0 : argv[0];
+    sp -= 16;
+    uint64_t random = sp;
+    std::array<uint8_t, 16> random_bytes{};
+    if (::getrandom(random_bytes.data(), random_bytes.size(), 0) < 0)
+        spdlog::warn("No random bytes for AT_RANDOM");
+    memory.write_block(random, random_bytes);
+
+    std::vector<uint64_t> table;
+    table.push_back(argv.size());
+    table.insert(table.end(), argv.begin(), argv.end());
+    table.push_back(0);
+    // No environment.
+    table.push_back(0);
+    size_t phent = elf.program_header_size();
+    const std::pair<uint64_t, uint64_t> auxv[] = {
+        {AT_PHDR, phdr_addr},
+        {AT_PHENT, phent},
+        {AT_PHNUM, phent != 0 ? phdrs.size() / phent : 0},
+        {AT_PAGESZ, page_size},
+        {AT_ENTRY, elf.entry()},
+        {AT_UID, getuid()},
+        {AT_EUID, geteuid()},
+        {AT_GID, getgid()},
+        {AT_EGID, getegid()},
+        {AT_HWCAP, hwcap},
+        {AT_CLKTCK, 100},
+        {AT_SECURE, 0},
+        {AT_RANDOM, random},
+        {AT_EXECFN, execfn},
+        {AT_NULL, 0},
+    };
+    for (auto [type, value] : auxv)
+    {
+        table.push_back(type);
+        table.push_back(value);
+    }
+
+    size_t word = xlen / 8;
+    sp = (sp - table.size() * word) & ~uint64_t(15);
+    if (sp < mmap_end)
+    {
+        spdlog::error("The arguments do not fit on the stack");
+        return 0;
+    }
+    for (size_t i = 0; i < table.size(); i++)
+    {
+        memory.write_block(
+            sp + i * word,
+            std::span(reinterpret_cast<const uint8_t*>(&table[i]), word));
+    }
+    return sp;
+}
+
+int LinuxSyscalls::host_fd(uint64_t fd) const
+{
+    return fd < fds.size() ? fds[fd] : -1;
+}
+
+int LinuxSyscalls::host_dirfd(uint64_t fd) const
+{
+    return int(fd) == guest_at_fdcwd ? AT_FDCWD : host_fd(fd);
+}
+
+int LinuxSyscalls::guest_fd(int fd)
+{
+    auto it = std::ranges::find(fds, -1);
+    if (it != fds.end())
+    {
+        *it = fd;
+        return it - fds.begin();
+    }
+    fds.push_back(fd);
+    return fds.size() - 1;
+}
+
+std::optional<std::string> LinuxSyscalls::string_at(uint64_t addr) const
+{
+    auto ram = memory.ram_view(addr);
+    auto nul = std::ranges::find(ram, uint8_t(0));
+    if (nul == ram.end()) return std::nullopt;
+    return std::string(ram.begin(), nul);
+}
+
+std::optional<uint64_t> LinuxSyscalls::word_at(uint64_t addr)
+{
+    uint64_t value = 0;
+    if (!memory.read_block(
+            addr, std::span(reinterpret_cast<uint8_t*>(&value), xlen / 8)))
+        return std::nullopt;
+    return value;
+}
+
+int64_t LinuxSyscalls::call(uint64_t number,
+                            const std::array<uint64_t, 6>& args)
+{
+    switch (number)
+    {
+        case IOCTL:
+            // Not a terminal, so stdout is fully buffered.
+            return host_fd(args[0]) < 0 ? -EBADF : -ENOTTY;
+        case FACCESSAT:
+        {
+            auto path = string_at(args[1]);
+            if (!path) return -EFAULT;
+            return result(
+                faccessat(host_dirfd(args[0]), path->c_str(), int(args[2]), 0));
+        }
+        case OPENAT:
+            return openat(args[0], args[1], args[2], args[3]);
+        case CLOSE:
+            return close(args[0]);
+        case LSEEK:
+            return lseek(args);
+        case READ:
+            return read(args[0], args[1], args[2]);
+        case WRITE:
+            return write(args[0], args[1], args[2]);
+        case READV:
+            return vector_io(args[0], args[1], args[2], false);
+        case WRITEV:
+            return vector_io(args[0], args[1], args[2], true);
+        case EXIT:
+        case EXIT_GROUP:
+            throw guest_exit(int(args[0] & 0xff));
+        case SET_TID_ADDRESS:
+        case GETPID:
+        case GETTID:
+            return getpid();
+        case GETPPID:
+            return getppid();
+        case GETUID:
+            return getuid();
+        case GETEUID:
+            return geteuid();
+        case GETGID:
+            return getgid();
+        case GETEGID:
+            return getegid();
+        // There are no signals or threads, and all of RAM is accessible.
+        case SET_ROBUST_LIST:
+        case RT_SIGACTION:
+        case RT_SIGPROCMASK:
+        case MPROTECT:
+        case MADVISE:
+            return 0;
+        case CLOCK_GETTIME:
+        case CLOCK_GETTIME64:
+            return clock_gettime(args[0], args[1]);
+        case UNAME:
+            return uname(args[0]);
+        case BRK:
+            return brk(args[0]);
+        case MUNMAP:
+            return munmap(args[0], args[1]);
+        case MMAP:
+            return mmap(args);
+        case GETRANDOM:
+            return getrandom(args[0], args[1], args[2]);
+        case STATX:
+            return statx(args);
+    }
+    if (unsupported.insert(number).second)
+        spdlog::warn("Unsupported system call {}", number);
+    return -ENOSYS;
+}
+
+int64_t LinuxSyscalls::openat(uint64_t dirfd, uint64_t path, uint64_t flags,
+                              uint64_t mode)
+{
+    auto name = string_at(path);
+    if (!name) return -EFAULT;
+    int host_flags = int(flags & O_ACCMODE);
+    for (auto [guest, host] : open_flags)
+        if ((flags & guest) == guest) host_flags |= host;
+    int fd = ::openat(host_dirfd(dirfd), name->c_str(), host_flags,
+                      mode_t(mode));
+    return fd < 0 ? -errno : guest_fd(fd);
+}
+
+int64_t LinuxSyscalls::close(uint64_t fd)
+{
+    int host = host_fd(fd);
+    if (host < 0) return -EBADF;
+    fds[fd] = -1;
+    // The emulator's standard streams stay open.
+    return fd < 3 ? 0 : result(::close(host));
+}
+
+int64_t LinuxSyscalls::lseek(const std::array<uint64_t, 6>& args)
+{
+    int fd = host_fd(args[0]);
+    if (fd < 0) return -EBADF;
+    if (xlen == 64)
+        return result(::lseek(fd, off_t(args[1]), int(args[2])));
+
+    // _llseek(fd, offset_high, offset_low, result, whence)
+    off_t offset = off_t(args[1] << 32 | (args[2] & 0xffffffff));
+    off_t position = ::lseek(fd, offset, int(args[4]));
+    if (position < 0) return -errno;
+    int64_t value = position;
+    if (!memory.write_block(
+            args[3], std::span(reinterpret_cast<const uint8_t*>(&value), 8)))
+        return -EFAULT;
+    return 0;
+}
+
+int64_t LinuxSyscalls::read(uint64_t fd, uint64_t buf, uint64_t count)
+{
+    int host = host_fd(fd);
+    if (host < 0) return -EBADF;
+    if (count == 0) return 0;
+    auto data = memory.ram_span(buf, count);
+    if (data.empty()) return -EFAULT;
+    return result(::read(host, data.data(), data.size()));
+}
+
+int64_t LinuxSyscalls::write(uint64_t fd, uint64_t buf, uint64_t count)
+{
+    int host = host_fd(fd);
+    if (host < 0) return -EBADF;
+    if (count == 0) return 0;
+    if (!memory.is_ram(buf, count)) return -EFAULT;
+    return result(::write(host, memory.ram_view(buf).data(), count));
+}
+
+int64_t LinuxSyscalls::vector_io(uint64_t fd, uint64_t iov, uint64_t count,
+                                 bool write)
+{
+    int host = host_fd(fd);
+    if (host < 0) return -EBADF;
+    if (count > iov_max) return -EINVAL;
+    std::vector<iovec> buffers(count);
+    for (uint64_t i = 0; i < count; i++)
+    {
+        auto base = word_at(iov + (2 * i) * (xlen / 8));
+        auto len = word_at(iov + (2 * i + 1) * (xlen / 8));
+        if (!base || !len) return -EFAULT;
+        if (*len == 0) continue;
+        if (write)
+        {
+            if (!memory.is_ram(*base, *len)) return -EFAULT;
+            buffers[i].iov_base =
+                const_cast<uint8_t*>(memory.ram_view(*base).data());
+        }
+        else
+        {
+            auto data = memory.ram_span(*base, *len);
+            if (data.empty()) return -EFAULT;
+            buffers[i].iov_base = data.data();
+        }
+        buffers[i].iov_len = *len;
+    }
+    return result(write ? ::writev(host, buffers.data(), int(count))
+                        : ::readv(host, buffers.data(), int(count)));
+}
+
+int64_t LinuxSyscalls::brk(uint64_t addr)
+{
+    if (addr < brk_start || addr > heap_limit || high(addr) > mmap_end)
+        return brk_end;
+    // Memory given back and taken again reads as zeros.
+    if (addr > brk_end) memory.fill_block(brk_end, 0, addr - brk_end);
+    brk_end = addr;
+    return brk_end;
+}
+
+int64_t LinuxSyscalls::mmap(const std::array<uint64_t, 6>& args)
+{
+    auto [addr, len, prot, flags, fd, offset] = args;
+    bool fixed = flags & guest_map_fixed;
+    bool anonymous = flags & guest_map_anonymous;
+    // Everything is checked before the mapping takes any memory.
+    if (len == 0 || len > MEMORY_SIZE) return -EINVAL;
+    len = align_up(len, page_size);
+    // RV32 passes the offset in pages (mmap2).
+    off_t position = off_t(xlen == 32 ? offset * page_size : offset);
+    if (position < 0 || position % page_size != 0) return -EINVAL;
+    int host = anonymous ? -1 : host_fd(fd);
+    if (!anonymous && host < 0) return -EBADF;
+    if (fixed)
+    {
+        if (addr % page_size != 0 || !memory.is_ram(addr, len)) return -EINVAL;
+    }
+    else
+    {
+        if (len > mmap_end - high(brk_end)) return -ENOMEM;
+        mmap_end -= len;
+        addr = mmap_end;
+    }
+    memory.fill_block(addr, 0, len);
+    if (anonymous) return addr;
+
+    // A private copy of the file, as nothing writes it back.
+    auto data = memory.ram_span(addr, len);
+    ssize_t done = 0;
+    while (done < ssize_t(len))
+    {
+        ssize_t n =
+            pread(host, data.data() + done, len - done, position + done);
+        if (n < 0)
+        {
+            int error = errno;
+            if (!fixed) mmap_end += len;
+            return -error;
+        }
+        if (n == 0) break;
+        done += n;
+    }
+    return addr;
+}
+
+int64_t LinuxSyscalls::munmap(uint64_t addr, uint64_t len)
+{
+    // Only the latest mapping is given back; others stay until exit.
+    if (addr == mmap_end)
+    {
+        mmap_end = std::min(mmap_end + align_up(len, page_size),
+                            MEMORY_BASE + MEMORY_SIZE - stack_size);
+    }
+    return 0;
+}
+
+int64_t LinuxSyscalls::clock_gettime(uint64_t clock, uint64_t tp)
+{
+    timespec now;
+    if (::clock_gettime(clockid_t(int(clock)), &now) != 0) return -errno;
+    // struct timespec on RV64 and struct timespec64 on RV32 are alike.
+    std::array<int64_t, 2> value = {now.tv_sec, now.tv_nsec};
+    if (!memory.write_block(
+            tp, std::span(reinterpret_cast<const uint8_t*>(value.data()),
+                          sizeof(value))))
+        return -EFAULT;
+    return 0;
+}
+
+int64_t LinuxSyscalls::uname(uint64_t buf)
+{
+    std::array<std::array<char, 65>, 6> value{};
+    auto set = [&value](int field, std::string_view text)
+    { std::ranges::copy(text, value[field].begin()); };
+    set(0, "Linux");
+    set(1, "nemu");
+    set(2, "6.1.0");
+    set(3, "#1");
+    set(4, xlen == 32 ? "riscv32" : "riscv64");
+    set(5, "(none)");
+    if (!memory.write_block(
+            buf, std::span(reinterpret_cast<const uint8_t*>(&value),
+                           sizeof(value))))
+        return -EFAULT;
+    return 0;
+}
+
+int64_t LinuxSyscalls::statx(const std::array<uint64_t, 6>& args)
+{
+    auto path = string_at(args[1]);
+    if (!path) return -EFAULT;
+    // struct statx is the same on every architecture.
+    struct statx value;
+    if (::statx(host_dirfd(args[0]), path->c_str(), int(args[2]),
+                unsigned(args[3]), &value) != 0)
+        return -errno;
+    if (!memory.write_block(
+            args[4], std::span(reinterpret_cast<const uint8_t*>(&value),
+                               sizeof(value))))
+        return -EFAULT;
+    return 0;
+}
+
+int64_t LinuxSyscalls::getrandom(uint64_t buf, uint64_t len, uint64_t flags)
+{
+    if (len == 0) return 0;
+    auto data = memory.ram_span(buf, len);
+    if (data.empty()) return -EFAULT;
+    return result(::getrandom(data.data(), data.size(), unsigned(flags)));
+}
@@ -1,11 +1,32 @@
 #include "Memory/Memory.h"
 
 #include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <new>
 
-Memory::Memory()
-    : physicalMemory(std::make_unique<std::array<uint8_t, MEMORY_SIZE>>())
+#include "Exception/NEMUException.hpp"
+
+namespace
+{
+
+uint8_t* map_ram(int fd)
+{
+    int flags = MAP_PRIVATE | MAP_NORESERVE | (fd < 0 ? MAP_ANONYMOUS : 0);
+    void* ram =
+        mmap(nullptr, MEMORY_SIZE, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if (ram == MAP_FAILED) throw std::bad_alloc();
+    return static_cast<uint8_t*>(ram);
+}
+
+}  // namespace
+
+Memory::Memory() : physicalMemory(map_ram(-1)), dirty(page_count, 1)
 {
     // std::random_device rd;
     // std::mt19937 gen(rd());
@@ -20,24 +41,157 @@ Memory::Memory()
     spdlog::info("Memory upper bound: 0x{:08x}", upper_bound);
 }
 
-constexpr bool Memory::in_range(paddr_t addr) const
+Memory::paddr_t Memory::ram_offset(paddr_t addr) const
+{
+    if (addr - lower_bound < MEMORY_SIZE) return addr - lower_bound;
+    if (addr - alias_base < alias_size) return addr - alias_base;
+    return MEMORY_SIZE;
+}
+
+// An access may not run from one view of RAM into the other.
+bool Memory::is_ram(paddr_t addr, size_t len) const
+{
+    if (addr - lower_bound < MEMORY_SIZE)
+        return upper_bound - addr >= paddr_t(len);
+    return addr - alias_base < alias_size &&
+           alias_base + alias_size - addr >= paddr_t(len);
+}
+
+Memory::Memory(const Image& image)
+    : alias_base(image.alias_base),
+      alias_size(image.alias_size),
+      physicalMemory(map_ram(image.fd)),
+      mmio_log(image.mmio_log),
+      dirty(page_count, 1)
 {
-    return addr >= lower_bound && addr < upper_bound;
 }
 
-Memory::~Memory() { /*spdlog::info("Memory destroyed.");*/ }
+Memory::~Memory() { munmap(physicalMemory, MEMORY_SIZE); }
 
 uint8_t* Memory::get_host_memory_addr(paddr_t paddr)
 {
-    if (!in_range(paddr))
+    auto offset = ram_offset(paddr);
+    if (offset == MEMORY_SIZE)
     {
         spdlog::error("Physical address 0x{:08x} out of range.", paddr);
         assert(false);
     }
-    return &(physicalMemory->at(0)) + (paddr - lower_bound);
+    return physicalMemory + offset;
+}
+
+void Memory::map_device(paddr_t base, paddr_t size, Device& device)
+{
+    mmio_regions.push_back(MMIORegion{base, size, &device});
+    spdlog::info("MMIO region [0x{:08x}, 0x{:08x})", base, base + size);
+}
+
+Memory::paddr_t Memory::alias_ram(paddr_t base)
+{
+    paddr_t end = std::min<paddr_t>(lower_bound, base + MEMORY_SIZE);
+    for (const auto& region : mmio_regions)
+    {
+        if (base - region.base < region.size) return 0;
+        if (region.base > base) end = std::min(end, region.base);
+    }
+    if (base >= end) return 0;
+    alias_base = base;
+    alias_size = end - base;
+    spdlog::info("RAM alias [0x{:08x}, 0x{:08x})", base, end);
+    return alias_size;
+}
+
+void Memory::track_writes(WriteHook hook)
+{
+    write_hook = std::move(hook);
+    clear_dirty();
+}
+
+void Memory::clear_dirty()
+{
+    std::fill(dirty.begin(), dirty.end(), 0);
+    dirty_list.clear();
+}
+
+void Memory::mark_dirty(size_t page)
+{
+    if (dirty[page]) return;
+    dirty[page] = 1;
+    dirty_list.push_back(page);
+}
+
+void Memory::note_write(size_t page)
+{
+    if (write_hook) write_hook(page, physicalMemory + page * page_size);
+    mark_dirty(page);
+}
+
+void Memory::note_write_range(paddr_t addr, size_t len)
+{
+    auto offset = ram_offset(addr);
+    auto first = offset / page_size;
+    auto last = (offset + len - 1) / page_size;
+    for (auto page = first; page <= last; page++)
+    {
+        if (!dirty[page]) note_write(page);
+    }
+}
+
+void Memory::restore_page(size_t page, const uint8_t* data)
+{
+    std::memcpy(physicalMemory + page * page_size, data, page_size);
+}
+
+// Pages that are still zero stay holes in the file.
+std::unique_ptr<Memory::Image> Memory::Image::create(const Memory& memory)
+{
+    int fd = memfd_create("nemu-ram", MFD_CLOEXEC);
+    void* file = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, MEMORY_SIZE) == 0)
+    {
+        file = mmap(nullptr, MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    fd, 0);
+    }
+    if (file == MAP_FAILED)
+    {
+        spdlog::error("Cannot create a memory file for RAM: {}",
+                      std::strerror(errno));
+        if (fd >= 0) ::close(fd);
+        return nullptr;
+    }
+    static const uint8_t zero[page_size] = {};
+    for (size_t page = 0; page < page_count; page++)
+    {
+        const uint8_t* data = memory.physicalMemory + page * page_size;
+        if (std::memcmp(data, zero, page_size) != 0)
+            std::memcpy(static_cast<uint8_t*>(file) + page * page_size, data,
+                        page_size);
+    }
+    munmap(file, MEMORY_SIZE);
+    return std::unique_ptr<Image>(new Image(fd, memory));
 }
 
-word_t Memory::pread(paddr_t addr, int len)
+Memory::Image::Image(int fd, const Memory& memory)
+    : fd(fd),
+      mmio_log(memory.mmio_log),
+      alias_base(memory.alias_base),
+      alias_size(memory.alias_size)
+{
+}
+
+Memory::Image::~Image() { ::close(fd); }
+
+Memory::MMIORegion& Memory::find_mmio(paddr_t addr)
+{
+    for (auto& region : mmio_regions)
+    {
+        if (addr - region.base < region.size) return region;
+    }
+    spdlog::error("Physical address 0x{:08x} out of range.", addr);
+    throw invalid_address();
+}
+
+template <typename W>
+W Memory::pread(paddr_t addr, int len)
 {
     if (len != 1 && len != 2 && len != 4 && len != 8)
     {
@@ -45,16 +199,42 @@ word_t Memory::pread(paddr_t addr, int len)
         assert(false);
     }
 
-    word_t data = 0;
+    // An access running past the end of RAM is not RAM either; no device
+    // claims it, so it ends as invalid_address.
+    if (!is_ram(addr, len))
+    {
+        counts.mmio_reads++;
+        if (mmio_mode == MMIOMode::REPLAY)
+        {
+            if (mmio_log_pos >= mmio_log.size())
+            {
+                spdlog::error("Replay log exhausted at 0x{:08x}.", addr);
+                throw invalid_address();
+            }
+            return mmio_log[mmio_log_pos++];
+        }
+        auto& region = find_mmio(addr);
+        auto data = region.device->read(addr - region.base, len);
+        if (mmio_mode == MMIOMode::RECORD)
+        {
+            mmio_log.resize(mmio_log_pos);
+            mmio_log.push_back(data);
+            mmio_log_pos++;
+        }
+        return data;
+    }
+
+    W data = 0;
     auto hostMemAddr = get_host_memory_addr(addr);
     for (int i = 0; i < len; i++)
     {
-        data |= hostMemAddr[i] << (i * 8);
+        data |= W(hostMemAddr[i]) << (i * 8);
     }
     return data;
 }
 
-void Memory::pwrite(paddr_t addr, word_t data, int len)
+template <typename W>
+void Memory::pwrite(paddr_t addr, W data, int len)
 {
     if (len != 1 && len != 2 && len != 4 && len != 8)
     {
@@ -62,6 +242,21 @@ void Memory::pwrite(paddr_t addr, word_t data, int len)
         assert(false);
     }
 
+    if (!is_ram(addr, len))
+    {
+        counts.mmio_writes++;
+        if (mmio_mode == MMIOMode::REPLAY) return;
+        auto& region = find_mmio(addr);
+        region.device->write(addr - region.base, data, len);
+        return;
+    }
+
+    auto offset = ram_offset(addr);
+    auto first = offset / page_size;
+    auto last = (offset + len - 1) / page_size;
+    if (!dirty[first]) note_write(first);
+    if (last != first && !dirty[last]) note_write(last);
+
     auto hostMemAddr = get_host_memory_addr(addr);
 
     for (int i = 0; i < len; i++)
@@ -78,29 +273,132 @@ void Memory::load_image(std::vector<uint8_t>& image)
         assert(false);
     }
 
-    for (size_t i = 0; i < image.size(); i++)
+    std::memcpy(physicalMemory, image.data(), image.size());
+}
+
+void Memory::load_segment(paddr_t addr, std::span<const uint8_t> data,
+                          size_t memsz)
+{
+    if (!is_ram(addr, memsz))
     {
-        physicalMemory->at(i) = image[i];
+        spdlog::error("Segment [0x{:08x}, 0x{:08x}) out of range.", addr,
+                      addr + memsz);
+        assert(false);
     }
+
+    auto hostMemAddr = get_host_memory_addr(addr);
+    std::memcpy(hostMemAddr, data.data(), data.size());
+    std::memset(hostMemAddr + data.size(), 0, memsz - data.size());
 }
 
-word_t Memory::inst_fetch(vaddr_t addr, int len) { return pread(addr, len); }
+uint32_t Memory::inst_fetch(vaddr_t addr, int len)
+{
+    return pread<uint32_t>(addr, len);
+}
 
-word_t Memory::vread(vaddr_t addr, int len)
+template <typename W>
+W Memory::vread(vaddr_t addr, int len)
 {
-    auto data = pread(addr, len);
+    counts.reads++;
+    auto data = pread<W>(addr, len);
 #ifdef TRACE_MEMORY
     spdlog::info("Load {} bytes at 0x{:08x}. Data: 0x{:08x}", len, addr, data);
 #endif
     return data;
 }
 
-void Memory::vwrite(vaddr_t addr, word_t data, int len)
+template <typename W>
+void Memory::vwrite(vaddr_t addr, W data, int len)
 {
 #ifdef TRACE_MEMORY
     spdlog::info("Store {} bytes at 0x{:08x}. Data: 0x{:08x}", len, addr, data);
 #endif
+    counts.writes++;
     pwrite(addr, data, len);
 }
 
-word_t Memory::debug_vread(vaddr_t addr, int len) { return pread(addr, len); }
\ No newline at end of file
+bool Memory::read_block(vaddr_t addr, std::span<uint8_t> data)
+{
+    if (data.empty()) return true;
+    if (!is_ram(addr, data.size())) return false;
+#ifdef TRACE_MEMORY
+    spdlog::info("Load {} bytes at 0x{:08x}.", data.size(), addr);
+#endif
+    counts.reads++;
+    std::memcpy(data.data(), get_host_memory_addr(addr), data.size());
+    return true;
+}
+
+bool Memory::write_block(vaddr_t addr, std::span<const uint8_t> data)
+{
+    if (data.empty()) return true;
+    if (!is_ram(addr, data.size())) return false;
+#ifdef TRACE_MEMORY
+    spdlog::info("Store {} bytes at 0x{:08x}.", data.size(), addr);
+#endif
+    counts.writes++;
+    note_write_range(addr, data.size());
+    std::memcpy(get_host_memory_addr(addr), data.data(), data.size());
+    return true;
+}
+
+bool Memory::move_block(vaddr_t dst, vaddr_t src, size_t len)
+{
+    if (len == 0) return true;
+    if (!is_ram(dst, len) || !is_ram(src, len)) return false;
+#ifdef TRACE_MEMORY
+    spdlog::info("Move {} bytes from 0x{:08x} to 0x{:08x}.", len, src, dst);
+#endif
+    counts.reads++;
+    counts.writes++;
+    note_write_range(dst, len);
+    std::memmove(get_host_memory_addr(dst), get_host_memory_addr(src), len);
+    return true;
+}
+
+bool Memory::fill_block(vaddr_t dst, uint8_t value, size_t len)
+{
+    if (len == 0) return true;
+    if (!is_ram(dst, len)) return false;
+#ifdef TRACE_MEMORY
+    spdlog::info("Fill {} bytes at 0x{:08x} with 0x{:02x}.", len, dst, value);
+#endif
+    counts.writes++;
+    note_write_range(dst, len);
+    std::memset(get_host_memory_addr(dst), value, len);
+    return true;
+}
+
+std::span<const uint8_t> Memory::ram_view(vaddr_t addr) const
+{
+    auto offset = ram_offset(addr);
+    if (offset == MEMORY_SIZE) return {};
+    // Up to the end of the view of RAM addr is in.
+    paddr_t end = addr - lower_bound < MEMORY_SIZE ? MEMORY_SIZE : alias_size;
+    return {physicalMemory + offset, end - offset};
+}
+
+std::span<uint8_t> Memory::ram_span(vaddr_t addr, size_t len)
+{
+    if (len == 0 || !is_ram(addr, len)) return {};
+    counts.writes++;
+    note_write_range(addr, len);
+    return {get_host_memory_addr(addr), len};
+}
+
+// Device reads from the debugger must not end up in the replay log.
+template <typename W>
+W Memory::debug_vread(vaddr_t addr, int len)
+{
+    if (is_ram(addr, len) || mmio_mode == MMIOMode::LIVE)
+        return pread<W>(addr, len);
+    auto& region = find_mmio(addr);
+    return region.device->read(addr - region.base, len);
+}
+
+template uint32_t Memory::vread<uint32_t>(vaddr_t addr, int len);
+template uint64_t Memory::vread<uint64_t>(vaddr_t addr, int len);
+template void Memory::vwrite<uint32_t>(vaddr_t addr, uint32_t data, int len);
+template void Memory::vwrite<uint64_t>(vaddr_t addr, uint64_t data, int len);
+template uint32_t Memory::debug_vread<uint32_t>(vaddr_t addr, int len);
+template uint64_t Memory::debug_vread<uint64_t>(vaddr_t addr, int len);
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include "Metrics/Metrics.h"
+
+#include <spdlog/spdlog.h>
+
+#include <format>
+#include <fstream>
+#include <iterator>
+
+Metrics::Metrics(std::filesystem::path path, std::chrono::milliseconds period)
+    : path(std::move(path)),
+      period(period),
+      exporter([this](std::stop_token stop) { run(stop); })
+{
+    spdlog::info("Writing metrics to {} every {} ms", this->path.string(),
+                 period.count());
+}
+
+Metrics::~Metrics()
+{
+    exporter.request_stop();
+    exporter.join();
+    write();
+}
+
+void Metrics::run(std::stop_token stop)
+{
+    std::unique_lock lock(mutex);
+    auto stopped = [&stop]() { return stop.stop_requested(); };
+    while (!wakeup.wait_for(lock, stop, period, stopped)) write();
+}
+
+void Metrics::write()
+{
+    auto now = Clock::now();
+    samples.push_back(
+        Sample{now, values.instructions.load(std::memory_order_relaxed)});
+    while (now - samples.front().time > windows[std::size(windows) - 1])
+        samples.pop_front();
+
+    auto temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::trunc);
+        file << format();
+        if (!file)
+        {
+            spdlog::warn("Cannot write metrics to {}", temporary.string());
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+        spdlog::warn("Cannot replace {}: {}", path.string(), error.message());
+}
+
+std::string Metrics::format()
+{
+    auto load = [](const std::atomic<uint64_t>& value)
+    { return value.load(std::memory_order_relaxed); };
+    std::string out;
+    auto it = std::back_inserter(out);
+    auto metric = [&](std::string_view name, std::string_view type,
+                      std::string_view help)
+    {
+        std::format_to(it, "# HELP {} {}\n# TYPE {} {}\n", name, help, name,
+                       type);
+    };
+
+    const auto& last = samples.back();
+    metric("nemu_instructions_retired_total", "counter",
+           "Instructions retired by the guest.");
+    std::format_to(it, "nemu_instructions_retired_total {}\n",
+                   last.instructions);
+
+    // From the newest sample at least a window old, or the oldest one while
+    // the run is younger than the window.
+    metric("nemu_instructions_per_second", "gauge",
+           "Instructions retired per second of host time.");
+    for (auto window : windows)
+    {
+        auto first = samples.begin();
+        while (std::next(first) != samples.end() &&
+               last.time - std::next(first)->time >= window)
+            ++first;
+        std::chrono::duration<double> elapsed = last.time - first->time;
+        double ips = elapsed.count() > 0
+                         ? (last.instructions - first->instructions) /
+                               elapsed.count()
+                         : 0;
+        std::format_to(it,
+                       "nemu_instructions_per_second{{window=\"{}s\"}} {}\n",
+                       window.count(), ips);
+    }
+
+    // Instructions that did not need decoding; a fused pair counts twice.
+    uint64_t misses = load(values.decode_misses);
+    metric("nemu_decode_cache_hits_total", "counter",
+           "Instructions run from the decode cache.");
+    std::format_to(it, "nemu_decode_cache_hits_total {}\n",
+                   last.instructions > misses ? last.instructions - misses
+                                              : 0);
+    metric("nemu_decode_cache_misses_total", "counter",
+           "Instructions decoded.");
+    std::format_to(it, "nemu_decode_cache_misses_total {}\n", misses);
+
+    metric("nemu_memory_reads_total", "counter", "Guest data reads.");
+    std::format_to(it, "nemu_memory_reads_total {}\n",
+                   load(values.memory_reads));
+    metric("nemu_memory_writes_total", "counter", "Guest data writes.");
+    std::format_to(it, "nemu_memory_writes_total {}\n",
+                   load(values.memory_writes));
+    metric("nemu_mmio_reads_total", "counter", "Guest device reads.");
+    std::format_to(it, "nemu_mmio_reads_total {}\n", load(values.mmio_reads));
+    metric("nemu_mmio_writes_total", "counter", "Guest device writes.");
+    std::format_to(it, "nemu_mmio_writes_total {}\n",
+                   load(values.mmio_writes));
+
+    metric("nemu_traps_total", "counter",
+           "Exceptions and interrupts taken, by cause.");
+    for (size_t i = 0; i < values.traps.size(); i++)
+    {
+        auto count = load(values.traps[i]);
+        if (count == 0) continue;
+        std::format_to(it,
+                       "nemu_traps_total{{cause=\"{}\",interrupt=\"{}\"}} {}\n",
+                       i % 16, i >= 16, count);
+    }
+    return out;
+}
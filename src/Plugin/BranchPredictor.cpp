@@ -0,0 +1,169 @@
+#include "Plugin/BranchPredictor.h"
+
+#include <algorithm>
+
+namespace
+{
+
+uint64_t mask(unsigned bits) { return (uint64_t(1) << bits) - 1; }
+
+// Moves a 2-bit counter towards taken or not taken.
+void train(uint8_t& counter, bool taken)
+{
+    if (taken && counter < 3)
+        counter++;
+    else if (!taken && counter > 0)
+        counter--;
+}
+
+}  // namespace
+
+std::unique_ptr<BranchPredictor> BranchPredictor::create(
+    std::string_view name)
+{
+    if (name == "bimodal") return std::make_unique<BimodalPredictor>();
+    if (name == "gshare") return std::make_unique<GsharePredictor>();
+    if (name == "tage") return std::make_unique<TagePredictor>();
+    return nullptr;
+}
+
+BimodalPredictor::BimodalPredictor(unsigned index_bits)
+    : index_bits(index_bits), counters(size_t(1) << index_bits, 1)
+{
+}
+
+bool BimodalPredictor::predict(uint64_t pc)
+{
+    return counters[pc >> 1 & mask(index_bits)] >= 2;
+}
+
+void BimodalPredictor::update(uint64_t pc, bool taken)
+{
+    train(counters[pc >> 1 & mask(index_bits)], taken);
+}
+
+GsharePredictor::GsharePredictor(unsigned index_bits)
+    : index_bits(index_bits), counters(size_t(1) << index_bits, 1)
+{
+}
+
+bool GsharePredictor::predict(uint64_t pc)
+{
+    return counters[((pc >> 1) ^ history) & mask(index_bits)] >= 2;
+}
+
+void GsharePredictor::update(uint64_t pc, bool taken)
+{
+    train(counters[((pc >> 1) ^ history) & mask(index_bits)], taken);
+    history = (history << 1 | taken) & mask(index_bits);
+}
+
+TagePredictor::TagePredictor()
+{
+    for (auto& table : entries) table.resize(size_t(1) << index_bits);
+}
+
+uint32_t TagePredictor::fold(unsigned length, unsigned width) const
+{
+    uint32_t folded = 0;
+    for (unsigned i = 0; i < length; i += width)
+    {
+        unsigned word = i / 64, offset = i % 64;
+        uint64_t bits = history[word] >> offset;
+        if (offset + width > 64 && word + 1 < history.size())
+            bits |= history[word + 1] << (64 - offset);
+        folded ^= bits & mask(std::min(width, length - i));
+    }
+    return folded;
+}
+
+bool TagePredictor::predict(uint64_t pc)
+{
+    provider = alternate = -1;
+    for (int t = tables - 1; t >= 0; t--)
+    {
+        unsigned length = history_lengths[t];
+        index[t] = ((pc >> 1) ^ (pc >> (1 + index_bits)) ^
+                    fold(length, index_bits)) &
+                   mask(index_bits);
+        tag[t] = ((pc >> 1) ^ fold(length, tag_bits) ^
+                  fold(length, tag_bits - 1) << 1) &
+                 mask(tag_bits);
+        if (entries[t][index[t]].tag != tag[t]) continue;
+        if (provider < 0)
+            provider = t;
+        else if (alternate < 0)
+            alternate = t;
+    }
+
+    bool base_prediction = base.predict(pc);
+    auto prediction = [this, base_prediction](int t)
+    { return t < 0 ? base_prediction : entries[t][index[t]].counter >= 0; };
+    provider_prediction = prediction(provider);
+    alternate_prediction = prediction(alternate);
+    return provider_prediction;
+}
+
+void TagePredictor::update(uint64_t pc, bool taken)
+{
+    if (provider < 0)
+    {
+        base.update(pc, taken);
+    }
+    else
+    {
+        auto& entry = entries[provider][index[provider]];
+        if (provider_prediction != alternate_prediction)
+        {
+            if (provider_prediction == taken && entry.useful < 3)
+                entry.useful++;
+            else if (provider_prediction != taken && entry.useful > 0)
+                entry.useful--;
+        }
+        entry.counter = std::clamp(entry.counter + (taken ? 1 : -1), -4, 3);
+    }
+
+    // Take a longer history for a branch the provider got wrong, or make
+    // room for one next time.
+    if (provider_prediction != taken)
+    {
+        bool allocated = false;
+        for (unsigned t = provider + 1; t < tables && !allocated; t++)
+        {
+            auto& entry = entries[t][index[t]];
+            if (entry.useful != 0) continue;
+            entry = Entry{tag[t], int8_t(taken ? 0 : -1), 0};
+            allocated = true;
+        }
+        for (unsigned t = provider + 1; t < tables && !allocated; t++)
+        {
+            auto& entry = entries[t][index[t]];
+            if (entry.useful > 0) entry.useful--;
+        }
+    }
+
+    if (++updates % useful_period == 0)
+    {
+        for (auto& table : entries)
+            for (auto& entry : table) entry.useful >>= 1;
+    }
+
+    for (size_t i = history.size() - 1; i > 0; i--)
+        history[i] = history[i] << 1 | history[i - 1] >> 63;
+    history[0] = history[0] << 1 | taken;
+}
+
+void ReturnStack::push(uint64_t return_pc)
+{
+    entries[top] = return_pc;
+    top = (top + 1) % depth;
+    size = std::min(size + 1, depth);
+}
+
+uint64_t ReturnStack::pop()
+{
+    if (size == 0) return 0;
+    top = (top + depth - 1) % depth;
+    size--;
+    return entries[top];
+}
@@ -0,0 +1,327 @@
+#include "Plugin/BranchProfiler.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <iterator>
+#include <string>
+#include <utility>
+
+namespace
+{
+
+constexpr unsigned JAL = 0b1101111;
+constexpr unsigned JALR = 0b1100111;
+
+// x1 and x5, the link registers of the calling convention.
+bool is_link(unsigned reg) { return reg == 1 || reg == 5; }
+
+double percent(uint64_t part, uint64_t whole)
+{
+    return whole != 0 ? 100.0 * part / whole : 0.0;
+}
+
+}  // namespace
+
+std::unique_ptr<BranchProfiler> BranchProfiler::create(
+    std::string_view args, const std::filesystem::path& image)
+{
+    std::string_view names = "bimodal:gshare:tage";
+    size_t top = 10;
+    while (!args.empty())
+    {
+        auto comma = args.find(',');
+        auto option = args.substr(0, comma);
+        args = comma == args.npos ? "" : args.substr(comma + 1);
+
+        if (option.starts_with("models="))
+        {
+            names = option.substr(7);
+        }
+        else if (option.starts_with("top="))
+        {
+            auto value = option.substr(4);
+            auto [end, error] = std::from_chars(
+                value.data(), value.data() + value.size(), top);
+            if (error != std::errc() || end != value.data() + value.size())
+            {
+                spdlog::error("Invalid branch option {}", option);
+                return nullptr;
+            }
+        }
+        else
+        {
+            spdlog::error("Unknown branch option {}", option);
+            return nullptr;
+        }
+    }
+
+    std::vector<std::unique_ptr<BranchPredictor>> models;
+    while (!names.empty())
+    {
+        auto colon = names.find(':');
+        auto name = names.substr(0, colon);
+        names = colon == names.npos ? "" : names.substr(colon + 1);
+        auto model = BranchPredictor::create(name);
+        if (model == nullptr || models.size() == max_models)
+        {
+            spdlog::error("Invalid branch predictor {}, expected up to {} of "
+                          "bimodal, gshare and tage",
+                          name, max_models);
+            return nullptr;
+        }
+        models.push_back(std::move(model));
+    }
+    if (models.empty())
+    {
+        spdlog::error("No branch predictor given");
+        return nullptr;
+    }
+
+    auto elf = image.empty() ? std::nullopt : ElfFile::open(image);
+    if (!elf) spdlog::warn("No ELF symbols, branches are not split");
+    return std::unique_ptr<BranchProfiler>(
+        new BranchProfiler(std::move(models), top, std::move(elf)));
+}
+
+BranchProfiler::BranchProfiler(
+    std::vector<std::unique_ptr<BranchPredictor>> models, size_t top,
+    std::optional<ElfFile> elf)
+    : models(std::move(models)), top(top), elf(std::move(elf))
+{
+}
+
+uint32_t BranchProfiler::slot(uint64_t pc, SiteKind kind)
+{
+    auto [it, inserted] = slots.try_emplace(pc, sites.size());
+    if (inserted)
+    {
+        sites.push_back(
+            Site{pc, elf ? elf->find_function(pc) : nullptr, kind});
+    }
+    return it->second;
+}
+
+void BranchProfiler::translate(const InstructionInfo& inst,
+                               Instrumentation& instrumentation)
+{
+    uint64_t end = inst.pc + inst.len;
+    unsigned opcode = inst.inst & 0x7f;
+    unsigned rd = inst.inst >> 7 & 0x1f;
+    unsigned rs1 = inst.inst >> 15 & 0x1f;
+
+    if (inst.kind == InstructionKind::BRANCH)
+    {
+        auto index = slot(inst.pc, SiteKind::CONDITIONAL);
+        instrumentation.control.push_back(
+            [this, index, end](uint64_t next_pc)
+            { conditional(sites[index], next_pc != end); });
+    }
+    else if (opcode == JAL && is_link(rd))
+    {
+        instrumentation.control.push_back([this, end](uint64_t)
+                                          { returns.push(end); });
+    }
+    else if (opcode == JALR)
+    {
+        // The return address stack hints of the JALR description.
+        bool pops = is_link(rs1) && (!is_link(rd) || rd != rs1);
+        bool pushes = is_link(rd);
+        auto index =
+            slot(inst.pc, pops ? SiteKind::RETURN : SiteKind::INDIRECT);
+        instrumentation.control.push_back(
+            [this, index, end, pops, pushes](uint64_t next_pc)
+            {
+                auto& site = sites[index];
+                site.executed++;
+                if (pops)
+                {
+                    site.mispredicted[0] += returns.pop() != next_pc;
+                }
+                else
+                {
+                    site.mispredicted[0] += site.last_target != next_pc;
+                    site.last_target = next_pc;
+                    site.targets[next_pc]++;
+                }
+                if (pushes) returns.push(end);
+            });
+    }
+    else if (inst.kind == InstructionKind::INDIRECT_JUMP &&
+             inst.inst != 0x30200073)
+    {
+        // A call run on the host returned without a return instruction.
+        instrumentation.control.push_back(
+            [this, end](uint64_t next_pc)
+            {
+                if (next_pc != end) returns.pop();
+            });
+    }
+}
+
+void BranchProfiler::conditional(Site& site, bool taken)
+{
+    site.executed++;
+    site.taken += taken;
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        site.mispredicted[i] += models[i]->predict(site.pc) != taken;
+        models[i]->update(site.pc, taken);
+    }
+}
+
+void BranchProfiler::halt(uint64_t pc, bool good) { report(); }
+
+bool BranchProfiler::merge(Plugin& next)
+{
+    auto other = dynamic_cast<BranchProfiler*>(&next);
+    if (other == nullptr || other->models.size() != models.size())
+        return false;
+    for (const auto& from : other->sites)
+    {
+        auto& site = sites[slot(from.pc, from.kind)];
+        site.executed += from.executed;
+        site.taken += from.taken;
+        for (size_t i = 0; i < max_models; i++)
+            site.mispredicted[i] += from.mispredicted[i];
+        site.last_target = from.last_target;
+        for (auto [target, count] : from.targets) site.targets[target] += count;
+    }
+    return true;
+}
+
+void BranchProfiler::report()
+{
+    struct Totals
+    {
+        uint64_t conditional = 0;
+        uint64_t taken = 0;
+        std::array<uint64_t, max_models> mispredicted{};
+        uint64_t returns = 0;
+        uint64_t returns_mispredicted = 0;
+        uint64_t indirect = 0;
+        uint64_t indirect_mispredicted = 0;
+
+        void add(const Site& site)
+        {
+            switch (site.kind)
+            {
+                case SiteKind::CONDITIONAL:
+                    conditional += site.executed;
+                    taken += site.taken;
+                    for (size_t i = 0; i < max_models; i++)
+                        mispredicted[i] += site.mispredicted[i];
+                    break;
+                case SiteKind::RETURN:
+                    returns += site.executed;
+                    returns_mispredicted += site.mispredicted[0];
+                    break;
+                case SiteKind::INDIRECT:
+                    indirect += site.executed;
+                    indirect_mispredicted += site.mispredicted[0];
+                    break;
+            }
+        }
+    };
+    auto name_of = [](const SymbolInfo* function)
+    { return function ? std::string(function->name) : "(unknown)"; };
+    // Misprediction rates by model, as columns.
+    auto rates = [this](const std::array<uint64_t, max_models>& mispredicted,
+                        uint64_t executed)
+    {
+        std::string out;
+        for (size_t i = 0; i < models.size(); i++)
+        {
+            std::format_to(std::back_inserter(out), " {:>9.2f}%",
+                           percent(mispredicted[i], executed));
+        }
+        return out;
+    };
+    std::string header;
+    for (const auto& model : models)
+        std::format_to(std::back_inserter(header), " {:>10}", model->name());
+    size_t last = models.size() - 1;
+
+    Totals totals;
+    std::unordered_map<const SymbolInfo*, Totals> functions;
+    for (const auto& site : sites)
+    {
+        totals.add(site);
+        functions[site.function].add(site);
+    }
+
+    spdlog::info("Branch profile, {} conditional branches, {:.2f}% taken:",
+                 totals.conditional, percent(totals.taken, totals.conditional));
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        spdlog::info("  {:<12} {:>12} mispredicted ({:6.2f}%)",
+                     models[i]->name(), totals.mispredicted[i],
+                     percent(totals.mispredicted[i], totals.conditional));
+    }
+    spdlog::info("  {:<12} {:>12} of {} mispredicted by the return stack "
+                 "({:6.2f}%)",
+                 "returns", totals.returns_mispredicted, totals.returns,
+                 percent(totals.returns_mispredicted, totals.returns));
+    spdlog::info("  {:<12} {:>12} of {} mispredicted by the last target "
+                 "({:6.2f}%)",
+                 "indirect", totals.indirect_mispredicted, totals.indirect,
+                 percent(totals.indirect_mispredicted, totals.indirect));
+
+    std::vector<std::pair<const SymbolInfo*, Totals>> by_function(
+        functions.begin(), functions.end());
+    std::ranges::sort(by_function, std::ranges::greater(),
+                      [last](const auto& entry)
+                      { return entry.second.mispredicted[last]; });
+    if (by_function.size() > top) by_function.resize(top);
+    spdlog::info("  {:<24} {:>12}{} {:>10} {:>10}", "function", "branches",
+                 header, "returns", "indirect");
+    for (const auto& [function, stats] : by_function)
+    {
+        spdlog::info("  {:<24} {:>12}{} {:>9.2f}% {:>9.2f}%",
+                     name_of(function), stats.conditional,
+                     rates(stats.mispredicted, stats.conditional),
+                     percent(stats.returns_mispredicted, stats.returns),
+                     percent(stats.indirect_mispredicted, stats.indirect));
+    }
+
+    std::vector<const Site*> hardest;
+    for (const auto& site : sites)
+        if (site.kind == SiteKind::CONDITIONAL) hardest.push_back(&site);
+    std::ranges::sort(hardest, std::ranges::greater(),
+                      [last](const Site* site)
+                      { return site->mispredicted[last]; });
+    if (hardest.size() > top) hardest.resize(top);
+    spdlog::info("  {:<12} {:<24} {:>12} {:>7}{}", "branch", "function",
+                 "executed", "taken", header);
+    for (const auto* site : hardest)
+    {
+        if (site->mispredicted[last] == 0) break;
+        spdlog::info("  {:<#12x} {:<24} {:>12} {:>6.2f}%{}", site->pc,
+                     name_of(site->function), site->executed,
+                     percent(site->taken, site->executed),
+                     rates(site->mispredicted, site->executed));
+    }
+
+    std::vector<const Site*> indirect;
+    for (const auto& site : sites)
+        if (site.kind == SiteKind::INDIRECT) indirect.push_back(&site);
+    std::ranges::sort(indirect, std::ranges::greater(), &Site::executed);
+    if (indirect.size() > top) indirect.resize(top);
+    for (const auto* site : indirect)
+    {
+        std::vector<std::pair<uint64_t, uint64_t>> targets(
+            site->targets.begin(), site->targets.end());
+        std::ranges::sort(targets, std::ranges::greater(),
+                          &std::pair<uint64_t, uint64_t>::second);
+        std::string out;
+        for (size_t i = 0; i < std::min<size_t>(targets.size(), 4); i++)
+        {
+            std::format_to(std::back_inserter(out), " {:#x}:{}",
+                           targets[i].first, targets[i].second);
+        }
+        spdlog::info("  indirect {:#x} in {}, {} targets:{}", site->pc,
+                     name_of(site->function), targets.size(), out);
+    }
+}
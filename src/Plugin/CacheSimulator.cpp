@@ -0,0 +1,412 @@
+#include "Plugin/CacheSimulator.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <numeric>
+#include <span>
+#include <string>
+#include <utility>
+
+namespace
+{
+
+std::optional<uint64_t> parse_number(std::string_view text)
+{
+    uint64_t value = 0;
+    auto [end, error] =
+        std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end == text.data()) return std::nullopt;
+    std::string_view suffix(end, text.data() + text.size());
+    if (suffix == "k" || suffix == "K") return value << 10;
+    if (suffix == "m" || suffix == "M") return value << 20;
+    if (suffix.empty()) return value;
+    return std::nullopt;
+}
+
+// SIZE:WAYS:LINE:POLICY, all of them powers of two.
+std::optional<CacheSimulator::Geometry> parse_geometry(std::string_view text)
+{
+    std::string_view fields[4];
+    for (auto& field : fields)
+    {
+        auto colon = text.find(':');
+        field = text.substr(0, colon);
+        text = colon == text.npos ? "" : text.substr(colon + 1);
+    }
+    auto size = parse_number(fields[0]);
+    auto ways = parse_number(fields[1]);
+    auto line = parse_number(fields[2]);
+    if (!size || !ways || !line || !text.empty() ||
+        !std::has_single_bit(*size) || !std::has_single_bit(*ways) ||
+        !std::has_single_bit(*line) || *line < 4 || *line > 4096 ||
+        *size < *ways * *line)
+        return std::nullopt;
+
+    CacheSimulator::Geometry geometry{*size, unsigned(*ways), unsigned(*line),
+                                      CacheSimulator::Policy::LRU};
+    if (fields[3] == "fifo")
+        geometry.policy = CacheSimulator::Policy::FIFO;
+    else if (fields[3] == "random")
+        geometry.policy = CacheSimulator::Policy::RANDOM;
+    else if (fields[3] != "lru")
+        return std::nullopt;
+    return geometry;
+}
+
+}  // namespace
+
+CacheSimulator::Cache::Cache(const Geometry& geometry)
+    : line(geometry.line),
+      ways(geometry.ways),
+      sets(geometry.size / geometry.ways / geometry.line),
+      policy(geometry.policy),
+      lines(geometry.size / geometry.line)
+{
+}
+
+auto CacheSimulator::Cache::access(uint64_t addr, bool write) -> Result
+{
+    uint64_t tag = addr / line;
+    auto set = lines.begin() + tag % sets * ways;
+    clock++;
+    for (auto way = set; way != set + ways; ++way)
+    {
+        if (!way->valid || way->tag != tag) continue;
+        if (policy == Policy::LRU) way->stamp = clock;
+        way->dirty |= write;
+        return Result{true, std::nullopt, false};
+    }
+
+    // An invalid way if there is one, else the victim of the policy.
+    auto victim = std::ranges::find(set, set + ways, false, &Line::valid);
+    if (victim == set + ways)
+    {
+        if (policy == Policy::RANDOM)
+        {
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            victim = set + random % ways;
+        }
+        else
+        {
+            victim = std::ranges::min_element(set, set + ways, {},
+                                              &Line::stamp);
+        }
+    }
+    Result result{false, std::nullopt, victim->valid && victim->dirty};
+    if (victim->valid) result.victim = victim->tag * line;
+    *victim = Line{tag, clock, true, write};
+    return result;
+}
+
+std::unique_ptr<CacheSimulator> CacheSimulator::create(
+    std::string_view args, const std::filesystem::path& image)
+{
+    std::array<Geometry, LEVELS> geometry = {
+        Geometry{32 << 10, 8, 64, Policy::LRU},
+        Geometry{32 << 10, 8, 64, Policy::LRU},
+        Geometry{1 << 20, 16, 64, Policy::LRU}};
+    bool threaded = false;
+    size_t top = 20;
+    while (!args.empty())
+    {
+        auto comma = args.find(',');
+        auto option = args.substr(0, comma);
+        args = comma == args.npos ? "" : args.substr(comma + 1);
+
+        auto equals = option.find('=');
+        auto key = option.substr(0, equals);
+        auto value = equals == option.npos ? "" : option.substr(equals + 1);
+        std::optional<Level> level;
+        if (key == "l1i")
+            level = L1I;
+        else if (key == "l1d")
+            level = L1D;
+        else if (key == "l2")
+            level = L2;
+
+        if (level)
+        {
+            auto parsed = parse_geometry(value);
+            if (!parsed)
+            {
+                spdlog::error("Invalid cache geometry {}, expected "
+                              "SIZE:WAYS:LINE:lru|fifo|random",
+                              option);
+                return nullptr;
+            }
+            geometry[*level] = *parsed;
+        }
+        else if (option == "thread")
+        {
+            threaded = true;
+        }
+        else if (key == "top" && parse_number(value))
+        {
+            top = *parse_number(value);
+        }
+        else
+        {
+            spdlog::error("Unknown cache option {}", option);
+            return nullptr;
+        }
+    }
+
+    auto elf = image.empty() ? std::nullopt : ElfFile::open(image);
+    if (!elf) spdlog::warn("No ELF symbols, cache statistics are not split");
+    return std::unique_ptr<CacheSimulator>(
+        new CacheSimulator(geometry, threaded, top, std::move(elf)));
+}
+
+CacheSimulator::CacheSimulator(const std::array<Geometry, LEVELS>& geometry,
+                               bool threaded, size_t top,
+                               std::optional<ElfFile> elf)
+    : caches{Cache(geometry[L1I]), Cache(geometry[L1D]), Cache(geometry[L2])},
+      top(top),
+      elf(std::move(elf)),
+      functions(this->elf ? this->elf->symbols().size() + 1 : 1)
+{
+    for (auto [name, level] :
+         {std::pair("L1I", L1I), std::pair("L1D", L1D), std::pair("L2", L2)})
+    {
+        const auto& g = geometry[level];
+        spdlog::info("{}: {} KiB, {}-way, {}-byte lines, {}", name,
+                     g.size >> 10, g.ways, g.line,
+                     g.policy == Policy::LRU    ? "LRU"
+                     : g.policy == Policy::FIFO ? "FIFO"
+                                                : "random");
+    }
+    if (!threaded) return;
+    queue = std::make_unique<SPSCRingBuffer<Access, 1 << 16>>();
+    simulator = std::jthread(
+        [this]()
+        {
+            std::array<Access, batch_size> accesses;
+            while (auto n = queue->wait_pop_n(accesses.data(), batch_size))
+                simulate(accesses.data(), n);
+        });
+}
+
+CacheSimulator::~CacheSimulator() { finish(); }
+
+uint32_t CacheSimulator::function_of(uint64_t pc) const
+{
+    auto sym = elf ? elf->find_function(pc) : nullptr;
+    return sym ? sym - elf->symbols().data() + 1 : 0;
+}
+
+void CacheSimulator::translate(const InstructionInfo& inst,
+                               Instrumentation& instrumentation)
+{
+    uint32_t function = function_of(inst.pc);
+    uint64_t line = caches[L1I].line_size();
+    uint64_t offset = inst.pc & (line - 1);
+    // The first instruction of a line, or one that runs into the next.
+    if (offset == 0 || offset + inst.len > line)
+    {
+        uint64_t addr = inst.pc + (offset == 0 ? 0 : inst.len - 1);
+        instrumentation.execute.push_back(
+            [this, addr, function]()
+            { record(addr, function, AccessType::FETCH); });
+    }
+
+    switch (inst.kind)
+    {
+        case InstructionKind::LOAD:
+        case InstructionKind::STORE:
+        {
+            auto type = inst.kind == InstructionKind::LOAD
+                            ? AccessType::READ
+                            : AccessType::WRITE;
+            instrumentation.memory.push_back(
+                [this, function, type](uint64_t addr)
+                { record(addr, function, type); });
+            break;
+        }
+        case InstructionKind::BRANCH:
+        case InstructionKind::JUMP:
+        case InstructionKind::INDIRECT_JUMP:
+        {
+            // Staying in the line needs no fetch.
+            uint64_t from = inst.pc + inst.len - 1;
+            instrumentation.control.push_back(
+                [this, from, line](uint64_t next_pc)
+                {
+                    if ((next_pc ^ from) & ~(line - 1)) enter(next_pc);
+                });
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void CacheSimulator::trap(uint64_t pc, uint64_t cause, uint64_t tval,
+                          uint64_t handler)
+{
+    enter(handler);
+}
+
+void CacheSimulator::halt(uint64_t pc, bool good)
+{
+    finish();
+    report();
+}
+
+bool CacheSimulator::merge(Plugin& next)
+{
+    auto other = dynamic_cast<CacheSimulator*>(&next);
+    if (other == nullptr || other->functions.size() != functions.size())
+        return false;
+    finish();
+    other->finish();
+    auto add = [](FunctionStats& to, const FunctionStats& from)
+    {
+        for (size_t level = 0; level < LEVELS; level++)
+        {
+            to[level].accesses += from[level].accesses;
+            to[level].misses += from[level].misses;
+            to[level].evictions += from[level].evictions;
+        }
+    };
+    add(totals, other->totals);
+    for (size_t i = 0; i < functions.size(); i++)
+        add(functions[i], other->functions[i]);
+    writebacks += other->writebacks;
+    return true;
+}
+
+// The first instruction of a line records its own fetch.
+void CacheSimulator::enter(uint64_t addr)
+{
+    if (addr & (caches[L1I].line_size() - 1))
+        record(addr, unresolved, AccessType::FETCH);
+}
+
+void CacheSimulator::flush()
+{
+    if (!simulator.joinable())
+    {
+        simulate(batch.data(), batched);
+    }
+    else
+    {
+        // The producer side of the queue never blocks; wait for room here.
+        for (size_t pushed = 0; pushed < batched;)
+        {
+            auto n = queue->push_n(batch.data() + pushed, batched - pushed);
+            if (n == 0) std::this_thread::yield();
+            pushed += n;
+        }
+    }
+    batched = 0;
+}
+
+// Simulates whatever is still batched or queued; later accesses are
+// simulated on this thread.
+void CacheSimulator::finish()
+{
+    flush();
+    if (!simulator.joinable()) return;
+    queue->close();
+    simulator.join();
+}
+
+void CacheSimulator::simulate(const Access* accesses, size_t n)
+{
+    uint64_t last_line = UINT64_MAX;
+    uint32_t last_function = 0;
+    for (const auto& access : std::span(accesses, n))
+    {
+        uint32_t function = access.function;
+        if (function == unresolved)
+        {
+            uint64_t line = access.addr / caches[L1I].line_size();
+            if (line != last_line)
+            {
+                last_line = line;
+                last_function = function_of(access.addr);
+            }
+            function = last_function;
+        }
+
+        bool fetch = access.type == AccessType::FETCH;
+        bool write = access.type == AccessType::WRITE;
+        auto l1 = fetch ? L1I : L1D;
+        auto result = caches[l1].access(access.addr, write);
+        count(l1, function, result);
+        if (result.hit) continue;
+        // Fill the line, then write back the dirty one it replaced.
+        auto l2 = caches[L2].access(access.addr, false);
+        count(L2, function, l2);
+        if (l2.victim_dirty) writebacks++;
+        if (result.victim_dirty)
+        {
+            l2 = caches[L2].access(*result.victim, true);
+            count(L2, function, l2);
+            if (l2.victim_dirty) writebacks++;
+        }
+    }
+}
+
+void CacheSimulator::count(Level level, uint32_t function,
+                           const Cache::Result& result)
+{
+    for (auto* stats : {&functions[function][level], &totals[level]})
+    {
+        stats->accesses++;
+        stats->misses += !result.hit;
+        stats->evictions += result.victim.has_value();
+    }
+}
+
+void CacheSimulator::report()
+{
+    auto rate = [](const Stats& stats)
+    {
+        return stats.accesses != 0 ? 100.0 * stats.misses / stats.accesses
+                                   : 0.0;
+    };
+    spdlog::info("Cache simulation:");
+    for (auto [name, level] :
+         {std::pair("L1I", L1I), std::pair("L1D", L1D), std::pair("L2", L2)})
+    {
+        const auto& stats = totals[level];
+        spdlog::info("  {:<4} {:>12} accesses {:>12} misses ({:6.2f}%) "
+                     "{:>12} evictions",
+                     name, stats.accesses, stats.misses, rate(stats),
+                     stats.evictions);
+    }
+    spdlog::info("  {} dirty lines written back from L2", writebacks);
+
+    auto misses = [this](size_t index)
+    {
+        const auto& stats = functions[index];
+        return stats[L1I].misses + stats[L1D].misses + stats[L2].misses;
+    };
+    std::vector<size_t> order(functions.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::stable_sort(order, std::ranges::greater(), misses);
+    if (order.size() > top) order.resize(top);
+
+    spdlog::info("  {:<24} {:>20} {:>20} {:>20} {:>11}", "function",
+                 "L1I misses", "L1D misses", "L2 misses", "evictions");
+    for (auto index : order)
+    {
+        const auto& stats = functions[index];
+        if (stats[L1I].accesses + stats[L1D].accesses == 0) continue;
+        std::string name(index == 0 ? "(unknown)"
+                                    : elf->symbols()[index - 1].name);
+        spdlog::info("  {:<24} {:>11} {:7.2f}% {:>11} {:7.2f}% {:>11} "
+                     "{:7.2f}% {:>11}",
+                     name, stats[L1I].misses, rate(stats[L1I]),
+                     stats[L1D].misses, rate(stats[L1D]), stats[L2].misses,
+                     rate(stats[L2]),
+                     stats[L1I].evictions + stats[L1D].evictions +
+                         stats[L2].evictions);
+    }
+}
@@ -0,0 +1,556 @@
+#include "Plugin/Coverage.h"
+
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+
+#include "Utils/ElfParser.h"
+
+namespace
+{
+
+constexpr char magic[8] = {'N', 'E', 'M', 'U', 'C', 'O', 'V', '1'};
+
+// The code of an image: .text and the .text.* sections, as one range.
+std::optional<std::pair<uint64_t, uint64_t>> code_range(const ElfFile& elf)
+{
+    uint64_t begin = UINT64_MAX, end = 0;
+    for (const auto& sec : elf.sections())
+    {
+        if (sec.size == 0 ||
+            (sec.name != ".text" && !sec.name.starts_with(".text.")))
+            continue;
+        begin = std::min(begin, sec.addr);
+        end = std::max(end, sec.addr + sec.size);
+    }
+    if (begin >= end) return std::nullopt;
+    return std::pair(begin & ~uint64_t(1), end);
+}
+
+// Halfwords of the loaded image; the gaps between sections read as 0.
+class Code
+{
+   public:
+    explicit Code(const ElfFile& elf) : segments(elf.segments()) {}
+
+    uint16_t halfword(uint64_t addr) const
+    {
+        for (const auto& seg : segments)
+        {
+            if (addr < seg.paddr || addr + 2 > seg.paddr + seg.data.size())
+                continue;
+            uint16_t value;
+            std::memcpy(&value, seg.data.data() + (addr - seg.paddr), 2);
+            return value;
+        }
+        return 0;
+    }
+
+    // FNV-1a.
+    uint64_t checksum(uint64_t begin, uint64_t end) const
+    {
+        uint64_t hash = 0xcbf29ce484222325;
+        for (uint64_t addr = begin; addr < end; addr += 2)
+        {
+            uint16_t value = halfword(addr);
+            for (int i = 0; i < 2; i++)
+            {
+                hash ^= value >> (8 * i) & 0xff;
+                hash *= 0x100000001b3;
+            }
+        }
+        return hash;
+    }
+
+   private:
+    const std::vector<SegmentInfo>& segments;
+};
+
+// An instruction of the image and what the runs did with it.
+struct Site
+{
+    uint64_t pc;
+    int len;
+    bool executed;
+    bool branch;
+    bool taken;
+    bool not_taken;
+};
+
+// The instructions of a record in address order, by their length encoding.
+// Zero halfwords, which are illegal, are taken for padding; other data
+// inside the code is taken for instructions.
+std::vector<Site> disassemble(const Coverage::Record& record,
+                              const Code& code)
+{
+    std::vector<Site> sites;
+    for (uint64_t pc = record.begin; pc < record.end;)
+    {
+        uint64_t bit = (pc - record.begin) / 2;
+        uint32_t inst = code.halfword(pc);
+        if (inst == 0 && !record.executed.test(bit))
+        {
+            pc += 2;
+            continue;
+        }
+        int len = (inst & 0b11) == 0b11 ? 4 : 2;
+        if (len == 4) inst |= uint32_t(code.halfword(pc + 2)) << 16;
+        // BRANCH, c.beqz and c.bnez.
+        bool branch = len == 4 ? (inst & 0x7f) == 0b1100011
+                               : (inst & 0b11) == 0b01 && inst >> 14 == 0b11;
+        sites.push_back(Site{pc, len, record.executed.test(bit), branch,
+                             record.taken.test(bit),
+                             record.not_taken.test(bit)});
+        pc += len;
+    }
+    return sites;
+}
+
+std::string json_string(std::string_view text)
+{
+    std::string out = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out += {'\\', c};
+        else if (static_cast<unsigned char>(c) < 0x20)
+            out += std::format("\\u{:04x}", c);
+        else
+            out += c;
+    }
+    return out + "\"";
+}
+
+// Writes the totals of sites as JSON members.
+void format_totals(std::string& out, std::span<const Site> sites)
+{
+    uint64_t executed = 0, branches = 0, taken = 0, not_taken = 0, both = 0;
+    for (const auto& site : sites)
+    {
+        executed += site.executed;
+        if (!site.branch) continue;
+        branches++;
+        taken += site.taken;
+        not_taken += site.not_taken;
+        both += site.taken && site.not_taken;
+    }
+    std::format_to(std::back_inserter(out),
+                   "\"instructions\": {}, \"executed\": {}, "
+                   "\"branches\": {}, \"taken\": {}, \"not_taken\": {}, "
+                   "\"both\": {}",
+                   sites.size(), executed, branches, taken, not_taken, both);
+}
+
+// Per-function and per-address coverage of one image.
+void format_record(std::string& out, const Coverage::Record& record,
+                   const ElfFile& elf)
+{
+    auto it = std::back_inserter(out);
+    auto sites = disassemble(record, Code(elf));
+    std::format_to(it, "    {{\"image\": {}, \"begin\": \"{:#x}\", ",
+                   json_string(record.image), record.begin);
+    std::format_to(it, "\"end\": \"{:#x}\", ", record.end);
+    format_totals(out, sites);
+
+    // A symbol without a size runs up to the next one.
+    out += ",\n     \"functions\": [";
+    std::vector<const SymbolInfo*> functions;
+    for (const auto& sym : elf.symbols())
+    {
+        if (sym.type == SymbolType::FUNC && sym.addr >= record.begin &&
+            sym.addr < record.end &&
+            (functions.empty() || functions.back()->addr != sym.addr))
+            functions.push_back(&sym);
+    }
+    auto site_at = [&sites](uint64_t addr)
+    {
+        return std::ranges::lower_bound(sites, addr, {}, &Site::pc);
+    };
+    for (size_t i = 0; i < functions.size(); i++)
+    {
+        const auto& sym = *functions[i];
+        uint64_t end = sym.size != 0          ? sym.addr + sym.size
+                       : i + 1 < functions.size() ? functions[i + 1]->addr
+                                                  : record.end;
+        std::format_to(it,
+                       "{}\n      {{\"name\": {}, \"address\": \"{:#x}\", ",
+                       i == 0 ? "" : ",", json_string(sym.name), sym.addr);
+        format_totals(out, std::span(site_at(sym.addr), site_at(end)));
+        out += "}";
+    }
+
+    out += "],\n     \"ranges\": [";
+    bool first = true;
+    for (auto site = sites.begin(); site != sites.end();)
+    {
+        if (!site->executed)
+        {
+            ++site;
+            continue;
+        }
+        auto last = site;
+        while (std::next(last) != sites.end() && std::next(last)->executed)
+            ++last;
+        std::format_to(it, "{}[\"{:#x}\", \"{:#x}\"]", first ? "" : ", ",
+                       site->pc, last->pc + last->len);
+        first = false;
+        site = std::next(last);
+    }
+
+    out += "],\n     \"branch_sites\": [";
+    first = true;
+    for (const auto& site : sites)
+    {
+        if (!site.branch) continue;
+        std::format_to(it,
+                       "{}\n      {{\"pc\": \"{:#x}\", \"taken\": {}, "
+                       "\"not_taken\": {}}}",
+                       first ? "" : ",", site.pc, site.taken, site.not_taken);
+        first = false;
+    }
+    out += "]}";
+}
+
+// Binary records in host byte order: the image path, the code range, the
+// checksum and the three bitmaps.
+template <typename Value>
+void put(std::string& out, Value value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename Value>
+bool get(std::istream& in, Value& value)
+{
+    return bool(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+void put_record(std::string& out, const Coverage::Record& record)
+{
+    put<uint32_t>(out, record.image.size());
+    out += record.image;
+    put(out, record.begin);
+    put(out, record.end);
+    put(out, record.checksum);
+    for (const auto* bitmap :
+         {&record.executed, &record.taken, &record.not_taken})
+    {
+        out.append(reinterpret_cast<const char*>(bitmap->words.data()),
+                   bitmap->words.size() * sizeof(uint64_t));
+    }
+}
+
+std::optional<Coverage::Record> get_record(std::istream& in)
+{
+    Coverage::Record record;
+    uint32_t length;
+    if (!get(in, length) || length > 4096) return std::nullopt;
+    record.image.resize(length);
+    if (!in.read(record.image.data(), length) || !get(in, record.begin) ||
+        !get(in, record.end) || !get(in, record.checksum) ||
+        record.end <= record.begin || record.end - record.begin > 1ull << 32)
+        return std::nullopt;
+    for (auto* bitmap : {&record.executed, &record.taken, &record.not_taken})
+    {
+        *bitmap = Coverage::Bitmap((record.end - record.begin + 1) / 2);
+        if (!in.read(reinterpret_cast<char*>(bitmap->words.data()),
+                     bitmap->words.size() * sizeof(uint64_t)))
+            return std::nullopt;
+    }
+    return record;
+}
+
+// An empty list if there is no file yet.
+std::optional<std::vector<Coverage::Record>> read_records(
+    const std::filesystem::path& file)
+{
+    std::vector<Coverage::Record> records;
+    std::ifstream in(file, std::ios::binary);
+    if (!in) return records;
+    char header[sizeof(magic)];
+    uint32_t count;
+    if (!in.read(header, sizeof(header)) ||
+        std::memcmp(header, magic, sizeof(magic)) != 0 || !get(in, count))
+        return std::nullopt;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        auto record = get_record(in);
+        if (!record) return std::nullopt;
+        records.push_back(std::move(*record));
+    }
+    return records;
+}
+
+// Through a temporary file and a rename, so an interrupted run does not
+// lose the coverage of the earlier ones.
+bool replace_file(const std::filesystem::path& file, const std::string& data)
+{
+    auto temporary = file;
+    temporary += ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out << data;
+        if (!out)
+        {
+            spdlog::error("Cannot write {}", temporary.string());
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, file, error);
+    if (error)
+    {
+        spdlog::error("Cannot replace {}: {}", file.string(), error.message());
+        return false;
+    }
+    return true;
+}
+
+// An exclusive flock on FILE.lock for as long as it lives, so runs that
+// share a coverage file merge into it one at a time. FILE itself is
+// replaced by a rename and cannot carry the lock.
+class FileLock
+{
+   public:
+    explicit FileLock(const std::filesystem::path& file)
+    {
+        auto path = file;
+        path += ".lock";
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            spdlog::error("Cannot open {}: {}", path.string(),
+                          std::strerror(errno));
+            return;
+        }
+        int result;
+        while ((result = flock(fd, LOCK_EX)) < 0 && errno == EINTR)
+            ;
+        if (result < 0)
+        {
+            spdlog::error("Cannot lock {}: {}", path.string(),
+                          std::strerror(errno));
+            close(fd);
+            fd = -1;
+        }
+    }
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+    ~FileLock()
+    {
+        if (fd >= 0) close(fd);
+    }
+
+    explicit operator bool() const { return fd >= 0; }
+
+   private:
+    int fd;
+};
+
+}  // namespace
+
+void Coverage::Bitmap::set(uint64_t first, uint64_t last)
+{
+    while (first < last && first % 64 != 0) set(first++);
+    for (; first + 64 <= last; first += 64) words[first / 64] = ~uint64_t(0);
+    while (first < last) set(first++);
+}
+
+void Coverage::Bitmap::merge(const Bitmap& other)
+{
+    for (size_t i = 0; i < words.size(); i++) words[i] |= other.words[i];
+}
+
+std::unique_ptr<Coverage> Coverage::create(const std::filesystem::path& image,
+                                           std::filesystem::path file)
+{
+    if (file.empty())
+    {
+        spdlog::error("Coverage needs a file: --plugin=coverage,FILE");
+        return nullptr;
+    }
+    auto elf = image.empty() ? std::nullopt : ElfFile::open(image);
+    auto range = elf ? code_range(*elf) : std::nullopt;
+    if (!range)
+    {
+        spdlog::error("Coverage needs an ELF file with a .text section");
+        return nullptr;
+    }
+    auto [begin, end] = *range;
+    uint64_t halfwords = (end - begin + 1) / 2;
+    Record record{std::filesystem::absolute(image).string(),
+                  begin,
+                  end,
+                  Code(*elf).checksum(begin, end),
+                  Bitmap(halfwords),
+                  Bitmap(halfwords),
+                  Bitmap(halfwords)};
+    spdlog::info("Coverage of [{:#x}, {:#x}) goes to {}", begin, end,
+                 file.string());
+    return std::unique_ptr<Coverage>(
+        new Coverage(std::move(record), std::move(file)));
+}
+
+Coverage::Coverage(Record record, std::filesystem::path file)
+    : record(std::move(record)), file(std::move(file))
+{
+}
+
+Coverage::~Coverage()
+{
+    if (!written) write();
+}
+
+void Coverage::translate(const InstructionInfo& inst,
+                         Instrumentation& instrumentation)
+{
+    if (!started)
+    {
+        block = entry = inst.pc;
+        started = true;
+    }
+    uint64_t end = inst.pc + inst.len;
+    if (inst.kind == InstructionKind::BRANCH && inst.pc >= record.begin &&
+        inst.pc < record.end)
+    {
+        uint64_t bit = (inst.pc - record.begin) / 2;
+        instrumentation.control.push_back(
+            [this, end, bit](uint64_t next_pc)
+            {
+                (next_pc == end ? record.not_taken : record.taken).set(bit);
+                leave(end, next_pc);
+            });
+    }
+    else if (inst.kind == InstructionKind::BRANCH ||
+             inst.kind == InstructionKind::JUMP ||
+             inst.kind == InstructionKind::INDIRECT_JUMP)
+    {
+        instrumentation.control.push_back([this, end](uint64_t next_pc)
+                                          { leave(end, next_pc); });
+    }
+}
+
+// The faulting instruction counts as executed, an interrupted one not.
+void Coverage::trap(uint64_t pc, uint64_t cause, uint64_t tval,
+                    uint64_t handler)
+{
+    // The interrupt bit is the top bit of an RV32 or RV64 mcause.
+    bool interrupt = cause >> 63 || cause >> 31 == 1;
+    leave(interrupt ? pc : pc + 2, handler);
+}
+
+void Coverage::halt(uint64_t pc, bool good)
+{
+    leave(pc + 2, pc);
+    write();
+    written = true;
+}
+
+bool Coverage::merge(Plugin& next)
+{
+    auto other = dynamic_cast<Coverage*>(&next);
+    if (other == nullptr || other->record.checksum != record.checksum)
+        return false;
+    // The block this ran last went on up to where next started.
+    if (other->started)
+    {
+        if (started) leave(other->entry, other->entry);
+        block = other->block;
+        entry = started ? entry : other->entry;
+        started = true;
+    }
+    record.executed.merge(other->record.executed);
+    record.taken.merge(other->record.taken);
+    record.not_taken.merge(other->record.not_taken);
+    other->written = true;
+    return true;
+}
+
+void Coverage::leave(uint64_t end, uint64_t next)
+{
+    uint64_t first = std::max(block, record.begin);
+    uint64_t last = std::min(end, record.end);
+    if (started && first < last)
+    {
+        record.executed.set((first - record.begin) / 2,
+                            (last - record.begin + 1) / 2);
+    }
+    block = next;
+}
+
+void Coverage::write()
+{
+    // Held through the report, which is read from the merged file too.
+    FileLock lock(file);
+    if (!lock) return;
+    auto records = read_records(file);
+    if (!records)
+    {
+        spdlog::error("{} is not a coverage file, not overwriting it",
+                      file.string());
+        return;
+    }
+    auto merged = record;
+    std::erase_if(*records,
+                  [&merged](const Record& other)
+                  {
+                      if (other.image != merged.image) return false;
+                      if (other.begin == merged.begin &&
+                          other.end == merged.end &&
+                          other.checksum == merged.checksum)
+                      {
+                          merged.executed.merge(other.executed);
+                          merged.taken.merge(other.taken);
+                          merged.not_taken.merge(other.not_taken);
+                      }
+                      else
+                      {
+                          spdlog::warn("{} changed, dropping its earlier "
+                                       "coverage",
+                                       merged.image);
+                      }
+                      return true;
+                  });
+    records->push_back(std::move(merged));
+
+    std::string data(magic, sizeof(magic));
+    put<uint32_t>(data, records->size());
+    for (const auto& each : *records) put_record(data, each);
+    if (!replace_file(file, data)) return;
+
+    std::string report = "{\"images\": [\n";
+    bool first = true;
+    for (const auto& each : *records)
+    {
+        auto elf = ElfFile::open(each.image);
+        auto range = elf ? code_range(*elf) : std::nullopt;
+        if (!range || *range != std::pair(each.begin, each.end) ||
+            Code(*elf).checksum(each.begin, each.end) != each.checksum)
+        {
+            spdlog::warn("{} is gone or changed, not reporting it",
+                         each.image);
+            continue;
+        }
+        if (!first) report += ",\n";
+        format_record(report, each, *elf);
+        first = false;
+    }
+    report += "\n]}\n";
+    auto json = file;
+    json += ".json";
+    if (replace_file(json, report))
+        spdlog::info("Coverage written to {} and {}", file.string(),
+                     json.string());
+}
@@ -0,0 +1,43 @@
+#include "Plugin/InstructionMix.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+InstructionMix::InstructionMix(size_t limit) : limit(limit) {}
+
+void InstructionMix::translate(const InstructionInfo& inst,
+                               Instrumentation& instrumentation)
+{
+    auto& count = counts[inst.name];
+    instrumentation.execute.push_back([&count]() { count++; });
+}
+
+void InstructionMix::halt(uint64_t pc, bool good)
+{
+    std::vector<std::pair<std::string_view, uint64_t>> sorted(counts.begin(),
+                                                              counts.end());
+    std::ranges::sort(sorted, std::ranges::greater(),
+                      &std::pair<std::string_view, uint64_t>::second);
+    uint64_t total = 0;
+    for (const auto& [name, count] : sorted) total += count;
+    if (limit != 0 && sorted.size() > limit) sorted.resize(limit);
+
+    spdlog::info("Instruction mix, {} instructions:", total);
+    for (const auto& [name, count] : sorted)
+    {
+        if (count == 0) break;
+        spdlog::info("  {:<12} {:>12} {:6.2f}%", name, count,
+                     100.0 * count / total);
+    }
+}
+
+bool InstructionMix::merge(Plugin& next)
+{
+    auto other = dynamic_cast<InstructionMix*>(&next);
+    if (other == nullptr) return false;
+    for (auto [name, count] : other->counts) counts[name] += count;
+    return true;
+}
@@ -0,0 +1,151 @@
+#include "Plugin/Plugin.h"
+
+#include <dlfcn.h>
+#include <spdlog/spdlog.h>
+
+#include <cstdlib>
+#include <string>
+
+#include "Plugin/BranchProfiler.h"
+#include "Plugin/CacheSimulator.h"
+#include "Plugin/Coverage.h"
+#include "Plugin/InstructionMix.h"
+
+namespace
+{
+
+std::unique_ptr<Plugin> make_instruction_mix(
+    const std::string& args, const std::filesystem::path& image)
+{
+    return std::make_unique<InstructionMix>(std::strtoull(args.c_str(),
+                                                          nullptr, 0));
+}
+
+std::unique_ptr<Plugin> make_coverage(const std::string& args,
+                                      const std::filesystem::path& image)
+{
+    return Coverage::create(image, args);
+}
+
+std::unique_ptr<Plugin> make_cache_simulator(
+    const std::string& args, const std::filesystem::path& image)
+{
+    return CacheSimulator::create(args, image);
+}
+
+std::unique_ptr<Plugin> make_branch_profiler(
+    const std::string& args, const std::filesystem::path& image)
+{
+    return BranchProfiler::create(args, image);
+}
+
+struct BuiltinPlugin
+{
+    std::string_view name;
+    // Returns nullptr, having logged why, if args are invalid.
+    std::unique_ptr<Plugin> (*make)(const std::string& args,
+                                    const std::filesystem::path& image);
+};
+
+constexpr BuiltinPlugin builtin_plugins[] = {
+    {"mix", make_instruction_mix},
+    {"coverage", make_coverage},
+    {"cache", make_cache_simulator},
+    {"branch", make_branch_profiler},
+};
+
+}  // namespace
+
+PluginManager::~PluginManager()
+{
+    plugins.clear();
+    for (auto library : libraries) dlclose(library);
+}
+
+bool PluginManager::load(std::string_view spec)
+{
+    auto comma = spec.find(',');
+    std::string name(spec.substr(0, comma));
+    std::string args(comma == spec.npos ? "" : spec.substr(comma + 1));
+
+    if (name.find('/') == std::string::npos)
+    {
+        for (const auto& builtin : builtin_plugins)
+        {
+            if (builtin.name != name) continue;
+            auto plugin = builtin.make(args, image);
+            if (plugin == nullptr)
+            {
+                spdlog::error("Plugin {} did not start", name);
+                return false;
+            }
+            add(std::move(plugin));
+            spdlog::info("Plugin {} loaded", name);
+            return true;
+        }
+        spdlog::error("No built-in plugin {}", name);
+        return false;
+    }
+
+    auto library = dlopen(name.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (library == nullptr)
+    {
+        spdlog::error("Cannot load plugin: {}", dlerror());
+        return false;
+    }
+    auto create = reinterpret_cast<PluginFactory>(
+        dlsym(library, "nemu_plugin_create"));
+    Plugin* plugin = create ? create(args.c_str()) : nullptr;
+    if (plugin == nullptr)
+    {
+        spdlog::error("Plugin {} did not start", name);
+        dlclose(library);
+        return false;
+    }
+    libraries.push_back(library);
+    add(std::unique_ptr<Plugin>(plugin));
+    spdlog::info("Plugin {} loaded", name);
+    return true;
+}
+
+void PluginManager::set_image(std::filesystem::path image)
+{
+    this->image = std::move(image);
+}
+
+void PluginManager::add(std::unique_ptr<Plugin> plugin)
+{
+    plugins.push_back(std::move(plugin));
+}
+
+Instrumentation PluginManager::translate(const InstructionInfo& inst)
+{
+    Instrumentation instrumentation;
+    for (auto& plugin : plugins) plugin->translate(inst, instrumentation);
+    return instrumentation;
+}
+
+void PluginManager::trap(uint64_t pc, uint64_t cause, uint64_t tval,
+                         uint64_t handler)
+{
+    for (auto& plugin : plugins) plugin->trap(pc, cause, tval, handler);
+}
+
+void PluginManager::halt(uint64_t pc, bool good)
+{
+    for (auto& plugin : plugins) plugin->halt(pc, good);
+}
+
+bool PluginManager::merge(PluginManager& next)
+{
+    for (size_t i = 0; i < plugins.size() && i < next.plugins.size(); i++)
+    {
+        if (!plugins[i]->merge(*next.plugins[i]))
+        {
+            spdlog::error("Plugin #{} cannot be merged across intervals",
+                          i + 1);
+            return false;
+        }
+    }
+    return true;
+}
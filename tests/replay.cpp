@@ -0,0 +1,89 @@
+// Records a guest that raises a machine software interrupt with a store to
+// the CLINT's msip, then seeks back and replays it. The replay has to take
+// the interrupt after the store, as the recorded run did, and end where it
+// ended.
+
+#include <spdlog/spdlog.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <print>
+
+#include "ISA/riscv/EmuCore.hpp"
+#include "Memory/Memory.h"
+#include "Monitor/Monitor.hpp"
+
+namespace
+{
+
+using Core32 = RISCV::EmuCore<32>;
+
+constexpr uint32_t program[] = {
+    0x00000297,  // auipc t0, 0
+    0x02c28293,  // addi t0, t0, 44
+    0x30529073,  // csrw mtvec, t0
+    0x00800293,  // li t0, 8
+    0x30429073,  // csrw mie, t0
+    0x30046073,  // csrsi mstatus, 8
+    0x02000337,  // lui t1, 0x2000
+    0x00100393,  // li t2, 1
+    0x00732023,  // sw t2, 0(t1)       raises msip
+    0x00000513,  // li a0, 0
+    0x0000006f,  // j .
+    0x34102473,  // handler: csrr s0, mepc
+    0x00032023,  // sw zero, 0(t1)
+    0x30200073,  // mret
+};
+constexpr uint32_t after_store = MEMORY_BASE + 9 * 4;
+constexpr uint64_t run_length = 20;
+
+int failures = 0;
+
+void expect(bool ok, const char *what)
+{
+    if (ok) return;
+    std::println("FAIL: {}", what);
+    failures++;
+}
+
+}  // namespace
+
+int main()
+{
+    spdlog::set_level(spdlog::level::warn);
+    auto firmware =
+        std::filesystem::temp_directory_path() / "nemu-replay-test.bin";
+    {
+        std::ofstream file(firmware, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(program), sizeof(program));
+    }
+
+    // The core's decode cache is too big for the stack.
+    auto memory = std::make_unique<Memory>();
+    auto core = std::make_unique<Core32>(*memory);
+    Monitor<Core32> monitor(*core, *memory, firmware);
+    std::filesystem::remove(firmware);
+    monitor.start_recording(4);
+    monitor.execute(run_length);
+    auto pc = monitor.get_reg_val("pc");
+    expect(monitor.get_reg_val("s0") == after_store,
+           "recorded run took the interrupt after the store");
+
+    expect(monitor.seek(0), "seek to the start");
+    expect(monitor.seek(12), "seek past the handler");
+    expect(monitor.get_reg_val("s0") == after_store,
+           "replay took the interrupt after the store");
+    expect(monitor.get_reg_val("pc") == after_store,
+           "replay returned behind the store");
+
+    expect(monitor.seek(run_length), "seek to the end");
+    expect(monitor.get_reg_val("pc") == pc, "replay ended where the run did");
+    expect(monitor.get_reg_val("s0") == after_store,
+           "replay ended with the recorded mepc");
+
+    if (failures == 0) std::println("PASS");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,140 @@
+// Pushes a known sequence through SPSCRingBuffer from a producer thread to
+// a consumer thread with push_n() and wait_pop_n(), and checks that every
+// item arrives once and in order. The queue is small, so the indices wrap
+// many times and the producer keeps finding it full; in the second run the
+// producer pauses now and then, so the consumer keeps blocking and has to
+// be woken. A consumer blocked on an empty queue has to return once the
+// queue is closed.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <print>
+#include <thread>
+#include <vector>
+
+#include "Utils/SPSCRingBuffer.h"
+
+namespace
+{
+
+using Queue = SPSCRingBuffer<uint64_t, 64>;
+
+int failures = 0;
+
+void expect(bool ok, const char *what)
+{
+    if (ok) return;
+    std::println("FAIL: {}", what);
+    failures++;
+}
+
+// Without a second thread: partial pushes into a full queue and pops that
+// wrap around the end of the buffer.
+void single_thread()
+{
+    Queue queue;
+    std::vector<uint64_t> items(2 * Queue::capacity());
+    for (size_t i = 0; i < items.size(); i++) items[i] = i;
+    expect(queue.push_n(items.data(), items.size()) == Queue::capacity(),
+           "push_n fills the queue and stops");
+    expect(!queue.try_push(0), "try_push fails on a full queue");
+    expect(queue.push_n(items.data(), 1) == 0, "push_n fails on a full queue");
+
+    std::vector<uint64_t> out(Queue::capacity());
+    expect(queue.pop_n(out.data(), 40) == 40, "pop_n takes what it asks for");
+    expect(queue.push_n(items.data() + 64, 30) == 30,
+           "push_n wraps around the end");
+    expect(queue.size() == Queue::capacity() - 10, "size after wrapping");
+    uint64_t next = 40;
+    size_t n;
+    while ((n = queue.pop_n(out.data(), out.size())) != 0)
+    {
+        for (size_t i = 0; i < n; i++)
+            expect(out[i] == next++, "pop_n keeps the order across the end");
+    }
+    expect(next == 94, "pop_n drains the queue");
+    expect(queue.empty(), "queue is empty");
+}
+
+// Streams count items; the producer sleeps after every pause_every items,
+// if not 0.
+void producer_consumer(uint64_t count, uint64_t pause_every)
+{
+    Queue queue;
+    uint64_t received = 0;
+    bool ordered = true;
+    std::thread consumer(
+        [&]()
+        {
+            std::vector<uint64_t> out(Queue::capacity());
+            size_t want = 1;
+            size_t n;
+            // Varying batch sizes, so pops end anywhere in the buffer.
+            while ((n = queue.wait_pop_n(out.data(), want)) != 0)
+            {
+                for (size_t i = 0; i < n; i++)
+                    ordered = ordered && out[i] == received + i;
+                received += n;
+                want = want % out.size() + 7;
+            }
+        });
+
+    std::vector<uint64_t> chunk;
+    uint64_t next = 0;
+    size_t size = 1;
+    while (next < count)
+    {
+        size = size % 100 + 13;
+        chunk.clear();
+        for (size_t i = 0; i < size && next + i < count; i++)
+            chunk.push_back(next + i);
+        size_t done = 0;
+        while (done < chunk.size())
+        {
+            auto pushed =
+                queue.push_n(chunk.data() + done, chunk.size() - done);
+            if (pushed == 0) std::this_thread::yield();
+            done += pushed;
+        }
+        if (pause_every != 0 &&
+            next / pause_every != (next + done) / pause_every)
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        next += done;
+    }
+    queue.close();
+    consumer.join();
+    expect(ordered, "items arrive in order");
+    expect(received == count, "every item arrives");
+}
+
+void close_while_blocked()
+{
+    Queue queue;
+    size_t popped = 1;
+    std::thread consumer(
+        [&]()
+        {
+            uint64_t item;
+            popped = queue.wait_pop_n(&item, 1);
+        });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    queue.close();
+    consumer.join();
+    expect(popped == 0, "close() wakes a blocked consumer");
+    expect(queue.closed(), "queue is closed");
+}
+
+}  // namespace
+
+int main()
+{
+    single_thread();
+    producer_consumer(2'000'000, 0);
+    producer_consumer(200'000, 1000);
+    close_while_blocked();
+
+    if (failures == 0) std::println("PASS");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}